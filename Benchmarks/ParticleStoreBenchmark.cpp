@@ -0,0 +1,167 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Purpose: Time the cpu particle update on ParticleStore against the array of structs and per particle virtual call it replaced.
+#include "../Vulkan/Game/ParticleStore.h"
+#include <chrono>
+#include <cstdio>
+#include <numeric>
+
+using namespace QZL;
+using namespace QZL::Game;
+
+static constexpr int kFrames = 200;
+static constexpr float kDeltaTime = 1.0f / 60.0f;
+static const glm::vec3 kCameraPosition(50.0f);
+
+// Rain, every particle falling straight down and respawned as soon as it expires
+static glm::vec3 randomPosition(std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> distribution(0.0f, 100.0f);
+	return glm::vec3(distribution(rng), distribution(rng), distribution(rng));
+}
+
+static float randomLifetime(std::mt19937& rng)
+{
+	return std::uniform_real_distribution<float>(0.0f, 2.0f)(rng);
+}
+
+// The layout and update loop ParticleSystem had before ParticleStore
+namespace Baseline {
+	struct Particle {
+		glm::vec3 velocity;
+		float lifetime;
+	};
+
+	class System {
+	public:
+		virtual ~System() = default;
+		virtual void updateParticle(Particle& particle, Graphics::ParticleVertex& vertex, float dt) = 0;
+	};
+
+	class Rain : public System {
+	public:
+		void updateParticle(Particle& particle, Graphics::ParticleVertex& vertex, float dt) override
+		{
+		}
+	};
+}
+
+template<typename Work>
+static double timeMilliseconds(Work work)
+{
+	const auto start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < kFrames; ++frame) {
+		work();
+	}
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / kFrames;
+}
+
+// Age, kill, integrate and respawn, then when drawing sort farthest first by a comparison sort and write the vertices in that order
+static double runBaseline(size_t count, bool draw)
+{
+	std::mt19937 rng(7);
+	std::vector<Baseline::Particle> particles(count);
+	std::vector<Graphics::ParticleVertex> vertices(count), drawn(count);
+	for (size_t i = 0; i < count; ++i) {
+		particles[i] = { glm::vec3(0.0f, -5.0f, 0.0f), randomLifetime(rng) };
+		vertices[i].position = randomPosition(rng);
+		vertices[i].scale = 2.0f;
+	}
+	std::unique_ptr<Baseline::System> system = std::make_unique<Baseline::Rain>();
+	std::vector<uint32_t> order;
+	std::vector<float> keys;
+	size_t active = count;
+	return timeMilliseconds([&]() {
+		size_t i = 0;
+		while (i < active) {
+			particles[i].lifetime -= kDeltaTime;
+			if (particles[i].lifetime <= 0.0f) {
+				particles[i] = particles[--active];
+				vertices[i] = vertices[active];
+				continue;
+			}
+			system->updateParticle(particles[i], vertices[i], kDeltaTime);
+			vertices[i].position += particles[i].velocity * kDeltaTime;
+			++i;
+		}
+		for (; active < count; ++active) {
+			particles[active] = { glm::vec3(0.0f, -5.0f, 0.0f), 2.0f };
+			vertices[active].position = randomPosition(rng);
+		}
+		if (!draw) {
+			return;
+		}
+		order.resize(active);
+		std::iota(order.begin(), order.end(), 0u);
+		keys.resize(active);
+		for (size_t i = 0; i < active; ++i) {
+			const glm::vec3 offset = vertices[i].position - kCameraPosition;
+			keys[i] = glm::dot(offset, offset);
+		}
+		std::sort(order.begin(), order.end(), [&keys](uint32_t lhs, uint32_t rhs) {
+			return keys[lhs] > keys[rhs];
+		});
+		for (size_t i = 0; i < active; ++i) {
+			drawn[i] = vertices[order[i]];
+		}
+	});
+}
+
+enum class DrawSort {
+	kNone,
+	// The comparison sort ParticleStore first shipped with
+	kComparison,
+	// ParticleStore::sortBackToFront
+	kStore
+};
+
+static double runStore(size_t count, DrawSort sort)
+{
+	std::mt19937 rng(7);
+	ParticleStore store(count);
+	store.spawn(count);
+	for (size_t i = 0; i < count; ++i) {
+		store.setParticle(i, randomPosition(rng), glm::vec3(0.0f, -5.0f, 0.0f), randomLifetime(rng), 2.0f);
+	}
+	std::vector<Graphics::ParticleVertex> drawn(count);
+	std::vector<uint32_t> order;
+	std::vector<float> keys;
+	return timeMilliseconds([&]() {
+		store.age(kDeltaTime);
+		store.killExpired();
+		store.integrate(kDeltaTime);
+		for (size_t i = store.spawn(count - store.size()); i < store.size(); ++i) {
+			store.setParticle(i, randomPosition(rng), glm::vec3(0.0f, -5.0f, 0.0f), 2.0f, 2.0f);
+		}
+		if (sort == DrawSort::kComparison) {
+			order.resize(store.size());
+			std::iota(order.begin(), order.end(), 0u);
+			keys.resize(store.size());
+			store.computeDistanceKeys(kCameraPosition, keys.data());
+			std::sort(order.begin(), order.end(), [&keys](uint32_t lhs, uint32_t rhs) {
+				return keys[lhs] > keys[rhs];
+			});
+		}
+		else if (sort == DrawSort::kStore) {
+			store.sortBackToFront(kCameraPosition, order);
+		}
+		if (sort != DrawSort::kNone) {
+			store.writeVertices(drawn.data(), order.data());
+		}
+	});
+}
+
+int main()
+{
+	std::printf("ms per frame, %d frames\n", kFrames);
+	for (size_t count : { size_t(4096), size_t(65536), size_t(262144) }) {
+		const double baselineUpdate = runBaseline(count, false);
+		const double storeUpdate = runStore(count, DrawSort::kNone);
+		const double baselineDraw = runBaseline(count, true);
+		const double comparisonDraw = runStore(count, DrawSort::kComparison);
+		const double storeDraw = runStore(count, DrawSort::kStore);
+		std::printf("%7zu particles  update %7.3f -> %7.3f (%.2fx)  with sort and vertices %7.3f -> comparison sort %7.3f, sortBackToFront %7.3f (%.2fx)\n",
+			count, baselineUpdate, storeUpdate, baselineUpdate / storeUpdate, baselineDraw, comparisonDraw, storeDraw, baselineDraw / storeDraw);
+	}
+	return 0;
+}
@@ -0,0 +1,155 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Purpose: Time TerrainQuery's batched height and normal queries against the same queries made one position at a time.
+#include "../Vulkan/Graphics/TerrainQuery.h"
+#include "../Vulkan/Graphics/TerrainTileCache.h"
+#include "../Vulkan/Graphics/TextureLoader.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+static constexpr uint32_t kTileSize = 64;
+static constexpr uint32_t kLevelCount = 5;
+static constexpr float kHeightScale = 100.0f;
+static constexpr size_t kQueryCount = 1 << 16;
+static constexpr int kRepeats = 50;
+static const char* kCacheFile = "TerrainQueryBenchmark.qterrain";
+
+// The tile cache is written here rather than cooked, so the texture loader's decoding is never reached
+uint16_t* TextureLoader::getCPUImage16(const std::string& name, int& width, int& height)
+{
+	return nullptr;
+}
+
+void TextureLoader::freeCPUImage(void* image)
+{
+}
+
+static uint16_t sampleTerrain(uint32_t x, uint32_t z)
+{
+	const float height = 0.5f + 0.25f * std::sin(float(x) * 0.031f) * std::cos(float(z) * 0.017f) + 0.2f * std::sin(float(x + z) * 0.11f);
+	return static_cast<uint16_t>(glm::clamp(height, 0.0f, 1.0f) * float(std::numeric_limits<uint16_t>::max()));
+}
+
+// Only level 0 is read by queries, the levels above are left zeroed
+static bool writeCache()
+{
+	const TerrainTileLayout layout = TerrainTileCache::getTileLayout(kTileSize);
+	const uint32_t tilesPerSide = 1u << (kLevelCount - 1);
+	uint64_t tileCount = 0;
+	for (uint32_t level = 0; level < kLevelCount; ++level) {
+		tileCount += uint64_t(tilesPerSide >> level) * (tilesPerSide >> level);
+	}
+
+	TerrainTileCacheHeader header = {};
+	header.magic = TerrainTileCache::kMagic;
+	header.version = TerrainTileCache::kVersion;
+	header.tileSize = kTileSize;
+	header.levelCount = kLevelCount;
+	header.heightScale = kHeightScale;
+	header.tileBytes = layout.size;
+	header.boundsOffset = sizeof(TerrainTileCacheHeader);
+	header.dataOffset = (header.boundsOffset + uint64_t(tilesPerSide) * tilesPerSide * sizeof(float) * 2 + 15) & ~uint64_t(15);
+
+	std::vector<char> data(header.dataOffset + tileCount * layout.size);
+	std::vector<float> bounds;
+	for (uint32_t tz = 0; tz < tilesPerSide; ++tz) {
+		for (uint32_t tx = 0; tx < tilesPerSide; ++tx) {
+			uint16_t* heights = reinterpret_cast<uint16_t*>(data.data() + header.dataOffset + (uint64_t(tz) * tilesPerSide + tx) * layout.size +
+				layout.heightOffset);
+			uint16_t minSample = std::numeric_limits<uint16_t>::max(), maxSample = 0;
+			for (uint32_t z = 0; z < layout.samplesPerSide; ++z) {
+				for (uint32_t x = 0; x < layout.samplesPerSide; ++x) {
+					const uint16_t sample = sampleTerrain(tx * kTileSize + x, tz * kTileSize + z);
+					heights[z * layout.samplesPerSide + x] = sample;
+					minSample = std::min(minSample, sample);
+					maxSample = std::max(maxSample, sample);
+				}
+			}
+			bounds.push_back(float(minSample) / float(std::numeric_limits<uint16_t>::max()) * kHeightScale);
+			bounds.push_back(float(maxSample) / float(std::numeric_limits<uint16_t>::max()) * kHeightScale);
+		}
+	}
+	std::memcpy(data.data(), &header, sizeof(header));
+	std::memcpy(data.data() + header.boundsOffset, bounds.data(), bounds.size() * sizeof(float));
+
+	std::ofstream file(kCacheFile, std::ios::binary);
+	file.write(data.data(), data.size());
+	return file.good();
+}
+
+template<typename Work>
+static double timeMilliseconds(Work work)
+{
+	const auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < kRepeats; ++i) {
+		work();
+	}
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / kRepeats;
+}
+
+static void runWorkload(TerrainQuery& query, const char* name, const std::vector<glm::vec2>& positions)
+{
+	std::vector<float> heights(positions.size()), batchHeights(positions.size());
+	std::vector<glm::vec3> normals(positions.size()), batchNormals(positions.size());
+
+	const double heightMs = timeMilliseconds([&]() {
+		for (size_t i = 0; i < positions.size(); ++i) {
+			heights[i] = query.getHeight(positions[i].x, positions[i].y);
+		}
+	});
+	const double batchHeightMs = timeMilliseconds([&]() {
+		query.getHeights(positions.data(), batchHeights.data(), positions.size());
+	});
+	const double normalMs = timeMilliseconds([&]() {
+		for (size_t i = 0; i < positions.size(); ++i) {
+			normals[i] = query.getNormal(positions[i].x, positions[i].y);
+		}
+	});
+	const double batchNormalMs = timeMilliseconds([&]() {
+		query.getNormals(positions.data(), batchNormals.data(), positions.size());
+	});
+
+	float heightError = 0.0f, normalError = 0.0f;
+	for (size_t i = 0; i < positions.size(); ++i) {
+		heightError = std::max(heightError, std::abs(heights[i] - batchHeights[i]));
+		normalError = std::max(normalError, glm::length(normals[i] - batchNormals[i]));
+	}
+	std::printf("%-10s heights %7.3f -> %7.3f ms (%.2fx)  normals %7.3f -> %7.3f ms (%.2fx)  max difference %g / %g\n", name,
+		heightMs, batchHeightMs, heightMs / batchHeightMs, normalMs, batchNormalMs, normalMs / batchNormalMs, heightError, normalError);
+}
+
+int main()
+{
+	if (!writeCache()) {
+		std::printf("Failed to write %s\n", kCacheFile);
+		return 1;
+	}
+	TerrainTileCache cache;
+	if (!cache.open(kCacheFile, "", kTileSize, kHeightScale)) {
+		std::printf("Failed to open %s\n", kCacheFile);
+		return 1;
+	}
+	TerrainQuery query(&cache);
+	std::printf("%zu queries, ms per pass over them\n", kQueryCount);
+
+	// Placement style rows crossing a few tiles, and scattered points over no more tiles than the query keeps decoded
+	std::vector<glm::vec2> positions(kQueryCount);
+	for (size_t i = 0; i < kQueryCount; ++i) {
+		positions[i] = glm::vec2(float(i % 256) * 0.75f + 100.0f, float(i / 256) * 0.75f + 100.0f);
+	}
+	runWorkload(query, "rows", positions);
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> scatter(0.0f, float(kTileSize * 7));
+	for (auto& position : positions) {
+		position = glm::vec2(scatter(rng), scatter(rng));
+	}
+	runWorkload(query, "scattered", positions);
+
+	cache.close();
+	std::remove(kCacheFile);
+	return 0;
+}
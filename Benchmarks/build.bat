@@ -0,0 +1,12 @@
+@echo off
+rem Run from a Visual Studio x64 developer command prompt, each benchmark is built and run from this folder
+set INCLUDES=/I C:\VulkanSDK\1.1.126.0\Include /I ../Lib/glfw/include /I ../Lib/glm
+set FLAGS=/nologo /std:c++17 /O2 /EHsc /DNDEBUG %INCLUDES%
+
+cl %FLAGS% /FeTerrainQueryBenchmark.exe TerrainQueryBenchmark.cpp ../Vulkan/Graphics/TerrainQuery.cpp ../Vulkan/Graphics/Heightfield.cpp ^
+	../Vulkan/Graphics/TerrainTileCache.cpp ../Vulkan/Graphics/MappedFile.cpp ../Vulkan/Graphics/MeshCache.cpp
+cl %FLAGS% /FeParticleStoreBenchmark.exe ParticleStoreBenchmark.cpp ../Vulkan/Game/ParticleStore.cpp ../Vulkan/Game/ParticlePool.cpp ^
+	../Vulkan/Graphics/FreeListAllocator.cpp
+
+del *.obj
+pause
\ No newline at end of file
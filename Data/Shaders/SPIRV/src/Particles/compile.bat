@@ -1,4 +1,10 @@
 C:\VulkanSDK\1.1.126.0\Bin\glslc.exe particles.frag -c -o ../../ParticlesFrag.spv
 C:\VulkanSDK\1.1.126.0\Bin\glslc.exe particles.vert -c -o ../../ParticlesVert.spv
-C:\VulkanSDK\1.1.126.0\Bin\glslc.exe particles.geom -c -o ../../ParticlesGeom.spv
+C:\VulkanSDK\1.1.126.0\Bin\glslc.exe particles_composite.frag -c -o ../../ParticlesCompositeFrag.spv
+C:\VulkanSDK\1.1.126.0\Bin\glslc.exe particle_simulate.comp -c -o ../../ParticleSimulate.spv
+C:\VulkanSDK\1.1.126.0\Bin\glslc.exe particle_emit.comp -c -o ../../ParticleEmit.spv
+C:\VulkanSDK\1.1.126.0\Bin\glslc.exe particle_compact.comp -c -o ../../ParticleCompact.spv
+C:\VulkanSDK\1.1.126.0\Bin\glslc.exe particle_sort_block.comp -c -o ../../ParticleSortBlock.spv
+C:\VulkanSDK\1.1.126.0\Bin\glslc.exe particle_sort_merge.comp -c -o ../../ParticleSortMerge.spv
+C:\VulkanSDK\1.1.126.0\Bin\glslc.exe particle_sort_gather.comp -c -o ../../ParticleSortGather.spv
 pause
\ No newline at end of file
@@ -0,0 +1,42 @@
+// Order independent transparency shared by the blended draws and their composite
+// Must match OitMode
+#define OIT_MODE_WEIGHTED_BLENDED 0
+#define OIT_MODE_LINKED_LIST 1
+#define OIT_INVALID_NODE 0xFFFFFFFF
+
+#ifndef OIT_SET
+#define OIT_SET 2
+#endif
+
+// Premultiplied colour packed to halves, matches OitNode
+struct Node {
+	uvec2 colour;
+	float depth;
+	uint next;
+};
+
+layout(set = OIT_SET, binding = 0) coherent buffer OitHeads {
+	uint heads[];
+};
+layout(set = OIT_SET, binding = 1) coherent buffer OitNodes {
+	uint nodeCount;
+	uint nodePadding[3];
+	Node nodes[];
+};
+
+// Nearer fragments weigh more, so the average colour leans towards what is in front. z is the window depth in [0, 1]
+float oitWeight(float alpha, float z)
+{
+	float farness = 1.0 - z;
+	return clamp(alpha * max(1e-2, 3e3 * farness * farness * farness), 1e-2, 3e3);
+}
+
+uvec2 oitPackColour(vec4 premultiplied)
+{
+	return uvec2(packHalf2x16(premultiplied.rg), packHalf2x16(premultiplied.ba));
+}
+
+vec4 oitUnpackColour(uvec2 packed)
+{
+	return vec4(unpackHalf2x16(packed.x), unpackHalf2x16(packed.y));
+}
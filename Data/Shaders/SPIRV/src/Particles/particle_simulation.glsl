@@ -0,0 +1,118 @@
+// Shared by the particle simulation and sorting kernels, the layouts match ParticleSimulator. Emitters own a range of the pool starting
+// at their first particle, and the alive and dead lists hold indices local to that range.
+
+#define PARTICLE_GROUP_SIZE 64 // Must match kWorkgroupSize in ParticleSimulator.cpp
+const uint PARTICLE_POOL_SIZE = 512 * 1024; // Must match ParticleSimulator::kMaxParticles
+
+struct Particle {
+	vec4 position; // w is the scale
+	vec4 velocity; // w is the remaining lifetime
+	vec4 textureOffset;
+};
+
+// What the renderer draws, densely packed in alive list order. Matches ParticleVertex, which cpu simulated particles are drawn from.
+struct ParticleInstance {
+	vec4 position; // w is the scale
+	vec4 velocity; // Velocity stretched billboards need the direction of travel, w is unused
+	vec4 textureOffset;
+};
+
+ParticleInstance makeInstance(Particle particle)
+{
+	return ParticleInstance(particle.position, vec4(particle.velocity.xyz, 0.0), particle.textureOffset);
+}
+
+struct EmitterParams {
+	vec4 origin; // w is the time step
+	vec4 spawnExtent; // w is the lifetime
+	vec4 velocity; // w is the lifetime variance
+	vec4 velocityVariance; // w is the scale
+	vec4 acceleration;
+	vec4 viewPosition;
+	uint emitterIdx;
+	uint firstParticle;
+	uint capacity;
+	uint emitCount;
+	uint currentList;
+	uint seed;
+	uint sortSize; // 0 when the emitter is not sorted per particle
+	uint padding;
+};
+
+struct EmitterState {
+	uint aliveCount[2];
+	uint deadCount;
+	uint claimed;
+	uint highWater;
+	uint padding[3];
+	uvec4 simulateDispatch;
+	uvec4 compactDispatch[2];
+	uvec4 draw;
+};
+
+layout(set = 0, binding = 0) buffer ParticleBuffer {
+	Particle particles[];
+};
+layout(set = 0, binding = 1) buffer AliveListBuffer {
+	uint aliveLists[];
+};
+layout(set = 0, binding = 2) buffer DeadListBuffer {
+	uint deadList[];
+};
+layout(set = 0, binding = 3) buffer EmitterStateBuffer {
+	EmitterState states[];
+};
+layout(set = 0, binding = 4) readonly buffer EmitterParamsBuffer {
+	EmitterParams emitters[];
+};
+layout(set = 0, binding = 5) writeonly buffer InstanceBuffer {
+	ParticleInstance instances[];
+};
+// Squared distance from the viewer and alive list index of the particles of sorted emitters, ordered by the sort kernels
+layout(set = 0, binding = 6) buffer SortKeyBuffer {
+	float sortKeys[];
+};
+layout(set = 0, binding = 7) buffer SortValueBuffer {
+	uint sortValues[];
+};
+
+layout(push_constant) uniform PushConstants {
+	uint paramsIdx;
+	uint sortSequence;
+	uint sortStride;
+} PC;
+
+uint aliveListIndex(uint list, uint firstParticle, uint idx)
+{
+	return list * PARTICLE_POOL_SIZE + firstParticle + idx;
+}
+
+// Append a particle to one of the emitter's alive lists, growing the dispatch that compacts the list as it passes each group
+void appendAlive(EmitterParams emitter, uint list, uint localIdx)
+{
+	uint idx = atomicAdd(states[emitter.emitterIdx].aliveCount[list], 1);
+	aliveLists[aliveListIndex(list, emitter.firstParticle, idx)] = localIdx;
+	if (idx % PARTICLE_GROUP_SIZE == 0) {
+		atomicMax(states[emitter.emitterIdx].compactDispatch[list].x, idx / PARTICLE_GROUP_SIZE + 1);
+	}
+}
+
+// PCG hash, good enough spread for spawn jitter from consecutive seeds
+uint hashRandom(uint value)
+{
+	uint state = value * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+// Uniform in [-1, 1]
+float randomSigned(inout uint seed)
+{
+	seed = hashRandom(seed);
+	return float(seed) / 4294967295.0 * 2.0 - 1.0;
+}
+
+vec3 randomSigned3(inout uint seed)
+{
+	return vec3(randomSigned(seed), randomSigned(seed), randomSigned(seed));
+}
@@ -0,0 +1,24 @@
+// Bitonic sort of a sorted emitter's keys and values, farthest from the viewer first. Each step compares the elements stride apart
+// within sequences of sortSequence elements, every other sequence in the opposite direction so pairs of them form the bitonic
+// sequences of the next size.
+
+#define PARTICLE_SORT_BLOCK_SIZE 1024 // Must match ParticleSimulator::kSortBlockSize
+// Below any squared distance, so the padding past the alive particles sorts to the end
+const float SORT_PADDING_KEY = -1.0;
+
+// The lower index of the pair the invocation compares, its partner is stride above
+uint sortPairIndex(uint invocation, uint stride)
+{
+	return (invocation / stride) * stride * 2 + invocation % stride;
+}
+
+// Sequences end up descending when their first element's index has the sequence size bit clear, so the whole range is descending
+bool sortDescending(uint idx, uint sequence)
+{
+	return (idx & sequence) == 0;
+}
+
+bool sortNeedsSwap(float lowKey, float highKey, bool descending)
+{
+	return descending ? lowKey < highKey : lowKey > highKey;
+}
@@ -2,19 +2,35 @@
 #extension GL_EXT_nonuniform_qualifier : require
 #extension GL_GOOGLE_include_directive : enable
 #include "../common.glsl"
+#define OIT_SET 3
+#include "oit.glsl"
 
 struct PerInstanceParams {
 	mat4 model;
 	vec4 tint;
+	vec4 billboardAxis;
+	vec4 billboardStretch;
 };
 
 layout(constant_id = 0) const uint SC_PARAMS_OFFSET = 0;
 layout(constant_id = 1) const uint SC_MATERIAL_OFFSET = 0;
+layout(constant_id = 2) const uint SC_SCREEN_WIDTH = 1;
+layout(constant_id = 3) const uint SC_NODE_CAPACITY = 0;
+
+// Fragments hidden by the scene must not take a node
+layout(early_fragment_tests) in;
 
 layout(location = 0) in vec2 inUvCoords;
 layout(location = 1) flat in int inInstanceIndex;
 
-layout(location = 0) out vec4 colour;
+// Weighted sum of premultiplied colour and weights, and the product of transmittance
+layout(location = 0) out vec4 accumulation;
+layout(location = 1) out float revealage;
+
+// Last member of ParticlePushConstants
+layout(push_constant) uniform PushConstants {
+	layout(offset = 108) uint oitMode;
+} PC;
 
 layout(set = COMMON_SET, binding = COMMON_PARAMS_BINDING) readonly buffer Params {
 	PerInstanceParams[] params;
@@ -25,5 +41,23 @@ layout(set = COMMON_SET, binding = COMMON_MATERIALS_BINDING) readonly buffer DIP
 
 void main()
 {
-	colour = texture(texSamplers[nonuniformEXT(textureIndices[SC_MATERIAL_OFFSET + inInstanceIndex])], inUvCoords);
+	vec4 colour = texture(texSamplers[nonuniformEXT(textureIndices[SC_MATERIAL_OFFSET + inInstanceIndex])], inUvCoords);
+	vec4 premultiplied = vec4(colour.rgb * colour.a, colour.a);
+
+	if (PC.oitMode == OIT_MODE_LINKED_LIST && colour.a > 0.0) {
+		uint nodeIdx = atomicAdd(nodeCount, 1);
+		if (nodeIdx < SC_NODE_CAPACITY) {
+			uint pixelIdx = uint(gl_FragCoord.y) * SC_SCREEN_WIDTH + uint(gl_FragCoord.x);
+			nodes[nodeIdx].colour = oitPackColour(premultiplied);
+			nodes[nodeIdx].depth = gl_FragCoord.z;
+			nodes[nodeIdx].next = atomicExchange(heads[pixelIdx], nodeIdx);
+			// Leaves both targets as they were under their blends
+			accumulation = vec4(0.0);
+			revealage = 0.0;
+			return;
+		}
+		// The lists are full, so this falls back to the weighted targets the composite puts behind the lists
+	}
+	accumulation = premultiplied * oitWeight(colour.a, gl_FragCoord.z);
+	revealage = colour.a;
 }
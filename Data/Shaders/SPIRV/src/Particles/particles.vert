@@ -2,29 +2,105 @@
 #extension GL_GOOGLE_include_directive : enable
 #include "../common.glsl"
 
-layout(location = 0) in vec3 inPosition;
-layout(location = 1) in float inScale;
-layout(location = 2) in vec2 inTexOffset;
+// Each instance is one particle, each of its 4 vertices a corner of the quad drawn as a strip
+#define PARTICLE_SET 2
+// Must match ParticleBillboardMode
+#define BILLBOARD_CAMERA_FACING 0
+#define BILLBOARD_VELOCITY_STRETCHED 1
+#define BILLBOARD_AXIS_ALIGNED 2
 
-layout(location = 0) out vec3 outPosition;
-layout(location = 1) out float outScale;
-layout(location = 2) out vec2 outTexOffset;
-layout(location = 3) flat out int outInstanceIndex;
-layout(location = 4) flat out vec4 outCameraPos;
+struct Params {
+	mat4 model;
+	vec4 tint; // w is the texture tile length
+	vec4 billboardAxis; // w is the billboard mode
+	vec4 billboardStretch; // x is the seconds of travel a velocity stretched quad spans
+};
+
+// Matches ParticleVertex and the ParticleInstance of particle_simulation.glsl
+struct ParticleInstance {
+	vec4 position; // w is the scale
+	vec4 velocity;
+	vec4 textureOffset;
+};
+
+layout(constant_id = 0) const uint SC_MVP_OFFSET = 0;
+layout(constant_id = 1) const uint SC_PARAMS_OFFSET = 0;
+
+layout(location = 0) out vec2 outUvCoords;
+layout(location = 1) flat out int outInstanceIndex;
 
 layout(push_constant) uniform PushConstants {
 	mat4 shadowMatrix;
 	vec4 cameraPosition;
 	vec3 mainLightPosition;
 	uint shadowTextureIdx;
+	uint paramsIdx;
+	uint firstParticle;
+	uint gpuSimulated;
 } PC;
 
+layout (set = COMMON_SET, binding = COMMON_MVP_BINDING) readonly buffer MVPs {
+	mat4[] mvps;
+};
+layout (set = COMMON_SET, binding = COMMON_PARAMS_BINDING) readonly buffer ShaderParams {
+	Params[] params;
+};
+layout(set = PARTICLE_SET, binding = 0) readonly buffer CpuParticles {
+	ParticleInstance cpuParticles[];
+};
+layout(set = PARTICLE_SET, binding = 1) readonly buffer GpuParticles {
+	ParticleInstance gpuParticles[];
+};
+
+// Bottom left, top left, bottom right, top right, in units of the particle's scale
+const vec2 CORNERS[4] = vec2[](vec2(-0.5, -0.5), vec2(-0.5, 0.5), vec2(0.5, -0.5), vec2(0.5, 0.5));
+const vec3 UP = vec3(0.0, 1.0, 0.0);
+
+// Right and up edges of a quad turning only about the axis to face the viewer, false when the axis points at the viewer
+bool turnAboutAxis(vec3 axis, vec3 toViewer, out vec3 right, out vec3 up)
+{
+	right = cross(axis, toViewer);
+	up = axis;
+	if (dot(right, right) < 1e-6) {
+		return false;
+	}
+	right = normalize(right);
+	return true;
+}
+
 void main()
 {
-	outCameraPos = PC.cameraPosition;
-	outPosition = inPosition;
-	outScale = inScale;
-	outTexOffset = inTexOffset;
-	outInstanceIndex = gl_InstanceIndex;
-	gl_Position = vec4(inPosition, 1.0);
+	uint particleIdx = PC.firstParticle + uint(gl_InstanceIndex);
+	ParticleInstance particle = PC.gpuSimulated != 0 ? gpuParticles[particleIdx] : cpuParticles[particleIdx];
+	Params parameters = params[SC_PARAMS_OFFSET + PC.paramsIdx];
+	// Billboarding is done in model space so any rotation of the system is applied correctly
+	vec3 viewerPosition = (inverse(parameters.model) * vec4(PC.cameraPosition.xyz, 1.0)).xyz;
+	vec3 toViewer = normalize(viewerPosition - particle.position.xyz);
+
+	vec3 right;
+	vec3 up;
+	bool turned = false;
+	uint mode = uint(parameters.billboardAxis.w);
+	if (mode == BILLBOARD_VELOCITY_STRETCHED) {
+		float speed = length(particle.velocity.xyz);
+		if (speed > 1e-4) {
+			turned = turnAboutAxis(particle.velocity.xyz / speed, toViewer, right, up);
+			up *= 1.0 + speed * parameters.billboardStretch.x;
+		}
+	}
+	else if (mode == BILLBOARD_AXIS_ALIGNED) {
+		turned = turnAboutAxis(normalize(parameters.billboardAxis.xyz), toViewer, right, up);
+	}
+	// Camera facing, and what the others fall back to when their axis gives no plane to face the viewer with
+	if (!turned) {
+		vec3 reference = abs(toViewer.y) < 0.999 ? UP : vec3(0.0, 0.0, 1.0);
+		right = normalize(cross(reference, toViewer));
+		up = cross(toViewer, right);
+	}
+
+	vec2 corner = CORNERS[gl_VertexIndex];
+	vec3 position = particle.position.xyz + particle.position.w * (corner.x * right + corner.y * up);
+	outUvCoords = particle.textureOffset.xy + (corner + 0.5) * parameters.tint.w;
+	outInstanceIndex = int(PC.paramsIdx);
+	gl_Position = mvps[SC_MVP_OFFSET + PC.paramsIdx] * vec4(position, 1.0);
 }
@@ -0,0 +1,86 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+#extension GL_GOOGLE_include_directive : enable
+#include "../common.glsl"
+#include "oit.glsl"
+
+// Fragments sorted per pixel, any more are treated as the weighted ones behind them
+#define MAX_SORTED_FRAGMENTS 16
+
+layout(constant_id = 0) const uint SC_ACCUMULATION_IDX = 0;
+layout(constant_id = 1) const uint SC_REVEALAGE_IDX = 0;
+layout(constant_id = 2) const uint SC_SCREEN_WIDTH = 1;
+layout(constant_id = 3) const uint SC_NODE_CAPACITY = 0;
+
+layout(location = 0) in vec2 inUV;
+
+// Blended over the scene with ONE, SRC_ALPHA, so alpha is the transmittance of everything composited
+layout(location = 0) out vec4 outColour;
+
+layout(push_constant) uniform PushConstants {
+	uint mode;
+} PC;
+
+// Average colour of the weighted fragments, over nothing, and their transmittance
+vec4 resolveWeighted()
+{
+	vec4 accumulation = texture(texSamplers[SC_ACCUMULATION_IDX], inUV);
+	float revealage = texture(texSamplers[SC_REVEALAGE_IDX], inUV).r;
+	vec3 average = accumulation.rgb / max(accumulation.a, 1e-5);
+	return vec4(average * (1.0 - revealage), revealage);
+}
+
+void main()
+{
+	vec4 weighted = resolveWeighted();
+	if (PC.mode != OIT_MODE_LINKED_LIST) {
+		outColour = weighted;
+		return;
+	}
+
+	// Keep the nearest fragments sorted far to near, those past the limit are blended as they come behind them
+	vec4 colours[MAX_SORTED_FRAGMENTS];
+	float depths[MAX_SORTED_FRAGMENTS];
+	uint count = 0;
+	vec3 colour = weighted.rgb;
+	float transmittance = weighted.a;
+
+	uint pixelIdx = uint(gl_FragCoord.y) * SC_SCREEN_WIDTH + uint(gl_FragCoord.x);
+	uint nodeIdx = heads[pixelIdx];
+	while (nodeIdx != OIT_INVALID_NODE && nodeIdx < SC_NODE_CAPACITY) {
+		vec4 fragment = oitUnpackColour(nodes[nodeIdx].colour);
+		float depth = nodes[nodeIdx].depth;
+		nodeIdx = nodes[nodeIdx].next;
+		if (count == MAX_SORTED_FRAGMENTS) {
+			// The farthest kept is at the front, blend whichever of it and this is farther
+			if (depth < depths[0]) {
+				vec4 swapped = colours[0];
+				colours[0] = fragment;
+				fragment = swapped;
+				float swappedDepth = depths[0];
+				depths[0] = depth;
+				depth = swappedDepth;
+				for (uint i = 1; i < count && depths[i] > depths[i - 1]; ++i) {
+					vec4 c = colours[i]; colours[i] = colours[i - 1]; colours[i - 1] = c;
+					float d = depths[i]; depths[i] = depths[i - 1]; depths[i - 1] = d;
+				}
+			}
+			colour = fragment.rgb + colour * (1.0 - fragment.a);
+			transmittance *= 1.0 - fragment.a;
+			continue;
+		}
+		uint i = count++;
+		for (; i > 0 && depths[i - 1] < depth; --i) {
+			colours[i] = colours[i - 1];
+			depths[i] = depths[i - 1];
+		}
+		colours[i] = fragment;
+		depths[i] = depth;
+	}
+
+	for (uint i = 0; i < count; ++i) {
+		colour = colours[i].rgb + colour * (1.0 - colours[i].a);
+		transmittance *= 1.0 - colours[i].a;
+	}
+	outColour = vec4(colour, transmittance);
+}
@@ -1,10 +1,21 @@
 #version 450
+#extension GL_GOOGLE_include_directive : enable
+#include "../common.glsl"
+#include "../Terrain/terrain_heightmap.glsl"
 
-layout(location = 0) in vec3 iPosition;
-layout(location = 1) in vec2 iTextureCoord;
-layout(location = 2) in vec3 iNormal;
+// Per node instance data, see TerrainNodeInstance
+layout(location = 0) in vec4 iNode;
+layout(location = 1) in vec4 iMorphCentre;
+layout(location = 2) in vec2 iMorphRange;
+layout(location = 4) in uvec4 iFineTile;
+layout(location = 5) in uvec4 iCoarseTile;
 
 layout(location = 0) flat out uint mvpOffset;
+layout(location = 1) flat out vec4 outNode;
+layout(location = 2) flat out vec4 outMorphCentre;
+layout(location = 3) flat out vec2 outMorphRange;
+layout(location = 4) flat out uvec4 outFineTile;
+layout(location = 5) flat out uvec4 outCoarseTile;
 
 layout(push_constant) uniform PushConstants {
 	uint mvpOffset;
@@ -12,5 +23,10 @@ layout(push_constant) uniform PushConstants {
 
 void main() {
 	mvpOffset = PC.mvpOffset;
-	gl_Position = vec4(iPosition, 1.0);
-}
\ No newline at end of file
+	outNode = iNode;
+	outMorphCentre = iMorphCentre;
+	outMorphRange = iMorphRange;
+	outFineTile = iFineTile;
+	outCoarseTile = iCoarseTile;
+	gl_Position = terrainNodePosition(gl_VertexIndex, iNode, iMorphCentre, iMorphRange, iFineTile, iCoarseTile);
+}
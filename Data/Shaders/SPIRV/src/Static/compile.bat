@@ -1,3 +1,5 @@
 C:\VulkanSDK\1.1.126.0\Bin\glslc.exe static.vert -c -o ../../StaticVert.spv
+C:\VulkanSDK\1.1.126.0\Bin\glslc.exe static.vert -c -DPACKED_VERTEX -o ../../StaticPackedVert.spv
 C:\VulkanSDK\1.1.126.0\Bin\glslc.exe static_deferred.frag -c -o ../../StaticDeferredFrag.spv
+C:\VulkanSDK\1.1.126.0\Bin\glslc.exe cluster_cull.comp -c -o ../../ClusterCull.spv
 pause
\ No newline at end of file
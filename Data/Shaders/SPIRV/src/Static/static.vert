@@ -15,7 +15,11 @@ layout(constant_id = 1) const uint SC_PARAMS_OFFSET = 0;
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec2 inTextureCoord;
+#ifdef PACKED_VERTEX
+layout(location = 2) in vec2 inNormal;
+#else
 layout(location = 2) in vec3 inNormal;
+#endif
 
 layout(location = 0) out vec2 outUV;
 layout(location = 1) out vec3 outNormal;
@@ -39,7 +43,12 @@ void main() {
 	gl_Position = mvps[SC_MVP_OFFSET + gl_InstanceIndex] * vec4(inPosition, 1.0);
 	outUV = inTextureCoord;
 	outWorldPos = (params[SC_PARAMS_OFFSET + gl_InstanceIndex].model * vec4(inPosition, 1.0)).xyz;
+#ifdef PACKED_VERTEX
+	// The model includes the position dequantization, which the packed normal was scaled to cancel, so only the direction is kept
+	outNormal = normalize(mat3(transpose(inverse(params[SC_PARAMS_OFFSET + gl_InstanceIndex].model))) * decodeOctahedral(inNormal));
+#else
 	outNormal = mat3(transpose(inverse(params[SC_PARAMS_OFFSET + gl_InstanceIndex].model))) * inNormal;
+#endif
 
 	outShadowCoord = (BIAS_MATRIX * PC.shadowMatrix * params[SC_PARAMS_OFFSET + gl_InstanceIndex].model) * vec4(inPosition, 1.0);
 	outShadowMapIdx = PC.shadowTextureIdx;
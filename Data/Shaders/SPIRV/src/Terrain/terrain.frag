@@ -18,6 +18,7 @@ layout (location = 2) in vec3 inNormal;
 layout (location = 3) flat in int instanceIndex;
 layout (location = 4) flat in vec3 inCamPos;
 layout (location = 5) flat in int inGrass;
+layout (location = 6) in vec3 inSplat;
 
 layout(set = COMMON_SET, binding = COMMON_PARAMS_BINDING) readonly buffer ParamsData
 {
@@ -28,9 +29,6 @@ layout(set = COMMON_SET, binding = COMMON_MATERIALS_BINDING) readonly buffer Tex
 	TextureIndices textureIndices[];
 };
 
-const float mixThreshold = 0.1;
-const float mixThresholdMult2 = mixThreshold * 2.0;
-
 const vec4 fogColour = vec4(0.7, 0.7, 0.8, 1.0);
 const vec3 grassColours[3] = vec3[](vec3(0.486, 0.988, 0.0), vec3(0.220, 0.273, 0.060), vec3(0.129, 0.203, 0.016) );
 
@@ -46,21 +44,14 @@ void main() {
 		outAlbedo = vec4(grassColours[inGrass], 1.0);
 	}
 	else {
-		// Terrain texture
+		// Terrain texture, weighted by the splat map cooked in to the tiles
 		float heightFactor = clamp(inWorldPos.y / parameters.heights.x, 0.0, 1.0);
 		vec4 texColour0 = texture(texSamplers[nonuniformEXT(texIndices.albedoIdx0)], texUV);
 		vec4 texColour1 = texture(texSamplers[nonuniformEXT(texIndices.albedoIdx1)], texUV);
 		vec4 texColour2 = texture(texSamplers[nonuniformEXT(texIndices.albedoIdx2)], texUV);
-		float heightFactors[3];
-		
-		float zboundary = heightFactor - (parameters.heights.z - mixThreshold);
-		float wboundary = heightFactor - (parameters.heights.w - mixThreshold);
-		heightFactors[0] = 1.0 - clamp(zboundary / mixThresholdMult2, 0.0, 1.0);
-		heightFactors[1] = clamp(zboundary/mixThresholdMult2, 0.0, 1.0) *
-			1.0 - clamp(wboundary / mixThresholdMult2, 0.0, 1.0);
-		heightFactors[2] = clamp(wboundary / mixThresholdMult2, 0.0, 1.0);
+		vec3 weights = inSplat / max(inSplat.x + inSplat.y + inSplat.z, 0.001);
 		
-		outAlbedo = vec4(texColour0.rgb * heightFactors[0] + texColour1.rgb * heightFactors[1] + texColour2.rgb * heightFactors[2], 1.0);
+		outAlbedo = vec4(texColour0.rgb * weights.x + texColour1.rgb * weights.y + texColour2.rgb * weights.z, 1.0);
 		vec4 tmpAlbedo = mix(fogColour, outAlbedo, heightFactor * heightFactor);
 		float distFactor = (distance(inWorldPos, inCamPos) - 0.1) / 1000.0;
 		outAlbedo = vec4(mix(outAlbedo, tmpAlbedo, distFactor * distFactor).rgb, 1.0);
@@ -4,19 +4,29 @@
 #define USE_VERTEX_PUSH_CONSTANTS
 #include "../common.glsl"
 #include "terrain_structs.glsl"
+#include "terrain_heightmap.glsl"
 
 layout(constant_id = 0) const uint SC_PARAMS_OFFSET = 0;
+layout(constant_id = 1) const uint SC_MATERIAL_OFFSET = 0;
 
-layout(location = 0) in vec3 iPosition;
-layout(location = 1) in vec2 iTextureCoord;
-layout(location = 2) in vec3 iNormal;
+// Per node instance data, see TerrainNodeInstance
+layout (location = 0) in vec4 iNode;
+layout (location = 1) in vec4 iMorphCentre;
+layout (location = 2) in vec2 iMorphRange;
+layout (location = 3) in uint iParamsIdx;
+layout (location = 4) in uvec4 iFineTile;
+layout (location = 5) in uvec4 iCoarseTile;
 
 layout (location = 0) out vec2 texUV;
 layout (location = 1) flat out int instanceIndex;
 layout (location = 2) out vec4 shadowCoord;
 layout (location = 3) flat out uint shadowMapIdx;
-layout (location = 4) out vec3 normal;
 layout (location = 5) flat out vec3 outCamPos;
+layout (location = 6) flat out vec4 outNode;
+layout (location = 7) flat out vec4 outMorphCentre;
+layout (location = 8) flat out vec2 outMorphRange;
+layout (location = 9) flat out uvec4 outFineTile;
+layout (location = 10) flat out uvec4 outCoarseTile;
 
 layout(set = COMMON_SET, binding = COMMON_PARAMS_BINDING) readonly buffer MaterialData
 {
@@ -24,11 +34,18 @@ layout(set = COMMON_SET, binding = COMMON_PARAMS_BINDING) readonly buffer Materi
 };
 
 void main() {
-	instanceIndex = gl_InstanceIndex;
-	gl_Position = vec4(iPosition, 1.0);
-	texUV = iTextureCoord;
-	normal = iNormal;
-	shadowCoord = (BIAS_MATRIX * PC.shadowMatrix * materials[SC_PARAMS_OFFSET + instanceIndex].model) * vec4(iPosition, 1.0);
+	// Nodes are instances, so the instance index of the entity comes with the node
+	instanceIndex = int(iParamsIdx);
+	// Only the corners are placed here, the evaluation shader resamples the tiles between them
+	vec4 position = terrainNodePosition(gl_VertexIndex, iNode, iMorphCentre, iMorphRange, iFineTile, iCoarseTile);
+	gl_Position = position;
+	texUV = position.xz * TERRAIN_UV_SCALE;
+	shadowCoord = (BIAS_MATRIX * PC.shadowMatrix * materials[SC_PARAMS_OFFSET + instanceIndex].model) * position;
 	shadowMapIdx = PC.shadowTextureIdx;
 	outCamPos = PC.cameraPosition.xyz;
+	outNode = iNode;
+	outMorphCentre = iMorphCentre;
+	outMorphRange = iMorphRange;
+	outFineTile = iFineTile;
+	outCoarseTile = iCoarseTile;
 }
@@ -0,0 +1,78 @@
+// Terrain vertices are pulled from the streamed tiles rather than a vertex buffer. Every quadtree node draws the same grid, indexed
+// x * (TERRAIN_NODE_GRID_DIMENSION + 1) + z, placed by the node's instance data. Positions are in level 0 samples, so the same
+// lookups serve the grid vertices and the tessellated points between them.
+// A tile is the texture indices of its height, normal and splat maps and its level, see TerrainTileStreamer. Each node samples a
+// fine tile and the coarse tile of the level above, blending from one to the other as it morphs.
+// Expects texSamplers from common.glsl.
+
+const int TERRAIN_NODE_GRID_DIMENSION = 16; // Must match TerrainQuadtree::kNodeGridDimension
+const int TERRAIN_TILE_SIZE = 256; // Must match TerrainTileStreamer::kTileSize
+const float TERRAIN_HEIGHT_SCALE = 200.0;
+const float TERRAIN_UV_SCALE = 1.0 / 6.0; // Texture repeats per level 0 sample
+
+// A node lies within a single tile of every level, found from its origin so points on the tile's far edge stay in it
+vec2 terrainTileUV(uvec4 tile, vec2 nodeOrigin, vec2 position)
+{
+	float spacing = float(1u << tile.w);
+	float span = float(TERRAIN_TILE_SIZE) * spacing;
+	vec2 sampleCoord = (position - floor(nodeOrigin / span) * span) / spacing;
+	// Samples are texel centres, the last row and column being the far edge shared with the next tile
+	return (sampleCoord + 0.5) / float(TERRAIN_TILE_SIZE + 1);
+}
+
+float sampleTileHeight(uvec4 tile, vec2 nodeOrigin, vec2 position)
+{
+	return textureLod(texSamplers[nonuniformEXT(tile.x)], terrainTileUV(tile, nodeOrigin, position), 0.0).r * TERRAIN_HEIGHT_SCALE;
+}
+
+// Only x and z are stored, the normal always points up
+vec3 sampleTileNormal(uvec4 tile, vec2 nodeOrigin, vec2 position)
+{
+	vec2 xz = textureLod(texSamplers[nonuniformEXT(tile.y)], terrainTileUV(tile, nodeOrigin, position), 0.0).rg;
+	return vec3(xz.x, sqrt(max(1.0 - dot(xz, xz), 0.0)), xz.y);
+}
+
+vec3 sampleTileSplat(uvec4 tile, vec2 nodeOrigin, vec2 position)
+{
+	return textureLod(texSamplers[nonuniformEXT(tile.z)], terrainTileUV(tile, nodeOrigin, position), 0.0).rgb;
+}
+
+// How much the terrain around the sample strays from its tangent plane, 0 to 1, cooked in to the splat map's alpha
+float sampleTileRoughness(uvec4 tile, vec2 nodeOrigin, vec2 position)
+{
+	return textureLod(texSamplers[nonuniformEXT(tile.z)], terrainTileUV(tile, nodeOrigin, position), 0.0).a;
+}
+
+// 0 where the node shows its own level, 1 where it matches the level above
+float terrainMorph(vec3 position, vec4 morphCentre, vec2 morphRange)
+{
+	return clamp((distance(position, morphCentre.xyz) - morphRange.x) / (morphRange.y - morphRange.x), 0.0, 1.0);
+}
+
+float sampleTerrainHeight(uvec4 fineTile, uvec4 coarseTile, vec2 nodeOrigin, vec2 position, float morph)
+{
+	return mix(sampleTileHeight(fineTile, nodeOrigin, position), sampleTileHeight(coarseTile, nodeOrigin, position), morph);
+}
+
+vec3 sampleTerrainNormal(uvec4 fineTile, uvec4 coarseTile, vec2 nodeOrigin, vec2 position, float morph)
+{
+	return normalize(mix(sampleTileNormal(fineTile, nodeOrigin, position), sampleTileNormal(coarseTile, nodeOrigin, position), morph));
+}
+
+vec3 sampleTerrainSplat(uvec4 fineTile, uvec4 coarseTile, vec2 nodeOrigin, vec2 position, float morph)
+{
+	return mix(sampleTileSplat(fineTile, nodeOrigin, position), sampleTileSplat(coarseTile, nodeOrigin, position), morph);
+}
+
+// node is the origin and size in level 0 samples, morphCentre and morphRange are in the same local space. Over the morph range the
+// odd grid vertices slide on to their even neighbours, so at the end of it the node matches the grid of the level above.
+vec4 terrainNodePosition(int vertexIndex, vec4 node, vec4 morphCentre, vec2 morphRange, uvec4 fineTile, uvec4 coarseTile)
+{
+	vec2 gridPos = vec2(vertexIndex / (TERRAIN_NODE_GRID_DIMENSION + 1), vertexIndex % (TERRAIN_NODE_GRID_DIMENSION + 1));
+	float cellSize = node.z / float(TERRAIN_NODE_GRID_DIMENSION);
+	vec2 position = node.xy + gridPos * cellSize;
+	float morph = terrainMorph(vec3(position.x, sampleTileHeight(fineTile, node.xy, position), position.y), morphCentre, morphRange);
+	gridPos -= fract(gridPos * 0.5) * 2.0 * morph;
+	position = node.xy + gridPos * cellSize;
+	return vec4(position.x, sampleTerrainHeight(fineTile, coarseTile, node.xy, position, morph), position.y, 1.0);
+}
@@ -1,9 +1,9 @@
 struct Params {
 	mat4 model;
 	vec4 heights;
-	float distanceFarMinusClose;
-	float closeDistance;
-	float patchRadius;
+	float trianglesPerPixel;
+	float flatTessellationScale;
+	float maxTessellationLevel;
 	float time;
 	vec4 frustumPlanes[6];
 };
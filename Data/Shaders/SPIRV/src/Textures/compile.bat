@@ -0,0 +1,2 @@
+C:\VulkanSDK\1.1.126.0\Bin\glslc.exe mip_downsample.comp -c -o ../../MipDownsample.spv
+pause
\ No newline at end of file
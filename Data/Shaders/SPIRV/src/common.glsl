@@ -107,3 +107,12 @@ mat3 calculateTBN(in vec3 normal, in vec3 tangent)
 {
 	return mat3(tangent, cross(normal, tangent), normal);
 }
+
+// Inverse of the octahedral encoding used for packed vertex normals and tangents
+vec3 decodeOctahedral(in vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
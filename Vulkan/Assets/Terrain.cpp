@@ -2,66 +2,95 @@
 #include "../Graphics/ShaderParams.h"
 #include "../Graphics/Material.h"
 #include "../Graphics/TextureManager.h"
-#include "../Graphics/Vertex.h"
-#include "../Graphics/TextureLoader.h"
+#include "../Graphics/TerrainTileStreamer.h"
+#include "../Graphics/TerrainQuadtree.h"
+#include "../Graphics/TerrainQuery.h"
+#include "../Graphics/SwapChain.h"
+#include "../SystemMasters.h"
 #include "Transform.h"
 
 using namespace QZL;
 using namespace Graphics;
 
-Terrain::Terrain(const std::string name, TextureManager* textureManager)
+Terrain::Terrain(const std::string name, const SystemMasters& masters)
 	: Entity(name)
 {
-	setGraphicsComponent(Graphics::RendererTypes::kTerrain, nullptr, new TerrainShaderParams(200.0f, 0.0f, 0.3f, 0.9f),
-		textureManager->requestMaterial(Graphics::RendererTypes::kTerrain, "Terrain"), "terrain", loadFunction);
+	// The heightmap is cooked in to tiles which are streamed in around the viewer as the quadtree selects nodes
+	streamer_ = new TerrainTileStreamer(masters.getLogicDevice(), masters.textureManager, masters.jobSystem, "Heightmaps/hmap1", kHeightScale, MAX_FRAMES_IN_FLIGHT);
+	quadtree_ = new TerrainQuadtree(streamer_);
+	query_ = new TerrainQuery(&streamer_->getCache());
+
+	setGraphicsComponent(Graphics::RendererTypes::kTerrain, nullptr, new TerrainShaderParams(kHeightScale, 0.0f, 0.3f, 0.9f),
+		masters.textureManager->requestMaterialAsync(Graphics::RendererTypes::kTerrain, "Terrain"), "terrain", loadFunction);
 }
 
-void Terrain::loadFunction(uint32_t& count, std::vector<char>& indices, std::vector<char>& vertices)
+Terrain::~Terrain()
 {
-	auto heightmap = TextureLoader::getCPUImage("Heightmaps/hmap1.png", 1024, 1024, 1, 1);
-	const int gridSize = 1024;
-	const int numSubGrids = 150;
-	const int subGridSize = gridSize / numSubGrids;
-	std::vector<uint16_t> inds;
-	std::vector<Graphics::Vertex> verts;
-	for (int x = 0; x < numSubGrids; ++x) {
-		for (int z = 0; z < numSubGrids; ++z) {
-			int expandedX = x * subGridSize;
-			int expandedZ = z * subGridSize;
-			float vx = float(expandedX);
-			float vz = float(expandedZ);
-			unsigned char rawHeight = heightmap[expandedX + expandedZ * 1024];
-			float vy = ((float)rawHeight / 256.0f) * 200.0f;
-			float u = float(x);
-			float v = float(z);
+	SAFE_DELETE(query_);
+	SAFE_DELETE(quadtree_);
+	SAFE_DELETE(streamer_);
+}
 
-			expandedX = expandedX == 0 ? 1 : expandedX == 1024 ? 1023 : expandedX;
-			expandedZ = expandedZ == 0 ? 1 : expandedZ == 1024 ? 1023 : expandedZ;
-			float hu = (float(heightmap[expandedX + (expandedZ + 1) * 1024]) / 256.0f) * 200.0f;
-			float hd = (float(heightmap[expandedX + (expandedZ - 1) * 1024]) / 256.0f) * 200.0f;
-			float hl = (float(heightmap[expandedX - 1 + expandedZ * 1024]) / 256.0f) * 200.0f;
-			float hr = (float(heightmap[expandedX + 1 + expandedZ * 1024]) / 256.0f) * 200.0f;
+// The terrain is expected to only be moved, scaled and turned about y, so the ground below a position is found from its x and z
+float Terrain::getHeight(const glm::vec3& position)
+{
+	const glm::mat4 model = getModelMatrix();
+	const glm::vec4 local = glm::inverse(model) * glm::vec4(position, 1.0f);
+	return (model * glm::vec4(local.x, query_->getHeight(local.x, local.z), local.z, 1.0f)).y;
+}
 
-			glm::vec3 normal = glm::vec3(hl - hr, 2.0f, hd - hu);
-			normal = glm::normalize(normal);
+glm::vec3 Terrain::getNormal(const glm::vec3& position)
+{
+	const glm::mat4 model = getModelMatrix();
+	const glm::vec4 local = glm::inverse(model) * glm::vec4(position, 1.0f);
+	return glm::normalize(glm::mat3(glm::transpose(glm::inverse(model))) * query_->getNormal(local.x, local.z));
+}
 
-			verts.emplace_back(vx, vy, vz, u, v, normal.x, normal.y, normal.z);
-		}
+float Terrain::getSlope(const glm::vec3& position)
+{
+	return std::acos(glm::clamp(getNormal(position).y, -1.0f, 1.0f));
+}
+
+bool Terrain::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance)
+{
+	// Moving the ray in to the terrain's space keeps distances along it the same
+	const glm::mat4 inverseModel = glm::inverse(getModelMatrix());
+	return query_->raycast(glm::vec3(inverseModel * glm::vec4(origin, 1.0f)), glm::mat3(inverseModel) * direction, maxDistance, distance);
+}
+
+void Terrain::getHeights(const std::vector<glm::vec3>& positions, std::vector<float>& heights)
+{
+	const glm::mat4 model = getModelMatrix();
+	const glm::mat4 inverseModel = glm::inverse(model);
+	std::vector<glm::vec2> localPositions(positions.size());
+	for (size_t i = 0; i < positions.size(); ++i) {
+		const glm::vec4 local = inverseModel * glm::vec4(positions[i], 1.0f);
+		localPositions[i] = glm::vec2(local.x, local.z);
+	}
+	heights.resize(positions.size());
+	query_->getHeights(localPositions.data(), heights.data(), localPositions.size());
+	for (size_t i = 0; i < positions.size(); ++i) {
+		heights[i] = (model * glm::vec4(localPositions[i].x, heights[i], localPositions[i].y, 1.0f)).y;
 	}
-	for (int x = 0; x < numSubGrids - 1; ++x) {
-		for (int z = 0; z < numSubGrids - 1; ++z) {
-			int xoffset0 = x * numSubGrids;
-			int xoffset1 = (x + 1) * numSubGrids;
+}
+
+void Terrain::loadFunction(uint32_t& count, std::vector<char>& indices, std::vector<char>& vertices)
+{
+	// An index names a grid vertex as x * (kNodeGridDimension + 1) + z, the shaders recover the position from gl_VertexIndex
+	constexpr int kGridVertices = TerrainQuadtree::kNodeGridDimension + 1;
+	std::vector<uint16_t> inds;
+	inds.reserve(TerrainQuadtree::kNodeGridDimension * TerrainQuadtree::kNodeGridDimension * 4);
+	for (int x = 0; x < kGridVertices - 1; ++x) {
+		for (int z = 0; z < kGridVertices - 1; ++z) {
+			int xoffset0 = x * kGridVertices;
+			int xoffset1 = (x + 1) * kGridVertices;
 			inds.push_back(xoffset0 + z);
 			inds.push_back(xoffset0 + z + 1);
 			inds.push_back(xoffset1 + z + 1);
 			inds.push_back(xoffset1 + z);
 		}
 	}
-	TextureLoader::freeCPUImage(heightmap);
 	count = uint32_t(inds.size());
 	indices.resize(inds.size() * sizeof(uint16_t));
-	vertices.resize(verts.size() * sizeof(Graphics::Vertex));
 	memcpy(indices.data(), inds.data(), inds.size() * sizeof(uint16_t));
-	memcpy(vertices.data(), verts.data(), verts.size() * sizeof(Graphics::Vertex));
 }
@@ -3,13 +3,39 @@
 
 namespace QZL {
 	namespace Graphics {
-		class TextureManager;
+		class TerrainTileStreamer;
+		class TerrainQuadtree;
+		class TerrainQuery;
 	}
+	struct SystemMasters;
 	class Terrain : public Entity {
 	public:
-		Terrain(const std::string name, Graphics::TextureManager* textureManager);
+		Terrain(const std::string name, const SystemMasters& masters);
+		~Terrain();
+		Graphics::TerrainQuadtree* getQuadtree() {
+			return quadtree_;
+		}
+
+		// Gameplay queries against the full resolution heightmap, in world space. Heights and normals are of the ground below
+		// the position, ignoring its height.
+		float getHeight(const glm::vec3& position);
+		glm::vec3 getNormal(const glm::vec3& position);
+		// Radians between the ground's normal and straight up
+		float getSlope(const glm::vec3& position);
+		// Distance along the normalised direction to where the ray first meets the ground, if that is within maxDistance
+		bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance);
+		// Ground heights below many positions, in the order given
+		void getHeights(const std::vector<glm::vec3>& positions, std::vector<float>& heights);
 	private:
+		// Only the patch indices of one node's grid are built, every selected quadtree node draws it as an instance and the terrain
+		// shaders place each grid vertex and fetch its height and normal from the streamed tiles
 		static void loadFunction(uint32_t& count, std::vector<char>& indices, std::vector<char>& vertices);
 		static constexpr float maxHeight = 100.0f;
+		// Must match TERRAIN_HEIGHT_SCALE in terrain_heightmap.glsl
+		static constexpr float kHeightScale = 200.0f;
+
+		Graphics::TerrainTileStreamer* streamer_;
+		Graphics::TerrainQuadtree* quadtree_;
+		Graphics::TerrainQuery* query_;
 	};
 }
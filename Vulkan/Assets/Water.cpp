@@ -13,7 +13,7 @@ Water::Water(const std::string name, TextureManager* textureManager)
 	: Entity(name)
 {
 	setGraphicsComponent(Graphics::RendererTypes::kWater, nullptr, new WaterShaderParams(glm::vec4(0.25f, 0.64f, 0.87f, 1.0f), glm::vec4(0.8f, 0.8f, 0.8f, 100.0f)),
-		textureManager->requestMaterial(Graphics::RendererTypes::kWater, "Water"), "water", loadFunction);
+		textureManager->requestMaterialAsync(Graphics::RendererTypes::kWater, "Water"), "water", loadFunction);
 }
 
 void Water::update(float dt, const glm::mat4& viewProjection, const glm::mat4& parentMatrix)
@@ -7,29 +7,36 @@ using namespace Game;
 FireSystem::FireSystem(const SystemMasters& initialiser)
 	: ParticleSystem(initialiser, &initialiser.graphicsMaster->getCamera(0)->position, 10, 0.0f, (1.0f / 3.0f), "Fire")
 {
+	// The same ten particles rising from a line along x, spread randomly along it rather than every ten units
+	supportsGpuSimulation_ = true;
+	emitterSettings_.maxParticles = 10;
+	emitterSettings_.lifetime = 50.0f;
+	emitterSettings_.spawnRate = float(emitterSettings_.maxParticles) / emitterSettings_.lifetime;
+	emitterSettings_.spawnOffset = glm::vec3(45.0f, 0.0f, 0.0f);
+	emitterSettings_.spawnExtent = glm::vec3(45.0f, 0.0f, 0.0f);
+	emitterSettings_.velocity = glm::vec3(0.0f, 1.0f, 0.0f);
+	emitterSettings_.scale = 1.0f;
+	// Flames stay upright however the viewer looks at them
+	billboardMode_ = Graphics::ParticleBillboardMode::kAxisAligned;
+	// The line of flames and the 50 units they rise over their lifetime
+	priority_ = ParticlePriority::kHigh;
+	boundsCentre_ = glm::vec3(45.0f, 25.0f, 0.0f);
+	boundsRadius_ = 52.0f;
 }
 
 void FireSystem::start()
 {
-	fetchDynamicBuffer();
-	particleCreation(0, 10);
 	transform()->position = *billboardPoint_;
 	transform()->scale = glm::vec3(1.0f);
-}
-
-void FireSystem::particleCreation(float dt, size_t expiredCount)
-{
-	for (size_t i = 0; i < expiredCount; ++i) {
-		// Can just assume not nullptr since its within expired count
-		auto p = allocateParticle();
-		p->lifetime = 50.0f;
-		p->velocity = glm::vec3(0.0f, 1.0f, 0.0f);// *((rand() % 100) / 100.0f);
-		vertices_[currentActiveSize_ - 1].position = glm::vec3(i * 10.0f, 0.0f, 0.0f);
-		vertices_[currentActiveSize_ - 1].scale = 1.0f;
-		vertices_[currentActiveSize_ - 1].textureOffset = glm::vec2(0.0, 0.0);
+	if (!initialiseStorage()) {
+		particleCreation(0, 10);
 	}
 }
 
-void FireSystem::updateParticle(Particle& particle, Graphics::ParticleVertex& vertex, float dt)
+void FireSystem::particleCreation(float dt, size_t freeCount)
 {
+	const size_t first = store_.spawn(freeCount);
+	for (size_t i = 0; i < store_.size() - first; ++i) {
+		store_.setParticle(first + i, glm::vec3(i * 10.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 50.0f, 1.0f);
+	}
 }
@@ -8,8 +8,7 @@ namespace QZL {
 			FireSystem(const SystemMasters& initialiser);
 			void start() override;
 		protected:
-			void particleCreation(float dt, size_t expiredCount) override;
-			void updateParticle(Particle& particle, Graphics::ParticleVertex& vertex, float dt) override;
+			void particleCreation(float dt, size_t freeCount) override;
 		};
 	}
 }
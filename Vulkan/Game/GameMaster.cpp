@@ -25,6 +25,7 @@
 #include "../Graphics/PhysicalDevice.h"
 #include "../Graphics/LogicDevice.h"
 #include "../Graphics/RenderObject.h"
+#include "../JobSystem.h"
 
 using namespace QZL;
 using namespace Game;
@@ -64,7 +65,7 @@ void GameMaster::loadStatics(Scene* scene)
 		tree->getTransform()->setScale(3.0f);
 		tree->getTransform()->position = pos;
 		tree->setGraphicsComponent(Graphics::RendererTypes::kStatic, nullptr, new Graphics::StaticShaderParams(),
-			masters_.textureManager->requestMaterial(Graphics::RendererTypes::kStatic, "ExampleStatic"), "tree");
+			masters_.textureManager->requestMaterialAsync(Graphics::RendererTypes::kStatic, "ExampleStatic"), "tree");
 		scene->addEntity(tree);
 	}
 
@@ -79,7 +80,7 @@ void GameMaster::loadStatics(Scene* scene)
 		turbineBase->getTransform()->rotationAngle = glm::radians(90.0f);
 		turbineBase->getTransform()->position = pos;
 		turbineBase->setGraphicsComponent(Graphics::RendererTypes::kStatic, nullptr, new Graphics::StaticShaderParams(20.0f),
-			masters_.textureManager->requestMaterial(Graphics::RendererTypes::kStatic, "turbine"), "TurbineBase");
+			masters_.textureManager->requestMaterialAsync(Graphics::RendererTypes::kStatic, "turbine"), "TurbineBase");
 		auto baseNode = scene->addEntity(turbineBase);
 		Entity* turbineBlade = new Entity("turbine_blade");
 		turbineBlade->getTransform()->position.y = 3.43f;
@@ -91,7 +92,7 @@ void GameMaster::loadStatics(Scene* scene)
 			}
 		});
 		turbineBlade->setGraphicsComponent(Graphics::RendererTypes::kStatic, nullptr, new Graphics::StaticShaderParams(10.0f),
-			masters_.textureManager->requestMaterial(Graphics::RendererTypes::kStatic, "turbine_blade"), "TurbineBladesAdjusted");
+			masters_.textureManager->requestMaterialAsync(Graphics::RendererTypes::kStatic, "turbine_blade"), "TurbineBladesAdjusted");
 		scene->addEntity(turbineBlade, turbineBase, baseNode);
 	}
 
@@ -105,7 +106,7 @@ void GameMaster::loadStatics(Scene* scene)
 		lampPost->getTransform()->setScale(0.05f);
 		lampPost->getTransform()->position = pos;
 		lampPost->setGraphicsComponent(Graphics::RendererTypes::kStatic, nullptr, new Graphics::StaticShaderParams(),
-			masters_.textureManager->requestMaterial(Graphics::RendererTypes::kStatic, "posts"), "poste_obj");
+			masters_.textureManager->requestMaterialAsync(Graphics::RendererTypes::kStatic, "posts"), "poste_obj");
 		auto baseNode = scene->addEntity(lampPost);
 		auto radius = rand() % 200 + 20;
 		Entity* light = new LightSource("lampLight", glm::normalize(pos * glm::vec3((float)(rand() % 100), (float)(rand() % 100), (float)(rand() % 100))), 
@@ -126,14 +127,19 @@ void GameMaster::loadGame()
 	scriptInit.owner = camera;
 	camera->setGameScript(new Camera(masters_));
 
-	Entity* terrain = new Terrain("terrain", masters_.textureManager);
+	Entity* terrain = new Terrain("terrain", masters_);
 	terrain->setGameScript(new TerrainScript(masters_));
 
 	Entity* sun = new Entity("sun");
 	scriptInit.owner = sun;
 	auto sunScript = new SunScript(masters_);
 	sun->setGameScript(sunScript);
-	//sun->setGraphicsComponent(Graphics::RendererTypes::kParticle, sunScript->makeShaderParams(), "sun", sunScript->getMaterial());
+	sun->setGraphicsComponent(Graphics::RendererTypes::kParticle, sunScript->makeShaderParams(), "sun", sunScript->getMaterial());
+
+	Entity* rain = new Entity("rain");
+	auto rainScript = new RainSystem(masters_);
+	rain->setGameScript(rainScript);
+	rain->setGraphicsComponent(Graphics::RendererTypes::kParticle, rainScript->makeShaderParams(), "rain", rainScript->getMaterial());
 
 	Skysphere* skysphere = new Skysphere("sky", masters_.getLogicDevice(), sunScript, scriptInit);
 
@@ -162,6 +168,7 @@ void GameMaster::loadGame()
 	scenes_[activeSceneIdx_]->addEntity(water);
 	scenes_[activeSceneIdx_]->addEntity(terrain);
 	scenes_[activeSceneIdx_]->addEntity(sun);
+	scenes_[activeSceneIdx_]->addEntity(rain);
 	//scenes_[activeSceneIdx_]->addEntity(teapotDeferred);
 	//scenes_[activeSceneIdx_]->addEntity(teapotDeferred2);
 	scenes_[activeSceneIdx_]->addEntity(light);
@@ -172,4 +179,6 @@ void GameMaster::loadGame()
 void GameMaster::start()
 {
 	scenes_[activeSceneIdx_]->start();
+	// Textures requested while the scene was built are uploaded by main thread jobs, the first frame samples all of them
+	masters_.jobSystem->waitAll();
 }
@@ -0,0 +1,156 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "ParticlePool.h"
+#include "../Graphics/LogicalCamera.h"
+
+using namespace QZL;
+using namespace QZL::Game;
+
+ParticlePool::ParticlePool(size_t capacity, uint32_t budget)
+	: allocator_(capacity), budget_(budget), overBudget_(false)
+{
+	for (auto& stream : streams_) {
+		stream.resize(capacity, 0.0f);
+	}
+}
+
+size_t ParticlePool::allocate(size_t capacity)
+{
+	if (capacity == 0) {
+		return kInvalidOffset;
+	}
+	// Kernels run over whole lane blocks, so every range is padded to stop them writing in to the next
+	const VkDeviceSize offset = allocator_.allocate(VkDeviceSize(capacity + ParticleStore::kLaneCount - 1) / ParticleStore::kLaneCount * ParticleStore::kLaneCount,
+		ParticleStore::kLaneCount);
+	return offset == Graphics::FreeListAllocator::kInvalidOffset ? kInvalidOffset : static_cast<size_t>(offset);
+}
+
+void ParticlePool::free(size_t offset, size_t capacity)
+{
+	allocator_.free(offset, VkDeviceSize(capacity + ParticleStore::kLaneCount - 1) / ParticleStore::kLaneCount * ParticleStore::kLaneCount);
+}
+
+uint32_t ParticlePool::addEmitter()
+{
+	uint32_t emitter;
+	if (!freeEmitters_.empty()) {
+		emitter = freeEmitters_.back();
+		freeEmitters_.pop_back();
+		emitters_[emitter] = Emitter();
+	}
+	else {
+		emitter = static_cast<uint32_t>(emitters_.size());
+		emitters_.emplace_back();
+	}
+	emitters_[emitter].active = true;
+	return emitter;
+}
+
+void ParticlePool::removeEmitter(uint32_t emitter)
+{
+	EXPECTS(emitter < emitters_.size() && emitters_[emitter].active);
+	emitters_[emitter].active = false;
+	freeEmitters_.push_back(emitter);
+}
+
+void ParticlePool::reportEmitter(uint32_t emitter, const ParticleEmitterState& state)
+{
+	EXPECTS(emitter < emitters_.size() && emitters_[emitter].active);
+	emitters_[emitter].state = state;
+}
+
+void ParticlePool::beginFrame(const Graphics::LogicalCamera* cameras, size_t cameraCount)
+{
+	frameStats_ = {};
+	frameStats_.budget = budget_;
+	frustums_.resize(cameraCount);
+	for (size_t i = 0; i < cameraCount; ++i) {
+		cameras[i].calculateFrustumPlanes(cameras[i].viewProjection, frustums_[i]);
+	}
+
+	order_.clear();
+	uint32_t remaining = budget_;
+	for (uint32_t i = 0; i < emitters_.size(); ++i) {
+		Emitter& emitter = emitters_[i];
+		if (!emitter.active) {
+			continue;
+		}
+		++frameStats_.emitterCount;
+		frameStats_.demand += emitter.state.demand;
+		emitter.budget = ParticleEmitterBudget();
+		emitter.distance = 0.0f;
+		emitter.distanceScale = 1.0f;
+		if (emitter.state.priority == ParticlePriority::kCritical) {
+			remaining -= std::min(remaining, emitter.state.demand);
+			continue;
+		}
+		if (emitter.state.boundsRadius > 0.0f) {
+			bool visible = false;
+			emitter.distance = FLT_MAX;
+			for (size_t j = 0; j < cameraCount; ++j) {
+				bool inFrustum = true;
+				for (const auto& plane : frustums_[j]) {
+					if (glm::dot(glm::vec3(plane), emitter.state.boundsCentre) + plane.w < -emitter.state.boundsRadius) {
+						inFrustum = false;
+						break;
+					}
+				}
+				visible = visible || inFrustum;
+				emitter.distance = std::min(emitter.distance, std::max(glm::distance(emitter.state.boundsCentre, cameras[j].position) - emitter.state.boundsRadius, 0.0f));
+			}
+			if (!visible) {
+				emitter.budget.spawnScale = 0.0f;
+				emitter.budget.minUpdateInterval = kCulledUpdateInterval;
+				emitter.budget.culled = true;
+				++frameStats_.culledEmitters;
+				continue;
+			}
+			if (emitter.distance > emitter.state.fullRateDistance) {
+				emitter.distanceScale = std::max(emitter.state.fullRateDistance / emitter.distance, kMinDistanceScale);
+			}
+		}
+		order_.push_back(i);
+	}
+
+	// Higher priorities first, then the nearest, so what the budget runs out on is what is least noticed
+	std::sort(order_.begin(), order_.end(), [this](uint32_t lhs, uint32_t rhs) {
+		const Emitter& a = emitters_[lhs];
+		const Emitter& b = emitters_[rhs];
+		return a.state.priority != b.state.priority ? a.state.priority > b.state.priority : a.distance < b.distance;
+	});
+	for (uint32_t i : order_) {
+		Emitter& emitter = emitters_[i];
+		const uint32_t demand = static_cast<uint32_t>(float(emitter.state.demand) * emitter.distanceScale);
+		const bool throttled = demand > remaining;
+		emitter.budget.spawnScale = emitter.distanceScale;
+		if (throttled) {
+			emitter.budget.spawnScale *= float(remaining) / float(demand);
+			++frameStats_.throttledEmitters;
+		}
+		remaining -= std::min(remaining, demand);
+		// Throttled ambient effects and distant emitters are updated less often as well as spawning less
+		const bool slowed = (emitter.state.priority == ParticlePriority::kLow && throttled) ||
+			emitter.distance > emitter.state.fullRateDistance * kReducedRateDistanceFactor;
+		if (slowed) {
+			emitter.budget.minUpdateInterval = kReducedUpdateInterval;
+			++frameStats_.reducedRateEmitters;
+		}
+	}
+}
+
+void ParticlePool::endFrame()
+{
+	for (const auto& emitter : emitters_) {
+		if (emitter.active) {
+			frameStats_.liveParticles += emitter.state.liveCount;
+		}
+	}
+	frameStats_.pooledCapacity = static_cast<uint32_t>(allocator_.getCapacity() - allocator_.getFreeSize());
+	const bool overBudget = frameStats_.throttledEmitters > 0;
+	if (overBudget != overBudget_) {
+		DEBUG_LOG("Particle budget " << (overBudget ? "exceeded" : "recovered") << ": demand " << frameStats_.demand << " of " << budget_ << ", "
+			<< frameStats_.throttledEmitters << " emitters throttled, " << frameStats_.liveParticles << " particles alive");
+		overBudget_ = overBudget;
+	}
+	stats_ = frameStats_;
+}
@@ -0,0 +1,136 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Purpose: Share particle storage between systems and hold every emitter to one live particle budget.
+#pragma once
+#include "../Graphics/VkUtil.h"
+#include "../Graphics/FreeListAllocator.h"
+#include "ParticleStore.h"
+
+namespace QZL {
+	namespace Graphics {
+		struct LogicalCamera;
+	}
+	namespace Game {
+		enum class ParticlePriority : uint32_t {
+			// Ambient effects, first to be throttled and slowed
+			kLow = 0,
+			kMedium,
+			kHigh,
+			// Never throttled or culled, their particles come out of the budget before any other emitter's
+			kCritical
+		};
+
+		// Reported by an emitter every update, the pool judges the next frame's budget from it
+		struct ParticleEmitterState {
+			ParticlePriority priority = ParticlePriority::kMedium;
+			// World space bounding sphere, a radius of 0 is unbounded and never culled
+			glm::vec3 boundsCentre = glm::vec3(0.0f);
+			float boundsRadius = 0.0f;
+			// Emitters spawn at their full rate within this distance of the nearest camera, and less the farther past it they are
+			float fullRateDistance = 50.0f;
+			// Particles alive now, an estimate for gpu simulated emitters
+			uint32_t liveCount = 0;
+			// Particles alive once the emitter settles at its full spawn rate
+			uint32_t demand = 0;
+		};
+
+		// What an emitter may do this frame
+		struct ParticleEmitterBudget {
+			// Fraction of the emitter's full spawn rate, and of its demand it may keep alive
+			float spawnScale = 1.0f;
+			// Updates are no more frequent than this, 0 for every frame
+			float minUpdateInterval = 0.0f;
+			// Outside every camera's view, so nothing is spawned or drawn
+			bool culled = false;
+		};
+
+		struct ParticlePoolStats {
+			uint32_t budget = 0;
+			uint32_t emitterCount = 0;
+			uint32_t culledEmitters = 0;
+			// Emitters given less than their distance scaled demand
+			uint32_t throttledEmitters = 0;
+			uint32_t reducedRateEmitters = 0;
+			// Sum of the emitters' demand before any scaling
+			uint32_t demand = 0;
+			uint32_t liveParticles = 0;
+			// Particles of the pool's streams taken by cpu stores
+			uint32_t pooledCapacity = 0;
+			uint32_t spawnRequested = 0;
+			uint32_t spawnGranted = 0;
+		};
+
+		/*
+			Cpu particle stores take ranges of the pool's streams rather than owning their own, so their memory is bounded and shared.
+			Separately from storage every particle system, cpu or gpu simulated, registers as an emitter. At the start of a frame the
+			pool scales each emitter's demand by its distance from the nearest camera and hands out the budget in priority order, nearest
+			first within a priority, so the live particles across every system stay below the budget however many effects are playing.
+			Emitters that do not fit are throttled and the low priority ones slowed, and emitters out of every camera's view are culled.
+			Emitters report their state during the frame, so budgets always come from the previous frame's state.
+		*/
+		class ParticlePool {
+		public:
+			ParticlePool(size_t capacity, uint32_t budget);
+
+			// Range of capacity particles in every stream, kInvalidOffset if there is no room
+			size_t allocate(size_t capacity);
+			void free(size_t offset, size_t capacity);
+			float* getStream(ParticleStream stream) {
+				return streams_[size_t(stream)].data();
+			}
+
+			uint32_t addEmitter();
+			void removeEmitter(uint32_t emitter);
+			void reportEmitter(uint32_t emitter, const ParticleEmitterState& state);
+			const ParticleEmitterBudget& getEmitterBudget(uint32_t emitter) const {
+				return emitters_[emitter].budget;
+			}
+			void recordSpawn(uint32_t requested, uint32_t granted) {
+				frameStats_.spawnRequested += requested;
+				frameStats_.spawnGranted += granted;
+			}
+
+			// Divide the budget between the emitters for this frame, the cameras' view projections must be current
+			void beginFrame(const Graphics::LogicalCamera* cameras, size_t cameraCount);
+			// Total up the frame's stats, reported by getFrameStats until the next frame ends
+			void endFrame();
+			const ParticlePoolStats& getFrameStats() const {
+				return stats_;
+			}
+			void setBudget(uint32_t budget) {
+				budget_ = budget;
+			}
+
+			static constexpr size_t kInvalidOffset = ~size_t(0);
+			static constexpr uint32_t kInvalidEmitter = ~0u;
+			// Update intervals of culled emitters, and of low priority or distant emitters when slowed
+			static constexpr float kCulledUpdateInterval = 0.25f;
+			static constexpr float kReducedUpdateInterval = 1.0f / 15.0f;
+			// Emitters farther than this many full rate distances are slowed whatever their priority
+			static constexpr float kReducedRateDistanceFactor = 4.0f;
+			// Distant emitters never drop below this fraction of their demand before the budget is applied
+			static constexpr float kMinDistanceScale = 0.1f;
+		private:
+			struct Emitter {
+				ParticleEmitterState state;
+				ParticleEmitterBudget budget;
+				bool active = false;
+				// Scratch for beginFrame
+				float distance = 0.0f;
+				float distanceScale = 1.0f;
+			};
+
+			std::array<std::vector<float>, size_t(ParticleStream::kCount)> streams_;
+			Graphics::FreeListAllocator allocator_;
+			std::vector<Emitter> emitters_;
+			std::vector<uint32_t> freeEmitters_;
+			// Emitters in the order the budget is handed out and the cameras' planes, kept to avoid allocating every frame
+			std::vector<uint32_t> order_;
+			std::vector<std::array<glm::vec4, 6>> frustums_;
+			uint32_t budget_;
+			ParticlePoolStats frameStats_;
+			ParticlePoolStats stats_;
+			bool overBudget_;
+		};
+	}
+}
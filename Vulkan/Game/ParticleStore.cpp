@@ -0,0 +1,251 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "ParticleStore.h"
+#include "ParticlePool.h"
+#include <numeric>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define QZL_PARTICLES_SSE
+#endif
+
+using namespace QZL;
+using namespace QZL::Game;
+
+// dst[i] += src[i] * scale over whole lane blocks
+static void multiplyAdd(float* dst, const float* src, float scale, size_t blocks)
+{
+#ifdef QZL_PARTICLES_SSE
+	const __m128 scaleLanes = _mm_set1_ps(scale);
+	for (size_t i = 0; i < blocks * ParticleStore::kLaneCount; i += ParticleStore::kLaneCount) {
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), scaleLanes)));
+	}
+#else
+	for (size_t i = 0; i < blocks * ParticleStore::kLaneCount; ++i) {
+		dst[i] += src[i] * scale;
+	}
+#endif
+}
+
+// dst[i] += value over whole lane blocks
+static void addScalar(float* dst, float value, size_t blocks)
+{
+#ifdef QZL_PARTICLES_SSE
+	const __m128 valueLanes = _mm_set1_ps(value);
+	for (size_t i = 0; i < blocks * ParticleStore::kLaneCount; i += ParticleStore::kLaneCount) {
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), valueLanes));
+	}
+#else
+	for (size_t i = 0; i < blocks * ParticleStore::kLaneCount; ++i) {
+		dst[i] += value;
+	}
+#endif
+}
+
+ParticleStore::ParticleStore(size_t capacity)
+	: size_(0), capacity_(capacity), pool_(nullptr), poolOffset_(0)
+{
+	const size_t padded = (capacity + kLaneCount - 1) / kLaneCount * kLaneCount;
+	ownedStorage_.resize(padded * streams_.size(), 0.0f);
+	for (size_t i = 0; i < streams_.size(); ++i) {
+		streams_[i] = ownedStorage_.data() + padded * i;
+	}
+}
+
+ParticleStore::ParticleStore(ParticlePool* pool, size_t capacity)
+	: size_(0), capacity_(capacity), pool_(pool), poolOffset_(ParticlePool::kInvalidOffset)
+{
+	ASSERT(pool_ != nullptr);
+	streams_.fill(nullptr);
+	poolOffset_ = pool_->allocate(capacity_);
+	if (poolOffset_ == ParticlePool::kInvalidOffset) {
+		DEBUG_LOG("Particle pool has no room for " << capacity_ << " particles");
+		capacity_ = 0;
+		return;
+	}
+	for (size_t i = 0; i < streams_.size(); ++i) {
+		streams_[i] = pool_->getStream(ParticleStream(i)) + poolOffset_;
+	}
+}
+
+ParticleStore::~ParticleStore()
+{
+	if (pool_ != nullptr && poolOffset_ != ParticlePool::kInvalidOffset) {
+		pool_->free(poolOffset_, capacity_);
+	}
+}
+
+size_t ParticleStore::spawn(size_t count)
+{
+	const size_t first = size_;
+	size_ = std::min(size_ + count, capacity_);
+	return first;
+}
+
+void ParticleStore::setParticle(size_t idx, const glm::vec3& position, const glm::vec3& velocity, float lifetime, float scale, const glm::vec2& textureOffset)
+{
+	EXPECTS(idx < size_);
+	const float values[size_t(ParticleStream::kCount)] = { position.x, position.y, position.z, velocity.x, velocity.y, velocity.z, lifetime, scale,
+		textureOffset.x, textureOffset.y };
+	for (size_t i = 0; i < streams_.size(); ++i) {
+		streams_[i][idx] = values[i];
+	}
+}
+
+void ParticleStore::integrate(float dt)
+{
+	for (size_t axis = 0; axis < 3; ++axis) {
+		multiplyAdd(get(ParticleStream(size_t(ParticleStream::kPositionX) + axis)), get(ParticleStream(size_t(ParticleStream::kVelocityX) + axis)),
+			dt, laneBlocks());
+	}
+}
+
+void ParticleStore::accelerate(const glm::vec3& acceleration, float dt)
+{
+	for (size_t axis = 0; axis < 3; ++axis) {
+		if (acceleration[int(axis)] != 0.0f) {
+			addScalar(get(ParticleStream(size_t(ParticleStream::kVelocityX) + axis)), acceleration[int(axis)] * dt, laneBlocks());
+		}
+	}
+}
+
+void ParticleStore::age(float dt)
+{
+	addScalar(get(ParticleStream::kLifetime), -dt, laneBlocks());
+}
+
+size_t ParticleStore::killExpired()
+{
+	const size_t initialSize = size_;
+	float* lifetimes = get(ParticleStream::kLifetime);
+	// Blocks are tested whole first, so the common case of nothing expiring in a block costs one compare
+	size_t block = 0;
+	while (block * kLaneCount < size_) {
+		const size_t first = block * kLaneCount;
+#ifdef QZL_PARTICLES_SSE
+		if (first + kLaneCount <= size_ && _mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(lifetimes + first), _mm_setzero_ps())) == 0) {
+			++block;
+			continue;
+		}
+#endif
+		// The particle swapped in to a gap has to be tested too, so the block is only passed once all of it is live
+		bool blockLive = true;
+		for (size_t i = first; i < std::min(first + kLaneCount, size_); ++i) {
+			if (lifetimes[i] <= 0.0f) {
+				move(size_ - 1, i);
+				--size_;
+				blockLive = false;
+				break;
+			}
+		}
+		if (blockLive) {
+			++block;
+		}
+	}
+	return initialSize - size_;
+}
+
+void ParticleStore::computeDistanceKeys(const glm::vec3& point, float* keys) const
+{
+	const float* x = get(ParticleStream::kPositionX);
+	const float* y = get(ParticleStream::kPositionY);
+	const float* z = get(ParticleStream::kPositionZ);
+#ifdef QZL_PARTICLES_SSE
+	const __m128 px = _mm_set1_ps(point.x);
+	const __m128 py = _mm_set1_ps(point.y);
+	const __m128 pz = _mm_set1_ps(point.z);
+	size_t i = 0;
+	for (; i + kLaneCount <= size_; i += kLaneCount) {
+		const __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), px);
+		const __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), py);
+		const __m128 dz = _mm_sub_ps(_mm_loadu_ps(z + i), pz);
+		_mm_storeu_ps(keys + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+	}
+	// The key array need not be padded, so the tail is done a lane at a time
+	for (; i < size_; ++i) {
+#else
+	for (size_t i = 0; i < size_; ++i) {
+#endif
+		const glm::vec3 offset = glm::vec3(x[i], y[i], z[i]) - point;
+		keys[i] = glm::dot(offset, offset);
+	}
+}
+
+void ParticleStore::sortBackToFront(const glm::vec3& point, std::vector<uint32_t>& order)
+{
+	order.resize(size_);
+	std::iota(order.begin(), order.end(), 0u);
+	distances_.resize(size_);
+	computeDistanceKeys(point, distances_.data());
+	if (size_ < kRadixMinCount) {
+		std::sort(order.begin(), order.end(), [this](uint32_t lhs, uint32_t rhs) {
+			return distances_[lhs] > distances_[rhs];
+		});
+		return;
+	}
+
+	// Squared distances are never negative, so their bits order as unsigned integers do, and inverting them puts the farthest first
+	constexpr uint32_t kBucketCount = 1u << kRadixBits;
+	constexpr uint32_t kDigitMask = kBucketCount - 1;
+	sortKeys_.resize(size_);
+	keyScratch_.resize(size_);
+	orderScratch_.resize(size_);
+	std::vector<std::array<uint32_t, kBucketCount>> histograms(kRadixPasses);
+	for (size_t i = 0; i < size_; ++i) {
+		uint32_t bits;
+		memcpy(&bits, &distances_[i], sizeof(bits));
+		sortKeys_[i] = ~bits;
+		for (uint32_t pass = 0; pass < kRadixPasses; ++pass) {
+			++histograms[pass][(sortKeys_[i] >> (pass * kRadixBits)) & kDigitMask];
+		}
+	}
+
+	for (uint32_t pass = 0; pass < kRadixPasses; ++pass) {
+		const uint32_t shift = pass * kRadixBits;
+		auto& offsets = histograms[pass];
+		// Every key sharing this digit leaves the order as it is
+		if (offsets[(sortKeys_[0] >> shift) & kDigitMask] == size_) {
+			continue;
+		}
+		uint32_t total = 0;
+		for (auto& offset : offsets) {
+			const uint32_t count = offset;
+			offset = total;
+			total += count;
+		}
+		for (size_t i = 0; i < size_; ++i) {
+			const uint32_t dst = offsets[(sortKeys_[i] >> shift) & kDigitMask]++;
+			keyScratch_[dst] = sortKeys_[i];
+			orderScratch_[dst] = order[i];
+		}
+		sortKeys_.swap(keyScratch_);
+		order.swap(orderScratch_);
+	}
+}
+
+void ParticleStore::writeVertices(Graphics::ParticleVertex* vertices, const uint32_t* order) const
+{
+	const float* x = get(ParticleStream::kPositionX);
+	const float* y = get(ParticleStream::kPositionY);
+	const float* z = get(ParticleStream::kPositionZ);
+	const float* vx = get(ParticleStream::kVelocityX);
+	const float* vy = get(ParticleStream::kVelocityY);
+	const float* vz = get(ParticleStream::kVelocityZ);
+	const float* scale = get(ParticleStream::kScale);
+	const float* u = get(ParticleStream::kTextureU);
+	const float* v = get(ParticleStream::kTextureV);
+	for (size_t i = 0; i < size_; ++i) {
+		const size_t src = order != nullptr ? order[i] : i;
+		vertices[i].position = glm::vec3(x[src], y[src], z[src]);
+		vertices[i].scale = scale[src];
+		vertices[i].velocity = glm::vec3(vx[src], vy[src], vz[src]);
+		vertices[i].textureOffset = glm::vec2(u[src], v[src]);
+	}
+}
+
+void ParticleStore::move(size_t from, size_t to)
+{
+	for (auto& stream : streams_) {
+		stream[to] = stream[from];
+	}
+}
@@ -0,0 +1,102 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Purpose: Structure of arrays storage for cpu simulated particles and the batch kernels that advance them.
+#pragma once
+#include "../Graphics/VkUtil.h"
+#include "../Graphics/Vertex.h"
+
+namespace QZL {
+	namespace Game {
+		class ParticlePool;
+
+		enum class ParticleStream : size_t {
+			kPositionX = 0,
+			kPositionY,
+			kPositionZ,
+			kVelocityX,
+			kVelocityY,
+			kVelocityZ,
+			kLifetime,
+			kScale,
+			kTextureU,
+			kTextureV,
+			kCount
+		};
+
+		/*
+			Live particles are packed at the front of every stream, so kernels run straight down the arrays four at a time with SSE, or a
+			lane at a time where it is unavailable. Streams are padded to a multiple of the lane count and kernels may write the padding.
+			Killing swaps the last live particle in to the gap, so order is not kept, draw order comes from sorting in writeVertices.
+			Streams are either owned by the store or a range of a ParticlePool's streams shared by every system, which is returned on
+			destruction. A store the pool could not fit has no capacity.
+		*/
+		class ParticleStore {
+		public:
+			explicit ParticleStore(size_t capacity);
+			ParticleStore(ParticlePool* pool, size_t capacity);
+			~ParticleStore();
+			ParticleStore(const ParticleStore&) = delete;
+			ParticleStore& operator=(const ParticleStore&) = delete;
+
+			size_t size() const {
+				return size_;
+			}
+			size_t capacity() const {
+				return capacity_;
+			}
+			float* get(ParticleStream stream) {
+				return streams_[size_t(stream)];
+			}
+			const float* get(ParticleStream stream) const {
+				return streams_[size_t(stream)];
+			}
+
+			// Make room for up to count more particles at the back, returning the index of the first. Fewer are added if full.
+			size_t spawn(size_t count);
+			void setParticle(size_t idx, const glm::vec3& position, const glm::vec3& velocity, float lifetime, float scale,
+				const glm::vec2& textureOffset = glm::vec2(0.0f));
+			void clear() {
+				size_ = 0;
+			}
+
+			// position += velocity * dt
+			void integrate(float dt);
+			// velocity += acceleration * dt
+			void accelerate(const glm::vec3& acceleration, float dt);
+			// lifetime -= dt
+			void age(float dt);
+			// Remove every particle whose lifetime has run out, returning how many were
+			size_t killExpired();
+			// Squared distance of every live particle from the point, enough to order them by distance
+			void computeDistanceKeys(const glm::vec3& point, float* keys) const;
+			// Fill order with the live particles' indices farthest from the point first, as blending needs them drawn
+			void sortBackToFront(const glm::vec3& point, std::vector<uint32_t>& order);
+			// Write the live particles in the given order, or storage order without one. Only the live particles are drawn.
+			void writeVertices(Graphics::ParticleVertex* vertices, const uint32_t* order = nullptr) const;
+
+			static constexpr size_t kLaneCount = 4;
+			static constexpr uint32_t kRadixBits = 11;
+			static constexpr uint32_t kRadixPasses = (32 + kRadixBits - 1) / kRadixBits;
+			// Below this a comparison sort beats clearing and walking the histograms
+			static constexpr size_t kRadixMinCount = 256;
+		private:
+			size_t laneBlocks() const {
+				return (size_ + kLaneCount - 1) / kLaneCount;
+			}
+			void move(size_t from, size_t to);
+
+			std::array<float*, size_t(ParticleStream::kCount)> streams_;
+			size_t size_;
+			size_t capacity_;
+			// Backs the streams when there is no pool
+			std::vector<float> ownedStorage_;
+			ParticlePool* pool_;
+			size_t poolOffset_;
+			// Scratch for sorting, kept to avoid allocating every update
+			std::vector<float> distances_;
+			std::vector<uint32_t> sortKeys_;
+			std::vector<uint32_t> keyScratch_;
+			std::vector<uint32_t> orderScratch_;
+		};
+	}
+}
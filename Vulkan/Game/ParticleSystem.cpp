@@ -2,94 +2,164 @@
 #include "../Graphics/RenderObject.h"
 #include "../System.h"
 #include "../Graphics/TextureManager.h"
+#include "../Assets/Entity.h"
+#include "GameMaster.h"
+#include "Scene.h"
 
 using namespace QZL;
 using namespace QZL::Game;
 
+bool ParticleSystem::gpuSimulationEnabled_ = true;
+bool ParticleSystem::sortingEnabled_ = false;
+
 void ParticleSystem::update(float dt, const glm::mat4& viewProjection, const glm::mat4& parentMatrix)
 {
+	// The pool may slow the system down, but never speeds it past its own interval
+	const ParticleEmitterBudget& budget = pool_->getEmitterBudget(poolEmitter_);
+	const float interval = std::max(updateInterval_, budget.minUpdateInterval);
 	elapsedUpdateTime_ += dt;
-	if (elapsedUpdateTime_ >= updateInterval_) {
+	if (isGpuSimulated()) {
+		if (elapsedUpdateTime_ >= interval) {
+			updateGpu(elapsedUpdateTime_, budget.spawnScale);
+			elapsedUpdateTime_ = 0.0f;
+		}
+	}
+	else if (elapsedUpdateTime_ >= interval) {
 		if (!alwaysAliveAndUnordered_) {
-			// Update or free every particle that is currently active
-			size_t i = 0;
-			while (i < currentActiveSize_) {
-				Particle& particle = particles_[i];
-				particle.lifetime -= elapsedUpdateTime_;
-				if (particles_[i].lifetime <= 0.0f) {
-					// i does not increment because the new particle at index i needs to be checked like any other,
-					// but currentActiveSize_ does decrement, so infinite loop should not be possible.
-					freeParticle(i);
-				}
-				else {
-					// Update velocity/lifetime and move position by velocity
-					Graphics::ParticleVertex& vertex = vertices_[i];
-					updateParticle(particle, vertex, elapsedUpdateTime_);
-					vertex.position = vertex.position + (particle.velocity * elapsedUpdateTime_);
-					++i;
-				}
-			}
+			// Age every particle that is currently active and free those that have expired
+			store_.age(elapsedUpdateTime_);
+			store_.killExpired();
+
+			// Update velocity by the system's behaviour and move position by velocity
+			updateParticles(elapsedUpdateTime_);
+			store_.integrate(elapsedUpdateTime_);
 
 			// Create any new particles, this is defined by derived classes
-			particleCreation(elapsedUpdateTime_, numDeadParticles_);
-
-			// Sort the particles to draw closest to the camera using insertion sort
-			for (size_t i = 1; i < currentActiveSize_; ++i) {
-				long long int j = i - 1;
-				auto iVertVal = vertices_[i];
-				auto iPartVal = particles_[i];
-				float iKey = glm::distance(vertices_[i].position, *billboardPoint_);
-				float jKey = glm::distance(vertices_[j].position, *billboardPoint_);
-				while (j >= 0 && jKey > iKey) {
-					vertices_[j + 1] = vertices_[j];
-					particles_[j + 1] = particles_[j];
-					--j;
-				}
-				vertices_[j + 1] = iVertVal;
-				particles_[j + 1] = iPartVal;
+			particleCreation(elapsedUpdateTime_, grantSpawn(budget.spawnScale));
+
+			// Sort the particles to draw farthest from the camera first, unless the system is only ordered against other systems
+			if (emitterSettings_.sortMode == Graphics::ParticleSortMode::kPerParticle) {
+				store_.sortBackToFront(*billboardPoint_, sortOrder_);
+			}
+			else {
+				sortOrder_.clear();
 			}
 		}
 		else {
-			for (size_t i = 0; i < currentActiveSize_; ++i) {
-				Graphics::ParticleVertex& vertex = vertices_[i];
-				updateParticle(particles_[i], vertex, dt);
-				vertex.position = particles_[i].velocity * elapsedUpdateTime_;
-			}
+			updateParticles(elapsedUpdateTime_);
+			store_.integrate(elapsedUpdateTime_);
+			sortOrder_.clear();
 		}
 		updateBuffer();
 		elapsedUpdateTime_ = 0.0f;
 	}
+	reportToPool(parentMatrix);
 }
 
 Graphics::BasicMesh* ParticleSystem::makeMesh()
 {
-	Graphics::BasicMesh* mesh = new Graphics::BasicMesh();
-	mesh->count = static_cast<uint32_t>(subBufferRange_.count);
-	mesh->vertexOffset = static_cast<uint32_t>(subBufferRange_.first / sizeof(Graphics::ParticleVertex));
-	mesh->indexOffset = 0;
-	return mesh;
+	mesh_ = new Graphics::BasicMesh();
+	// The sub buffer range is already in particles, gpu simulated systems draw their emitter instead
+	mesh_->count = static_cast<uint32_t>(store_.size());
+	mesh_->vertexOffset = static_cast<int32_t>(subBufferRange_.first);
+	mesh_->indexOffset = 0;
+	return mesh_;
 }
 
 ParticleSystem::ParticleSystem(const SystemMasters& initialiser, glm::vec3* billboardPoint,
 	size_t maxParticles, float updateInterval, float textureTileLength, const std::string materialName)
 	: GameScript(initialiser), updateInterval_(updateInterval), billboardPoint_(billboardPoint), elapsedUpdateTime_(0.0f), alwaysAliveAndUnordered_(false),
-	numDeadParticles_(maxParticles), currentActiveSize_(0), tint_(0.0f), materialName_(materialName), textureTileLength_(textureTileLength)
+	pool_(initialiser.gameMaster->getActiveScene()->getParticlePool()), store_(pool_, maxParticles), tint_(0.0f), materialName_(materialName), textureTileLength_(textureTileLength),
+	billboardMode_(Graphics::ParticleBillboardMode::kCameraFacing), billboardAxis_(0.0f, 1.0f, 0.0f), velocityStretch_(0.0f), buffer_(nullptr), mesh_(nullptr),
+	subBufferRange_({ 0, 0 }), supportsGpuSimulation_(false), priority_(ParticlePriority::kMedium), boundsCentre_(0.0f), boundsRadius_(0.0f),
+	fullRateDistance_(50.0f), gpuEmitter_(Graphics::ParticleSimulator::kInvalidEmitter), spawnAccumulator_(0.0f)
 {
 	ASSERT(billboardPoint_ != nullptr);
-	particles_.resize(maxParticles);
-	vertices_.resize(maxParticles);
+	poolEmitter_ = pool_->addEmitter();
+	sortOrder_.reserve(maxParticles);
 
 	material_ = sysMasters_->textureManager->requestMaterial(Graphics::RendererTypes::kParticle, materialName_);
 }
 
 ParticleSystem::~ParticleSystem()
 {
+	if (isGpuSimulated()) {
+		sysMasters_->graphicsMaster->getParticleSimulator()->destroyEmitter(gpuEmitter_);
+	}
+	pool_->removeEmitter(poolEmitter_);
+}
+
+bool ParticleSystem::initialiseStorage()
+{
+	Graphics::ParticleSimulator* simulator = sysMasters_->graphicsMaster->getParticleSimulator();
+	// Whatever order the system asked for, the composite does not need one
+	if (!sortingEnabled_) {
+		emitterSettings_.sortMode = Graphics::ParticleSortMode::kNone;
+	}
+	if (supportsGpuSimulation_ && gpuSimulationEnabled_ && simulator != nullptr) {
+		gpuEmitter_ = simulator->createEmitter(emitterSettings_);
+		if (isGpuSimulated()) {
+			return true;
+		}
+		DEBUG_LOG("Particle system " << materialName_ << " falls back to the cpu");
+	}
+	fetchDynamicBuffer();
+	return false;
+}
+
+void ParticleSystem::updateGpu(float dt, float spawnScale)
+{
+	spawnAccumulator_ += emitterSettings_.spawnRate * spawnScale * dt;
+	const uint32_t emitCount = static_cast<uint32_t>(std::min(spawnAccumulator_, float(emitterSettings_.maxParticles)));
+	spawnAccumulator_ = std::min(spawnAccumulator_ - float(emitCount), 1.0f);
+	pool_->recordSpawn(static_cast<uint32_t>(emitterSettings_.spawnRate * dt), emitCount);
+	// The viewer in model space, which is where the simulator keeps the particles
+	glm::vec3 viewPosition = glm::vec3(0.0f);
+	if (emitterSettings_.sortMode == Graphics::ParticleSortMode::kPerParticle) {
+		viewPosition = glm::vec3(glm::inverse(owningEntity_->getModelMatrix()) * glm::vec4(*billboardPoint_, 1.0f));
+	}
+	sysMasters_->graphicsMaster->getParticleSimulator()->updateEmitter(gpuEmitter_, getSpawnOrigin(), viewPosition, dt, emitCount);
+}
+
+size_t ParticleSystem::grantSpawn(float spawnScale)
+{
+	// The budget limits how many may be alive rather than how many spawn, so a throttled system settles at its share as particles expire
+	const size_t allowed = static_cast<size_t>(float(store_.capacity()) * spawnScale);
+	const size_t requested = store_.capacity() - store_.size();
+	const size_t granted = allowed > store_.size() ? std::min(requested, allowed - store_.size()) : 0;
+	pool_->recordSpawn(static_cast<uint32_t>(requested), static_cast<uint32_t>(granted));
+	return granted;
+}
+
+void ParticleSystem::reportToPool(const glm::mat4& parentMatrix)
+{
+	ParticleEmitterState state;
+	state.priority = priority_;
+	state.fullRateDistance = fullRateDistance_;
+	if (boundsRadius_ > 0.0f) {
+		// The entity's model matrix is only set after update, so it is made from the parent's here
+		const glm::mat4 model = parentMatrix * transform()->toModelMatrix();
+		const float scale = glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+		state.boundsCentre = glm::vec3(model * glm::vec4(boundsCentre_, 1.0f));
+		state.boundsRadius = boundsRadius_ * scale;
+	}
+	if (isGpuSimulated()) {
+		// Counts never come back from the gpu, so the emitter is assumed settled at its budgeted rate
+		const float lifetime = emitterSettings_.lifetime + emitterSettings_.lifetimeVariance;
+		state.demand = std::min(emitterSettings_.maxParticles, static_cast<uint32_t>(emitterSettings_.spawnRate * lifetime));
+		state.liveCount = static_cast<uint32_t>(float(state.demand) * pool_->getEmitterBudget(poolEmitter_).spawnScale);
+	}
+	else {
+		state.demand = static_cast<uint32_t>(store_.capacity());
+		state.liveCount = static_cast<uint32_t>(store_.size());
+	}
+	pool_->reportEmitter(poolEmitter_, state);
 }
 
 void ParticleSystem::fetchDynamicBuffer()
 {
 	buffer_ = sysMasters_->graphicsMaster->getDynamicBuffer(Graphics::RendererTypes::kParticle);
-	subBufferRange_ = buffer_->allocateSubBufferRange(particles_.size());
+	subBufferRange_ = buffer_->allocateSubBufferRange(store_.capacity());
 }
 
 void ParticleSystem::nextTextureTile(glm::vec2& tileOffset)
@@ -108,25 +178,10 @@ void ParticleSystem::nextTextureTile(glm::vec2& tileOffset)
 
 void ParticleSystem::updateBuffer()
 {
-	void* v = buffer_->getSubBufferData(subBufferRange_.first);
-	memcpy(v, vertices_.data(), vertices_.size() * sizeof(Graphics::ParticleVertex));
-}
-
-Particle* ParticleSystem::allocateParticle()
-{
-	Particle* p = nullptr;
-	if (numDeadParticles_ > 0) {
-		p = &particles_[currentActiveSize_];
-		--numDeadParticles_;
-		updateActiveSize();
+	// Gathered straight in to the mapped buffer in draw order
+	auto vertices = static_cast<Graphics::ParticleVertex*>(buffer_->getSubBufferData(subBufferRange_.first));
+	store_.writeVertices(vertices, sortOrder_.empty() ? nullptr : sortOrder_.data());
+	if (mesh_ != nullptr) {
+		mesh_->count = static_cast<uint32_t>(store_.size());
 	}
-	return p;
-}
-
-void ParticleSystem::freeParticle(size_t idx)
-{
-	particles_[idx].swapAndReset(particles_[currentActiveSize_ - 1]);
-	std::swap(vertices_[idx], vertices_[currentActiveSize_ - 1]);
-	++numDeadParticles_;
-	updateActiveSize();
 }
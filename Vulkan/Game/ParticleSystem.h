@@ -4,6 +4,9 @@
 #include "../Graphics/Material.h"
 #include "../Graphics/ShaderParams.h"
 #include "../Graphics/ElementBufferObject.h"
+#include "../Graphics/ParticleSimulator.h"
+#include "ParticleStore.h"
+#include "ParticlePool.h"
 
 namespace QZL {
 	namespace Graphics {
@@ -12,29 +15,16 @@ namespace QZL {
 		struct BasicMesh;
 	}
 	namespace Game {
-		// Particles are a special kind of entity made only of points, and expanded to billboarded textured quads in a shader.
+		// Particles are a special kind of entity made only of points, and expanded to billboarded textured quads in the vertex shader.
 		// Individual particles are grouped in to a ParticleSystem which defines some behaviour and tracks all of its particles lifetime.
 		// To avoid having a model matrix for every individual particle, the system will have only one, and the particles' positions (points)
 		// will be defined relative to that point. Each individual particle positions is just a vertex of the particle system, in a dynamic element buffer.
-
-		// A 'Particle' only needs to know its index inside the system's vertex range, how long its been alive for, and its velocity.
-		struct Particle {
-			glm::vec3 velocity;
-			float lifetime;
-
-			Particle() {
-				reset();
-			}
-			void reset() {
-				velocity = glm::vec3(0.0f);
-				lifetime = 0.0f;
-			}
-			void swapAndReset(Particle& other) {
-				lifetime = other.lifetime;
-				velocity = other.velocity;
-				other.reset();
-			}
-		};
+		// On the cpu particles are held as structure of arrays and advanced in batches, so derived systems describe their behaviour as
+		// a pass over the whole store rather than per particle.
+		// Systems whose behaviour is fully described by their emitter settings can instead be simulated on the gpu, where the particles
+		// never come back to the cpu and far more of them are affordable.
+		// Either way the system is an emitter of the scene's particle pool, which scales its spawning and update rate to keep every
+		// system within one budget, and culls it when no camera can see it.
 
 		class ParticleSystem : public GameScript {
 		public:
@@ -44,42 +34,73 @@ namespace QZL {
 			// Update can be overriden by a derived class when needed, however this provides the basic particle system logic
 			virtual void update(float dt, const glm::mat4& viewProjection, const glm::mat4& parentMatrix) override;
 			Graphics::ParticleShaderParams* makeShaderParams() {
-				return new Graphics::ParticleShaderParams(textureTileLength_, tint_);
+				return new Graphics::ParticleShaderParams(textureTileLength_, tint_, billboardMode_, billboardAxis_, velocityStretch_);
 			}
 			Graphics::BasicMesh* makeMesh();
 			Graphics::Material* getMaterial() {
 				return material_;
 			}
+			bool isGpuSimulated() const {
+				return gpuEmitter_ != Graphics::ParticleSimulator::kInvalidEmitter;
+			}
+			// The simulator's emitter drawn in place of the mesh, kInvalidEmitter for systems on the cpu
+			uint32_t getGpuEmitter() const {
+				return gpuEmitter_;
+			}
+			// Out of every camera's view this frame, so not drawn
+			bool isCulled() const {
+				return pool_->getEmitterBudget(poolEmitter_).culled;
+			}
+			// Systems started while this is off keep to the cpu path, which tests use to check their behaviour on the cpu
+			static void setGpuSimulationEnabled(bool enabled) {
+				gpuSimulationEnabled_ = enabled;
+			}
+			// Particles are composited order independently so their draw order no longer matters, systems started while this is on
+			// still sort their particles, and the scene its systems, which is only useful to compare the cost of sorting
+			static void setSortingEnabled(bool enabled) {
+				sortingEnabled_ = enabled;
+			}
+			static bool isSortingEnabled() {
+				return sortingEnabled_;
+			}
 		protected:
 			// Number of tiles on xy is identical for x and y, as textures must be square.
 			ParticleSystem(const SystemMasters& initialiser, glm::vec3* billboardPoint,
 				size_t maxParticles, float updateInterval, float textureTileLength, const std::string materialName);
 			virtual ~ParticleSystem();
+			// Register with the gpu simulator if the system supports it and it is enabled, otherwise fetch the dynamic buffer the cpu path
+			// writes. Returns true for the gpu, in which case particleCreation and updateParticles are never called.
+			bool initialiseStorage();
 			void fetchDynamicBuffer();
+			// Centre of this frame's gpu spawning in model space
+			virtual glm::vec3 getSpawnOrigin() {
+				return glm::vec3(0.0f);
+			}
 
-			virtual void particleCreation(float dt, size_t expiredCount) = 0;
-			virtual void updateParticle(Particle& particle, Graphics::ParticleVertex& vertex, float dt) = 0;
+			// Spawn up to freeCount particles in to store_, which is already limited by the pool's budget
+			virtual void particleCreation(float dt, size_t freeCount) = 0;
+			// Apply the system's behaviour to every live particle, before they are moved by their velocity
+			virtual void updateParticles(float dt) {}
 
 			// Tiles in the texture must be arranged left to right, top to bottom.
 			void nextTextureTile(glm::vec2& currentOffset);
 
 			void updateBuffer();
+			// Tell the pool how many particles the system has and wants, and where it is, for it to budget the next frame
+			void reportToPool(const glm::mat4& parentMatrix);
 			
 			// When true, system update is skipped, instead just updating each particle. This optimises when
 			// particles have infinite lifetime and do not overlap. This is false by default.
 			bool alwaysAliveAndUnordered_;
-			Particle* allocateParticle();
 
 			Graphics::Material* material_;
 			float textureTileLength_;
 			glm::vec4 tint_;
-			size_t currentActiveSize_;
-			
-			// Allocate particle returns nullptr if there is no available particle
-			void freeParticle(size_t idx);
-			void updateActiveSize() {
-				currentActiveSize_ = particles_.size() - numDeadParticles_;
-			}
+			// How the quads are turned towards the viewer, see ParticleBillboardMode. Camera facing by default.
+			Graphics::ParticleBillboardMode billboardMode_;
+			glm::vec3 billboardAxis_;
+			// Seconds of travel a velocity stretched quad spans
+			float velocityStretch_;
 
 			// The particles are not necessarily updated every frame, but after a specified time interval in seconds. An interval of 0 will
 			// cause it to update once per frame.
@@ -88,11 +109,36 @@ namespace QZL {
 			glm::vec3* billboardPoint_;
 			Graphics::SubBufferRange subBufferRange_;
 			Graphics::ElementBufferObject* buffer_;
+			// Owned by the graphics component, its count follows the live particles
+			Graphics::BasicMesh* mesh_;
 
 			std::string materialName_;
-			size_t numDeadParticles_;
-			std::vector<Particle> particles_;
-			std::vector<Graphics::ParticleVertex> vertices_;
+			ParticlePool* pool_;
+			ParticleStore store_;
+			// Draw order of the particles in store_, empty to draw them as stored
+			std::vector<uint32_t> sortOrder_;
+
+			// Set by systems that can be simulated on the gpu, whose capacity there need not match the cpu's
+			bool supportsGpuSimulation_;
+			Graphics::ParticleEmitterSettings emitterSettings_;
+
+			// Budgeting in the pool, medium priority and unbounded by default
+			ParticlePriority priority_;
+			// Model space bounding sphere of the particles, a radius of 0 is never culled
+			glm::vec3 boundsCentre_;
+			float boundsRadius_;
+			float fullRateDistance_;
+		private:
+			void updateGpu(float dt, float spawnScale);
+			// Free particles the budget lets the cpu store spawn in to
+			size_t grantSpawn(float spawnScale);
+
+			uint32_t gpuEmitter_;
+			uint32_t poolEmitter_;
+			// Fractions of a particle carried between frames so low spawn rates still spawn
+			float spawnAccumulator_;
+			static bool gpuSimulationEnabled_;
+			static bool sortingEnabled_;
 		};
 	}
 }
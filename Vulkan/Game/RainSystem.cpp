@@ -1,4 +1,5 @@
 #include "RainSystem.h"
+#include "../Assets/Entity.h"
 
 using namespace QZL;
 using namespace QZL::Game;
@@ -6,29 +7,43 @@ using namespace QZL::Game;
 RainSystem::RainSystem(const SystemMasters& initialiser)
 	: ParticleSystem(initialiser, &initialiser.graphicsMaster->getCamera(0)->position, 20, 0.0f, (1.0f / 3.0f), "rain")
 {
+	// The cpu path keeps its original 20 drops, on the gpu the same drops fill a volume around the viewer
+	supportsGpuSimulation_ = true;
+	emitterSettings_.maxParticles = kGpuMaxParticles;
+	emitterSettings_.lifetime = 1.0f;
+	emitterSettings_.lifetimeVariance = 0.2f;
+	emitterSettings_.spawnRate = float(kGpuMaxParticles) / emitterSettings_.lifetime;
+	emitterSettings_.spawnOffset = glm::vec3(0.0f, 5.0f, 0.0f);
+	emitterSettings_.spawnExtent = glm::vec3(kGpuSpawnRadius, 5.0f, kGpuSpawnRadius);
+	emitterSettings_.velocity = glm::vec3(0.0f, -5.0f, 0.0f);
+	emitterSettings_.velocityVariance = glm::vec3(0.2f, 1.0f, 0.2f);
+	emitterSettings_.scale = 2.0f;
+	// Drops streak along their fall
+	billboardMode_ = Graphics::ParticleBillboardMode::kVelocityStretched;
+	velocityStretch_ = 0.1f;
+	// Ambient and always around the viewer, so never culled but the first to thin out when effects need the budget
+	priority_ = ParticlePriority::kLow;
 }
 
 void RainSystem::start()
 {
-	fetchDynamicBuffer();
-	particleCreation(0, 20);
 	transform()->position = *billboardPoint_;
 	transform()->scale = glm::vec3(1.0f);
+	if (!initialiseStorage()) {
+		particleCreation(0, 20);
+	}
 }
 
-void RainSystem::particleCreation(float dt, size_t expiredCount)
+glm::vec3 RainSystem::getSpawnOrigin()
 {
-	for (size_t i = 0; i < expiredCount; ++i) {
-		// Can just assume not nullptr since its within expired count
-		auto p = allocateParticle();
-		p->lifetime = 1.0f;
-		p->velocity = glm::vec3(0.0f, -5.0f, 0.0f);// *((rand() % 100) / 100.0f);
-		vertices_[currentActiveSize_ - 1].position = *billboardPoint_ + glm::vec3(10.0f) * ((rand() % 100) / 100.0f);
-		vertices_[currentActiveSize_ - 1].scale = 2.0f;
-		vertices_[currentActiveSize_ - 1].textureOffset = glm::vec2(0.0, 0.0);
-	}
+	// Keep falling around the viewer as they move
+	return glm::vec3(glm::inverse(owningEntity_->getModelMatrix()) * glm::vec4(*billboardPoint_, 1.0f));
 }
 
-void RainSystem::updateParticle(Particle& particle, Graphics::ParticleVertex& vertex, float dt)
+void RainSystem::particleCreation(float dt, size_t freeCount)
 {
+	const size_t first = store_.spawn(freeCount);
+	for (size_t i = first; i < store_.size(); ++i) {
+		store_.setParticle(i, *billboardPoint_ + glm::vec3(10.0f) * ((rand() % 100) / 100.0f), glm::vec3(0.0f, -5.0f, 0.0f), 1.0f, 2.0f);
+	}
 }
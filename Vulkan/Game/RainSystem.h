@@ -9,8 +9,11 @@ namespace QZL {
 			RainSystem(const SystemMasters& initialiser);
 			void start() override;
 		protected:
-			void particleCreation(float dt, size_t expiredCount) override;
-			void updateParticle(Particle& particle, Graphics::ParticleVertex& vertex, float dt) override;
+			void particleCreation(float dt, size_t freeCount) override;
+			glm::vec3 getSpawnOrigin() override;
+		private:
+			static constexpr uint32_t kGpuMaxParticles = 256 * 1024;
+			static constexpr float kGpuSpawnRadius = 60.0f;
 		};
 	}
 }
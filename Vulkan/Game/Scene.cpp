@@ -4,13 +4,20 @@
 #include "../SystemMasters.h"
 #include "../Graphics/GraphicsMaster.h"
 #include "ParticleSystem.h"
+#include "ParticlePool.h"
 #include "../Graphics/StorageBuffer.h"
 #include "../Graphics/Descriptor.h"
 #include "../Graphics/Mesh.h"
 #include "../Graphics/LogicalCamera.h"
 #include "../Graphics/MeshLoader.h"
 #include "../Assets/LightSource.h"
+#include "../Assets/Terrain.h"
+#include "../Graphics/TerrainQuadtree.h"
 #include "../Graphics/GlobalRenderData.h"
+#include "../Graphics/TextureManager.h"
+#include "../Graphics/TextureStreamer.h"
+#include "../Graphics/Material.h"
+#include "../JobSystem.h"
 
 using namespace QZL;
 using namespace Graphics;
@@ -21,11 +28,15 @@ Scene::Scene(const SystemMasters* masters)
 	rootNode_ = new SceneHeirarchyNode();
 	rootNode_->parentNode = nullptr;
 	rootNode_->entity = nullptr;
+	std::fill(std::begin(lodBias_), std::end(lodBias_), 1.0f);
+	particlePool_ = new Game::ParticlePool(kParticlePoolCapacity, kParticleBudget);
 }
 
 Scene::~Scene()
 {
 	deleteHeirarchyRecursively(rootNode_);
+	// The particle systems return their storage to the pool as they are deleted
+	SAFE_DELETE(particlePool_);
 	SAFE_DELETE(graphicsInfo_.mvpBuffer);
 	SAFE_DELETE(graphicsInfo_.paramsBuffer);
 	SAFE_DELETE(graphicsInfo_.materialBuffer);
@@ -33,10 +44,10 @@ Scene::~Scene()
 
 struct SortKey {
 	float key;
-	VkDrawIndexedIndirectCommand cmd;
+	IndexedDrawCommand cmd;
 };
 
-void Scene::sort(RendererTypes rtype)
+void Scene::sort(RendererTypes rtype, bool farthestFirst)
 {
 	auto& distances = graphicsWriteInfo_.distances[(size_t)rtype];
 	auto& cmds = graphicsCommandLists_[(size_t)rtype];
@@ -48,7 +59,7 @@ void Scene::sort(RendererTypes rtype)
 		key.cmd = cmds[i];
 		j = i - 1;
 
-		while (j >= 0 && distances[j] > key.key)
+		while (j >= 0 && (farthestFirst ? distances[j] < key.key : distances[j] > key.key))
 		{
 			distances[j + 1] = distances[j];
 			cmds[j + 1] = cmds[j];
@@ -60,7 +71,7 @@ void Scene::sort(RendererTypes rtype)
 	}
 }
 
-std::vector<VkDrawIndexedIndirectCommand>* Scene::update(LogicalCamera* cameras, const size_t cameraCount, float dt, const uint32_t& frameIdx, GlobalRenderData* grd)
+std::vector<IndexedDrawCommand>* Scene::update(LogicalCamera* cameras, const size_t cameraCount, float dt, const uint32_t& frameIdx, GlobalRenderData* grd)
 {
 	for (auto& cmdList : graphicsCommandLists_) {
 		cmdList.clear();
@@ -81,12 +92,17 @@ std::vector<VkDrawIndexedIndirectCommand>* Scene::update(LogicalCamera* cameras,
 
 	graphicsWriteInfo_.lightData.clear();
 
+	particlePool_->beginFrame(cameras, cameraCount);
 	for (size_t i = 0; i < rootNode_->childNodes.size(); ++i) {
 		updateRecursively(rootNode_->childNodes[i], cameras, cameraCount, glm::mat4(), dt, frameIdx);
 	}
+	particlePool_->endFrame();
 
 	sort(RendererTypes::kStatic);
-	sort(RendererTypes::kParticle);
+	// Particles are composited order independently, sorting the systems farthest first is only kept to compare its cost
+	if (ParticleSystem::isSortingEnabled()) {
+		sort(RendererTypes::kParticle, true);
+	}
 
 	// Write frame's data to the gpu buffers
 	graphicsWriteInfo_.mvpPtr = (char*)graphicsInfo_.mvpBuffer->bindRange();
@@ -133,6 +149,13 @@ SceneHeirarchyNode* Scene::addEntity(Entity* entity, Entity* parent, SceneHeirar
 	parentNode->childNodes.push_back(childNode);
 	childNode->entity->setSceneNode(childNode);
 
+	// Read the mesh on a worker while the rest of the scene is built, start places it once the element buffers exist
+	auto graphicsComponent = entity->getGraphicsComponent();
+	if (graphicsComponent != nullptr && graphicsComponent->getLoadInfo() == nullptr && graphicsComponent->getRendererType() != RendererTypes::kParticle &&
+		!(kRendererTypeFlags[(size_t)graphicsComponent->getRendererType()] & RendererFlags::FULLSCREEN)) {
+		MeshLoader::loadMeshAsync(graphicsComponent->getMeshName(), masters_->jobSystem);
+	}
+
 	return childNode;
 }
 
@@ -354,36 +377,128 @@ void Scene::addToCommandList(Graphics::GraphicsComponent* component, LogicalCame
 	auto rtype = component->getRendererType();
 	if (!(kRendererTypeFlags[(size_t)rtype] & RendererFlags::FULLSCREEN)) {
 		BasicMesh* mesh = component->getMesh();
+		// Graphics data has already been written for this component, so its instance is the last one written
+		const uint32_t instanceIdx = static_cast<uint32_t>(graphicsWriteInfo_.offsets[(size_t)rtype] - 1);
+		const float distance = glm::distance(component->getEntity()->getTransform()->position, mainCamera.position);
+		requestTextureDetail(component, mainCamera);
 		if (kRendererTypeFlags[(size_t)rtype] & RendererFlags::NON_INDEXED) {
-			graphicsCommandLists_[(size_t)rtype].push_back({ mesh->count, 1, 0, mesh->vertexOffset, (uint32_t)graphicsCommandLists_[(size_t)rtype].size() });
-		}
-		else {
-			if (rtype == RendererTypes::kLight) {
-				auto light = static_cast<LightSource*>(component->getEntity())->getLight();
-				if (glm::length(mainCamera.position - light.position) > light.volumeScale) {
-					graphicsCommandLists_[(size_t)RendererTypes::kLight].push_back({ mesh->count, 1, 0, mesh->vertexOffset,  (uint32_t)graphicsWriteInfo_.lightData.size() });
-				}
-				else {
-					graphicsCommandLists_[(size_t)RendererTypes::kLightInside].push_back({ mesh->count, 1, 0, mesh->vertexOffset,  (uint32_t)graphicsWriteInfo_.lightData.size() });
+			IndexedDrawCommand cmd = { { mesh->count, 1, 0, mesh->vertexOffset, instanceIdx }, mesh->indexType };
+			if (rtype == RendererTypes::kParticle) {
+				auto particleSystem = static_cast<Game::ParticleSystem*>(component->getEntity()->getGameScript());
+				if (particleSystem->isCulled()) {
+					return;
 				}
-				graphicsWriteInfo_.lightData.push_back(light);
-			}
-			else {
-				graphicsCommandLists_[(size_t)rtype].push_back({ mesh->count, 1, mesh->indexOffset, mesh->vertexOffset, (uint32_t)graphicsCommandLists_[(size_t)rtype].size() });
+				cmd.particleEmitter = particleSystem->getGpuEmitter();
 			}
+			graphicsCommandLists_[(size_t)rtype].push_back(cmd);
+			graphicsWriteInfo_.distances[(size_t)rtype].push_back(distance);
+		}
+		else if (rtype == RendererTypes::kLight) {
+			auto light = static_cast<LightSource*>(component->getEntity())->getLight();
+			auto lightType = glm::length(mainCamera.position - light.position) > light.volumeScale ? RendererTypes::kLight : RendererTypes::kLightInside;
+			pushDrawCommands(graphicsCommandLists_[(size_t)lightType], mesh, (uint32_t)graphicsWriteInfo_.lightData.size());
+			graphicsWriteInfo_.lightData.push_back(light);
+			graphicsWriteInfo_.distances[(size_t)rtype].push_back(distance);
 		}
+		else if (rtype == RendererTypes::kTerrain) {
+			// Drawn as the quadtree nodes selected for each camera, which need the terrain's transform to cull against
+			auto quadtree = static_cast<Terrain*>(component->getEntity())->getQuadtree();
+			quadtree->setModelMatrix(component->getEntity()->getModelMatrix());
+			IndexedDrawCommand cmd = { { mesh->count, 1, mesh->indexOffset, mesh->vertexOffset, instanceIdx }, mesh->indexType };
+			cmd.terrain = quadtree;
+			graphicsCommandLists_[(size_t)rtype].push_back(cmd);
+			graphicsWriteInfo_.distances[(size_t)rtype].push_back(distance);
+		}
+		else {
+			// Distances are sorted alongside the commands so there must be one per command
+			const size_t drawCount = pushDrawCommands(graphicsCommandLists_[(size_t)rtype], mesh, instanceIdx, selectLod(component, mainCamera),
+				rtype == RendererTypes::kStatic);
+			graphicsWriteInfo_.distances[(size_t)rtype].insert(graphicsWriteInfo_.distances[(size_t)rtype].end(), drawCount, distance);
+		}
+	}
+}
 
-		graphicsWriteInfo_.distances[(size_t)rtype].push_back(glm::distance(component->getEntity()->getTransform()->position, mainCamera.position));
+const MeshLod* Scene::selectLod(GraphicsComponent* component, const LogicalCamera& camera)
+{
+	BasicMesh* mesh = component->getMesh();
+	if (mesh->lods.empty() || camera.viewportHeight <= 0.0f) {
+		return nullptr;
+	}
+	// Project the error of the closest point of the bounding sphere
+	const float pixelsPerUnit = projectBounds(component, camera);
+
+	const float threshold = kLodErrorThreshold * lodBias_[(size_t)component->getRendererType()];
+	const MeshLod* selected = nullptr;
+	for (const auto& lod : mesh->lods) {
+		if (lod.error * pixelsPerUnit > threshold) {
+			break;
+		}
+		selected = &lod;
+	}
+	return selected;
+}
+
+float Scene::projectBounds(GraphicsComponent* component, const LogicalCamera& camera)
+{
+	// Using the largest scale of the entity's transform
+	BasicMesh* mesh = component->getMesh();
+	const glm::mat4 model = component->getEntity()->getModelMatrix();
+	const float scale = glm::max(glm::length(glm::vec3(model[0])), glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+	const glm::vec3 centre = glm::vec3(model * glm::vec4((mesh->boundsMin + mesh->boundsMax) * 0.5f, 1.0f));
+	const float radius = glm::length(mesh->boundsMax - mesh->boundsMin) * 0.5f * scale;
+	// Orthographic projections have no perspective divide, so sizes do not shrink with distance
+	const bool perspective = camera.projectionMatrix[2][3] != 0.0f;
+	const float distance = perspective ? glm::max(glm::distance(centre, camera.position) - radius, 1e-3f) : 1.0f;
+	return glm::abs(camera.projectionMatrix[1][1]) * 0.5f * camera.viewportHeight / distance * scale;
+}
+
+void Scene::requestTextureDetail(GraphicsComponent* component, const LogicalCamera& camera)
+{
+	TextureStreamer* streamer = masters_->textureManager->getStreamer();
+	Material* material = component->getMaterial();
+	if (streamer == nullptr || material == nullptr || material->data == nullptr) {
+		return;
+	}
+	// Meshes without bounds have no known size on screen, so want their textures' full detail
+	BasicMesh* mesh = component->getMesh();
+	float screenPixels = FLT_MAX;
+	if (mesh->boundsMax != mesh->boundsMin && camera.viewportHeight > 0.0f) {
+		screenPixels = projectBounds(component, camera) * glm::length(mesh->boundsMax - mesh->boundsMin);
+	}
+	// Every material is its textures' indices first
+	const uint32_t* textures = static_cast<const uint32_t*>(material->data);
+	for (size_t i = 0; i < Materials::materialTextureCountLUT[(size_t)component->getRendererType()]; ++i) {
+		streamer->requestDetail(textures[i], screenPixels);
+	}
+}
+
+size_t Scene::pushDrawCommands(std::vector<IndexedDrawCommand>& commandList, BasicMesh* mesh, uint32_t instanceIdx, const MeshLod* lod, bool cullClusters)
+{
+	if (lod != nullptr) {
+		commandList.push_back({ { lod->count, 1, mesh->indexOffset + lod->indexOffset, mesh->vertexOffset, instanceIdx }, mesh->indexType });
+		return 1;
+	}
+	if (mesh->parts.empty()) {
+		commandList.push_back({ { mesh->count, 1, mesh->indexOffset, mesh->vertexOffset, instanceIdx }, mesh->indexType, 
+			cullClusters && !mesh->clusters.empty() ? mesh : nullptr });
+		return 1;
+	}
+	for (auto& part : mesh->parts) {
+		commandList.push_back({ { part.count, 1, part.indexOffset, part.vertexOffset, instanceIdx }, mesh->indexType });
 	}
+	return mesh->parts.size();
 }
 
 void Scene::writeGraphicsData(Graphics::GraphicsComponent* component, LogicalCamera* cameras, size_t cameraCount, glm::mat4& ctm, const uint32_t& frameIdx)
 {
 	auto rtype = component->getRendererType();
+	// Packed meshes store positions relative to their bounds, which must be undone before the object's own transform
+	BasicMesh* mesh = component->getMesh();
+	const glm::mat4 model = mesh != nullptr ? ctm * mesh->positionDequantization : ctm;
 	if (kRendererTypeFlags[(size_t)rtype] & RendererFlags::DESCRIPTOR_MVP) {
 		for (size_t i = 0; i < cameraCount; ++i) {
 			auto offset = (graphicsInfo_.mvpOffsetSizes[(size_t)rtype] + graphicsWriteInfo_.offsets[(size_t)rtype]) * sizeof(glm::mat4);
-			auto mvp = cameras[i].viewProjection * ctm;
+			auto mvp = cameras[i].viewProjection * model;
 			std::memcpy(&graphicsWriteInfo_.graphicsMVPData[i].data()[offset], (char*)&mvp, sizeof(glm::mat4));
 		}
 	}
@@ -391,7 +506,7 @@ void Scene::writeGraphicsData(Graphics::GraphicsComponent* component, LogicalCam
 		ShaderParams* tmpParams = component->getShaderParams();
 		size_t paramsSize = ShaderParams::shaderParamsLUT[(size_t)rtype];
 		if (kRendererTypeFlags[(size_t)rtype] & RendererFlags::INCLUDE_MODEL) {
-			std::memcpy((char*)tmpParams, (char*)&ctm, sizeof(glm::mat4));
+			std::memcpy((char*)tmpParams, (char*)&model, sizeof(glm::mat4));
 		}
 		auto offset = (graphicsWriteInfo_.offsets[(size_t)rtype] + graphicsInfo_.paramsOffsetSizes[(size_t)rtype]) * paramsSize;
 		std::memcpy(&graphicsWriteInfo_.graphicsParamsData.data()[offset], (char*)tmpParams, paramsSize);
@@ -4,6 +4,7 @@
 #include "../Graphics/SceneDescriptorInfo.h"
 #include "../Graphics/LogicalCamera.h"
 #include "../Graphics/Light.h"
+#include "../Graphics/DrawElementsCommand.h"
 
 namespace QZL {
 	class Entity;
@@ -13,6 +14,11 @@ namespace QZL {
 		class LogicDevice;
 		class DescriptorBuffer;
 		struct LogicalCamera;
+		struct BasicMesh;
+		struct MeshLod;
+	}
+	namespace Game {
+		class ParticlePool;
 	}
 
 	struct SceneHeirarchyNode {
@@ -62,7 +68,7 @@ namespace QZL {
 		~Scene();
 		// Calls update on every entity in the scene hierarchy, giving a combined model matrix such that
 		// parents are the spatial root of their children.
-		std::vector<VkDrawIndexedIndirectCommand>* update(Graphics::LogicalCamera* cameras, const size_t cameraCount, float dt, const uint32_t& frameIdx, Graphics::GlobalRenderData* grd);
+		std::vector<Graphics::IndexedDrawCommand>* update(Graphics::LogicalCamera* cameras, const size_t cameraCount, float dt, const uint32_t& frameIdx, Graphics::GlobalRenderData* grd);
 
 		void start();
 		/*  
@@ -87,6 +93,15 @@ namespace QZL {
 		void findDescriptorRequirements(std::unordered_map<Graphics::RendererTypes, uint32_t>& instancesCount);
 		Graphics::SceneGraphicsInfo* createDescriptors(uint32_t numFrameImages, const VkPhysicalDeviceLimits& limits);
 
+		// Scales the screen space error allowed when picking a mesh's level of detail, higher values switch to simpler meshes sooner
+		void setLodBias(Graphics::RendererTypes rtype, float bias) {
+			lodBias_[(size_t)rtype] = bias;
+		}
+		// Storage and budget shared by the scene's particle systems
+		Game::ParticlePool* getParticlePool() {
+			return particlePool_;
+		}
+
 	private:
 		// Auxilliary recursive lookup
 		SceneHeirarchyNode* findEntityNodeRecursively(Entity* entity, SceneHeirarchyNode* node);
@@ -101,14 +116,33 @@ namespace QZL {
 		void addDynamicDescriptor(Graphics::DescriptorBuffer*& buffer, size_t& range, uint32_t offsets[(size_t)Graphics::RendererTypes::kNone], std::vector<DescriptorData> data,
 			uint32_t numFrameImages, VkDeviceSize alignment, uint32_t bindingIdx, std::string name, VkShaderStageFlags flags, const Graphics::LogicDevice* logicDevice);
 		void addToCommandList(Graphics::GraphicsComponent* component, Graphics::LogicalCamera& mainCamera);
+		// One command per mesh part, all drawing the same instance. Returns the number of commands added.
+		// Only the static command list is cluster culled, so only its full detail draws may ask for it.
+		size_t pushDrawCommands(std::vector<Graphics::IndexedDrawCommand>& commandList, Graphics::BasicMesh* mesh, uint32_t instanceIdx, 
+			const Graphics::MeshLod* lod = nullptr, bool cullClusters = false);
+		// The least detailed level whose projected error is below the threshold, nullptr to draw the full detail mesh
+		const Graphics::MeshLod* selectLod(Graphics::GraphicsComponent* component, const Graphics::LogicalCamera& camera);
+		// Screen pixels per model space unit at the closest point of the mesh's bounding sphere
+		float projectBounds(Graphics::GraphicsComponent* component, const Graphics::LogicalCamera& camera);
+		// Tell the texture streamer how large the component's material textures are drawn
+		void requestTextureDetail(Graphics::GraphicsComponent* component, const Graphics::LogicalCamera& camera);
 		void writeGraphicsData(Graphics::GraphicsComponent* component, Graphics::LogicalCamera* cameras, size_t cameraCount, glm::mat4& ctm, const uint32_t& frameIdx);
-		void sort(Graphics::RendererTypes rtype);
+		// Order the commands nearest the main camera first, or farthest first for blended types drawn back to front
+		void sort(Graphics::RendererTypes rtype, bool farthestFirst = false);
 
 		SceneHeirarchyNode* rootNode_;
 		Graphics::SceneGraphicsInfo graphicsInfo_;
 		GraphicsWriteInfo graphicsWriteInfo_;
-		std::vector<VkDrawIndexedIndirectCommand> graphicsCommandLists_[(size_t)Graphics::RendererTypes::kNone];
+		std::vector<Graphics::IndexedDrawCommand> graphicsCommandLists_[(size_t)Graphics::RendererTypes::kNone];
+		float lodBias_[(size_t)Graphics::RendererTypes::kNone];
+		Game::ParticlePool* particlePool_;
 		
 		const SystemMasters* masters_;
+
+		// Pixels a simplified mesh may deviate from the full detail mesh before a more detailed level is used
+		static constexpr float kLodErrorThreshold = 1.0f;
+		// Particles held by cpu simulated systems, and alive across every system
+		static constexpr size_t kParticlePoolCapacity = 64 * 1024;
+		static constexpr uint32_t kParticleBudget = 384 * 1024;
 	};
 }
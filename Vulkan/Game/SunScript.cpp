@@ -12,6 +12,8 @@ SunScript::SunScript(const SystemMasters& initialiser)
 	sunCamera_(initialiser.graphicsMaster->getCamera(1))
 {
 	angle2 = angle_;
+	// Always visible somewhere in the sky
+	priority_ = ParticlePriority::kCritical;
 }
 
 SunScript::~SunScript()
@@ -32,14 +34,14 @@ void SunScript::start()
 {
 	transform()->position = glm::vec3(512.0f, 0.0f, 512.0f);
 	transform()->rotationAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+	const size_t first = store_.spawn(2);
 	// Setup sun
-	vertices_[0].position = glm::vec3(1.0f * RADIUS, 0.0f, 0.0f);
-	vertices_[0].scale = 40.0f;
-	vertices_[0].textureOffset = glm::vec2(0.0f);
+	store_.setParticle(first, glm::vec3(1.0f * RADIUS, 0.0f, 0.0f), glm::vec3(0.0f), 1.0f, 40.0f);
 	// Setup moon
-	vertices_[1].position = glm::vec3(-1.0f * RADIUS, 0.0f, 0.0f);
-	vertices_[1].scale = 40.0f;
-	vertices_[1].textureOffset = glm::vec2(0.0f, 0.0f);
+	store_.setParticle(first + 1, glm::vec3(-1.0f * RADIUS, 0.0f, 0.0f), glm::vec3(0.0f), 1.0f, 40.0f);
+	// Neither moves in model space, so they are written once
+	fetchDynamicBuffer();
+	updateBuffer();
 
 	intensity_ = glm::vec3(6.5e-7, 5.1e-7, 4.75e-7) * glm::vec3(1e7);
 }
@@ -69,4 +71,5 @@ void SunScript::update(float dt, const glm::mat4& viewProjection, const glm::mat
 	localUp.x = x * glm::cos(PI_BY_TWO) - y * glm::sin(PI_BY_TWO);
 	localUp.y = x * glm::sin(PI_BY_TWO) + y * glm::cos(PI_BY_TWO);
 	sunCamera_->viewMatrix = glm::lookAt((dir2 * RADIUS) + glm::vec3(512.0f, 0.0f, 512.0f), glm::vec3(512.0f, 0.0f, 512.0f), localUp);
+	reportToPool(parentMatrix);
 }
@@ -17,9 +17,8 @@ void TerrainScript::update(float dt, const glm::mat4& viewProjection, const glm:
 {
 	const float kSnowAccumulationRate = 0.00001f;
 	static_cast<TerrainShaderParams*>(owningEntity_->getGraphicsComponent()->getShaderParams())->heights.w -= kSnowAccumulationRate;
-	static_cast<TerrainShaderParams*>(owningEntity_->getGraphicsComponent()->getShaderParams())->distanceFarMinusClose = 200.0f;
-	static_cast<TerrainShaderParams*>(owningEntity_->getGraphicsComponent()->getShaderParams())->closeDistance = 60.0f;
-	static_cast<TerrainShaderParams*>(owningEntity_->getGraphicsComponent()->getShaderParams())->patchRadius = 40.0f;
-	static_cast<TerrainShaderParams*>(owningEntity_->getGraphicsComponent()->getShaderParams())->maxTessellationWeight += dt * 1.3f;
+	// Wrapped so the sway keeps its precision however long the game runs
+	float& time = static_cast<TerrainShaderParams*>(owningEntity_->getGraphicsComponent()->getShaderParams())->time;
+	time = std::fmod(time + dt * 1.3f, glm::two_pi<float>());
 	mainCamera_->calculateFrustumPlanes(viewProjection, static_cast<TerrainShaderParams*>(owningEntity_->getGraphicsComponent()->getShaderParams())->frustumPlanes);
 }
@@ -0,0 +1,212 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "ClusterCuller.h"
+#include "LogicDevice.h"
+#include "DeviceMemory.h"
+#include "Descriptor.h"
+#include "ComputePipeline.h"
+#include "FrameAllocator.h"
+#include "StorageBuffer.h"
+#include "RendererBase.h"
+#include "SceneDescriptorInfo.h"
+#include "Mesh.h"
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+static constexpr uint32_t kWorkgroupSize = 64;
+
+ClusterCuller::ClusterCuller(const LogicDevice* logicDevice, SceneGraphicsInfo* graphicsInfo, uint32_t frameCount)
+	: logicDevice_(logicDevice), graphicsInfo_(graphicsInfo), pipeline_(nullptr), jobAllocator_(nullptr), layout_(VK_NULL_HANDLE), set_(VK_NULL_HANDLE),
+	  clusterBuffer_(), drawBuffer_(), clusterRanges_(kMaxClusters), frameCount_(frameCount), frameCounter_(0), frameIdx_(0), viewIdx_(0),
+	  maxDrawsPerCall_(1)
+{
+	VkPhysicalDeviceFeatures features;
+	vkGetPhysicalDeviceFeatures(logicDevice->getPhysicalDevice(), &features);
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(logicDevice->getPhysicalDevice(), &properties);
+	// The instance index is the draw's first instance, which indirect draws can only set with this feature
+	supported_ = features.drawIndirectFirstInstance == VK_TRUE;
+	if (!supported_) {
+		DEBUG_LOG("Cluster culling disabled, drawIndirectFirstInstance is not supported");
+		return;
+	}
+	maxDrawsPerCall_ = features.multiDrawIndirect == VK_TRUE ? properties.limits.maxDrawIndirectCount : 1;
+
+	DeviceMemory* deviceMemory = logicDevice_->getDeviceMemory();
+	clusterBuffer_ = deviceMemory->createBuffer("ClusterBuffer", MemoryAllocationPattern::kDynamicResource, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		sizeof(GpuCluster) * kMaxClusters, MemoryAccessType::kPersistant);
+	ASSERT(clusterBuffer_.mappedData != nullptr);
+	drawBuffer_ = deviceMemory->createBuffer("ClusterDrawBuffer", MemoryAllocationPattern::kRenderTarget, 
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, 
+		sizeof(VkDrawIndexedIndirectCommand) * kMaxClusterDraws * NUM_CAMERAS * frameCount);
+	// Every frame takes the whole range so the dynamic offset plus the descriptor's range is always within the buffer
+	jobAllocator_ = new FrameAllocator(deviceMemory, sizeof(CullJob) * kMaxJobs, frameCount, properties.limits.minStorageBufferOffsetAlignment,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, "ClusterJobAllocator");
+	jobs_.reserve(kMaxJobs);
+
+	createDescriptorSet();
+	std::vector<VkPushConstantRange> pushConstantRanges = { RendererBase::setupPushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(CullPushConstants), 0) };
+	pipeline_ = new ComputePipeline(logicDevice_, ComputePipeline::makeLayoutInfo(1, &layout_, pushConstantRanges), "ClusterCull");
+}
+
+ClusterCuller::~ClusterCuller()
+{
+	for (auto& mesh : meshes_) {
+		mesh.first->onDestroyed = nullptr;
+	}
+	if (!supported_) {
+		return;
+	}
+	SAFE_DELETE(pipeline_);
+	SAFE_DELETE(jobAllocator_);
+	logicDevice_->getDeviceMemory()->deleteAllocation(clusterBuffer_.id, clusterBuffer_.buffer);
+	logicDevice_->getDeviceMemory()->deleteAllocation(drawBuffer_.id, drawBuffer_.buffer);
+}
+
+void ClusterCuller::cull(VkCommandBuffer cmdBuffer, uint32_t frameIdx, uint32_t imageIdx, const LogicalCamera* cameras, std::vector<IndexedDrawCommand>& commandList)
+{
+	frameIdx_ = frameIdx;
+	// The fence for this frame has been waited on, so clusters retired frameCount frames ago are no longer read
+	++frameCounter_;
+	size_t retired = 0;
+	for (; retired < retiredClusters_.size() && frameCounter_ - retiredClusters_[retired].frame >= frameCount_; ++retired) {
+		clusterRanges_.free(retiredClusters_[retired].firstCluster, retiredClusters_[retired].clusterCount);
+	}
+	retiredClusters_.erase(retiredClusters_.begin(), retiredClusters_.begin() + retired);
+	jobs_.clear();
+	uint32_t drawCount = 0;
+	for (auto& cmd : commandList) {
+		if (cmd.clusterMesh == nullptr) {
+			continue;
+		}
+		const uint32_t clusterCount = static_cast<uint32_t>(cmd.clusterMesh->clusters.size());
+		MeshEntry entry;
+		if (!supported_ || jobs_.size() == kMaxJobs || drawCount + clusterCount > kMaxClusterDraws || !registerMesh(cmd.clusterMesh, entry)) {
+			cmd.clusterMesh = nullptr;
+			continue;
+		}
+		cmd.firstClusterDraw = drawCount;
+		jobs_.push_back({ entry.objectToVertex, entry.firstCluster, clusterCount, drawCount, cmd.draw.firstInstance, cmd.draw.firstIndex, cmd.draw.vertexOffset });
+		drawCount += clusterCount;
+	}
+	if (jobs_.empty()) {
+		return;
+	}
+
+	jobAllocator_->beginFrame(frameIdx);
+	const FrameAllocation jobAllocation = jobAllocator_->allocate(jobAllocator_->getFrameCapacity());
+	memcpy(jobAllocation.data, jobs_.data(), jobs_.size() * sizeof(CullJob));
+
+	vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_->getPipeline());
+	for (uint32_t view = 0; view < NUM_CAMERAS; ++view) {
+		const uint32_t dynamicOffsets[2] = {
+			uint32_t(graphicsInfo_->mvpRange) * (imageIdx + (graphicsInfo_->numFrameIndices * view)),
+			uint32_t(jobAllocation.offset)
+		};
+		vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_->getLayout(), 0, 1, &set_, 2, dynamicOffsets);
+
+		CullPushConstants pushConstants;
+		pushConstants.mvpOffset = graphicsInfo_->mvpOffsetSizes[(size_t)RendererTypes::kStatic];
+		pushConstants.drawBase = static_cast<uint32_t>(drawBase(frameIdx, view));
+		// Perspective projections have a w row of (0, 0, -1, 0), orthographic ones (0, 0, 0, 1)
+		pushConstants.coneCulling = cameras[view].projectionMatrix[2][3] != 0.0f ? 1 : 0;
+		pushConstants.jobCount = static_cast<uint32_t>(jobs_.size());
+		vkCmdPushConstants(cmdBuffer, pipeline_->getLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+		vkCmdDispatch(cmdBuffer, pushConstants.jobCount, 1, 1);
+	}
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void ClusterCuller::recordDraws(VkCommandBuffer cmdBuffer, const IndexedDrawCommand& cmd) const
+{
+	EXPECTS(cmd.clusterMesh != nullptr);
+	const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	const uint32_t clusterCount = static_cast<uint32_t>(cmd.clusterMesh->clusters.size());
+	const VkDeviceSize offset = (drawBase(frameIdx_, viewIdx_) + cmd.firstClusterDraw) * stride;
+	for (uint32_t first = 0; first < clusterCount; first += maxDrawsPerCall_) {
+		vkCmdDrawIndexedIndirect(cmdBuffer, drawBuffer_.buffer, offset + VkDeviceSize(first) * stride, std::min(maxDrawsPerCall_, clusterCount - first), stride);
+	}
+}
+
+bool ClusterCuller::registerMesh(const BasicMesh* mesh, MeshEntry& entry)
+{
+	auto it = meshes_.find(mesh);
+	if (it != meshes_.end()) {
+		entry = it->second;
+		return true;
+	}
+	const VkDeviceSize firstCluster = clusterRanges_.allocate(mesh->clusters.size());
+	if (firstCluster == FreeListAllocator::kInvalidOffset) {
+		DEBUG_LOG("Cluster buffer is full, meshes drawn from now on are not cluster culled");
+		return false;
+	}
+
+	// Free ranges are only reused once no frame in flight reads them, so no synchronisation is needed
+	GpuCluster* gpuClusters = static_cast<GpuCluster*>(clusterBuffer_.mappedData) + firstCluster;
+	for (const auto& cluster : mesh->clusters) {
+		*gpuClusters++ = { glm::vec4(cluster.center, cluster.radius), glm::vec4(cluster.coneAxis, cluster.coneCutoff), cluster.indexOffset, cluster.indexCount };
+	}
+	// Clusters are in object space while the mvp buffer expects packed vertex positions
+	entry.firstCluster = static_cast<uint32_t>(firstCluster);
+	entry.objectToVertex = glm::inverse(mesh->positionDequantization);
+	meshes_.emplace(mesh, entry);
+	EXPECTS(!mesh->onDestroyed);
+	mesh->onDestroyed = [this](const BasicMesh* destroyed) {
+		releaseMesh(destroyed);
+	};
+	return true;
+}
+
+void ClusterCuller::releaseMesh(const BasicMesh* mesh)
+{
+	auto it = meshes_.find(mesh);
+	if (it == meshes_.end()) {
+		return;
+	}
+	retiredClusters_.push_back({ it->second.firstCluster, static_cast<uint32_t>(mesh->clusters.size()), frameCounter_ });
+	meshes_.erase(it);
+}
+
+void ClusterCuller::createDescriptorSet()
+{
+	Descriptor* descriptor = logicDevice_->getPrimaryDescriptor();
+	VkDescriptorSetLayoutBinding bindings[4] = {};
+	const VkDescriptorType types[4] = { 
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER 
+	};
+	for (uint32_t i = 0; i < 4; ++i) {
+		bindings[i].binding = i;
+		bindings[i].descriptorCount = 1;
+		bindings[i].descriptorType = types[i];
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	layout_ = descriptor->makeLayout({ bindings[0], bindings[1], bindings[2], bindings[3] });
+	set_ = descriptor->getSet(descriptor->createSets({ layout_ }));
+
+	// The mvp buffer is written through its own descriptor buffer so the set is kept up to date if defragmentation moves it
+	descriptor->updateDescriptorSets({ graphicsInfo_->mvpBuffer->descriptorWrite(set_, 0, graphicsInfo_->mvpRange) });
+
+	VkDescriptorBufferInfo bufferInfos[3] = {
+		{ clusterBuffer_.buffer, 0, VK_WHOLE_SIZE },
+		{ jobAllocator_->getBuffer(), 0, jobAllocator_->getFrameCapacity() },
+		{ drawBuffer_.buffer, 0, VK_WHOLE_SIZE }
+	};
+	std::vector<VkWriteDescriptorSet> descriptorWrites(3);
+	for (uint32_t i = 0; i < 3; ++i) {
+		descriptorWrites[i] = {};
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].dstSet = set_;
+		descriptorWrites[i].dstBinding = i + 1;
+		descriptorWrites[i].dstArrayElement = 0;
+		descriptorWrites[i].descriptorType = types[i + 1];
+		descriptorWrites[i].descriptorCount = 1;
+		descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+	}
+	descriptor->updateDescriptorSets(descriptorWrites);
+}
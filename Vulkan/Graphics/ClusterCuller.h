@@ -0,0 +1,110 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Purpose: Cull the clusters of large meshes on the gpu so only those which may be visible are drawn.
+#pragma once
+#include "VkUtil.h"
+#include "MemoryAllocation.h"
+#include "DrawElementsCommand.h"
+#include "LogicalCamera.h"
+#include "FreeListAllocator.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		class LogicDevice;
+		class ComputePipeline;
+		class FrameAllocator;
+		struct SceneGraphicsInfo;
+
+		/*
+			Before the passes are recorded a compute dispatch per camera tests every cluster of the frame's clustered draws against the
+			camera's frustum and, for perspective cameras, its normal cone. One indirect draw is written per cluster with an instance count
+			of 0 or 1, so culled clusters cost only their command. Only core compute and indirect draws are used, drawIndirectCount and
+			mesh shaders are not needed so this also runs on software implementations such as lavapipe. Without multiDrawIndirect
+			each cluster is drawn with its own indirect call. Orthographic cameras skip the cone test as the shadow pass draws back faces.
+		*/
+		class ClusterCuller {
+		public:
+			ClusterCuller(const LogicDevice* logicDevice, SceneGraphicsInfo* graphicsInfo, uint32_t frameCount);
+			~ClusterCuller();
+
+			// Replace the clustered draws of the static command list with culled indirect draws for every camera. Draws which can not be
+			// culled, because the device lacks support or the buffers are full, have their cluster mesh cleared so they are drawn whole.
+			void cull(VkCommandBuffer cmdBuffer, uint32_t frameIdx, uint32_t imageIdx, const LogicalCamera* cameras, std::vector<IndexedDrawCommand>& commandList);
+			// Select the camera whose culling results following draws use
+			void bindView(uint32_t viewIdx) {
+				viewIdx_ = viewIdx;
+			}
+			// Record the indirect draws for a command which still has its cluster mesh after culling
+			void recordDraws(VkCommandBuffer cmdBuffer, const IndexedDrawCommand& cmd) const;
+
+			static constexpr uint32_t kMaxClusters = 64 * 1024;
+			static constexpr uint32_t kMaxClusterDraws = 32 * 1024;
+			static constexpr uint32_t kMaxJobs = 1024;
+		private:
+			// Matches the layouts in cluster_cull.comp
+			struct GpuCluster {
+				glm::vec4 sphere;
+				glm::vec4 cone;
+				uint32_t indexOffset;
+				uint32_t indexCount;
+				uint32_t padding[2];
+			};
+			struct CullJob {
+				glm::mat4 objectToVertex;
+				uint32_t firstCluster;
+				uint32_t clusterCount;
+				uint32_t firstDraw;
+				uint32_t instanceIdx;
+				uint32_t indexOffset;
+				int32_t vertexOffset;
+				uint32_t padding[2];
+			};
+			struct CullPushConstants {
+				uint32_t mvpOffset;
+				uint32_t drawBase;
+				uint32_t coneCulling;
+				uint32_t jobCount;
+			};
+			struct MeshEntry {
+				uint32_t firstCluster;
+				glm::mat4 objectToVertex;
+			};
+
+			struct RetiredClusters {
+				uint32_t firstCluster;
+				uint32_t clusterCount;
+				uint64_t frame;
+			};
+
+			// Copy the mesh's clusters in to the cluster buffer the first time it is drawn, false if there is no room
+			bool registerMesh(const BasicMesh* mesh, MeshEntry& entry);
+			// Forget a destroyed mesh, its clusters are reused once no frame in flight can be reading them
+			void releaseMesh(const BasicMesh* mesh);
+			void createDescriptorSet();
+			VkDeviceSize drawBase(uint32_t frameIdx, uint32_t viewIdx) const {
+				return (VkDeviceSize(frameIdx) * NUM_CAMERAS + viewIdx) * kMaxClusterDraws;
+			}
+
+			const LogicDevice* logicDevice_;
+			SceneGraphicsInfo* graphicsInfo_;
+			ComputePipeline* pipeline_;
+			FrameAllocator* jobAllocator_;
+			VkDescriptorSetLayout layout_;
+			VkDescriptorSet set_;
+			MemoryAllocationDetails clusterBuffer_;
+			MemoryAllocationDetails drawBuffer_;
+			std::unordered_map<const BasicMesh*, MeshEntry> meshes_;
+			// Ranges of the cluster buffer in clusters
+			FreeListAllocator clusterRanges_;
+			std::vector<RetiredClusters> retiredClusters_;
+			std::vector<CullJob> jobs_;
+			const uint32_t frameCount_;
+			uint64_t frameCounter_;
+			uint32_t frameIdx_;
+			uint32_t viewIdx_;
+			uint32_t maxDrawsPerCall_;
+			bool supported_;
+		};
+	}
+}
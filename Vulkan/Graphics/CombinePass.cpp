@@ -4,55 +4,50 @@
 #include "GraphicsMaster.h"
 #include "SwapChainDetails.h"
 #include "FullscreenRenderer.h"
+#include "ParticleRenderer.h"
 #include "Image.h"
 #include "LogicDevice.h"
 #include "SceneDescriptorInfo.h"
 #include "GlobalRenderData.h"
 #include "TextureManager.h"
 #include "ElementBufferObject.h"
+#include "OitCompositeRenderer.h"
+#include "../InputManager.h"
 
 using namespace QZL;
 using namespace QZL::Graphics;
 
 CombinePass::CombinePass(GraphicsMaster* master, LogicDevice* logicDevice, const SwapChainDetails& swapChainDetails, GlobalRenderData* grd, SceneGraphicsInfo* graphicsInfo)
-	: RenderPass(master, logicDevice, swapChainDetails, grd, graphicsInfo)
+	: RenderPass(master, logicDevice, swapChainDetails, grd, graphicsInfo), particleRenderer_(nullptr), oitCompositeRenderer_(nullptr), oitPass_(VK_NULL_HANDLE),
+	compositePass_(VK_NULL_HANDLE), input_(new InputProfile()), oitMode_(OitMode::kWeightedBlended)
 {
-	CreateInfo createInfo = {};
 	createColourBuffer(logicDevice, swapChainDetails);
-	// Forward rendering colour and depth
-	createInfo.attachments.push_back(makeAttachment(swapChainDetails.surfaceFormat.format, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE,
-		VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
-
-	std::vector<VkAttachmentReference> colourAttachmentRefs;
-	VkAttachmentReference colourRef = {};
-	colourRef.attachment = 0;
-	colourRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-	colourAttachmentRefs.push_back(colourRef);
-
-	createInfo.subpasses.push_back(makeSubpass(VK_PIPELINE_BIND_POINT_GRAPHICS, colourAttachmentRefs, nullptr));
-	
-	createInfo.dependencies.push_back(makeSubpassDependency(
-		VK_SUBPASS_EXTERNAL,
-		0,
-		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
-		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT)
-	);
-	createInfo.dependencies.push_back(makeSubpassDependency(
-		0, 
-		VK_SUBPASS_EXTERNAL,
-		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT));
-
-	std::vector<VkImageView> attachmentImages = { colourBuffer_->getImageView() };
-	createRenderPass(createInfo, attachmentImages);
+	input_->profileBindings.push_back({ { GLFW_KEY_O }, [this]() {
+		oitMode_ = oitMode_ == OitMode::kWeightedBlended ? OitMode::kLinkedList : OitMode::kWeightedBlended;
+		particleRenderer_->setOitMode(oitMode_);
+	}, 0.2f });
+	master->getMasters().inputManager->addProfile("Order independent transparency", input_);
 }
 
 CombinePass::~CombinePass()
 {
+	SAFE_DELETE(input_);
 	SAFE_DELETE(colourBuffer_);
+	SAFE_DELETE(accumulationBuffer_);
+	SAFE_DELETE(revealageBuffer_);
 	SAFE_DELETE(atmosphereRenderer_);
 	SAFE_DELETE(environmentRenderer_);
 	SAFE_DELETE(combineRenderer_);
+	SAFE_DELETE(particleRenderer_);
+	SAFE_DELETE(oitCompositeRenderer_);
+	for (auto framebuffer : oitFramebuffers_) {
+		vkDestroyFramebuffer(*logicDevice_, framebuffer, nullptr);
+	}
+	vkDestroyRenderPass(*logicDevice_, oitPass_, nullptr);
+	for (auto framebuffer : compositeFramebuffers_) {
+		vkDestroyFramebuffer(*logicDevice_, framebuffer, nullptr);
+	}
+	vkDestroyRenderPass(*logicDevice_, compositePass_, nullptr);
 }
 
 void CombinePass::doFrame(FrameInfo& frameInfo)
@@ -82,19 +77,74 @@ void CombinePass::doFrame(FrameInfo& frameInfo)
 	scissor.offset.y = 0;
 	vkCmdSetScissor(frameInfo.cmdBuffer, 0, 1, &scissor);
 
-	const uint32_t dynamicOffsets[3] = {
+	const auto globalOffsets = globalRenderData_->getDynamicOffsets();
+	uint32_t dynamicOffsets[3 + GlobalRenderData::kDynamicOffsetCount] = {
 		uint32_t(graphicsInfo_->mvpRange) * (frameInfo.frameIdx + (graphicsInfo_->numFrameIndices * frameInfo.mainCameraIdx)),
 		uint32_t(graphicsInfo_->paramsRange) * frameInfo.frameIdx,
-		uint32_t(graphicsInfo_->materialRange) * frameInfo.frameIdx
+		uint32_t(graphicsInfo_->materialRange) * frameInfo.frameIdx,
+		globalOffsets[0], globalOffsets[1], globalOffsets[2]
 	};
 
 	VkDescriptorSet sets[2] = { graphicsInfo_->set, globalRenderData_->getSet() };
-	vkCmdBindDescriptorSets(frameInfo.cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, atmosphereRenderer_->getPipelineLayout(), 0, 2, sets, 3, dynamicOffsets);
+	vkCmdBindDescriptorSets(frameInfo.cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, atmosphereRenderer_->getPipelineLayout(), 0, 2, sets, 3 + GlobalRenderData::kDynamicOffsetCount, dynamicOffsets);
 
 	environmentRenderer_->recordFrame(frameInfo.frameIdx, frameInfo.cmdBuffer, nullptr);
 	atmosphereRenderer_->recordFrame(frameInfo.frameIdx, frameInfo.cmdBuffer, nullptr);
 	combineRenderer_->recordFrame(frameInfo.frameIdx, frameInfo.cmdBuffer, nullptr);
 	vkCmdEndRenderPass(frameInfo.cmdBuffer);
+
+	// Particles are drawn once per camera, in the half of the screen its deferred pass drew, to the order independent targets in
+	// whatever order they come, then composited over the lit scene
+	auto& particleCommands = frameInfo.commandLists[(size_t)RendererTypes::kParticle];
+	if (!particleCommands.empty()) {
+		if (oitMode_ == OitMode::kLinkedList) {
+			oitCompositeRenderer_->clearLists(frameInfo.cmdBuffer);
+		}
+		std::array<VkClearValue, 3> oitClearValues = {};
+		oitClearValues[0].color = { 0.0f, 0.0f, 0.0f, 0.0f };
+		oitClearValues[1].color = { 1.0f, 0.0f, 0.0f, 0.0f };
+		auto oitBi = beginInfo(frameInfo.frameIdx, { 0, 0 }, 0, oitPass_, oitFramebuffers_[frameInfo.frameIdx]);
+		oitBi.clearValueCount = static_cast<uint32_t>(oitClearValues.size());
+		oitBi.pClearValues = oitClearValues.data();
+		vkCmdBeginRenderPass(frameInfo.cmdBuffer, &oitBi, VK_SUBPASS_CONTENTS_INLINE);
+
+		const uint32_t viewCount = frameInfo.splitscreenEnabled ? 2 : 1;
+		const uint32_t viewWidth = swapChainDetails_.extent.width / viewCount;
+		for (uint32_t cameraIdx = 0; cameraIdx < viewCount; ++cameraIdx) {
+			viewport.x = float(viewWidth * cameraIdx);
+			viewport.width = float(viewWidth);
+			vkCmdSetViewport(frameInfo.cmdBuffer, 0, 1, &viewport);
+			scissor.offset.x = int32_t(viewWidth * cameraIdx);
+			scissor.extent.width = viewWidth;
+			vkCmdSetScissor(frameInfo.cmdBuffer, 0, 1, &scissor);
+
+			dynamicOffsets[0] = uint32_t(graphicsInfo_->mvpRange) * (frameInfo.frameIdx + (graphicsInfo_->numFrameIndices * cameraIdx));
+			vkCmdBindDescriptorSets(frameInfo.cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, particleRenderer_->getPipelineLayout(), 0, 2, sets,
+				3 + GlobalRenderData::kDynamicOffsetCount, dynamicOffsets);
+			VertexPushConstants vpc;
+			vpc.cameraPosition = glm::vec4(frameInfo.cameras[cameraIdx].position, 1.0f);
+			vkCmdPushConstants(frameInfo.cmdBuffer, particleRenderer_->getPipelineLayout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(vpc), &vpc);
+			particleRenderer_->recordFrame(frameInfo.frameIdx, frameInfo.cmdBuffer, &particleCommands, cameraIdx > 0);
+		}
+		vkCmdEndRenderPass(frameInfo.cmdBuffer);
+
+		auto compositeBi = beginInfo(frameInfo.frameIdx, { 0, 0 }, 0, compositePass_, compositeFramebuffers_[frameInfo.frameIdx]);
+		vkCmdBeginRenderPass(frameInfo.cmdBuffer, &compositeBi, VK_SUBPASS_CONTENTS_INLINE);
+		viewport.x = 0;
+		viewport.width = float(swapChainDetails_.extent.width);
+		vkCmdSetViewport(frameInfo.cmdBuffer, 0, 1, &viewport);
+		scissor.offset.x = 0;
+		scissor.extent.width = swapChainDetails_.extent.width;
+		vkCmdSetScissor(frameInfo.cmdBuffer, 0, 1, &scissor);
+
+		vkCmdBindDescriptorSets(frameInfo.cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, oitCompositeRenderer_->getPipelineLayout(), 0, 2, sets,
+			3 + GlobalRenderData::kDynamicOffsetCount, dynamicOffsets);
+		OitCompositePushConstants compositePushConstants = {};
+		compositePushConstants.mode = oitMode_;
+		vkCmdPushConstants(frameInfo.cmdBuffer, oitCompositeRenderer_->getPipelineLayout(), VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(compositePushConstants), &compositePushConstants);
+		oitCompositeRenderer_->recordFrame(frameInfo.frameIdx, frameInfo.cmdBuffer, nullptr);
+		vkCmdEndRenderPass(frameInfo.cmdBuffer);
+	}
 }
 
 void CombinePass::createRenderers()
@@ -153,12 +203,79 @@ void CombinePass::createRenderers()
 	createInfo2.pipelineCreateInfo = pci;
 	combineRenderer_ = new FullscreenRenderer(createInfo2, logicDevice_, renderPass_, globalRenderData_, graphicsInfo_);
 
+	// The lists' capacity and the screen width, which finds a pixel's list, are shared by the particles and composite
+	const uint32_t nodeCapacity = OitCompositeRenderer::nodeCapacityFor(swapChainDetails_.extent);
+	uint32_t compositeConstants[4] = { accumulationIdx_, revealageIdx_, swapChainDetails_.extent.width, nodeCapacity };
+	entries.clear();
+	for (uint32_t i = 0; i < 4; ++i) {
+		entries.push_back(RendererBase::makeSpecConstantEntry(i, sizeof(uint32_t) * i, sizeof(uint32_t)));
+	}
+	VkSpecializationInfo compositeSpecConstants = RendererBase::setupSpecConstants(4, entries.data(), sizeof(uint32_t) * 4, compositeConstants);
+	std::vector<ShaderStageInfo> compositeStageInfos;
+	compositeStageInfos.emplace_back("FullscreenVert", VK_SHADER_STAGE_VERTEX_BIT, nullptr);
+	compositeStageInfos.emplace_back("ParticlesCompositeFrag", VK_SHADER_STAGE_FRAGMENT_BIT, &compositeSpecConstants);
+	VkPushConstantRange compositePushConstants = RendererBase::setupPushConstantRange(VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(OitCompositePushConstants), 0);
+
+	// The composite leaves the average colour premultiplied by its coverage and the transmittance in alpha, so the scene is scaled by alpha
+	PipelineCreateInfo compositePci = pci;
+	compositePci.debugName = "OitComposite";
+	compositePci.blendOps.srcColourFactor = VK_BLEND_FACTOR_ONE;
+	compositePci.blendOps.dstColourFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	compositePci.blendOps.srcAlphaFactor = VK_BLEND_FACTOR_ZERO;
+	compositePci.blendOps.dstAlphaFactor = VK_BLEND_FACTOR_ONE;
+	createInfo2.shaderStages = compositeStageInfos;
+	createInfo2.pipelineCreateInfo = compositePci;
+	createInfo2.pcRangesCount = 1;
+	createInfo2.pcRanges = &compositePushConstants;
+	oitCompositeRenderer_ = new OitCompositeRenderer(createInfo2, logicDevice_, compositePass_, globalRenderData_, graphicsInfo_, swapChainDetails_.extent);
+
+	VkPushConstantRange particlePushConstants[2] = {
+		RendererBase::setupPushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(VertexPushConstants), 0),
+		RendererBase::setupPushConstantRange(kParticlePushConstantStages, sizeof(ParticlePushConstants), sizeof(VertexPushConstants))
+	};
+	static_assert(sizeof(VertexPushConstants) + sizeof(ParticlePushConstants) <= kMaxPushConstantSize, "Particle push constants exceed the guaranteed size");
+
+	uint32_t particleOffsets[2] = { graphicsInfo_->mvpOffsetSizes[(size_t)RendererTypes::kParticle], graphicsInfo_->paramsOffsetSizes[(size_t)RendererTypes::kParticle] };
+	uint32_t particleFragConstants[4] = { graphicsInfo_->paramsOffsetSizes[(size_t)RendererTypes::kParticle], graphicsInfo_->materialOffsetSizes[(size_t)RendererTypes::kParticle],
+		swapChainDetails_.extent.width, nodeCapacity };
+	VkSpecializationInfo particleVertSpecConstants = RendererBase::setupSpecConstants(2, entries.data(), sizeof(uint32_t) * 2, particleOffsets);
+	VkSpecializationInfo particleFragSpecConstants = RendererBase::setupSpecConstants(4, entries.data(), sizeof(uint32_t) * 4, particleFragConstants);
+	std::vector<ShaderStageInfo> particleStageInfos;
+	particleStageInfos.emplace_back("ParticlesVert", VK_SHADER_STAGE_VERTEX_BIT, &particleVertSpecConstants);
+	particleStageInfos.emplace_back("ParticlesFrag", VK_SHADER_STAGE_FRAGMENT_BIT, &particleFragSpecConstants);
+
+	// Tested against the deferred depth but never written, so blended systems behind one another still show. Colour and weight
+	// are summed in the accumulation target and the revealage is multiplied by each fragment's transmittance.
+	pci.debugName = "Particle";
+	pci.enableDepthTest = VK_TRUE;
+	pci.enableDepthWrite = VK_FALSE;
+	pci.cullFace = VK_CULL_MODE_NONE;
+	pci.colourAttachmentCount = 2;
+	pci.attachmentBlendOps.resize(2);
+	pci.attachmentBlendOps[0].srcColourFactor = VK_BLEND_FACTOR_ONE;
+	pci.attachmentBlendOps[0].dstColourFactor = VK_BLEND_FACTOR_ONE;
+	pci.attachmentBlendOps[0].srcAlphaFactor = VK_BLEND_FACTOR_ONE;
+	pci.attachmentBlendOps[0].dstAlphaFactor = VK_BLEND_FACTOR_ONE;
+	pci.attachmentBlendOps[1].srcColourFactor = VK_BLEND_FACTOR_ZERO;
+	pci.attachmentBlendOps[1].dstColourFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR;
+	pci.attachmentBlendOps[1].srcAlphaFactor = VK_BLEND_FACTOR_ZERO;
+	pci.attachmentBlendOps[1].dstAlphaFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	createInfo2.shaderStages = particleStageInfos;
+	createInfo2.pipelineCreateInfo = pci;
+	createInfo2.pcRangesCount = 2;
+	createInfo2.pcRanges = particlePushConstants;
+	particleRenderer_ = new ParticleRenderer(createInfo2, logicDevice_, oitPass_, globalRenderData_, graphicsInfo_, oitCompositeRenderer_);
+	particleRenderer_->setOitMode(oitMode_);
+
 	graphicsMaster_->setRenderer(RendererTypes::kAtmosphere, atmosphereRenderer_);
+	graphicsMaster_->setRenderer(RendererTypes::kParticle, particleRenderer_);
 }
 
 void CombinePass::initRenderPassDependency(std::vector<Image*> dependencyAttachment)
 {
-	ASSERT(dependencyAttachment.size() == 4);
+	ASSERT(dependencyAttachment.size() == 5);
+	createPass();
+	createOitPasses(dependencyAttachment[4]);
 	diffuseIdx_ = graphicsMaster_->getMasters().textureManager->allocateTexture("DiffuseSampler", dependencyAttachment[0],
 		{ VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, 1.0f, VK_SHADER_STAGE_FRAGMENT_BIT, VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE });
 	specularIdx_ = graphicsMaster_->getMasters().textureManager->allocateTexture("SpecularSampler", dependencyAttachment[1],
@@ -167,13 +284,123 @@ void CombinePass::initRenderPassDependency(std::vector<Image*> dependencyAttachm
 		{ VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, 1.0f, VK_SHADER_STAGE_FRAGMENT_BIT, VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE });
 	ambientIdx_ = graphicsMaster_->getMasters().textureManager->allocateTexture("AmbientSampler", dependencyAttachment[3],
 		{ VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, 1.0f, VK_SHADER_STAGE_FRAGMENT_BIT, VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE });
+	// Read a texel per pixel, so never filtered
+	accumulationIdx_ = graphicsMaster_->getMasters().textureManager->allocateTexture("OitAccumulationSampler", accumulationBuffer_,
+		{ VK_FILTER_NEAREST, VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, 1.0f, VK_SHADER_STAGE_FRAGMENT_BIT, VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE });
+	revealageIdx_ = graphicsMaster_->getMasters().textureManager->allocateTexture("OitRevealageSampler", revealageBuffer_,
+		{ VK_FILTER_NEAREST, VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, 1.0f, VK_SHADER_STAGE_FRAGMENT_BIT, VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE });
 	createRenderers();
 }
 
+void CombinePass::createPass()
+{
+	CreateInfo createInfo = {};
+	createInfo.attachments.push_back(makeAttachment(swapChainDetails_.surfaceFormat.format, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE,
+		VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+
+	std::vector<VkAttachmentReference> colourAttachmentRefs;
+	VkAttachmentReference colourRef = {};
+	colourRef.attachment = 0;
+	colourRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colourAttachmentRefs.push_back(colourRef);
+
+	createInfo.subpasses.push_back(makeSubpass(VK_PIPELINE_BIND_POINT_GRAPHICS, colourAttachmentRefs, nullptr));
+	
+	createInfo.dependencies.push_back(makeSubpassDependency(
+		VK_SUBPASS_EXTERNAL,
+		0,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT)
+	);
+	createInfo.dependencies.push_back(makeSubpassDependency(
+		0, 
+		VK_SUBPASS_EXTERNAL,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT));
+
+	std::vector<VkImageView> attachmentImages = { colourBuffer_->getImageView() };
+	createRenderPass(createInfo, attachmentImages);
+}
+
+void CombinePass::createOitPasses(Image* depthBuffer)
+{
+	CreateInfo createInfo = {};
+	// Accumulation and revealage, and the deferred depth which forward drawn particles are tested against but never write
+	createInfo.attachments.push_back(makeAttachment(kAccumulationFormat, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE,
+		VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+	createInfo.attachments.push_back(makeAttachment(kRevealageFormat, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE,
+		VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+	createInfo.attachments.push_back(makeAttachment(swapChainDetails_.depthFormat, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_LOAD, VK_ATTACHMENT_STORE_OP_STORE,
+		VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+
+	std::vector<VkAttachmentReference> colourAttachmentRefs;
+	VkAttachmentReference colourRef = {};
+	colourRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colourRef.attachment = 0;
+	colourAttachmentRefs.push_back(colourRef);
+	colourRef.attachment = 1;
+	colourAttachmentRefs.push_back(colourRef);
+	VkAttachmentReference depthRef = {};
+	depthRef.attachment = 2;
+	depthRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+	createInfo.subpasses.push_back(makeSubpass(VK_PIPELINE_BIND_POINT_GRAPHICS, colourAttachmentRefs, &depthRef));
+
+	createInfo.dependencies.push_back(makeSubpassDependency(
+		VK_SUBPASS_EXTERNAL,
+		0,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT)
+	);
+	// The composite reads the targets, and in linked list mode the lists the particles appended to
+	createInfo.dependencies.push_back(makeSubpassDependency(
+		0,
+		VK_SUBPASS_EXTERNAL,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT));
+
+	std::vector<VkImageView> attachmentImages = { accumulationBuffer_->getImageView(), revealageBuffer_->getImageView(), depthBuffer->getImageView() };
+	createRenderPass(createInfo, attachmentImages, { 0, 0 }, &oitPass_, oitFramebuffers_);
+
+	// The lit scene is loaded and the particles blended over it
+	CreateInfo compositeCreateInfo = {};
+	compositeCreateInfo.attachments.push_back(makeAttachment(swapChainDetails_.surfaceFormat.format, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_LOAD, VK_ATTACHMENT_STORE_OP_STORE,
+		VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+
+	colourAttachmentRefs.resize(1);
+	colourAttachmentRefs[0].attachment = 0;
+	compositeCreateInfo.subpasses.push_back(makeSubpass(VK_PIPELINE_BIND_POINT_GRAPHICS, colourAttachmentRefs, nullptr));
+
+	compositeCreateInfo.dependencies.push_back(makeSubpassDependency(
+		VK_SUBPASS_EXTERNAL,
+		0,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT)
+	);
+	compositeCreateInfo.dependencies.push_back(makeSubpassDependency(
+		0,
+		VK_SUBPASS_EXTERNAL,
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT));
+
+	std::vector<VkImageView> compositeAttachmentImages = { colourBuffer_->getImageView() };
+	createRenderPass(compositeCreateInfo, compositeAttachmentImages, { 0, 0 }, &compositePass_, compositeFramebuffers_);
+}
+
 void CombinePass::createColourBuffer(LogicDevice* logicDevice, const SwapChainDetails& swapChainDetails)
 {
 	colourBuffer_ = new Image(logicDevice, Image::makeCreateInfo(VK_IMAGE_TYPE_2D, 1, 1, swapChainDetails.surfaceFormat.format, VK_IMAGE_TILING_OPTIMAL,
 		VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_SAMPLE_COUNT_1_BIT, swapChainDetails.extent.width, swapChainDetails.extent.height, 1),
 		MemoryAllocationPattern::kRenderTarget, { VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL }, "GeometryColourBuffer");
 	colourBuffer_->getImageInfo().imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	accumulationBuffer_ = new Image(logicDevice, Image::makeCreateInfo(VK_IMAGE_TYPE_2D, 1, 1, kAccumulationFormat, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_SAMPLE_COUNT_1_BIT, swapChainDetails.extent.width, swapChainDetails.extent.height, 1),
+		MemoryAllocationPattern::kRenderTarget, { VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL }, "OitAccumulationBuffer");
+	accumulationBuffer_->getImageInfo().imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	revealageBuffer_ = new Image(logicDevice, Image::makeCreateInfo(VK_IMAGE_TYPE_2D, 1, 1, kRevealageFormat, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_SAMPLE_COUNT_1_BIT, swapChainDetails.extent.width, swapChainDetails.extent.height, 1),
+		MemoryAllocationPattern::kRenderTarget, { VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL }, "OitRevealageBuffer");
+	revealageBuffer_->getImageInfo().imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 }
@@ -2,10 +2,13 @@
 // Date: 01/11/19
 #pragma once
 #include "RenderPass.h"
+#include "OitCompositeRenderer.h"
 
 namespace QZL {
+	struct InputProfile;
 	namespace Graphics {
 		class RendererBase;
+		class ParticleRenderer;
 		class CombinePass : public RenderPass {
 			friend class SwapChain;
 		protected:
@@ -16,16 +19,37 @@ namespace QZL {
 			void initRenderPassDependency(std::vector<Image*> dependencyAttachment) override;
 		private:
 			void createColourBuffer(LogicDevice* logicDevice, const SwapChainDetails& swapChainDetails);
+			void createPass();
+			// Particles are drawn in their own pass to the accumulation and revealage targets, then a second composites them over the colour.
+			// Made once the deferred depth buffer is known, which particles are tested against.
+			void createOitPasses(Image* depthBuffer);
 
 			RendererBase* atmosphereRenderer_;
 			RendererBase* environmentRenderer_;
 			RendererBase* combineRenderer_;
+			ParticleRenderer* particleRenderer_;
+			OitCompositeRenderer* oitCompositeRenderer_;
+
+			VkRenderPass oitPass_;
+			VkRenderPass compositePass_;
+			std::vector<VkFramebuffer> oitFramebuffers_;
+			std::vector<VkFramebuffer> compositeFramebuffers_;
 
 			Image* colourBuffer_;
+			Image* accumulationBuffer_;
+			Image* revealageBuffer_;
+			uint32_t accumulationIdx_;
+			uint32_t revealageIdx_;
 			uint32_t diffuseIdx_;
 			uint32_t specularIdx_;
 			uint32_t albedoIdx_;
 			uint32_t ambientIdx_;
+
+			InputProfile* input_;
+			OitMode oitMode_;
+
+			static constexpr VkFormat kAccumulationFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+			static constexpr VkFormat kRevealageFormat = VK_FORMAT_R16_SFLOAT;
 		};
 	}
 }
@@ -54,6 +54,12 @@ const VkDescriptorSet Descriptor::getSet(size_t idx)
 	return sets_[idx];
 }
 
+void Descriptor::reset()
+{
+	CHECK_VKRESULT(vkResetDescriptorPool(*logicDevice_, pool_, 0));
+	sets_.clear();
+}
+
 VkDescriptorSetLayout Descriptor::makeLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings, const void* pNext)
 {
 	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
@@ -16,6 +16,8 @@ namespace QZL
 			// Increment the index returned appropriately to match a set.
 			size_t createSets(const std::vector<VkDescriptorSetLayout>& layouts);
 			const VkDescriptorSet getSet(size_t idx);
+			// Free every set made from the pool, none may still be in use by the gpu
+			void reset();
 
 			VkDescriptorSetLayout makeLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings, const void* pNext = nullptr);
 			void updateDescriptorSets(const std::vector<VkWriteDescriptorSet>& descriptorWrites);
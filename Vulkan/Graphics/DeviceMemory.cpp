@@ -21,11 +21,17 @@ private:
 	void deleteAllocation(AllocationID id, VkImage image);
 	void* mapMemory(const AllocationID& id);
 	void unmapMemory(const AllocationID& id);
+	void invalidateMemory(const AllocationID& id, VkDeviceSize offset, VkDeviceSize size);
 	void transferMemory(const VkBuffer& srcBuffer, const VkBuffer& dstBuffer, VkDeviceSize srcOffset, VkDeviceSize dstOffset, VkDeviceSize size);
+	void transferMemory(const VkBuffer& srcBuffer, const VkBuffer& dstBuffer, VkBufferCopy* copyRanges, uint32_t count);
 	void transferMemory(const VkBuffer& srcBuffer, const VkImage& dstImage, VkDeviceSize srcOffset, uint32_t width, uint32_t height, VkShaderStageFlags stages, Image* image);
 	void transferMemory(const VkBuffer& srcBuffer, const VkImage& dstImage, VkBufferImageCopy* copyRanges, uint32_t count);
 	void changeImageLayout(VkImageMemoryBarrier barrier, VkPipelineStageFlags oldStage, VkPipelineStageFlags newStage, VkCommandBuffer& cmdBuffer);
 	void changeImageLayout(VkImageMemoryBarrier barrier, VkPipelineStageFlags oldStage, VkPipelineStageFlags newStage);
+	void submitImmediate(const std::function<void(VkCommandBuffer)>& record);
+	void setMovable(const AllocationID& id, RelocationCallback callback);
+	bool defragment(uint32_t maxMoves, VkDeviceSize maxBytes);
+	float calculateFragmentation();
 
 	Impl(PhysicalDevice* physicalDevice, LogicDevice* logicDevice, VkCommandBuffer transferCmdBuffer, VkQueue queue);
 	~Impl();
@@ -38,9 +44,19 @@ private:
 	void selectImageLayoutInfo(const VkImage& image, const VkImageLayout oldLayout, const VkImageLayout newLayout, const VkFormat& format, uint32_t mipLevels,
 		VkPipelineStageFlags& oldStage, VkPipelineStageFlags& newStage, VkImageMemoryBarrier& barrier);
 
+	// Buffers must be recreated with the same parameters when their allocation is moved
+	struct BufferInfo {
+		VkBufferCreateInfo createInfo;
+		std::string debugName;
+		MemoryAllocationDetails details;
+	};
+
 	VmaAllocator allocator_;
 	AllocationID availableId_; // 0 reserved for invalid id
 	std::map<AllocationID, VmaAllocation> allocations_;
+	std::map<AllocationID, BufferInfo> bufferInfos_;
+	std::map<AllocationID, RelocationCallback> movableBuffers_;
+	DefragmentationStats defragStats_;
 	VkQueue queue_;
 	VkCommandBuffer transferCmdBuffer_;
 	LogicDevice* logicDevice_;
@@ -88,6 +104,10 @@ const MemoryAllocationDetails DeviceMemory::Impl::createBuffer(std::string debug
 	vmaGetMemoryTypeProperties(allocator_, allocInfo.memoryType, &memFlags);
 
 	fixAccessType(allocationDetails.access, allocInfo, memFlags);
+	if (allocationDetails.access == MemoryAccessType::kPersistant)
+		allocationDetails.mappedData = allocInfo.pMappedData;
+
+	bufferInfos_[allocationDetails.id] = { bufferCreateInfo, debugName, allocationDetails };
 
 	return allocationDetails;
 }
@@ -119,6 +139,8 @@ void DeviceMemory::Impl::deleteAllocation(AllocationID id, VkBuffer buffer)
 {
 	vmaDestroyBuffer(allocator_, buffer, allocations_[id]);
 	allocations_.erase(id);
+	bufferInfos_.erase(id);
+	movableBuffers_.erase(id);
 }
 
 void DeviceMemory::Impl::deleteAllocation(AllocationID id, VkImage image)
@@ -139,6 +161,11 @@ void DeviceMemory::Impl::unmapMemory(const AllocationID& id)
 	vmaUnmapMemory(allocator_, allocations_[id]);
 }
 
+void DeviceMemory::Impl::invalidateMemory(const AllocationID& id, VkDeviceSize offset, VkDeviceSize size)
+{
+	vmaInvalidateAllocation(allocator_, allocations_[id], offset, size);
+}
+
 void DeviceMemory::Impl::transferMemory(const VkBuffer& srcBuffer, const VkBuffer& dstBuffer, VkDeviceSize srcOffset, VkDeviceSize dstOffset, VkDeviceSize size)
 {
 	VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
@@ -157,6 +184,23 @@ void DeviceMemory::Impl::transferMemory(const VkBuffer& srcBuffer, const VkBuffe
 	vkQueueWaitIdle(queue_);
 }
 
+void DeviceMemory::Impl::transferMemory(const VkBuffer& srcBuffer, const VkBuffer& dstBuffer, VkBufferCopy* copyRanges, uint32_t count)
+{
+	VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(transferCmdBuffer_, &beginInfo);
+
+	vkCmdCopyBuffer(transferCmdBuffer_, srcBuffer, dstBuffer, count, copyRanges);
+
+	vkEndCommandBuffer(transferCmdBuffer_);
+	VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &transferCmdBuffer_;
+
+	vkQueueSubmit(queue_, 1, &submitInfo, VK_NULL_HANDLE);
+	vkQueueWaitIdle(queue_);
+}
+
 void DeviceMemory::Impl::transferMemory(const VkBuffer& srcBuffer, const VkImage& dstImage, VkDeviceSize srcOffset, uint32_t width, uint32_t height, VkShaderStageFlags stages, Image* image)
 {
 	VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
@@ -176,8 +220,6 @@ void DeviceMemory::Impl::transferMemory(const VkBuffer& srcBuffer, const VkImage
 
 	vkCmdCopyBufferToImage(transferCmdBuffer_, srcBuffer, dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
 
-	//if (image != nullptr) image->generateMipmaps(transferCmdBuffer_, stages);
-
 	vkEndCommandBuffer(transferCmdBuffer_);
 	VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
 	submitInfo.commandBufferCount = 1;
@@ -226,11 +268,162 @@ void DeviceMemory::Impl::changeImageLayout(VkImageMemoryBarrier barrier, VkPipel
 	vkQueueWaitIdle(queue_);
 }
 
+void DeviceMemory::Impl::submitImmediate(const std::function<void(VkCommandBuffer)>& record)
+{
+	VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(transferCmdBuffer_, &beginInfo);
+
+	record(transferCmdBuffer_);
+
+	vkEndCommandBuffer(transferCmdBuffer_);
+
+	VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &transferCmdBuffer_;
+
+	vkQueueSubmit(queue_, 1, &submitInfo, VK_NULL_HANDLE);
+	vkQueueWaitIdle(queue_);
+}
+
+void DeviceMemory::Impl::setMovable(const AllocationID& id, RelocationCallback callback)
+{
+	auto it = bufferInfos_.find(id);
+	ASSERT(it != bufferInfos_.end());
+	// Moving a persistently mapped allocation would invalidate the mapped pointer held by the owner
+	if (it->second.details.access == MemoryAccessType::kPersistant) {
+		return;
+	}
+	movableBuffers_[id] = callback;
+}
+
+bool DeviceMemory::Impl::defragment(uint32_t maxMoves, VkDeviceSize maxBytes)
+{
+	if (movableBuffers_.empty() || maxMoves == 0) {
+		return false;
+	}
+
+	std::vector<AllocationID> ids;
+	std::vector<VmaAllocation> allocations;
+	ids.reserve(movableBuffers_.size());
+	allocations.reserve(movableBuffers_.size());
+	for (auto& movable : movableBuffers_) {
+		ids.push_back(movable.first);
+		allocations.push_back(allocations_[movable.first]);
+	}
+	std::vector<VkBool32> changed(allocations.size(), VK_FALSE);
+
+	VkCommandBufferBeginInfo beginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(transferCmdBuffer_, &beginInfo);
+
+	// Host visible memory is moved by VMA on the CPU, device local memory is moved by copies recorded in to the command buffer
+	VmaDefragmentationInfo2 defragInfo = {};
+	defragInfo.allocationCount = static_cast<uint32_t>(allocations.size());
+	defragInfo.pAllocations = allocations.data();
+	defragInfo.pAllocationsChanged = changed.data();
+	defragInfo.maxCpuBytesToMove = maxBytes;
+	defragInfo.maxCpuAllocationsToMove = maxMoves;
+	defragInfo.maxGpuBytesToMove = maxBytes;
+	defragInfo.maxGpuAllocationsToMove = maxMoves;
+	defragInfo.commandBuffer = transferCmdBuffer_;
+
+	VmaDefragmentationStats vmaStats = {};
+	VmaDefragmentationContext context = VK_NULL_HANDLE;
+	VkResult result = vmaDefragmentationBegin(allocator_, &defragInfo, &vmaStats, &context);
+
+	vkEndCommandBuffer(transferCmdBuffer_);
+	VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &transferCmdBuffer_;
+
+	vkQueueSubmit(queue_, 1, &submitInfo, VK_NULL_HANDLE);
+	vkQueueWaitIdle(queue_);
+
+	// Negative results are errors, VK_NOT_READY only means the copies had to be submitted before ending
+	ASSERT(result >= 0);
+	CHECK_VKRESULT(vmaDefragmentationEnd(allocator_, context));
+
+	bool anyMoved = false;
+	for (size_t i = 0; i < ids.size(); ++i) {
+		if (changed[i] == VK_FALSE) {
+			continue;
+		}
+		// The data is already in its new place, only the buffer needs to be recreated and bound to it
+		BufferInfo& info = bufferInfos_[ids[i]];
+		vkDestroyBuffer(*logicDevice_, info.details.buffer, nullptr);
+		CHECK_VKRESULT(vkCreateBuffer(*logicDevice_, &info.createInfo, nullptr, &info.details.buffer));
+		CHECK_VKRESULT(vmaBindBufferMemory(allocator_, allocations[i], info.details.buffer));
+		Validation::addDebugName(logicDevice_, VK_OBJECT_TYPE_BUFFER, (uint64_t)info.details.buffer, info.debugName);
+
+		movableBuffers_[ids[i]](info.details);
+		anyMoved = true;
+	}
+
+	defragStats_.bytesMoved += vmaStats.bytesMoved;
+	defragStats_.bytesFreed += vmaStats.bytesFreed;
+	defragStats_.allocationsMoved += vmaStats.allocationsMoved;
+	defragStats_.blocksFreed += vmaStats.deviceMemoryBlocksFreed;
+	defragStats_.passes++;
+	defragStats_.fragmentation = calculateFragmentation();
+	if (anyMoved) {
+		DEBUG_LOG("Defragmentation moved " << vmaStats.allocationsMoved << " allocations (" << vmaStats.bytesMoved << " bytes), freed " 
+			<< vmaStats.bytesFreed << " bytes. Fragmentation now " << defragStats_.fragmentation);
+	}
+	return anyMoved;
+}
+
+float DeviceMemory::Impl::calculateFragmentation()
+{
+	struct Range {
+		VkDeviceSize begin;
+		VkDeviceSize end;
+		bool movable;
+	};
+	std::map<VkDeviceMemory, std::vector<Range>> blocks;
+	for (auto& allocation : allocations_) {
+		VmaAllocationInfo info;
+		vmaGetAllocationInfo(allocator_, allocation.second, &info);
+		blocks[info.deviceMemory].push_back({ info.offset, info.offset + info.size, movableBuffers_.count(allocation.first) != 0 });
+	}
+
+	// Defragmentation can only close the free ranges between movable buffers, so the rest of each block, and the blocks holding
+	// only images or mapped buffers, are left out rather than keeping the measure above the threshold with space it cannot reclaim
+	VkDeviceSize unusedBytes = 0;
+	VkDeviceSize unusedRangeSizeMax = 0;
+	for (auto& block : blocks) {
+		std::vector<Range>& ranges = block.second;
+		std::sort(ranges.begin(), ranges.end(), [](const Range& a, const Range& b) { return a.begin < b.begin; });
+		size_t first = ranges.size(), last = 0;
+		for (size_t i = 0; i < ranges.size(); ++i) {
+			if (ranges[i].movable) {
+				first = std::min(first, i);
+				last = i;
+			}
+		}
+		if (first == ranges.size()) {
+			continue;
+		}
+		VkDeviceSize end = ranges[first].end;
+		for (size_t i = first + 1; i <= last; ++i) {
+			if (ranges[i].begin > end) {
+				unusedBytes += ranges[i].begin - end;
+				unusedRangeSizeMax = std::max(unusedRangeSizeMax, ranges[i].begin - end);
+			}
+			end = std::max(end, ranges[i].end);
+		}
+	}
+	if (unusedBytes == 0) {
+		return 0.0f;
+	}
+	return 1.0f - static_cast<float>(unusedRangeSizeMax) / static_cast<float>(unusedBytes);
+}
+
 void DeviceMemory::Impl::fixAccessType(MemoryAccessType& access, VmaAllocationInfo allocInfo, VkMemoryPropertyFlags memFlags)
 {
 	switch (access) {
 	case MemoryAccessType::kPersistant:
-		if (allocInfo.pUserData == nullptr)
+		if (allocInfo.pMappedData == nullptr)
 			access = MemoryAccessType::kTransfer;
 		break;
 	case MemoryAccessType::kDirect:
@@ -398,10 +591,18 @@ void DeviceMemory::unmapMemory(const AllocationID& id)
 {
 	pImpl_->unmapMemory(id);
 }
+void DeviceMemory::invalidateMemory(const AllocationID& id, VkDeviceSize offset, VkDeviceSize size)
+{
+	pImpl_->invalidateMemory(id, offset, size);
+}
 void DeviceMemory::transferMemory(const VkBuffer& srcBuffer, const VkBuffer& dstBuffer, VkDeviceSize srcOffset, VkDeviceSize dstOffset, VkDeviceSize size)
 {
 	pImpl_->transferMemory(srcBuffer, dstBuffer, srcOffset, dstOffset, size);
 }
+void DeviceMemory::transferMemory(const VkBuffer& srcBuffer, const VkBuffer& dstBuffer, VkBufferCopy* copyRanges, uint32_t count)
+{
+	pImpl_->transferMemory(srcBuffer, dstBuffer, copyRanges, count);
+}
 void DeviceMemory::transferMemory(const VkBuffer& srcBuffer, const VkImage& dstImage, VkDeviceSize srcOffset, uint32_t width, uint32_t height, VkShaderStageFlags stages, Image* image)
 {
 	pImpl_->transferMemory(srcBuffer, dstImage, srcOffset, width, height, stages, image);
@@ -418,3 +619,23 @@ void DeviceMemory::changeImageLayout(VkImageMemoryBarrier barrier, VkPipelineSta
 {
 	pImpl_->changeImageLayout(barrier, oldStage, newStage);
 }
+void DeviceMemory::submitImmediate(const std::function<void(VkCommandBuffer)>& record)
+{
+	pImpl_->submitImmediate(record);
+}
+void DeviceMemory::setMovable(const AllocationID& id, RelocationCallback callback)
+{
+	pImpl_->setMovable(id, callback);
+}
+bool DeviceMemory::defragment(uint32_t maxMoves, VkDeviceSize maxBytes)
+{
+	return pImpl_->defragment(maxMoves, maxBytes);
+}
+float DeviceMemory::calculateFragmentation()
+{
+	return pImpl_->calculateFragmentation();
+}
+const DefragmentationStats& DeviceMemory::getDefragmentationStats()
+{
+	return pImpl_->defragStats_;
+}
@@ -24,12 +24,27 @@ namespace QZL
 			void deleteAllocation(AllocationID id, VkImage image);
 			void* mapMemory(const AllocationID& id);
 			void unmapMemory(const AllocationID& id);
+			// Make GPU writes visible to the host, needed before reading mapped memory which may not be host coherent
+			void invalidateMemory(const AllocationID& id, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
 			void transferMemory(const VkBuffer& srcBuffer, const VkBuffer& dstBuffer, VkDeviceSize srcOffset, VkDeviceSize dstOffset, VkDeviceSize size);
+			void transferMemory(const VkBuffer& srcBuffer, const VkBuffer& dstBuffer, VkBufferCopy* copyRanges, uint32_t count);
 			void transferMemory(const VkBuffer& srcBuffer, const VkImage& dstImage, VkDeviceSize srcOffset, uint32_t width, uint32_t height, 
 				VkShaderStageFlags stages = VK_SHADER_STAGE_FRAGMENT_BIT, Image* image = nullptr);
 			void transferMemory(const VkBuffer& srcBuffer, const VkImage& dstImage, VkBufferImageCopy* copyRanges, uint32_t count);
 			void changeImageLayout(VkImageMemoryBarrier barrier, VkPipelineStageFlags oldStage, VkPipelineStageFlags newStage, VkCommandBuffer& cmdBuffer);
 			void changeImageLayout(VkImageMemoryBarrier barrier, VkPipelineStageFlags oldStage, VkPipelineStageFlags newStage);
+			// Record in to the transfer command buffer, submit it and wait for the queue to finish
+			void submitImmediate(const std::function<void(VkCommandBuffer)>& record);
+
+			// Allow defragmentation to move the buffer allocation, the callback is given the new details after each move.
+			// Images and persistently mapped buffers are never moved.
+			void setMovable(const AllocationID& id, RelocationCallback callback);
+			// Move at most maxMoves movable allocations, copying at most maxBytes. None of the movable buffers may be in use 
+			// by the GPU when this is called. Returns true if any allocation was moved.
+			bool defragment(uint32_t maxMoves, VkDeviceSize maxBytes);
+			// Portion of the free memory between movable buffers which is not part of the largest free range
+			float calculateFragmentation();
+			const DefragmentationStats& getDefragmentationStats();
 
 		private:
 			DeviceMemory(PhysicalDevice* physicalDevice, LogicDevice* logicDevice, VkCommandBuffer transferCmdBuffer, VkQueue queue);
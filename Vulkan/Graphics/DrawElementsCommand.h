@@ -1,11 +1,14 @@
 // Author: Ralph Ridley
 // Date: 01/11/19
 #pragma once
-#include "../../Shared/Utility.h"
+#include "VkUtil.h"
 
 namespace QZL
 {
 	namespace Graphics {
+		struct BasicMesh;
+		class TerrainQuadtree;
+
 		struct DrawElementsCommand {
 			uint32_t count;
 			uint32_t instanceCount;
@@ -17,5 +20,20 @@ namespace QZL
 			{
 			}
 		};
+
+		// An indexed draw and the index type of the mesh it draws, so meshes with 16 and 32 bit indices can share a command list
+		struct IndexedDrawCommand {
+			VkDrawIndexedIndirectCommand draw;
+			VkIndexType indexType;
+			// Set when the whole mesh is drawn and has clusters, the cluster culler then replaces the draw with one indirect draw per cluster
+			// starting at firstClusterDraw. Cleared by the culler if it can not cull the mesh, leaving the plain draw.
+			const BasicMesh* clusterMesh = nullptr;
+			uint32_t firstClusterDraw = 0;
+			// Set for terrain draws, the terrain node selector replaces the draw with an instanced draw of each camera's quadtree nodes
+			TerrainQuadtree* terrain = nullptr;
+			uint32_t terrainDraw = 0;
+			// Set for gpu simulated particle systems, whose particles and draw arguments the particle simulator writes for this emitter
+			uint32_t particleEmitter = ~0u;
+		};
 	}
 }
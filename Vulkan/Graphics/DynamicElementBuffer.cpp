@@ -6,45 +6,151 @@
 using namespace QZL;
 using namespace QZL::Graphics;
 
-DynamicElementBuffer::DynamicElementBuffer(DeviceMemory* deviceMemory, size_t swapChainImageCount, size_t sizeOfVertices, size_t sizeOfIndices)
-	: ElementBufferObject(deviceMemory, sizeOfVertices, sizeOfIndices), swapChainImageCount_(swapChainImageCount)
+DynamicElementBuffer::DynamicElementBuffer(DeviceMemory* deviceMemory, uint32_t frameCount, size_t sizeOfVertices, size_t sizeOfIndices)
+	: ElementBufferObject(deviceMemory, sizeOfVertices, sizeOfIndices), frameCount_(frameCount), vertexUsage_(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT), vertexRegionSize_(0), indexRegionSize_(0),
+	  vertexDirty_(frameCount), indexDirty_(frameCount)
 {
+	ASSERT(frameCount_ > 0);
 	isDynamic_ = true;
 }
 
+DynamicElementBuffer::~DynamicElementBuffer()
+{
+	if (vertexBufferDetails_.buffer != VK_NULL_HANDLE) {
+		deviceMemory_->deleteAllocation(vertexBufferDetails_.id, vertexBufferDetails_.buffer);
+	}
+	if (indexBufferDetails_.buffer != VK_NULL_HANDLE) {
+		deviceMemory_->deleteAllocation(indexBufferDetails_.id, indexBufferDetails_.buffer);
+	}
+	// Already cleaned up, stop the base class from deleting the buffers again
+	isCommitted_ = false;
+}
+
 void DynamicElementBuffer::commit()
 {
-	vertexBufferDetails_ = deviceMemory_->createBuffer("DynamicEBO VertexBuffer", MemoryAllocationPattern::kDynamicResource, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexData_.size() * swapChainImageCount_);
+	if (isCommitted_) {
+		return;
+	}
 	isCommitted_ = true;
+	// Every region starts as a full copy, after which only dirty ranges are copied
+	vertexRegionSize_ = vertexData_.size();
+	if (vertexRegionSize_ > 0) {
+		vertexBufferDetails_ = deviceMemory_->createBuffer("DynamicEBO VertexBuffer", MemoryAllocationPattern::kDynamicResource, vertexUsage_,
+			vertexRegionSize_ * frameCount_, MemoryAccessType::kPersistant);
+		ASSERT(vertexBufferDetails_.mappedData != nullptr);
+		for (uint32_t i = 0; i < frameCount_; ++i) {
+			memcpy(static_cast<char*>(vertexBufferDetails_.mappedData) + vertexRegionSize_ * i, vertexData_.data(), vertexRegionSize_);
+		}
+	}
+	// Regions are bound at an offset so each must start aligned to the index size
+	indexRegionSize_ = isIndexed() ? ((indexData_.size() + sizeof(uint32_t) - 1) / sizeof(uint32_t)) * sizeof(uint32_t) : 0;
+	if (indexRegionSize_ > 0) {
+		indexBufferDetails_ = deviceMemory_->createBuffer("DynamicEBO IndexBuffer", MemoryAllocationPattern::kDynamicResource, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+			indexRegionSize_ * frameCount_, MemoryAccessType::kPersistant);
+		ASSERT(indexBufferDetails_.mappedData != nullptr);
+		for (uint32_t i = 0; i < frameCount_; ++i) {
+			memcpy(static_cast<char*>(indexBufferDetails_.mappedData) + indexRegionSize_ * i, indexData_.data(), indexData_.size());
+		}
+	}
+	for (uint32_t i = 0; i < frameCount_; ++i) {
+		vertexDirty_[i].clear();
+		indexDirty_[i].clear();
+	}
 }
 
 void DynamicElementBuffer::bind(VkCommandBuffer cmdBuffer, const size_t idx)
 {
-	VkDeviceSize offset = vertexData_.size() * idx;
-	vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &vertexBufferDetails_.buffer, &offset);
-	if (isIndexed()) {
-		vkCmdBindIndexBuffer(cmdBuffer, getIndexBuffer(), 0, indexType_);
+	ASSERT(isCommitted_ && vertexBufferDetails_.buffer != VK_NULL_HANDLE && idx < frameCount_);
+	VkDeviceSize vertexOffset = vertexRegionSize_ * idx;
+	vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &vertexBufferDetails_.buffer, &vertexOffset);
+	if (indexBufferDetails_.buffer != VK_NULL_HANDLE) {
+		vkCmdBindIndexBuffer(cmdBuffer, indexBufferDetails_.buffer, indexRegionSize_ * idx, indexType_);
 	}
 }
 
 void DynamicElementBuffer::updateBuffer(VkCommandBuffer& cmdBuffer, const uint32_t& idx)
 {
-	if (vertexBufferDetails_.mappedData != nullptr) {
-		memcpy(static_cast<char*>(vertexBufferDetails_.mappedData) + (idx * vertexData_.size()), vertexData_.data(), vertexData_.size());
+	ASSERT(isCommitted_ && idx < frameCount_);
+	if (vertexRegionSize_ > 0) {
+		flush(vertexDirty_[idx], vertexData_, static_cast<char*>(vertexBufferDetails_.mappedData) + vertexRegionSize_ * idx);
 	}
-	else {
-		char* dataPtr = static_cast<char*>(deviceMemory_->mapMemory(vertexBufferDetails_.id));
-		memcpy(dataPtr + (idx * vertexData_.size()), vertexData_.data(), vertexData_.size());
-		deviceMemory_->unmapMemory(vertexBufferDetails_.id);
+	if (indexRegionSize_ > 0) {
+		flush(indexDirty_[idx], indexData_, static_cast<char*>(indexBufferDetails_.mappedData) + indexRegionSize_ * idx);
 	}
 }
 
 SubBufferRange DynamicElementBuffer::allocateSubBufferRange(size_t count)
 {
-	return { addVertices(nullptr, count * sizeOfVertices_), count };
+	SubBufferRange range = { addVertices(nullptr, count * sizeOfVertices_), count };
+	subBufferCounts_[range.first] = count;
+	return range;
 }
 
 void* DynamicElementBuffer::getSubBufferData(size_t firstVertex)
 {
-	return &vertexData_[firstVertex];
+	auto subBuffer = subBufferCounts_.find(firstVertex);
+	markVerticesDirty(firstVertex, subBuffer != subBufferCounts_.end() ? subBuffer->second : vertexCount_ - firstVertex);
+	return getVertexData(firstVertex);
+}
+
+void DynamicElementBuffer::markVerticesDirty(size_t firstVertex, size_t count)
+{
+	EXPECTS(firstVertex + count <= vertexCount_);
+	markDirty(vertexDirty_, firstVertex * sizeOfVertices_, (firstVertex + count) * sizeOfVertices_);
+}
+
+void DynamicElementBuffer::markIndicesDirty(size_t firstIndex, size_t count)
+{
+	EXPECTS((firstIndex + count) * sizeOfIndices_ <= indexData_.size());
+	markDirty(indexDirty_, firstIndex * sizeOfIndices_, (firstIndex + count) * sizeOfIndices_);
+}
+
+void* DynamicElementBuffer::getMappedVertices(uint32_t frameIdx, size_t firstVertex)
+{
+	ASSERT(isCommitted_ && frameIdx < frameCount_ && vertexBufferDetails_.mappedData != nullptr);
+	return static_cast<char*>(vertexBufferDetails_.mappedData) + vertexRegionSize_ * frameIdx + firstVertex * sizeOfVertices_;
+}
+
+void DynamicElementBuffer::markDirty(std::vector<std::vector<DirtySpan>>& regions, size_t begin, size_t end)
+{
+	// Before commit every region is filled whole, so there is nothing to track
+	if (!isCommitted_ || begin == end) {
+		return;
+	}
+	for (auto& spans : regions) {
+		spans.push_back({ begin, end });
+		// Merged each time the count doubles past the limit, so repeated marks stay bounded without copying the gaps between spans
+		const size_t count = spans.size();
+		if (count >= kMaxDirtySpans && (count & (count - 1)) == 0) {
+			mergeSpans(spans);
+		}
+	}
+}
+
+void DynamicElementBuffer::flush(std::vector<DirtySpan>& spans, const std::vector<char>& data, char* region)
+{
+	mergeSpans(spans);
+	for (const auto& span : spans) {
+		memcpy(region + span.begin, data.data() + span.begin, span.end - span.begin);
+	}
+	spans.clear();
+}
+
+void DynamicElementBuffer::mergeSpans(std::vector<DirtySpan>& spans)
+{
+	if (spans.empty()) {
+		return;
+	}
+	std::sort(spans.begin(), spans.end(), [](const DirtySpan& a, const DirtySpan& b) { return a.begin < b.begin; });
+	size_t merged = 0;
+	for (size_t i = 1; i < spans.size(); ++i) {
+		// Only touching spans are merged, copying a gap could overwrite data written straight in to the region
+		if (spans[i].begin <= spans[merged].end) {
+			spans[merged].end = std::max(spans[merged].end, spans[i].end);
+		}
+		else {
+			spans[++merged] = spans[i];
+		}
+	}
+	spans.resize(merged + 1);
 }
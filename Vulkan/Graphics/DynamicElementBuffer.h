@@ -5,19 +5,62 @@
 
 namespace QZL {
 	namespace Graphics {
+		// Vertex and index data is kept on the cpu and mirrored in to a persistently mapped buffer with a region per frame index,
+		// so a frame never writes a region the gpu may still be reading. Writers mark the ranges they change and updateBuffer only
+		// copies the merged dirty ranges in to the region being recorded, each region catches up when its frame index comes round.
 		class DynamicElementBuffer : public ElementBufferObject {
 		public:
-			DynamicElementBuffer(DeviceMemory* deviceMemory, size_t swapChainImageCount, size_t sizeOfVertices, size_t sizeOfIndices = 0);
-			~DynamicElementBuffer() { }
+			DynamicElementBuffer(DeviceMemory* deviceMemory, uint32_t frameCount, size_t sizeOfVertices, size_t sizeOfIndices = 0);
+			~DynamicElementBuffer();
 
 			void commit() override;
 			void bind(VkCommandBuffer cmdBuffer, const size_t idx) override;
 			void updateBuffer(VkCommandBuffer& cmdBuffer, const uint32_t& idx) override;
 			SubBufferRange allocateSubBufferRange(size_t count) override;
+			// Marks the whole sub buffer starting at firstVertex as dirty, use markVerticesDirty when less of it changes
 			void* getSubBufferData(size_t firstVertex) override;
 
+			// The cpu copy of the vertices, changes must be marked dirty to reach the gpu
+			void* getVertexData(size_t firstVertex) {
+				return &vertexData_[firstVertex * sizeOfVertices_];
+			}
+			void markVerticesDirty(size_t firstVertex, size_t count);
+			void markIndicesDirty(size_t firstIndex, size_t count);
+			// Write straight in to one frame's region, skipping the cpu copy. Only that frame sees the data so it suits ranges rewritten
+			// every frame, which must not also be marked dirty or the stale cpu copy would overwrite them.
+			void* getMappedVertices(uint32_t frameIdx, size_t firstVertex);
+			// Usage the vertex buffer is created with besides being bound as vertices, must be given before commit
+			void addVertexUsage(VkBufferUsageFlags usage) {
+				EXPECTS(!isCommitted_);
+				vertexUsage_ |= usage;
+			}
+			// Bytes between the starts of consecutive frames' vertices, valid once committed
+			VkDeviceSize getVertexRegionSize() const {
+				return vertexRegionSize_;
+			}
+
 		private:
-			size_t swapChainImageCount_;
+			struct DirtySpan {
+				size_t begin;
+				size_t end;
+			};
+			void markDirty(std::vector<std::vector<DirtySpan>>& regions, size_t begin, size_t end);
+			// Copy the region's merged dirty spans from the cpu data in to the mapped region and clear them
+			void flush(std::vector<DirtySpan>& spans, const std::vector<char>& data, char* region);
+			// Sort the spans and merge those that overlap or touch, spans with a gap between them are kept apart
+			void mergeSpans(std::vector<DirtySpan>& spans);
+
+			const uint32_t frameCount_;
+			VkBufferUsageFlags vertexUsage_;
+			VkDeviceSize vertexRegionSize_;
+			VkDeviceSize indexRegionSize_;
+			// Dirty spans in bytes, one list per frame region
+			std::vector<std::vector<DirtySpan>> vertexDirty_;
+			std::vector<std::vector<DirtySpan>> indexDirty_;
+			std::unordered_map<size_t, size_t> subBufferCounts_;
+
+			// A region that is not drawn for a while merges its touching spans once it holds this many rather than growing without bound
+			static constexpr size_t kMaxDirtySpans = 256;
 		};
 	}
 }
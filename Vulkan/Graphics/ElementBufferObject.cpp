@@ -7,11 +7,12 @@
 using namespace QZL;
 using namespace QZL::Graphics;
 
-ElementBufferObject::ElementBufferObject(DeviceMemory* deviceMemory, size_t sizeOfVertices, size_t sizeOfIndices)
-	: deviceMemory_(deviceMemory), sizeOfVertices_(sizeOfVertices), sizeOfIndices_(sizeOfIndices), isDynamic_(false), isCommitted_(false),
-	  indexCount_(0), vertexCount_(0)
+ElementBufferObject::ElementBufferObject(DeviceMemory* deviceMemory, size_t sizeOfVertices, size_t sizeOfIndices, GeometryArena* arena)
+	: deviceMemory_(deviceMemory), sizeOfVertices_(sizeOfVertices), sizeOfIndices_(sizeOfIndices), largestIndexStride_(sizeOfIndices), isDynamic_(false), isCommitted_(false),
+	  indexCount_(0), vertexCount_(0), vertexType_(VertexTypes::VERTEX), arena_(arena), arenaHandle_(0)
 {
-	ASSERT(sizeOfVertices != 0 && sizeOfIndices <= 4 && sizeOfIndices != 3);
+	// Index only buffers have nothing to bind outside the arena
+	ASSERT((sizeOfVertices != 0 || (arena != nullptr && sizeOfIndices != 0)) && sizeOfIndices <= 4 && sizeOfIndices != 3);
 
 	indexType_ = sizeOfIndices == 2 ? VK_INDEX_TYPE_UINT16 : 
 		sizeOfIndices == 4 ? VK_INDEX_TYPE_UINT32 :
@@ -22,15 +23,25 @@ ElementBufferObject::ElementBufferObject(DeviceMemory* deviceMemory, size_t size
 	indexBufferDetails_.buffer = VK_NULL_HANDLE;
 }
 
+ElementBufferObject::ElementBufferObject(DeviceMemory* deviceMemory, VertexTypes vertexType, size_t sizeOfIndices, GeometryArena* arena)
+	: ElementBufferObject(deviceMemory, getVertexSize(vertexType), sizeOfIndices, arena)
+{
+	vertexType_ = vertexType;
+}
+
 ElementBufferObject::ElementBufferObject(DeviceMemory* deviceMemory)
-	: deviceMemory_(deviceMemory), sizeOfVertices_(0), sizeOfIndices_(0), isDynamic_(false), isCommitted_(true), indexCount_(0), vertexCount_(0), indexType_(VK_INDEX_TYPE_NONE_NV)
+	: deviceMemory_(deviceMemory), sizeOfVertices_(0), sizeOfIndices_(0), largestIndexStride_(0), isDynamic_(false), isCommitted_(true), indexCount_(0), vertexCount_(0), indexType_(VK_INDEX_TYPE_NONE_NV), vertexType_(VertexTypes::VERTEX),
+	  arena_(nullptr), arenaHandle_(0)
 {
 	vertexBufferDetails_ = deviceMemory_->createBuffer("EBO VertexBuffer", MemoryAllocationPattern::kStaticResource, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, 1);
 }
 
 ElementBufferObject::~ElementBufferObject()
 {
-	if (isCommitted_) {
+	if (isCommitted_ && arena_ != nullptr) {
+		arena_->free(arenaHandle_);
+	}
+	else if (isCommitted_) {
 		deviceMemory_->deleteAllocation(vertexBufferDetails_.id, vertexBufferDetails_.buffer);
 		if (isIndexed()) {
 			deviceMemory_->deleteAllocation(indexBufferDetails_.id, indexBufferDetails_.buffer);
@@ -43,6 +54,10 @@ ElementBufferObject::~ElementBufferObject()
 
 void ElementBufferObject::bind(VkCommandBuffer cmdBuffer, const size_t idx)
 {
+	if (arena_ != nullptr) {
+		arena_->bind(cmdBuffer);
+		return;
+	}
 	VkDeviceSize offset = 0;
 	vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &vertexBufferDetails_.buffer, &offset);
 	if (isIndexed()) {
@@ -50,6 +65,17 @@ void ElementBufferObject::bind(VkCommandBuffer cmdBuffer, const size_t idx)
 	}
 }
 
+void ElementBufferObject::bindIndexBuffer(VkCommandBuffer cmdBuffer, VkIndexType indexType)
+{
+	ASSERT(isIndexed() && !isDynamic());
+	if (arena_ != nullptr) {
+		arena_->bindIndexBuffer(cmdBuffer, indexType);
+	}
+	else {
+		vkCmdBindIndexBuffer(cmdBuffer, indexBufferDetails_.buffer, 0, indexType);
+	}
+}
+
 void ElementBufferObject::commit()
 {
 	if (isCommitted_) {
@@ -62,6 +88,10 @@ void ElementBufferObject::commit()
 	if (largestSize == 0) {
 		return;
 	}
+	if (arena_ != nullptr) {
+		commitToArena();
+		return;
+	}
 
 	MemoryAllocationDetails stagingBuffer = deviceMemory_->createBuffer("", MemoryAllocationPattern::kStaging, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, largestSize);
 
@@ -83,14 +113,24 @@ void ElementBufferObject::commit()
 
 	deviceMemory_->deleteAllocation(stagingBuffer.id, stagingBuffer.buffer);
 
+	// The buffers are rebound every frame so picking up the new handles after a move is enough
+	deviceMemory_->setMovable(vertexBufferDetails_.id, [this](const MemoryAllocationDetails& details) { vertexBufferDetails_ = details; });
+	if (isIndexed()) {
+		deviceMemory_->setMovable(indexBufferDetails_.id, [this](const MemoryAllocationDetails& details) { indexBufferDetails_ = details; });
+	}
+
 	if (!isDynamic()) {
 		vertexData_.clear();
 	}
 	isCommitted_ = true;
 }
 
-size_t ElementBufferObject::addVertices(void* data, const size_t size)
+size_t ElementBufferObject::addVertices(const void* data, const size_t size)
 {
+	if (sizeOfVertices_ == 0) {
+		ASSERT(!isCommitted_ && size == 0);
+		return 0;
+	}
 	ASSERT(!isCommitted_ && ((size % sizeOfVertices_) == 0));
 	const size_t prevSize = vertexData_.size();
 	vertexData_.resize(prevSize + size);
@@ -102,17 +142,21 @@ size_t ElementBufferObject::addVertices(void* data, const size_t size)
 	return prevSize / sizeOfVertices_;
 }
 
-size_t ElementBufferObject::addIndices(void* data, const size_t size)
+size_t ElementBufferObject::addIndices(const void* data, const size_t size, size_t indexStride)
 {
-	ASSERT(!isCommitted_ && ((size % sizeOfIndices_) == 0));
-	const size_t prevSize = indexData_.size();
+	indexStride = indexStride == 0 ? sizeOfIndices_ : indexStride;
+	ASSERT(!isCommitted_ && isIndexed() && ((size % indexStride) == 0));
+	// Dynamic buffers are bound at an offset in to the frame allocator so can not switch index type
+	ASSERT(indexStride == sizeOfIndices_ || (!isDynamic() && (indexStride == sizeof(uint16_t) || indexStride == sizeof(uint32_t))));
+	// Pad so the range can be addressed by an index offset of its own type
+	const size_t prevSize = ((indexData_.size() + indexStride - 1) / indexStride) * indexStride;
 	indexData_.resize(prevSize + size);
 	if (data != nullptr) {
 		memcpy(indexData_.data() + prevSize, data, size);
 	}
-	indexCount_ += static_cast<uint32_t>(size / sizeOfIndices_);
-	ASSERT(indexCount_ == (indexData_.size() / sizeOfIndices_));
-	return prevSize / sizeOfIndices_;
+	indexCount_ += static_cast<uint32_t>(size / indexStride);
+	largestIndexStride_ = std::max(largestIndexStride_, indexStride);
+	return prevSize / indexStride;
 }
 
 void ElementBufferObject::emplaceMesh(const std::string name, uint32_t count, uint32_t vertexOffset, uint32_t indexOffset)
@@ -121,4 +165,38 @@ void ElementBufferObject::emplaceMesh(const std::string name, uint32_t count, ui
 	meshes_[name]->count = count;
 	meshes_[name]->indexOffset = indexOffset;
 	meshes_[name]->vertexOffset = vertexOffset;
+	meshes_[name]->indexType = indexType_;
+}
+
+void ElementBufferObject::commitToArena()
+{
+	ASSERT(!isDynamic());
+	// The whole range is aligned for the largest index type so every mesh offset stays a whole number of indices
+	const size_t indexStride = isIndexed() ? largestIndexStride_ : sizeof(uint16_t);
+	indexData_.resize(((indexData_.size() + indexStride - 1) / indexStride) * indexStride);
+	arenaHandle_ = arena_->allocate(vertexData_.data(), vertexData_.size(), sizeOfVertices_, indexData_.data(), indexData_.size(), indexStride,
+		[this](const GeometryRange& oldRange, const GeometryRange& newRange) { offsetMeshes(oldRange, newRange); });
+	// Mesh offsets were local to this buffer until now
+	offsetMeshes({}, arena_->getRange(arenaHandle_));
+
+	vertexData_.clear();
+	indexData_.clear();
+	isCommitted_ = true;
+}
+
+void ElementBufferObject::offsetMeshes(const GeometryRange& oldRange, const GeometryRange& newRange)
+{
+	const int32_t vertexDelta = sizeOfVertices_ == 0 ? 0 :
+		static_cast<int32_t>(newRange.vertexOffset / sizeOfVertices_) - static_cast<int32_t>(oldRange.vertexOffset / sizeOfVertices_);
+	for (auto& mesh : meshes_) {
+		const size_t indexStride = mesh.second->indexType == VK_INDEX_TYPE_UINT32 ? sizeof(uint32_t) : 
+			mesh.second->indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeOfIndices_;
+		const int64_t indexDelta = isIndexed() ? static_cast<int64_t>(newRange.indexOffset / indexStride) - static_cast<int64_t>(oldRange.indexOffset / indexStride) : 0;
+		mesh.second->vertexOffset += vertexDelta;
+		mesh.second->indexOffset = static_cast<uint32_t>(mesh.second->indexOffset + indexDelta);
+		for (auto& part : mesh.second->parts) {
+			part.vertexOffset += vertexDelta;
+			part.indexOffset = static_cast<uint32_t>(part.indexOffset + indexDelta);
+		}
+	}
 }
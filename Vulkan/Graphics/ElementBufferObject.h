@@ -3,6 +3,8 @@
 #pragma once
 #include "VkUtil.h"
 #include "MemoryAllocation.h"
+#include "GeometryArena.h"
+#include "Vertex.h"
 
 namespace QZL {
 	namespace Graphics {
@@ -22,20 +24,32 @@ namespace QZL {
 			Before use by the GPU, commit() must be called. An error will be thrown if bind() is called while the buffer is not committed. Upon commit(), the
 			size of the buffer is locked in, GPU side buffers are created, and CPU side data is cleared (unless the buffer is dynamic). If the buffer is static then 
 			it cannot be updated after commit().
+
+			If a geometry arena is given then the data is placed in the shared arena buffers instead of buffers owned by this object. Mesh offsets
+			are then global to the arena, so meshes from any arena backed buffer can be drawn after binding the arena once. An arena backed buffer
+			may be index only (VertexTypes::NONE), its meshes then draw with a vertex offset of 0 and the shader pulls the vertex data itself.
+
+			Static buffers may hold meshes with 32 bit indices alongside the default index size. Both live in the same index buffer with 32 bit
+			ranges aligned to 4 bytes, so a mesh's index offset is in units of its own index type and bindIndexBuffer switches between them.
 		*/
 		class ElementBufferObject {
 			friend class MeshLoader;
 		public:
-			ElementBufferObject(DeviceMemory* deviceMemory, size_t sizeOfVertices, size_t sizeOfIndices = 0);
+			ElementBufferObject(DeviceMemory* deviceMemory, size_t sizeOfVertices, size_t sizeOfIndices = 0, GeometryArena* arena = nullptr);
+			// Meshes loaded from file are converted in to the given vertex format
+			ElementBufferObject(DeviceMemory* deviceMemory, VertexTypes vertexType, size_t sizeOfIndices = 0, GeometryArena* arena = nullptr);
 			ElementBufferObject(DeviceMemory* deviceMemory);
 			virtual ~ElementBufferObject();
 
 			virtual void bind(VkCommandBuffer cmdBuffer, const size_t idx);
 			virtual void commit();
+			// Rebind the index buffer as the given type, bind() always binds it as the default type
+			void bindIndexBuffer(VkCommandBuffer cmdBuffer, VkIndexType indexType);
 
 			// Parameter "size" should be the sizeof the data type * the number of data elements
-			size_t addVertices(void* data, const size_t size);
-			size_t addIndices(void* data, const size_t size);
+			size_t addVertices(const void* data, const size_t size);
+			// Index stride defaults to sizeOfIndices, the returned offset is in units of the stride
+			size_t addIndices(const void* data, const size_t size, size_t indexStride = 0);
 
 			// When using vertex only, count is the number of vertices. When using indexed data, count is the number of indices.
 			void emplaceMesh(const std::string name, uint32_t count, uint32_t vertexOffset, uint32_t indexOffset = 0);
@@ -52,12 +66,24 @@ namespace QZL {
 				return isCommitted_;
 			}
 
+			VkIndexType getIndexType() {
+				return indexType_;
+			}
+
+			VertexTypes getVertexType() {
+				return vertexType_;
+			}
+
 			VkBuffer getVertexBuffer() {
-				return vertexBufferDetails_.buffer;
+				return arena_ != nullptr ? arena_->getVertexBuffer() : vertexBufferDetails_.buffer;
 			}
 
 			VkBuffer getIndexBuffer() {
-				return indexBufferDetails_.buffer;
+				return arena_ != nullptr ? arena_->getIndexBuffer() : indexBufferDetails_.buffer;
+			}
+
+			GeometryArena* getArena() {
+				return arena_;
 			}
 
 			uint32_t indexCount() {
@@ -84,8 +110,13 @@ namespace QZL {
 			virtual void* getSubBufferData(size_t firstVertex) { return nullptr; }
 
 		protected:
+			void commitToArena();
+			// Shift mesh offsets by the difference between the arena ranges
+			void offsetMeshes(const GeometryRange& oldRange, const GeometryRange& newRange);
+
 			const size_t sizeOfVertices_;
 			const size_t sizeOfIndices_;
+			size_t largestIndexStride_;
 			bool isDynamic_;
 			bool isCommitted_;
 
@@ -93,6 +124,9 @@ namespace QZL {
 			MemoryAllocationDetails indexBufferDetails_;
 			DeviceMemory* deviceMemory_;
 			VkIndexType indexType_;
+			VertexTypes vertexType_;
+			GeometryArena* arena_;
+			GeometryHandle arenaHandle_;
 
 			uint32_t vertexCount_;
 			uint32_t indexCount_;
@@ -0,0 +1,47 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "FrameAllocator.h"
+#include "DeviceMemory.h"
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+FrameAllocator::FrameAllocator(DeviceMemory* deviceMemory, VkDeviceSize frameCapacity, uint32_t frameCount, VkDeviceSize minAlignment,
+	VkBufferUsageFlags usage, std::string debugName)
+	: deviceMemory_(deviceMemory), minAlignment_(std::max(minAlignment, VkDeviceSize(16))), frameBase_(0), head_(0), highWaterMark_(0), 
+	  frameCount_(frameCount)
+{
+	// Round the regions so every frame starts aligned
+	frameCapacity_ = ((frameCapacity + minAlignment_ - 1) / minAlignment_) * minAlignment_;
+	bufferDetails_ = deviceMemory_->createBuffer(debugName, MemoryAllocationPattern::kDynamicResource, usage, frameCapacity_ * frameCount_, 
+		MemoryAccessType::kPersistant);
+	ASSERT(bufferDetails_.access == MemoryAccessType::kPersistant && bufferDetails_.mappedData != nullptr);
+}
+
+FrameAllocator::~FrameAllocator()
+{
+	deviceMemory_->deleteAllocation(bufferDetails_.id, bufferDetails_.buffer);
+}
+
+void FrameAllocator::beginFrame(uint32_t frameIdx)
+{
+	EXPECTS(frameIdx < frameCount_);
+	highWaterMark_ = std::max(highWaterMark_, head_ - frameBase_);
+	frameBase_ = frameCapacity_ * frameIdx;
+	head_ = frameBase_;
+}
+
+FrameAllocation FrameAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+	alignment = std::max(alignment, minAlignment_);
+	VkDeviceSize offset = ((head_ + alignment - 1) / alignment) * alignment;
+	// Running out is a capacity bug rather than something to recover from, the previous frame may still be reading the next region
+	ASSERT(offset + size <= frameBase_ + frameCapacity_);
+	head_ = offset + size;
+
+	FrameAllocation allocation;
+	allocation.buffer = bufferDetails_.buffer;
+	allocation.offset = offset;
+	allocation.data = static_cast<char*>(bufferDetails_.mappedData) + offset;
+	return allocation;
+}
@@ -0,0 +1,64 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Per frame linear allocator for transient data written by the cpu every frame.
+#pragma once
+#include "VkUtil.h"
+#include "MemoryAllocation.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		class DeviceMemory;
+
+		struct FrameAllocation {
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceSize offset = 0; // From the start of the buffer, usable as a dynamic offset or vertex buffer offset
+			void* data = nullptr;
+		};
+
+		// One persistently mapped buffer split in to a region per frame in flight. Allocations are a pointer bump
+		// and are only valid until the same frame index begins again, which must be after its fence has signalled.
+		class FrameAllocator {
+		public:
+			FrameAllocator(DeviceMemory* deviceMemory, VkDeviceSize frameCapacity, uint32_t frameCount, VkDeviceSize minAlignment, 
+				VkBufferUsageFlags usage, std::string debugName);
+			~FrameAllocator();
+
+			// Discard everything allocated the last time this frame index was used
+			void beginFrame(uint32_t frameIdx);
+			// Alignment of 0 uses the minimum alignment given on creation
+			FrameAllocation allocate(VkDeviceSize size, VkDeviceSize alignment = 0);
+			template<typename T>
+			FrameAllocation upload(const T* data, size_t count = 1);
+
+			VkBuffer getBuffer() const {
+				return bufferDetails_.buffer;
+			}
+			VkDeviceSize getFrameCapacity() const {
+				return frameCapacity_;
+			}
+			// Largest amount used by any frame, for tuning the capacity
+			VkDeviceSize getHighWaterMark() const {
+				return highWaterMark_;
+			}
+
+		private:
+			DeviceMemory* deviceMemory_;
+			MemoryAllocationDetails bufferDetails_;
+			VkDeviceSize frameCapacity_;
+			VkDeviceSize minAlignment_;
+			VkDeviceSize frameBase_;
+			VkDeviceSize head_;
+			VkDeviceSize highWaterMark_;
+			uint32_t frameCount_;
+		};
+
+		template<typename T>
+		inline FrameAllocation FrameAllocator::upload(const T* data, size_t count)
+		{
+			FrameAllocation allocation = allocate(sizeof(T) * count);
+			memcpy(allocation.data, data, sizeof(T) * count);
+			return allocation;
+		}
+	}
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "LogicalCamera.h"
+#include "DrawElementsCommand.h"
 
 namespace QZL {
 	namespace Graphics {
@@ -12,7 +13,7 @@ namespace QZL {
 			uint32_t viewportWidth = 0;
 			bool splitscreenEnabled = false;
 			VkCommandBuffer cmdBuffer = VK_NULL_HANDLE;
-			std::vector<VkDrawIndexedIndirectCommand>* commandLists;
+			std::vector<IndexedDrawCommand>* commandLists;
 		};
 	}
 }
@@ -0,0 +1,77 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "FreeListAllocator.h"
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+FreeListAllocator::FreeListAllocator(VkDeviceSize capacity)
+{
+	reset(capacity);
+}
+
+VkDeviceSize FreeListAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+	EXPECTS(size > 0 && alignment > 0);
+	for (auto it = freeRanges_.begin(); it != freeRanges_.end(); ++it) {
+		const VkDeviceSize rangeStart = it->first;
+		const VkDeviceSize rangeEnd = it->first + it->second;
+		const VkDeviceSize alignedStart = ((rangeStart + alignment - 1) / alignment) * alignment;
+		if (alignedStart + size > rangeEnd) {
+			continue;
+		}
+
+		// Padding before the aligned start stays free, as does anything after the allocation
+		freeRanges_.erase(it);
+		if (alignedStart > rangeStart) {
+			freeRanges_[rangeStart] = alignedStart - rangeStart;
+		}
+		if (alignedStart + size < rangeEnd) {
+			freeRanges_[alignedStart + size] = rangeEnd - (alignedStart + size);
+		}
+		freeSize_ -= size;
+		return alignedStart;
+	}
+	return kInvalidOffset;
+}
+
+void FreeListAllocator::free(VkDeviceSize offset, VkDeviceSize size)
+{
+	EXPECTS(offset + size <= capacity_);
+	freeSize_ += size;
+
+	auto next = freeRanges_.lower_bound(offset);
+	// Merge with the following range
+	if (next != freeRanges_.end() && next->first == offset + size) {
+		size += next->second;
+		next = freeRanges_.erase(next);
+	}
+	// Merge with the preceding range
+	if (next != freeRanges_.begin()) {
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == offset) {
+			prev->second += size;
+			return;
+		}
+	}
+	freeRanges_[offset] = size;
+}
+
+void FreeListAllocator::reset(VkDeviceSize capacity)
+{
+	capacity_ = capacity;
+	freeSize_ = capacity;
+	freeRanges_.clear();
+	if (capacity > 0) {
+		freeRanges_[0] = capacity;
+	}
+}
+
+VkDeviceSize FreeListAllocator::getLargestFreeRange() const
+{
+	VkDeviceSize largest = 0;
+	for (auto& range : freeRanges_) {
+		largest = std::max(largest, range.second);
+	}
+	return largest;
+}
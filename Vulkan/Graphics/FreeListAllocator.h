@@ -0,0 +1,40 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Suballocates ranges of a fixed capacity, no memory is owned only offsets are handed out.
+#pragma once
+#include "VkUtil.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		class FreeListAllocator {
+		public:
+			static constexpr VkDeviceSize kInvalidOffset = ~VkDeviceSize(0);
+
+			FreeListAllocator(VkDeviceSize capacity);
+
+			// First fit, returns kInvalidOffset if no free range can hold the aligned size
+			VkDeviceSize allocate(VkDeviceSize size, VkDeviceSize alignment = 1);
+			// Size must match the size given on allocation. Neighbouring free ranges are merged.
+			void free(VkDeviceSize offset, VkDeviceSize size);
+			// Discard all allocations, optionally changing the capacity
+			void reset(VkDeviceSize capacity);
+
+			VkDeviceSize getCapacity() const {
+				return capacity_;
+			}
+			VkDeviceSize getFreeSize() const {
+				return freeSize_;
+			}
+			size_t getFreeRangeCount() const {
+				return freeRanges_.size();
+			}
+			VkDeviceSize getLargestFreeRange() const;
+
+		private:
+			VkDeviceSize capacity_;
+			VkDeviceSize freeSize_;
+			std::map<VkDeviceSize, VkDeviceSize> freeRanges_; // offset to size
+		};
+	}
+}
@@ -17,7 +17,7 @@ FullscreenRenderer::FullscreenRenderer(RendererCreateInfo2& createInfo2, LogicDe
 		pipelineLayouts_.data(), createInfo2.pcRangesCount, createInfo2.pcRanges), createInfo2.shaderStages, createInfo2.pipelineCreateInfo, RendererPipeline::PrimitiveType::kNone);
 }
 
-void FullscreenRenderer::recordFrame(const uint32_t frameIdx, VkCommandBuffer cmdBuffer, std::vector<VkDrawIndexedIndirectCommand>* commandList, bool ignoreEboBind)
+void FullscreenRenderer::recordFrame(const uint32_t frameIdx, VkCommandBuffer cmdBuffer, std::vector<IndexedDrawCommand>* commandList, bool ignoreEboBind)
 {
 	beginFrame(cmdBuffer);
 	vkCmdDraw(cmdBuffer, 3, 1, 0, 0);
@@ -10,7 +10,7 @@ namespace QZL
 		public:
 			FullscreenRenderer(RendererCreateInfo2& createInfo2, LogicDevice* logicDevice, VkRenderPass renderPass, GlobalRenderData* grd, SceneGraphicsInfo* graphicsInfo);
 			~FullscreenRenderer() = default;
-			void recordFrame(const uint32_t frameIdx, VkCommandBuffer cmdBuffer, std::vector<VkDrawIndexedIndirectCommand>* commandList, bool ignoreEboBind = false) override;
+			void recordFrame(const uint32_t frameIdx, VkCommandBuffer cmdBuffer, std::vector<IndexedDrawCommand>* commandList, bool ignoreEboBind = false) override;
 		};
 	}
 }
@@ -0,0 +1,215 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "GeometryArena.h"
+#include "DeviceMemory.h"
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+GeometryArena::GeometryArena(DeviceMemory* deviceMemory, VkDeviceSize vertexCapacity, VkDeviceSize indexCapacity, uint32_t frameCount)
+	: deviceMemory_(deviceMemory), vertexAllocator_(vertexCapacity), indexAllocator_(indexCapacity), nextHandle_(0), frameCount_(frameCount),
+	  frameCounter_(0)
+{
+	vertexBufferDetails_ = createPool(vertexCapacity, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, "GeometryArena VertexBuffer");
+	indexBufferDetails_ = createPool(indexCapacity, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, "GeometryArena IndexBuffer");
+}
+
+GeometryArena::~GeometryArena()
+{
+	if (!blocks_.empty()) {
+		DEBUG_LOG("Geometry arena destroyed with " << blocks_.size() << " ranges still allocated");
+	}
+	for (auto& retired : retiredBuffers_) {
+		deviceMemory_->deleteAllocation(retired.details.id, retired.details.buffer);
+	}
+	deviceMemory_->deleteAllocation(vertexBufferDetails_.id, vertexBufferDetails_.buffer);
+	deviceMemory_->deleteAllocation(indexBufferDetails_.id, indexBufferDetails_.buffer);
+}
+
+GeometryHandle GeometryArena::allocate(const void* vertices, VkDeviceSize vertexSize, VkDeviceSize vertexStride, const void* indices,
+	VkDeviceSize indexSize, VkDeviceSize indexStride, MoveCallback onMove)
+{
+	// Index only ranges have no vertices, they are drawn with a vertex offset of 0
+	ASSERT((vertexSize > 0 || indexSize > 0) && (vertexSize == 0 || (vertexStride > 0 && (vertexSize % vertexStride) == 0)));
+	ASSERT((indexStride == sizeof(uint16_t) || indexStride == sizeof(uint32_t)) && (indexSize % indexStride) == 0);
+
+	GeometryRange range;
+	range.vertexSize = vertexSize;
+	range.indexSize = indexSize;
+	if (!tryAllocate(range, vertexStride, indexStride)) {
+		// Growing packs the existing ranges, so the free space at the end is guaranteed to fit the aligned request
+		reallocate(std::max(vertexAllocator_.getCapacity() * 2, vertexAllocator_.getCapacity() + vertexSize + vertexStride),
+			std::max(indexAllocator_.getCapacity() * 2, indexAllocator_.getCapacity() + indexSize + indexStride));
+		ASSERT(tryAllocate(range, vertexStride, indexStride));
+	}
+
+	if (vertexSize > 0) {
+		upload(vertices, vertexSize, vertexBufferDetails_.buffer, range.vertexOffset);
+	}
+	if (indexSize > 0) {
+		upload(indices, indexSize, indexBufferDetails_.buffer, range.indexOffset);
+	}
+
+	const GeometryHandle handle = nextHandle_++;
+	blocks_[handle] = { range, vertexStride, indexStride, onMove };
+	return handle;
+}
+
+void GeometryArena::free(GeometryHandle handle)
+{
+	auto it = blocks_.find(handle);
+	ASSERT(it != blocks_.end());
+	const GeometryRange& range = it->second.range;
+	if (range.vertexSize > 0) {
+		vertexAllocator_.free(range.vertexOffset, range.vertexSize);
+	}
+	if (range.indexSize > 0) {
+		indexAllocator_.free(range.indexOffset, range.indexSize);
+	}
+	blocks_.erase(it);
+}
+
+const GeometryRange& GeometryArena::getRange(GeometryHandle handle)
+{
+	return blocks_[handle].range;
+}
+
+void GeometryArena::compact()
+{
+	reallocate(vertexAllocator_.getCapacity(), indexAllocator_.getCapacity());
+}
+
+float GeometryArena::calculateFragmentation() const
+{
+	float fragmentation = 0.0f;
+	for (const FreeListAllocator* allocator : { &vertexAllocator_, &indexAllocator_ }) {
+		if (allocator->getFreeSize() > 0) {
+			fragmentation = std::max(fragmentation, 1.0f - float(allocator->getLargestFreeRange()) / float(allocator->getFreeSize()));
+		}
+	}
+	return fragmentation;
+}
+
+void GeometryArena::beginFrame()
+{
+	// Buffers retired during a frame were last read by it, so are free once its frame slot comes round again
+	++frameCounter_;
+	for (auto it = retiredBuffers_.begin(); it != retiredBuffers_.end();) {
+		if (frameCounter_ - it->frame < frameCount_) {
+			++it;
+			continue;
+		}
+		deviceMemory_->deleteAllocation(it->details.id, it->details.buffer);
+		it = retiredBuffers_.erase(it);
+	}
+}
+
+void GeometryArena::bind(VkCommandBuffer cmdBuffer)
+{
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &vertexBufferDetails_.buffer, &offset);
+	vkCmdBindIndexBuffer(cmdBuffer, indexBufferDetails_.buffer, 0, VK_INDEX_TYPE_UINT16);
+}
+
+void GeometryArena::bindIndexBuffer(VkCommandBuffer cmdBuffer, VkIndexType indexType)
+{
+	vkCmdBindIndexBuffer(cmdBuffer, indexBufferDetails_.buffer, 0, indexType);
+}
+
+bool GeometryArena::tryAllocate(GeometryRange& range, VkDeviceSize vertexAlignment, VkDeviceSize indexAlignment)
+{
+	if (range.vertexSize > 0) {
+		range.vertexOffset = vertexAllocator_.allocate(range.vertexSize, vertexAlignment);
+		if (range.vertexOffset == FreeListAllocator::kInvalidOffset) {
+			return false;
+		}
+	}
+	if (range.indexSize > 0) {
+		range.indexOffset = indexAllocator_.allocate(range.indexSize, indexAlignment);
+		if (range.indexOffset == FreeListAllocator::kInvalidOffset) {
+			if (range.vertexSize > 0) {
+				vertexAllocator_.free(range.vertexOffset, range.vertexSize);
+			}
+			return false;
+		}
+	}
+	return true;
+}
+
+void GeometryArena::reallocate(VkDeviceSize vertexCapacity, VkDeviceSize indexCapacity)
+{
+	std::vector<std::pair<GeometryHandle, GeometryRange>> oldRanges;
+	oldRanges.reserve(blocks_.size());
+	for (auto& block : blocks_) {
+		oldRanges.emplace_back(block.first, block.second.range);
+	}
+
+	vertexAllocator_.reset(vertexCapacity);
+	indexAllocator_.reset(indexCapacity);
+	MemoryAllocationDetails vertexBufferDetails = createPool(vertexCapacity, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, "GeometryArena VertexBuffer");
+	MemoryAllocationDetails indexBufferDetails = createPool(indexCapacity, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, "GeometryArena IndexBuffer");
+
+	// Placing in offset order into a fresh allocator packs the ranges without reordering them
+	std::vector<VkBufferCopy> vertexCopies;
+	std::vector<VkBufferCopy> indexCopies;
+	std::sort(oldRanges.begin(), oldRanges.end(), [](const auto& lhs, const auto& rhs) {
+		return lhs.second.vertexOffset < rhs.second.vertexOffset;
+	});
+	for (auto& old : oldRanges) {
+		Block& block = blocks_[old.first];
+		if (block.range.vertexSize == 0) {
+			continue;
+		}
+		block.range.vertexOffset = vertexAllocator_.allocate(block.range.vertexSize, block.vertexAlignment);
+		ASSERT(block.range.vertexOffset != FreeListAllocator::kInvalidOffset);
+		vertexCopies.push_back({ old.second.vertexOffset, block.range.vertexOffset, block.range.vertexSize });
+	}
+	std::sort(oldRanges.begin(), oldRanges.end(), [](const auto& lhs, const auto& rhs) {
+		return lhs.second.indexOffset < rhs.second.indexOffset;
+	});
+	for (auto& old : oldRanges) {
+		Block& block = blocks_[old.first];
+		if (block.range.indexSize == 0) {
+			continue;
+		}
+		block.range.indexOffset = indexAllocator_.allocate(block.range.indexSize, block.indexAlignment);
+		ASSERT(block.range.indexOffset != FreeListAllocator::kInvalidOffset);
+		indexCopies.push_back({ old.second.indexOffset, block.range.indexOffset, block.range.indexSize });
+	}
+
+	if (!vertexCopies.empty()) {
+		deviceMemory_->transferMemory(vertexBufferDetails_.buffer, vertexBufferDetails.buffer, vertexCopies.data(), static_cast<uint32_t>(vertexCopies.size()));
+	}
+	if (!indexCopies.empty()) {
+		deviceMemory_->transferMemory(indexBufferDetails_.buffer, indexBufferDetails.buffer, indexCopies.data(), static_cast<uint32_t>(indexCopies.size()));
+	}
+	// Command buffers recorded this frame or still in flight may have bound the old buffers
+	retiredBuffers_.push_back({ vertexBufferDetails_, frameCounter_ });
+	retiredBuffers_.push_back({ indexBufferDetails_, frameCounter_ });
+	vertexBufferDetails_ = vertexBufferDetails;
+	indexBufferDetails_ = indexBufferDetails;
+
+	for (auto& old : oldRanges) {
+		Block& block = blocks_[old.first];
+		if (block.onMove && (block.range.vertexOffset != old.second.vertexOffset || block.range.indexOffset != old.second.indexOffset)) {
+			block.onMove(old.second, block.range);
+		}
+	}
+}
+
+MemoryAllocationDetails GeometryArena::createPool(VkDeviceSize capacity, VkBufferUsageFlags usage, std::string debugName)
+{
+	// Transfer source is needed so ranges can be copied out when compacting
+	return deviceMemory_->createBuffer(debugName, MemoryAllocationPattern::kStaticResource, 
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, capacity);
+}
+
+void GeometryArena::upload(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset)
+{
+	MemoryAllocationDetails stagingBuffer = deviceMemory_->createBuffer("", MemoryAllocationPattern::kStaging, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, size);
+	void* mapped = deviceMemory_->mapMemory(stagingBuffer.id);
+	memcpy(mapped, data, size);
+	deviceMemory_->unmapMemory(stagingBuffer.id);
+	deviceMemory_->transferMemory(stagingBuffer.buffer, dstBuffer, 0, dstOffset, size);
+	deviceMemory_->deleteAllocation(stagingBuffer.id, stagingBuffer.buffer);
+}
@@ -0,0 +1,92 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// A single vertex buffer and index buffer shared by all static geometry. Ranges are suballocated with a free list so that
+// every static mesh, regardless of renderer, can be drawn after one bind. Offsets are global to the arena buffers.
+// 16 and 32 bit indices share the index buffer, 32 bit ranges are 4 byte aligned so both can be addressed from offset 0.
+#pragma once
+#include "FreeListAllocator.h"
+#include "MemoryAllocation.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		class DeviceMemory;
+
+		using GeometryHandle = uint32_t;
+
+		// Byte offsets and sizes in to the arena buffers
+		struct GeometryRange {
+			VkDeviceSize vertexOffset = 0;
+			VkDeviceSize vertexSize = 0;
+			VkDeviceSize indexOffset = 0;
+			VkDeviceSize indexSize = 0;
+		};
+
+		class GeometryArena {
+		public:
+			// Called when compaction or growth has moved a range, owners must offset anything derived from the old range
+			using MoveCallback = std::function<void(const GeometryRange& oldRange, const GeometryRange& newRange)>;
+
+			// Buffers replaced by growth or compaction are kept for frameCount frames, as frames in flight may still read them
+			GeometryArena(DeviceMemory* deviceMemory, VkDeviceSize vertexCapacity, VkDeviceSize indexCapacity, uint32_t frameCount);
+			~GeometryArena();
+
+			// Upload the data in to the arena, growing it if needed. The vertex range is aligned to the vertex stride so 
+			// it can be addressed with a vertex offset, the index range is aligned to indexStride for the same reason.
+			// A range may be index only, for geometry whose shaders pull their vertices.
+			GeometryHandle allocate(const void* vertices, VkDeviceSize vertexSize, VkDeviceSize vertexStride, const void* indices, 
+				VkDeviceSize indexSize, VkDeviceSize indexStride, MoveCallback onMove);
+			void free(GeometryHandle handle);
+			const GeometryRange& getRange(GeometryHandle handle);
+
+			// Pack all ranges to the front of the buffers so that the free space is contiguous
+			void compact();
+			// Portion of free space outside of the largest free range, for whichever pool is worse
+			float calculateFragmentation() const;
+			// Call once a frame after its fence has been waited on, frees replaced buffers no frame in flight can still read
+			void beginFrame();
+
+			// Binds the index buffer as 16 bit, use bindIndexBuffer to switch for 32 bit ranges
+			void bind(VkCommandBuffer cmdBuffer);
+			void bindIndexBuffer(VkCommandBuffer cmdBuffer, VkIndexType indexType);
+
+			VkBuffer getVertexBuffer() {
+				return vertexBufferDetails_.buffer;
+			}
+			VkBuffer getIndexBuffer() {
+				return indexBufferDetails_.buffer;
+			}
+
+		private:
+			struct Block {
+				GeometryRange range;
+				VkDeviceSize vertexAlignment;
+				VkDeviceSize indexAlignment;
+				MoveCallback onMove;
+			};
+			struct RetiredBuffer {
+				MemoryAllocationDetails details;
+				uint64_t frame;
+			};
+
+			bool tryAllocate(GeometryRange& range, VkDeviceSize vertexAlignment, VkDeviceSize indexAlignment);
+			// Create new buffers of the given capacities and copy all blocks in to them packed in their current order
+			void reallocate(VkDeviceSize vertexCapacity, VkDeviceSize indexCapacity);
+			MemoryAllocationDetails createPool(VkDeviceSize capacity, VkBufferUsageFlags usage, std::string debugName);
+			void upload(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset);
+
+			DeviceMemory* deviceMemory_;
+			MemoryAllocationDetails vertexBufferDetails_;
+			MemoryAllocationDetails indexBufferDetails_;
+			FreeListAllocator vertexAllocator_;
+			FreeListAllocator indexAllocator_;
+
+			GeometryHandle nextHandle_;
+			std::map<GeometryHandle, Block> blocks_;
+
+			const uint32_t frameCount_;
+			uint64_t frameCounter_;
+			std::vector<RetiredBuffer> retiredBuffers_;
+		};
+	}
+}
@@ -2,13 +2,15 @@
 #include "GraphicsMaster.h"
 #include "SwapChainDetails.h"
 #include "IndexedRenderer.h"
-#include "ParticleRenderer.h"
 #include "Image.h"
 #include "LogicDevice.h"
 #include "SceneDescriptorInfo.h"
 #include "GlobalRenderData.h"
 #include "TextureManager.h"
 #include "ElementBufferObject.h"
+#include "GeometryArena.h"
+#include "ClusterCuller.h"
+#include "TerrainNodeSelector.h"
 
 using namespace QZL;
 using namespace QZL::Graphics;
@@ -76,7 +78,6 @@ DeferredPass::~DeferredPass()
 	SAFE_DELETE(albedoBuffer_);
 	SAFE_DELETE(staticRenderer_);
 	SAFE_DELETE(terrainRenderer_);
-	SAFE_DELETE(particleRenderer_);
 	SAFE_DELETE(waterRenderer_);
 }
 
@@ -110,14 +111,16 @@ void DeferredPass::doFrame(FrameInfo& frameInfo)
 	scissor.offset.y = 0;
 	vkCmdSetScissor(frameInfo.cmdBuffer, 0, 1, &scissor);
 
-	const uint32_t dynamicOffsets[3] = {
+	const auto globalOffsets = globalRenderData_->getDynamicOffsets();
+	const uint32_t dynamicOffsets[3 + GlobalRenderData::kDynamicOffsetCount] = {
 		uint32_t(graphicsInfo_->mvpRange) * (frameInfo.frameIdx + (graphicsInfo_->numFrameIndices * frameInfo.mainCameraIdx)),
 		uint32_t(graphicsInfo_->paramsRange) * frameInfo.frameIdx,
-		uint32_t(graphicsInfo_->materialRange) * frameInfo.frameIdx
+		uint32_t(graphicsInfo_->materialRange) * frameInfo.frameIdx,
+		globalOffsets[0], globalOffsets[1], globalOffsets[2]
 	};
 
 	VkDescriptorSet sets[2] = { graphicsInfo_->set, globalRenderData_->getSet() };
-	vkCmdBindDescriptorSets(frameInfo.cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, staticRenderer_->getPipelineLayout(), 0, 2, sets, 3, dynamicOffsets);
+	vkCmdBindDescriptorSets(frameInfo.cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, staticRenderer_->getPipelineLayout(), 0, 2, sets, 3 + GlobalRenderData::kDynamicOffsetCount, dynamicOffsets);
 
 	VertexPushConstants vpc;
 	vpc.cameraPosition = glm::vec4(frameInfo.cameras[frameInfo.mainCameraIdx].position, 1.0f);
@@ -125,19 +128,32 @@ void DeferredPass::doFrame(FrameInfo& frameInfo)
 	vpc.shadowTextureIdx = shadowDepthIdx_;
 	vpc.shadowMatrix = frameInfo.cameras[1].viewProjection;
 	vkCmdPushConstants(frameInfo.cmdBuffer, terrainRenderer_->getPipelineLayout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(vpc), &vpc);
-
-	staticRenderer_->recordFrame(frameInfo.frameIdx, frameInfo.cmdBuffer, &frameInfo.commandLists[(size_t)RendererTypes::kStatic]);
-	waterRenderer_->recordFrame(frameInfo.frameIdx, frameInfo.cmdBuffer, &frameInfo.commandLists[(size_t)RendererTypes::kWater]);
-	terrainRenderer_->recordFrame(frameInfo.frameIdx, frameInfo.cmdBuffer, &frameInfo.commandLists[(size_t)RendererTypes::kTerrain]);
+	TessellationPushConstants tpc;
+	tpc.viewportSize = glm::vec2(float(frameInfo.viewportWidth), float(swapChainDetails_.extent.height));
+	vkCmdPushConstants(frameInfo.cmdBuffer, terrainRenderer_->getPipelineLayout(), VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT,
+		sizeof(VertexPushConstants) + sizeof(FragmentPushConstants), sizeof(tpc), &tpc);
+
+	// All geometry drawn in this pass lives in the shared arena
+	logicDevice_->getGeometryArena()->bind(frameInfo.cmdBuffer);
+	graphicsInfo_->clusterCuller->bindView(frameInfo.mainCameraIdx);
+	graphicsInfo_->terrainSelector->bindView(frameInfo.mainCameraIdx);
+	staticRenderer_->recordFrame(frameInfo.frameIdx, frameInfo.cmdBuffer, &frameInfo.commandLists[(size_t)RendererTypes::kStatic], true);
+	waterRenderer_->recordFrame(frameInfo.frameIdx, frameInfo.cmdBuffer, &frameInfo.commandLists[(size_t)RendererTypes::kWater], true);
+	terrainRenderer_->recordFrame(frameInfo.frameIdx, frameInfo.cmdBuffer, &frameInfo.commandLists[(size_t)RendererTypes::kTerrain], true);
 	vkCmdEndRenderPass(frameInfo.cmdBuffer);
 }
 
 void DeferredPass::createRenderers()
 {
-	VkPushConstantRange pushConstants[2] = {
+	// Shared by every renderer of the pass so the constants pushed once stay valid across their pipelines
+	VkPushConstantRange pushConstants[3] = {
 		RendererBase::setupPushConstantRange(VK_SHADER_STAGE_VERTEX_BIT, sizeof(VertexPushConstants), 0),
-		RendererBase::setupPushConstantRange(VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(FragmentPushConstants), sizeof(VertexPushConstants))
+		RendererBase::setupPushConstantRange(VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(FragmentPushConstants), sizeof(VertexPushConstants)),
+		RendererBase::setupPushConstantRange(VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT, sizeof(TessellationPushConstants),
+			sizeof(VertexPushConstants) + sizeof(FragmentPushConstants))
 	};
+	static_assert(sizeof(VertexPushConstants) + sizeof(FragmentPushConstants) + sizeof(TessellationPushConstants) <= kMaxPushConstantSize,
+		"Deferred pass push constants exceed the guaranteed size");
 
 	uint32_t specConstantValues[3] = { graphicsInfo_->mvpOffsetSizes[(size_t)RendererTypes::kStatic], 
 		graphicsInfo_->paramsOffsetSizes[(size_t)RendererTypes::kStatic], graphicsInfo_->materialOffsetSizes[(size_t)RendererTypes::kStatic] };
@@ -150,7 +166,7 @@ void DeferredPass::createRenderers()
 	VkSpecializationInfo specializationInfo = RendererBase::setupSpecConstants(2, specEntries.data(), sizeof(uint32_t) * 2, specConstantValues);
 	VkSpecializationInfo specializationInfo2 = RendererBase::setupSpecConstants(2, specEntries.data(), sizeof(uint32_t) * 2, &specConstantValues[1]);
 	std::vector<ShaderStageInfo> stageInfos;
-	stageInfos.emplace_back("StaticVert", VK_SHADER_STAGE_VERTEX_BIT, &specializationInfo);
+	stageInfos.emplace_back(kStaticVertexType == VertexTypes::VERTEX ? "StaticVert" : "StaticPackedVert", VK_SHADER_STAGE_VERTEX_BIT, &specializationInfo);
 	stageInfos.emplace_back("StaticDeferredFrag", VK_SHADER_STAGE_FRAGMENT_BIT, &specializationInfo2);
 
 	PipelineCreateInfo pci = {};
@@ -169,10 +185,10 @@ void DeferredPass::createRenderers()
 	RendererCreateInfo2 createInfo2;
 	createInfo2.shaderStages = stageInfos;
 	createInfo2.pipelineCreateInfo = pci;
-	createInfo2.pcRangesCount = 2;
+	createInfo2.pcRangesCount = 3;
 	createInfo2.pcRanges = pushConstants;
-	createInfo2.ebo = new ElementBufferObject(logicDevice_->getDeviceMemory(), sizeof(Vertex), sizeof(uint16_t));
-	createInfo2.vertexTypes = VertexTypes::VERTEX;
+	createInfo2.ebo = new ElementBufferObject(logicDevice_->getDeviceMemory(), kStaticVertexType, sizeof(uint16_t), logicDevice_->getGeometryArena());
+	createInfo2.vertexTypes = kStaticVertexType;
 
 	staticRenderer_ = new IndexedRenderer(createInfo2, logicDevice_, renderPass_, globalRenderData_, graphicsInfo_);
 
@@ -182,8 +198,8 @@ void DeferredPass::createRenderers()
 		RendererBase::makeSpecConstantEntry(1, sizeof(uint32_t), sizeof(uint32_t)),
 		RendererBase::makeSpecConstantEntry(2, sizeof(uint32_t) * 2, sizeof(uint32_t))
 	};
-	auto vertSpecConstant = RendererBase::setupSpecConstants(1, mapEntryTerrain.data(), sizeof(uint32_t), &offsets[1]);
-	auto tescSpecConstant = RendererBase::setupSpecConstants(2, mapEntryTerrain.data(), sizeof(uint32_t) * 2, &offsets[1]);
+	auto vertSpecConstant = RendererBase::setupSpecConstants(2, mapEntryTerrain.data(), sizeof(uint32_t) * 2, &offsets[1]);
+	auto tescSpecConstant = RendererBase::setupSpecConstants(3, mapEntryTerrain.data(), sizeof(uint32_t) * 3, offsets);
 	auto teseSpecConstant = RendererBase::setupSpecConstants(3, mapEntryTerrain.data(), sizeof(uint32_t) * 3, offsets);
 	auto fragSpecConstant = RendererBase::setupSpecConstants(2, mapEntryTerrain.data(), sizeof(uint32_t) * 2, &offsets[1]);
 	auto geomSpecConstant = RendererBase::setupSpecConstants(2, mapEntryTerrain.data(), sizeof(uint32_t) * 2, &offsets);
@@ -198,8 +214,10 @@ void DeferredPass::createRenderers()
 	pci.debugName = "Terrain";
 	pci.primitiveTopology = VK_PRIMITIVE_TOPOLOGY_PATCH_LIST;
 	createInfo2.pipelineCreateInfo = pci;
-	createInfo2.ebo = new ElementBufferObject(logicDevice_->getDeviceMemory(), sizeof(Vertex), sizeof(uint16_t));
+	// The terrain grid is index only, its shaders pull the vertices from the heightmap
+	createInfo2.ebo = new ElementBufferObject(logicDevice_->getDeviceMemory(), VertexTypes::NONE, sizeof(uint16_t), logicDevice_->getGeometryArena());
 	createInfo2.shaderStages = stageInfosTerrain;
+	createInfo2.vertexTypes = VertexTypes::TERRAIN_NODE;
 	terrainRenderer_ = new IndexedRenderer(createInfo2, logicDevice_, renderPass_, globalRenderData_, graphicsInfo_);
 
 
@@ -223,12 +241,12 @@ void DeferredPass::createRenderers()
 
 	pci.debugName = "Water";
 	createInfo2.pipelineCreateInfo = pci;
-	createInfo2.ebo = new ElementBufferObject(logicDevice_->getDeviceMemory(), sizeof(Vertex), sizeof(uint16_t));
+	createInfo2.ebo = new ElementBufferObject(logicDevice_->getDeviceMemory(), sizeof(Vertex), sizeof(uint16_t), logicDevice_->getGeometryArena());
 	createInfo2.shaderStages = stageInfosWater;
+	createInfo2.vertexTypes = VertexTypes::VERTEX;
 	waterRenderer_ = new IndexedRenderer(createInfo2, logicDevice_, renderPass_, globalRenderData_, graphicsInfo_);
 
 	graphicsMaster_->setRenderer(RendererTypes::kStatic, staticRenderer_);
-	graphicsMaster_->setRenderer(RendererTypes::kParticle, nullptr);
 	graphicsMaster_->setRenderer(RendererTypes::kTerrain, terrainRenderer_);
 	graphicsMaster_->setRenderer(RendererTypes::kWater, waterRenderer_);
 }
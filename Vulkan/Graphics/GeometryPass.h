@@ -20,7 +20,6 @@ namespace QZL {
 
 			RendererBase* staticRenderer_;
 			RendererBase* terrainRenderer_;
-			RendererBase* particleRenderer_;
 			RendererBase* waterRenderer_;
 
 			Image* depthBuffer_;
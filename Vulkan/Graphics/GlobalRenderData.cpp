@@ -3,28 +3,42 @@
 #include "GlobalRenderData.h"
 #include "TextureManager.h"
 #include "TextureSampler.h"
+#include "SwapChain.h"
 
 using namespace QZL;
 using namespace QZL::Graphics;
 
+// Transient memory for every per frame update, shared by the global uniforms and anything else using getFrameAllocator
+static constexpr VkDeviceSize kFrameAllocatorCapacity = 1024 * 1024;
+
+static VkDescriptorSetLayoutBinding makeDynamicUniformBinding(uint32_t binding, VkShaderStageFlags stageFlags)
+{
+	VkDescriptorSetLayoutBinding layoutBinding = {};
+	layoutBinding.binding = binding;
+	layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	layoutBinding.descriptorCount = 1;
+	layoutBinding.stageFlags = stageFlags;
+	layoutBinding.pImmutableSamplers = nullptr;
+	return layoutBinding;
+}
+
 void GlobalRenderData::updateData(uint32_t idx, Light& data)
 {
-	Light* lightingPtr = static_cast<Light*>(lightingUbo_->bindRange());
-	lightingPtr[idx] = data;
-	lightingUbo_->unbindRange();
+	EXPECTS(idx < MAX_LIGHTS);
+	static_cast<Light*>(lightingAllocation_.data)[idx] = data;
 }
 
 void GlobalRenderData::updateLightData(std::vector<Light>& lights)
 {
 	ASSERT(lights.size() < MAX_LIGHTS);
-	Light* lightingPtr = static_cast<Light*>(lightingUbo_->bindRange());
-	memcpy(lightingPtr, lights.data(), lights.size() * sizeof(Light));
-	lightingUbo_->unbindRange();
+	memcpy(lightingAllocation_.data, lights.data(), lights.size() * sizeof(Light));
+	// The region was last written by whichever frame used it before, and shaders loop over every light
+	memset(static_cast<Light*>(lightingAllocation_.data) + lights.size(), 0, (MAX_LIGHTS - lights.size()) * sizeof(Light));
 }
 
 void GlobalRenderData::updateCameraData(LogicalCamera& mainCamera, float screenX, float screenY)
 {
-	CameraInfo* camInfo = (CameraInfo*)cameraInfoUbo_->bindRange();
+	CameraInfo* camInfo = static_cast<CameraInfo*>(cameraInfoAllocation_.data);
 	camInfo->projMatrix = mainCamera.projectionMatrix;
 	camInfo->inverseViewProj = glm::inverse(mainCamera.viewProjection);
 	camInfo->nearPlaneZ = 0.1f;
@@ -33,7 +47,6 @@ void GlobalRenderData::updateCameraData(LogicalCamera& mainCamera, float screenX
 	camInfo->viewMatrix = mainCamera.viewMatrix;
 	camInfo->screenX = screenX;
 	camInfo->screenY = screenY;
-	cameraInfoUbo_->unbindRange();
 }
 
 void sampleKernelGeneration(glm::vec4* data) {
@@ -54,31 +67,53 @@ void sampleKernelGeneration(glm::vec4* data) {
 
 void GlobalRenderData::updatePostData(float screenX, float screenY, glm::mat4& shadowMatrix)
 {
-	PostProcessInfo* postInfo = (PostProcessInfo*)postProcessInfoUbo_->bindRange();
-	postInfo->shadowMatrix = shadowMatrix;
-	postInfo->ssaoBias = 0.015f;
-	postInfo->ssaoKernelSize = SSAO_KERNEL_SIZE;
-	postInfo->ssaoNoiseScale = glm::vec2(screenX / 4.0f, screenY / 4.0f);
-	postInfo->ssaoRadius = 0.5f;
-	sampleKernelGeneration(postInfo->ssaoSamples);
-	postProcessInfoUbo_->unbindRange();
+	postProcessInfo_.shadowMatrix = shadowMatrix;
+	postProcessInfo_.ssaoBias = 0.015f;
+	postProcessInfo_.ssaoKernelSize = SSAO_KERNEL_SIZE;
+	postProcessInfo_.ssaoNoiseScale = glm::vec2(screenX / 4.0f, screenY / 4.0f);
+	postProcessInfo_.ssaoRadius = 0.5f;
+	sampleKernelGeneration(postProcessInfo_.ssaoSamples);
+}
+
+void GlobalRenderData::beginFrame(uint32_t frameIdx)
+{
+	frameIdx_ = frameIdx;
+	frameAllocator_->beginFrame(frameIdx);
+	// The descriptors cover the full ranges, so these are allocated up front even if an update is skipped this frame
+	lightingAllocation_ = frameAllocator_->allocate(sizeof(Light) * MAX_LIGHTS);
+	cameraInfoAllocation_ = frameAllocator_->allocate(sizeof(CameraInfo));
+	postProcessInfoAllocation_ = frameAllocator_->upload(&postProcessInfo_);
+}
+
+void GlobalRenderData::writeTextureDescriptors()
+{
+	textureManager_->writePendingDescriptors(sets_[frameIdx_], frameIdx_);
 }
 
 GlobalRenderData::GlobalRenderData(LogicDevice* logicDevice, TextureManager* textureManager, VkDescriptorSetLayoutBinding descriptorIndexBinding)
+	: textureManager_(textureManager), frameIdx_(0), postProcessInfo_()
 {
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(logicDevice->getPhysicalDevice(), &properties);
+	frameAllocator_ = new FrameAllocator(logicDevice->getDeviceMemory(), kFrameAllocatorCapacity, MAX_FRAMES_IN_FLIGHT,
+		std::max(properties.limits.minUniformBufferOffsetAlignment, properties.limits.minStorageBufferOffsetAlignment),
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		"GlobalFrameAllocator");
+	beginFrame(0);
+
 	environmentTexture_ = textureManager->requestTextureSeparate({ 
 		"Environments/rightImage", "Environments/leftImage", "Environments/upImage", 
 		"Environments/downImage", "Environments/frontImage", "Environments/backImage"
 	});
-	createDescriptorSet(logicDevice, { 0, 0, 0, 0, VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT }, &descriptorIndexBinding);
+	// Partially bound as entries are only written once their textures are, and a frame's set catches up when its slot comes round
+	createDescriptorSet(logicDevice, { 0, 0, 0, 0, VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT },
+		&descriptorIndexBinding);
 }
 
 GlobalRenderData::~GlobalRenderData()
 {
 	SAFE_DELETE(environmentTexture_);
-	SAFE_DELETE(lightingUbo_);
-	SAFE_DELETE(cameraInfoUbo_);
-	SAFE_DELETE(postProcessInfoUbo_);
+	SAFE_DELETE(frameAllocator_);
 }
 
 void GlobalRenderData::createDescriptorSet(LogicDevice* logicDevice, std::vector<VkDescriptorBindingFlagsEXT> bindingFlags, VkDescriptorSetLayoutBinding* descriptorIndexBinding)
@@ -88,22 +123,41 @@ void GlobalRenderData::createDescriptorSet(LogicDevice* logicDevice, std::vector
 	setLayoutBindingFlags.bindingCount = static_cast<uint32_t>(bindingFlags.size());
 	setLayoutBindingFlags.pBindingFlags = bindingFlags.data();
 
-	lightingUbo_ = DescriptorBuffer::makeBuffer<UniformBuffer>(logicDevice, MemoryAllocationPattern::kDynamicResource, 0, 0,
-		sizeof(Light) * MAX_LIGHTS, VK_SHADER_STAGE_ALL_GRAPHICS, "GlobalLightingBuffer");
-
+	VkDescriptorSetLayoutBinding lightingBinding = makeDynamicUniformBinding(0, VK_SHADER_STAGE_ALL_GRAPHICS);
 	VkDescriptorSetLayoutBinding environmentBinding = TextureSampler::makeBinding(1, VK_SHADER_STAGE_FRAGMENT_BIT);
-
-	cameraInfoUbo_ = DescriptorBuffer::makeBuffer<UniformBuffer>(logicDevice, MemoryAllocationPattern::kDynamicResource, 2, 0,
-		sizeof(CameraInfo), VK_SHADER_STAGE_ALL_GRAPHICS, "GlobalCameraInfoBuffer");
-
-	postProcessInfoUbo_ = DescriptorBuffer::makeBuffer<UniformBuffer>(logicDevice, MemoryAllocationPattern::kDynamicResource, 3, 0,
-		sizeof(PostProcessInfo), VK_SHADER_STAGE_FRAGMENT_BIT, "GlobalPostProcessBuffer");
+	VkDescriptorSetLayoutBinding cameraInfoBinding = makeDynamicUniformBinding(2, VK_SHADER_STAGE_ALL_GRAPHICS);
+	VkDescriptorSetLayoutBinding postProcessInfoBinding = makeDynamicUniformBinding(3, VK_SHADER_STAGE_FRAGMENT_BIT);
 
 	auto descriptor = logicDevice->getPrimaryDescriptor();
-	layout_ = descriptor->makeLayout({ lightingUbo_->getBinding(), cameraInfoUbo_->getBinding(), 
-		postProcessInfoUbo_->getBinding(), environmentBinding , *descriptorIndexBinding }, &setLayoutBindingFlags);
-	auto idx = descriptor->createSets({ layout_ });
-	set_ = descriptor->getSet(idx);
-	descriptor->updateDescriptorSets({ lightingUbo_->descriptorWrite(set_), environmentTexture_->descriptorWrite(set_, 1), 
-		cameraInfoUbo_->descriptorWrite(set_), postProcessInfoUbo_->descriptorWrite(set_) });
+	layout_ = descriptor->makeLayout({ lightingBinding, cameraInfoBinding, postProcessInfoBinding, environmentBinding, 
+		*descriptorIndexBinding }, &setLayoutBindingFlags);
+	std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, layout_);
+	auto idx = descriptor->createSets(layouts);
+	for (size_t i = 0; i < layouts.size(); ++i) {
+		sets_.push_back(descriptor->getSet(idx + i));
+	}
+
+	// All three point at the start of the frame allocator, the real location is supplied by the dynamic offsets each frame
+	VkDescriptorBufferInfo bufferInfos[kDynamicOffsetCount] = {
+		{ frameAllocator_->getBuffer(), 0, sizeof(Light) * MAX_LIGHTS },
+		{ frameAllocator_->getBuffer(), 0, sizeof(CameraInfo) },
+		{ frameAllocator_->getBuffer(), 0, sizeof(PostProcessInfo) }
+	};
+	const uint32_t bindings[kDynamicOffsetCount] = { 0, 2, 3 };
+	std::vector<VkWriteDescriptorSet> writes;
+	for (auto set : sets_) {
+		writes.push_back(environmentTexture_->descriptorWrite(set, 1));
+		for (uint32_t i = 0; i < kDynamicOffsetCount; ++i) {
+			VkWriteDescriptorSet write = {};
+			write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet = set;
+			write.dstBinding = bindings[i];
+			write.dstArrayElement = 0;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			write.descriptorCount = 1;
+			write.pBufferInfo = &bufferInfos[i];
+			writes.push_back(write);
+		}
+	}
+	descriptor->updateDescriptorSets(writes);
 }
@@ -4,6 +4,7 @@
 #include "VkUtil.h"
 #include "StorageBuffer.h"
 #include "Descriptor.h"
+#include "FrameAllocator.h"
 #include "Light.h"
 #include "LogicalCamera.h"
 
@@ -36,12 +37,24 @@ namespace QZL {
 		class GlobalRenderData {
 			friend class SwapChain;
 		public:
+			// Lighting, camera info and post process info are dynamic uniform buffers, in binding order
+			static constexpr uint32_t kDynamicOffsetCount = 3;
+
+			// The set for the frame being recorded, each frame in flight has its own so texture array writes never touch a pending set
 			VkDescriptorSet getSet() const {
-				return set_;
+				return sets_[frameIdx_];
 			}
 			VkDescriptorSetLayout getLayout() const {
 				return layout_;
 			}
+			// Offsets of this frame's data, append to any other dynamic offsets when binding the set
+			std::array<uint32_t, kDynamicOffsetCount> getDynamicOffsets() const {
+				return { uint32_t(lightingAllocation_.offset), uint32_t(cameraInfoAllocation_.offset), uint32_t(postProcessInfoAllocation_.offset) };
+			}
+			// Transient per frame memory, anything allocated is only valid for the frame currently being recorded
+			FrameAllocator* getFrameAllocator() {
+				return frameAllocator_;
+			}
 			void updateData(uint32_t idx, Light& data);
 			void updateLightData(std::vector<Light>& lights);
 			void updateCameraData(LogicalCamera& mainCamera, float screenX, float screenY);
@@ -50,12 +63,21 @@ namespace QZL {
 			GlobalRenderData(LogicDevice* logicDevice, TextureManager* textureManager, VkDescriptorSetLayoutBinding descriptorIndexBinding);
 			~GlobalRenderData();
 			void createDescriptorSet(LogicDevice* logicDevice, std::vector<VkDescriptorBindingFlagsEXT> bindingFlags, VkDescriptorSetLayoutBinding* descriptorIndexBinding = nullptr);
+			// Must only be called once the fence for frameIdx has signalled
+			void beginFrame(uint32_t frameIdx);
+			// Bring this frame's texture array up to date, after anything that changes textures this frame and before the set is first bound
+			void writeTextureDescriptors();
 
-			VkDescriptorSet set_;
+			TextureManager* textureManager_;
+			uint32_t frameIdx_;
+			std::vector<VkDescriptorSet> sets_;
 			VkDescriptorSetLayout layout_;
-			DescriptorBuffer* lightingUbo_;
-			DescriptorBuffer* cameraInfoUbo_;
-			DescriptorBuffer* postProcessInfoUbo_;
+			FrameAllocator* frameAllocator_;
+			FrameAllocation lightingAllocation_;
+			FrameAllocation cameraInfoAllocation_;
+			FrameAllocation postProcessInfoAllocation_;
+			// Rarely changes but is copied in to every frame's allocation
+			PostProcessInfo postProcessInfo_;
 			TextureSampler* environmentTexture_;
 		};
 	}
@@ -13,12 +13,12 @@ using namespace Graphics;
 GraphicsComponent::GraphicsComponent(Entity* owner, RendererTypes type, ShaderParams* perMeshParams, ShaderParams* perInstanceParams,
 	const std::string& meshName, MeshLoadFunc loadFunc, Material* material)
 	: rtype_(type), owningEntity_(owner), meshParameters_(perMeshParams), instanceParameters_(perInstanceParams),
-	meshName_(meshName), loadFunc_(loadFunc), material_(material)
+	meshName_(meshName), loadFunc_(loadFunc), material_(material), mesh_(nullptr)
 {
 }
 
 GraphicsComponent::GraphicsComponent(Entity* owner, RendererTypes type, ShaderParams* params, const std::string& meshName, Material* material)
-	: rtype_(type), owningEntity_(owner), instanceParameters_(params), meshName_(meshName), loadFunc_(nullptr), material_(material)
+	: rtype_(type), owningEntity_(owner), instanceParameters_(params), meshName_(meshName), loadFunc_(nullptr), material_(material), mesh_(nullptr)
 {
 }
 
@@ -29,6 +29,11 @@ LogicalCamera* GraphicsMaster::getCamera(size_t idx)
 	return swapChain_->getCamera(idx);
 }
 
+ParticleSimulator* GraphicsMaster::getParticleSimulator()
+{
+	return swapChain_->getParticleSimulator();
+}
+
 const bool GraphicsMaster::supportsOptionalExtension(OptionalExtensions ext)
 {
 	return details_.physicalDevice->optionalExtensionsEnabled_[ext];
@@ -64,7 +69,8 @@ GraphicsMaster::GraphicsMaster(SystemMasters& masters)
 	initDevices(surfaceCapabilities, enabledLayerCount, enabledLayerNames);
 
 	masters_.textureManager = new Graphics::TextureManager(getLogicDevice(), getLogicDevice()->getPrimaryDescriptor(),
-		details_.physicalDevice->getDeviceLimits().maxSamplerAllocationCount, supportsOptionalExtension(OptionalExtensions::kDescriptorIndexing));
+		details_.physicalDevice->getDeviceLimits().maxSamplerAllocationCount, supportsOptionalExtension(OptionalExtensions::kDescriptorIndexing), masters_.jobSystem,
+		MAX_FRAMES_IN_FLIGHT);
 
 	swapChain_ = new SwapChain(this, details_.window, details_.surface, details_.logicDevice, surfaceCapabilities);
 	swapChain_->setCommandBuffers(std::vector<VkCommandBuffer>(details_.logicDevice->commandBuffers_.begin() + 1, details_.logicDevice->commandBuffers_.end()));
@@ -23,6 +23,7 @@ namespace QZL
 		class SwapChain;
 		class RenderObject;
 		class ElementBufferObject;
+		class ParticleSimulator;
 		struct BasicMesh;
 		struct DeviceSurfaceCapabilities;
 		struct DeviceSwapChainDetails;
@@ -49,6 +50,8 @@ namespace QZL
 			ElementBufferObject* getDynamicBuffer(RendererTypes type);
 
 			LogicalCamera* getCamera(size_t idx);
+			// Null until the render path is initialised
+			ParticleSimulator* getParticleSimulator();
 			const LogicDevice* getLogicDevice() {
 				return details_.logicDevice;
 			}
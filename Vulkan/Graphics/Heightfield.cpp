@@ -0,0 +1,158 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "Heightfield.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define QZL_HEIGHTFIELD_SSE
+#endif
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+Heightfield::Heightfield(const uint16_t* samples, uint32_t size, float heightScale)
+	: size_(size), heightScale_(heightScale), samples_(samples, samples + size_t(size + 1) * (size + 1))
+{
+	ASSERT(size >= (1u << kFirstMip) && (size & (size - 1)) == 0);
+	for (uint32_t mip = kFirstMip; (size_ >> mip) > 0; ++mip) {
+		const int blocks = static_cast<int>(size_ >> mip);
+		std::vector<glm::vec2> minMax(size_t(blocks) * blocks);
+		for (int bz = 0; bz < blocks; ++bz) {
+			for (int bx = 0; bx < blocks; ++bx) {
+				glm::vec2& block = minMax[size_t(bz) * blocks + bx];
+				if (mip == kFirstMip) {
+					const int blockSize = 1 << mip;
+					block = getSampleMinMax(bx * blockSize, bz * blockSize, (bx + 1) * blockSize, (bz + 1) * blockSize);
+					continue;
+				}
+				// The children share their inner edges, so together they cover exactly the samples of the block
+				block = getBlockMinMax(mip - 1, bx * 2, bz * 2);
+				for (const auto& offset : { glm::ivec2(1, 0), glm::ivec2(0, 1), glm::ivec2(1, 1) }) {
+					const glm::vec2 child = getBlockMinMax(mip - 1, bx * 2 + offset.x, bz * 2 + offset.y);
+					block = glm::vec2(glm::min(block.x, child.x), glm::max(block.y, child.y));
+				}
+			}
+		}
+		minMaxMips_.push_back(std::move(minMax));
+	}
+}
+
+float Heightfield::getSampleHeight(int x, int z) const
+{
+	const int last = static_cast<int>(size_);
+	const uint16_t sample = samples_[size_t(glm::clamp(z, 0, last)) * (size_ + 1) + size_t(glm::clamp(x, 0, last))];
+	return float(sample) / float(std::numeric_limits<uint16_t>::max()) * heightScale_;
+}
+
+float Heightfield::getHeight(float x, float z) const
+{
+	const int x0 = static_cast<int>(std::floor(x));
+	const int z0 = static_cast<int>(std::floor(z));
+	const float fx = x - float(x0);
+	const float fz = z - float(z0);
+	const float nearRow = glm::mix(getSampleHeight(x0, z0), getSampleHeight(x0 + 1, z0), fx);
+	const float farRow = glm::mix(getSampleHeight(x0, z0 + 1), getSampleHeight(x0 + 1, z0 + 1), fx);
+	return glm::mix(nearRow, farRow, fz);
+}
+
+void Heightfield::getHeights(const float* x, const float* z, float* heights, size_t count) const
+{
+	size_t i = 0;
+#ifdef QZL_HEIGHTFIELD_SSE
+	// Clamping first leaves every coordinate positive, so truncating floors it, and gives the same samples getSampleHeight clamps to
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 last = _mm_set1_ps(float(size_));
+	const __m128 unormMax = _mm_set1_ps(float(std::numeric_limits<uint16_t>::max()));
+	const __m128 heightScale = _mm_set1_ps(heightScale_);
+	const size_t rowPitch = size_ + 1;
+	for (; i + kLaneCount <= count; i += kLaneCount) {
+		const __m128 px = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(x + i), zero), last);
+		const __m128 pz = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(z + i), zero), last);
+		const __m128i ix = _mm_cvttps_epi32(px);
+		const __m128i iz = _mm_cvttps_epi32(pz);
+		const __m128 x0 = _mm_cvtepi32_ps(ix);
+		const __m128 z0 = _mm_cvtepi32_ps(iz);
+		const __m128i ix1 = _mm_cvttps_epi32(_mm_min_ps(_mm_add_ps(x0, one), last));
+		const __m128i iz1 = _mm_cvttps_epi32(_mm_min_ps(_mm_add_ps(z0, one), last));
+
+		// SSE2 has no gather, the corners are read a lane at a time
+		alignas(16) int32_t columns[2][kLaneCount];
+		alignas(16) int32_t rows[2][kLaneCount];
+		_mm_store_si128(reinterpret_cast<__m128i*>(columns[0]), ix);
+		_mm_store_si128(reinterpret_cast<__m128i*>(columns[1]), ix1);
+		_mm_store_si128(reinterpret_cast<__m128i*>(rows[0]), iz);
+		_mm_store_si128(reinterpret_cast<__m128i*>(rows[1]), iz1);
+		alignas(16) int32_t corners[4][kLaneCount];
+		for (size_t lane = 0; lane < kLaneCount; ++lane) {
+			const uint16_t* nearRow = samples_.data() + size_t(rows[0][lane]) * rowPitch;
+			const uint16_t* farRow = samples_.data() + size_t(rows[1][lane]) * rowPitch;
+			corners[0][lane] = nearRow[columns[0][lane]];
+			corners[1][lane] = nearRow[columns[1][lane]];
+			corners[2][lane] = farRow[columns[0][lane]];
+			corners[3][lane] = farRow[columns[1][lane]];
+		}
+		__m128 cornerHeights[4];
+		for (size_t corner = 0; corner < 4; ++corner) {
+			const __m128 unorm = _mm_cvtepi32_ps(_mm_load_si128(reinterpret_cast<const __m128i*>(corners[corner])));
+			cornerHeights[corner] = _mm_mul_ps(_mm_div_ps(unorm, unormMax), heightScale);
+		}
+
+		// The same operations in the same order as getHeight, so the two agree exactly
+		const __m128 fx = _mm_sub_ps(px, x0);
+		const __m128 fz = _mm_sub_ps(pz, z0);
+		const __m128 nearHeight = _mm_add_ps(cornerHeights[0], _mm_mul_ps(fx, _mm_sub_ps(cornerHeights[1], cornerHeights[0])));
+		const __m128 farHeight = _mm_add_ps(cornerHeights[2], _mm_mul_ps(fx, _mm_sub_ps(cornerHeights[3], cornerHeights[2])));
+		_mm_storeu_ps(heights + i, _mm_add_ps(nearHeight, _mm_mul_ps(fz, _mm_sub_ps(farHeight, nearHeight))));
+	}
+#endif
+	for (; i < count; ++i) {
+		heights[i] = getHeight(x[i], z[i]);
+	}
+}
+
+glm::vec2 Heightfield::getAreaMinMax(int x0, int z0, int x1, int z1) const
+{
+	const int last = static_cast<int>(size_);
+	x0 = glm::clamp(x0, 0, last);
+	z0 = glm::clamp(z0, 0, last);
+	x1 = glm::clamp(x1, x0, last);
+	z1 = glm::clamp(z1, z0, last);
+	// Blocks at least as large as the area, so no more than two of them are needed along each side
+	const int extent = std::max(x1 - x0, z1 - z0);
+	uint32_t mip = 0;
+	while ((1 << mip) < extent) {
+		++mip;
+	}
+	if (mip < kFirstMip) {
+		return getSampleMinMax(x0, z0, x1, z1);
+	}
+	// A block's far edge is included, so an area ending on a block boundary does not need the next block
+	glm::vec2 minMax(std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest());
+	for (int bz = z0 >> mip; bz <= std::max(z1 - 1, z0) >> mip; ++bz) {
+		for (int bx = x0 >> mip; bx <= std::max(x1 - 1, x0) >> mip; ++bx) {
+			const glm::vec2 block = getBlockMinMax(mip, bx, bz);
+			minMax = glm::vec2(glm::min(minMax.x, block.x), glm::max(minMax.y, block.y));
+		}
+	}
+	return minMax;
+}
+
+glm::vec2 Heightfield::getBlockMinMax(uint32_t mip, int bx, int bz) const
+{
+	EXPECTS(mip >= kFirstMip && mip - kFirstMip < minMaxMips_.size());
+	const int blocks = static_cast<int>(size_ >> mip);
+	return minMaxMips_[mip - kFirstMip][size_t(glm::clamp(bz, 0, blocks - 1)) * blocks + size_t(glm::clamp(bx, 0, blocks - 1))];
+}
+
+glm::vec2 Heightfield::getSampleMinMax(int x0, int z0, int x1, int z1) const
+{
+	glm::vec2 minMax(std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest());
+	for (int z = z0; z <= z1; ++z) {
+		for (int x = x0; x <= x1; ++x) {
+			const float height = getSampleHeight(x, z);
+			minMax = glm::vec2(glm::min(minMax.x, height), glm::max(minMax.y, height));
+		}
+	}
+	return minMax;
+}
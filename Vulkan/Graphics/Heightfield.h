@@ -0,0 +1,49 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Purpose: Cpu copy of a square grid of heights with a min/max mip chain, for bounding areas of the terrain without visiting every sample.
+#pragma once
+#include "VkUtil.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		class Heightfield {
+		public:
+			// Samples are (size + 1)^2 16 bit heights row by row, the last row and column being the far edge shared with the neighbouring
+			// tile. Heights are scaled to [0, heightScale], matching the unorm sampling in the terrain shaders. size must be a power of two.
+			Heightfield(const uint16_t* samples, uint32_t size, float heightScale);
+
+			uint32_t getSize() const {
+				return size_;
+			}
+			float getHeightScale() const {
+				return heightScale_;
+			}
+			// Coordinates are clamped to [0, size]
+			float getSampleHeight(int x, int z) const;
+			// Bilinear between the samples around x, z, matching the linear filtering of the shaders
+			float getHeight(float x, float z) const;
+			// getHeight for count positions, four at a time with SSE2 where it is available
+			void getHeights(const float* x, const float* z, float* heights, size_t count) const;
+			// Min and max height over the samples [x0, x1] x [z0, z1], both edges included. Conservative, the blocks read may cover
+			// a little more than the area.
+			glm::vec2 getAreaMinMax(int x0, int z0, int x1, int z1) const;
+			// Min and max over the block of 2^mip quads at bx, bz, the samples on both of its edges included. mip runs from kFirstMip
+			// up to the whole field.
+			glm::vec2 getBlockMinMax(uint32_t mip, int bx, int bz) const;
+
+			// Smaller areas are few enough samples to read directly
+			static constexpr uint32_t kFirstMip = 2;
+			// Positions getHeights filters at once
+			static constexpr size_t kLaneCount = 4;
+		private:
+			glm::vec2 getSampleMinMax(int x0, int z0, int x1, int z1) const;
+
+			uint32_t size_;
+			float heightScale_;
+			std::vector<uint16_t> samples_;
+			// Starting from kFirstMip
+			std::vector<std::vector<glm::vec2>> minMaxMips_;
+		};
+	}
+}
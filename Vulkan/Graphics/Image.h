@@ -24,14 +24,19 @@ namespace QZL {
 				VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_COLOR_BIT);
 			void changeLayout(VkCommandBuffer& cmdBuffer, VkImageLayout newLayout, VkPipelineStageFlags oldStageFlags = (VkPipelineStageFlags)0, 
 				VkPipelineStageFlags newStageFlags = (VkPipelineStageFlags)0, VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_COLOR_BIT);
-			uint32_t calculateMipLevels(uint32_t width, uint32_t height);
-			void generateMipmaps(VkCommandBuffer cmdBuffer, VkShaderStageFlags stages);
+			static uint32_t calculateMipLevels(uint32_t width, uint32_t height);
+			// Blit each mip down from the one above, with every mip in the transfer dst layout and the first written. Leaves the image
+			// shader read only for samplingStages.
+			void generateMipmaps(VkCommandBuffer cmdBuffer, VkPipelineStageFlags samplingStages);
 			const VkImageView& getImageView();
 			const VkImage& getImage();
 			const VkImageLayout& getLayout();
 			const uint32_t getMipLevels() {
 				return mipLevels_;
 			}
+			VkFormat getFormat() {
+				return format_;
+			}
 			VkDescriptorImageInfo& getImageInfo() {
 				return imageInfo_;
 			}
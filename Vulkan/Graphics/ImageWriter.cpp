@@ -0,0 +1,197 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "ImageWriter.h"
+#include <fstream>
+#include <glm/gtc/packing.hpp>
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+// Largest block a stored (uncompressed) deflate block can hold
+static constexpr size_t kMaxStoredBlockSize = 65535;
+
+static uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t size)
+{
+	static std::array<uint32_t, 256> table = []() {
+		std::array<uint32_t, 256> t;
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; ++k) {
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+			t[i] = c;
+		}
+		return t;
+	}();
+	for (size_t i = 0; i < size; ++i) {
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+static void appendBigEndian(std::vector<uint8_t>& out, uint32_t value)
+{
+	out.push_back(uint8_t(value >> 24));
+	out.push_back(uint8_t(value >> 16));
+	out.push_back(uint8_t(value >> 8));
+	out.push_back(uint8_t(value));
+}
+
+static void writeChunk(std::ofstream& file, const char type[4], const std::vector<uint8_t>& data)
+{
+	std::vector<uint8_t> header;
+	appendBigEndian(header, uint32_t(data.size()));
+	header.insert(header.end(), type, type + 4);
+	uint32_t crc = crc32Update(0xFFFFFFFFu, header.data() + 4, 4);
+	crc = crc32Update(crc, data.data(), data.size()) ^ 0xFFFFFFFFu;
+	std::vector<uint8_t> footer;
+	appendBigEndian(footer, crc);
+
+	file.write(reinterpret_cast<const char*>(header.data()), header.size());
+	file.write(reinterpret_cast<const char*>(data.data()), data.size());
+	file.write(reinterpret_cast<const char*>(footer.data()), footer.size());
+}
+
+bool ImageWriter::writePng(const std::string& fileName, uint32_t width, uint32_t height, uint32_t channels, const void* data, size_t rowPitch)
+{
+	EXPECTS(channels >= 1 && channels <= 4 && width > 0 && height > 0);
+	static const uint8_t kColourTypes[4] = { 0, 4, 2, 6 }; // Grey, grey alpha, rgb, rgba
+	const size_t rowSize = size_t(width) * channels;
+	rowPitch = rowPitch == 0 ? rowSize : rowPitch;
+
+	// Each scanline is prefixed with filter type 0 (none)
+	std::vector<uint8_t> raw;
+	raw.reserve((rowSize + 1) * height);
+	const uint8_t* src = static_cast<const uint8_t*>(data);
+	for (uint32_t y = 0; y < height; ++y) {
+		raw.push_back(0);
+		raw.insert(raw.end(), src + y * rowPitch, src + y * rowPitch + rowSize);
+	}
+
+	// Zlib stream made of stored deflate blocks
+	std::vector<uint8_t> idat;
+	idat.reserve(raw.size() + (raw.size() / kMaxStoredBlockSize + 1) * 5 + 6);
+	idat.push_back(0x78);
+	idat.push_back(0x01);
+	uint32_t adlerA = 1, adlerB = 0;
+	size_t offset = 0;
+	do {
+		const size_t blockSize = std::min(kMaxStoredBlockSize, raw.size() - offset);
+		const bool finalBlock = offset + blockSize == raw.size();
+		idat.push_back(finalBlock ? 1 : 0);
+		idat.push_back(uint8_t(blockSize));
+		idat.push_back(uint8_t(blockSize >> 8));
+		idat.push_back(uint8_t(~blockSize));
+		idat.push_back(uint8_t(~blockSize >> 8));
+		idat.insert(idat.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+		for (size_t i = offset; i < offset + blockSize; ++i) {
+			adlerA = (adlerA + raw[i]) % 65521;
+			adlerB = (adlerB + adlerA) % 65521;
+		}
+		offset += blockSize;
+	} while (offset < raw.size());
+	appendBigEndian(idat, (adlerB << 16) | adlerA);
+
+	std::vector<uint8_t> ihdr;
+	appendBigEndian(ihdr, width);
+	appendBigEndian(ihdr, height);
+	ihdr.push_back(8); // Bit depth
+	ihdr.push_back(kColourTypes[channels - 1]);
+	ihdr.push_back(0); // Compression
+	ihdr.push_back(0); // Filter
+	ihdr.push_back(0); // Interlace
+
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file.is_open()) {
+		DEBUG_ERR("Could not open " << fileName << " for writing");
+		return false;
+	}
+	static const uint8_t kSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	file.write(reinterpret_cast<const char*>(kSignature), sizeof(kSignature));
+	writeChunk(file, "IHDR", ihdr);
+	writeChunk(file, "IDAT", idat);
+	writeChunk(file, "IEND", {});
+	return file.good();
+}
+
+uint32_t ImageWriter::formatSize(VkFormat format)
+{
+	switch (format) {
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+	case VK_FORMAT_R32_SFLOAT:
+	case VK_FORMAT_D32_SFLOAT:
+		return 4;
+	case VK_FORMAT_R16G16B16A16_SFLOAT:
+		return 8;
+	case VK_FORMAT_R32G32B32A32_SFLOAT:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+static uint8_t unitToByte(float value)
+{
+	return uint8_t(glm::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+bool ImageWriter::convertToRGBA8(VkFormat format, uint32_t width, uint32_t height, const void* data, size_t rowPitch, std::vector<uint8_t>& rgba)
+{
+	const uint32_t texelSize = formatSize(format);
+	if (texelSize == 0) {
+		return false;
+	}
+	rowPitch = rowPitch == 0 ? size_t(width) * texelSize : rowPitch;
+	rgba.resize(size_t(width) * height * 4);
+
+	for (uint32_t y = 0; y < height; ++y) {
+		const uint8_t* row = static_cast<const uint8_t*>(data) + y * rowPitch;
+		uint8_t* dst = rgba.data() + size_t(y) * width * 4;
+		for (uint32_t x = 0; x < width; ++x, dst += 4) {
+			const uint8_t* texel = row + size_t(x) * texelSize;
+			switch (format) {
+			case VK_FORMAT_R8G8B8A8_UNORM:
+			case VK_FORMAT_R8G8B8A8_SRGB:
+				memcpy(dst, texel, 4);
+				break;
+			case VK_FORMAT_B8G8R8A8_UNORM:
+			case VK_FORMAT_B8G8R8A8_SRGB:
+				dst[0] = texel[2];
+				dst[1] = texel[1];
+				dst[2] = texel[0];
+				dst[3] = texel[3];
+				break;
+			case VK_FORMAT_R32_SFLOAT:
+			case VK_FORMAT_D32_SFLOAT: {
+				float value;
+				memcpy(&value, texel, sizeof(float));
+				dst[0] = dst[1] = dst[2] = unitToByte(value);
+				dst[3] = 255;
+				break;
+			}
+			case VK_FORMAT_R16G16B16A16_SFLOAT: {
+				uint16_t halves[4];
+				memcpy(halves, texel, sizeof(halves));
+				for (int c = 0; c < 4; ++c) {
+					dst[c] = unitToByte(glm::unpackHalf1x16(halves[c]));
+				}
+				break;
+			}
+			case VK_FORMAT_R32G32B32A32_SFLOAT: {
+				float values[4];
+				memcpy(values, texel, sizeof(values));
+				for (int c = 0; c < 4; ++c) {
+					dst[c] = unitToByte(values[c]);
+				}
+				break;
+			}
+			default:
+				return false;
+			}
+		}
+	}
+	return true;
+}
@@ -0,0 +1,22 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#pragma once
+#include "VkUtil.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		// Writes images to disk without any loss, intended for captures which are compared against reference images
+		class ImageWriter {
+		public:
+			// Data is 8 bits per channel with 1 to 4 channels, a row pitch of 0 means rows are tightly packed.
+			// The image data is stored uncompressed in the png so writing is fast, returns false if the file could not be written.
+			static bool writePng(const std::string& fileName, uint32_t width, uint32_t height, uint32_t channels, const void* data, size_t rowPitch = 0);
+			// Convert image data read back from the GPU to tightly packed 8 bit rgba, returns false if the format is not supported.
+			// Float formats are clamped to [0, 1], depth and single channel formats are replicated across rgb.
+			static bool convertToRGBA8(VkFormat format, uint32_t width, uint32_t height, const void* data, size_t rowPitch, std::vector<uint8_t>& rgba);
+			// Bytes per texel for the formats convertToRGBA8 supports, 0 otherwise
+			static uint32_t formatSize(VkFormat format);
+		};
+	}
+}
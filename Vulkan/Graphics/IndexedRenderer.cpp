@@ -2,6 +2,10 @@
 #include "ElementBufferObject.h"
 #include "GlobalRenderData.h"
 #include "SceneDescriptorInfo.h"
+#include "LogicDevice.h"
+#include "GeometryArena.h"
+#include "ClusterCuller.h"
+#include "TerrainNodeSelector.h"
 
 using namespace QZL;
 using namespace QZL::Graphics;
@@ -16,14 +20,43 @@ IndexedRenderer::IndexedRenderer(RendererCreateInfo2& createInfo2, LogicDevice*
 		pipelineLayouts_.data(), createInfo2.pcRangesCount, createInfo2.pcRanges), createInfo2.shaderStages, createInfo2.pipelineCreateInfo, createInfo2.tessellationPrims, createInfo2.vertexTypes);
 }
 
-void IndexedRenderer::recordFrame(const uint32_t frameIdx, VkCommandBuffer cmdBuffer, std::vector<VkDrawIndexedIndirectCommand>* commandList, bool ignoreEboBind)
+void IndexedRenderer::recordFrame(const uint32_t frameIdx, VkCommandBuffer cmdBuffer, std::vector<IndexedDrawCommand>* commandList, bool ignoreEboBind)
 {
 	if (commandList->size() == 0)
 		return;
 	beginFrame(cmdBuffer);
 	if (!ignoreEboBind) ebo_->bind(cmdBuffer, frameIdx);
 
+	// Whoever bound the buffer bound it as the default type, rebind only when a mesh needs the other one
+	const VkIndexType defaultIndexType = ebo_ != nullptr ? ebo_->getIndexType() : VK_INDEX_TYPE_UINT16;
+	VkIndexType boundIndexType = defaultIndexType;
 	for (auto& cmd : *commandList) {
-		vkCmdDrawIndexed(cmdBuffer, cmd.indexCount, cmd.instanceCount, cmd.firstIndex, cmd.vertexOffset, cmd.firstInstance);
+		if (cmd.indexType != boundIndexType) {
+			bindIndexBuffer(cmdBuffer, cmd.indexType);
+			boundIndexType = cmd.indexType;
+		}
+		if (cmd.clusterMesh != nullptr) {
+			graphicsInfo_->clusterCuller->recordDraws(cmdBuffer, cmd);
+			continue;
+		}
+		if (cmd.terrain != nullptr) {
+			graphicsInfo_->terrainSelector->recordDraws(cmdBuffer, cmd);
+			continue;
+		}
+		vkCmdDrawIndexed(cmdBuffer, cmd.draw.indexCount, cmd.draw.instanceCount, cmd.draw.firstIndex, cmd.draw.vertexOffset, cmd.draw.firstInstance);
+	}
+	// Renderers after this one in the pass may rely on the shared arena binding
+	if (boundIndexType != defaultIndexType) {
+		bindIndexBuffer(cmdBuffer, defaultIndexType);
+	}
+}
+
+void IndexedRenderer::bindIndexBuffer(VkCommandBuffer cmdBuffer, VkIndexType indexType)
+{
+	if (ebo_ != nullptr) {
+		ebo_->bindIndexBuffer(cmdBuffer, indexType);
+	}
+	else {
+		logicDevice_->getGeometryArena()->bindIndexBuffer(cmdBuffer, indexType);
 	}
 }
@@ -10,7 +10,10 @@ namespace QZL
 		public:
 			IndexedRenderer(RendererCreateInfo2& createInfo2, LogicDevice* logicDevice, VkRenderPass renderPass, GlobalRenderData* grd, SceneGraphicsInfo* graphicsInfo);
 			~IndexedRenderer() = default;
-			void recordFrame(const uint32_t frameIdx, VkCommandBuffer cmdBuffer, std::vector<VkDrawIndexedIndirectCommand>* commandList, bool ignoreEboBind = false) override;
+			void recordFrame(const uint32_t frameIdx, VkCommandBuffer cmdBuffer, std::vector<IndexedDrawCommand>* commandList, bool ignoreEboBind = false) override;
+		private:
+			// Renderers without their own buffer draw from the geometry arena bound by their pass
+			void bindIndexBuffer(VkCommandBuffer cmdBuffer, VkIndexType indexType);
 		};
 	}
 }
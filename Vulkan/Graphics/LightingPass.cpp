@@ -96,14 +96,16 @@ void LightingPass::doFrame(FrameInfo& frameInfo)
 	fpc.screenX = float(frameInfo.viewportX) / float(swapChainDetails_.extent.width);
 	fpc.screenY = 0;
 
-	const uint32_t dynamicOffsets[3] = {
+	const auto globalOffsets = globalRenderData_->getDynamicOffsets();
+	const uint32_t dynamicOffsets[3 + GlobalRenderData::kDynamicOffsetCount] = {
 		uint32_t(graphicsInfo_->mvpRange) * (frameInfo.frameIdx + (graphicsInfo_->numFrameIndices * frameInfo.mainCameraIdx)),
 		uint32_t(graphicsInfo_->paramsRange) * frameInfo.frameIdx,
-		uint32_t(graphicsInfo_->materialRange) * frameInfo.frameIdx
+		uint32_t(graphicsInfo_->materialRange) * frameInfo.frameIdx,
+		globalOffsets[0], globalOffsets[1], globalOffsets[2]
 	};
 
 	VkDescriptorSet sets[2] = { graphicsInfo_->set, globalRenderData_->getSet() };
-	vkCmdBindDescriptorSets(frameInfo.cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lightingRenderer_->getPipelineLayout(), 0, 2, sets, 3, dynamicOffsets);
+	vkCmdBindDescriptorSets(frameInfo.cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lightingRenderer_->getPipelineLayout(), 0, 2, sets, 3 + GlobalRenderData::kDynamicOffsetCount, dynamicOffsets);
 	vkCmdPushConstants(frameInfo.cmdBuffer, lightingRenderer_->getPipelineLayout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(vpc), &vpc);
 	vkCmdPushConstants(frameInfo.cmdBuffer, lightingRenderer_->getPipelineLayout(), VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(vpc), sizeof(fpc), &fpc);
 
@@ -188,7 +190,7 @@ void LightingPass::createRenderers()
 	createInfo2.pipelineCreateInfo = pci;
 	createInfo2.pcRangesCount = 2;
 	createInfo2.pcRanges = pushConstants;
-	createInfo2.ebo = new ElementBufferObject(logicDevice_->getDeviceMemory(), sizeof(Vertex), sizeof(uint16_t));
+	createInfo2.ebo = new ElementBufferObject(logicDevice_->getDeviceMemory(), sizeof(Vertex), sizeof(uint16_t), logicDevice_->getGeometryArena());
 	createInfo2.vertexTypes = VertexTypes::VERTEX;
 
 	lightingRenderer_ = new IndexedRenderer(createInfo2, logicDevice_, renderPass_, globalRenderData_, graphicsInfo_);
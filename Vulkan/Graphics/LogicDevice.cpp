@@ -3,6 +3,7 @@
 #include "GraphicsMaster.h"
 #include "PhysicalDevice.h"
 #include "DeviceMemory.h"
+#include "GeometryArena.h"
 #include "Descriptor.h"
 #include <fstream>
 #include <sstream>
@@ -34,11 +35,13 @@ LogicDevice::LogicDevice(PhysicalDevice* physicalDevice, VkDevice device, const
 	createPrimaryDescriptor();
 
 	deviceMemory_ = new DeviceMemory(physicalDevice, this, commandBuffers_[0], getQueueHandle(QueueFamilyType::kGraphicsQueue));
+	geometryArena_ = new GeometryArena(deviceMemory_, kGeometryArenaVertexSize, kGeometryArenaIndexSize, MAX_FRAMES_IN_FLIGHT);
 }
 
 LogicDevice::~LogicDevice()
 {
 	SAFE_DELETE(primaryDescriptor_);
+	SAFE_DELETE(geometryArena_);
 	SAFE_DELETE(deviceMemory_);
 	vkFreeCommandBuffers(device_, primaryCommandPool_, static_cast<uint32_t>(commandBuffers_.size()), commandBuffers_.data());
 	vkDestroyCommandPool(device_, primaryCommandPool_, nullptr);
@@ -113,6 +116,11 @@ DeviceMemory* LogicDevice::getDeviceMemory() const
 	return deviceMemory_;
 }
 
+GeometryArena* LogicDevice::getGeometryArena() const
+{
+	return geometryArena_;
+}
+
 const uint32_t LogicDevice::getFamilyIndex(QueueFamilyType type) const
 {
 	EXPECTS(type != QueueFamilyType::kNumQueueFamilyTypes);
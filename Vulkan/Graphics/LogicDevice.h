@@ -5,6 +5,7 @@ namespace QZL
 {
 	namespace Graphics {
 		class DeviceMemory;
+		class GeometryArena;
 		class PhysicalDevice;
 		class SwapChain;
 		class Descriptor;
@@ -28,11 +29,15 @@ namespace QZL
 			friend class GraphicsMaster;
 
 			static constexpr char const* kDescriptorRequirementsName = "../Data/descriptor-requirements.txt";
+			// Initial sizes of the shared geometry buffers, the arena grows if these are exceeded
+			static constexpr VkDeviceSize kGeometryArenaVertexSize = 32 * 1024 * 1024;
+			static constexpr VkDeviceSize kGeometryArenaIndexSize = 8 * 1024 * 1024;
 		public:
 			VkDevice getLogicDevice() const;
 			VkPhysicalDevice getPhysicalDevice() const;
 
 			DeviceMemory* getDeviceMemory() const;
+			GeometryArena* getGeometryArena() const;
 			const uint32_t getFamilyIndex(QueueFamilyType type) const;
 			const std::vector<uint32_t>& getAllIndices() const;
 			VkQueue getQueueHandle(QueueFamilyType type) const;
@@ -62,6 +67,7 @@ namespace QZL
 
 			PhysicalDevice* physicalDevice_; // Hold physical device so only logic device needs to be passed around
 			DeviceMemory* deviceMemory_;
+			GeometryArena* geometryArena_;
 
 			std::vector<uint32_t> queueFamilyIndices_;
 			std::vector<VkQueue> queueHandles_;
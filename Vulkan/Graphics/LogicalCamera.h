@@ -15,7 +15,9 @@ namespace QZL {
 			glm::mat4 viewProjection;
 			glm::vec3 position;
 			glm::vec3 lookPoint;
-			void calculateFrustumPlanes(const glm::mat4& mvp, std::array<glm::vec4, 6>& planes) {
+			// Height in pixels of the viewport the camera renders to, used to convert object space error to screen space
+			float viewportHeight = 0.0f;
+			void calculateFrustumPlanes(const glm::mat4& mvp, std::array<glm::vec4, 6>& planes) const {
 				// Based on https://github.com/SaschaWillems/Vulkan/blob/master/base/frustum.hpp
 				float n = 0.0f;
 				for (int p = 0; p < 6; ++p) {
@@ -0,0 +1,118 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+#ifdef _WIN32
+MappedFile::MappedFile()
+	: data_(nullptr), size_(0), fileHandle_(INVALID_HANDLE_VALUE), mappingHandle_(nullptr)
+{
+}
+#else
+MappedFile::MappedFile()
+	: data_(nullptr), size_(0)
+{
+}
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+void MappedFile::prefetch() const
+{
+	const volatile char* bytes = static_cast<const volatile char*>(data_);
+	for (size_t i = 0; i < size_; i += kPageSize) {
+		bytes[i];
+	}
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const std::string& fileName)
+{
+	close();
+	fileHandle_ = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (fileHandle_ == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle_, &fileSize) || fileSize.QuadPart == 0) {
+		close();
+		return false;
+	}
+	mappingHandle_ = CreateFileMappingA(fileHandle_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mappingHandle_ == nullptr) {
+		close();
+		return false;
+	}
+	data_ = MapViewOfFile(mappingHandle_, FILE_MAP_READ, 0, 0, 0);
+	if (data_ == nullptr) {
+		close();
+		return false;
+	}
+	size_ = static_cast<size_t>(fileSize.QuadPart);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (data_ != nullptr) {
+		UnmapViewOfFile(data_);
+	}
+	if (mappingHandle_ != nullptr) {
+		CloseHandle(mappingHandle_);
+	}
+	if (fileHandle_ != INVALID_HANDLE_VALUE) {
+		CloseHandle(fileHandle_);
+	}
+	data_ = nullptr;
+	size_ = 0;
+	mappingHandle_ = nullptr;
+	fileHandle_ = INVALID_HANDLE_VALUE;
+}
+#else
+bool MappedFile::open(const std::string& fileName)
+{
+	close();
+	int fd = ::open(fileName.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	void* data = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+	data_ = data;
+	size_ = static_cast<size_t>(fileStat.st_size);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (data_ != nullptr) {
+		munmap(const_cast<void*>(data_), size_);
+	}
+	data_ = nullptr;
+	size_ = 0;
+}
+#endif
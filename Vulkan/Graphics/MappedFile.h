@@ -0,0 +1,44 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Read only memory mapping of a whole file.
+#pragma once
+#include "VkUtil.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		class MappedFile {
+		public:
+			MappedFile();
+			~MappedFile();
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
+
+			// Returns false if the file does not exist, is empty or can not be mapped
+			bool open(const std::string& fileName);
+			void close();
+
+			bool isOpen() const {
+				return data_ != nullptr;
+			}
+			const void* getData() const {
+				return data_;
+			}
+			size_t getSize() const {
+				return size_;
+			}
+			// Read every page so the file is paged in on the calling thread rather than wherever it is first used
+			void prefetch() const;
+
+		private:
+			const void* data_;
+			size_t size_;
+			// Smallest page size of the supported platforms, touching more often than needed is harmless
+			static constexpr size_t kPageSize = 4096;
+#ifdef _WIN32
+			void* fileHandle_;
+			void* mappingHandle_;
+#endif
+		};
+	}
+}
@@ -13,7 +13,7 @@
 using namespace QZL;
 using namespace QZL::Graphics;
 
-const size_t Materials::materialTextureCountLUT[(size_t)RendererTypes::kNone] = { 2, 3, 1, 1 };
+const size_t Materials::materialTextureCountLUT[(size_t)RendererTypes::kNone] = { 2, 5, 1, 1, 1, 0, 3 };
 const size_t Materials::materialSizeLUT[(size_t)RendererTypes::kNone] = { sizeof(Static), sizeof(Terrain), sizeof(Atmosphere), sizeof(Particle), sizeof(PostProcess), 0, sizeof(Water) };
 
 void Materials::loadMaterial(TextureManager* texManager, RendererTypes type, std::string fileName, void* data)
@@ -21,21 +21,31 @@ void Materials::loadMaterial(TextureManager* texManager, RendererTypes type, std
 	std::vector<std::string> lines;
 
 	if (fileName != "") {
-		std::ifstream file("../Data/Materials/" + fileName + ".qmat");
-		ASSERT(file.is_open());
-		size_t count;
-		file >> count;
-		lines.reserve(count + 1);
-		std::string line;
-		while (line != "END") {
-			file >> line;
-			lines.emplace_back(line);
-		}
-		file.close();
-		(*getLoadingFunction(type))(texManager, data, lines);
+		readMaterial(fileName, lines);
+		fillMaterial(texManager, type, data, lines);
 	}
 }
 
+void Materials::readMaterial(const std::string& fileName, std::vector<std::string>& lines)
+{
+	std::ifstream file("../Data/Materials/" + fileName + ".qmat");
+	ASSERT(file.is_open());
+	size_t count;
+	file >> count;
+	lines.reserve(count + 1);
+	std::string line;
+	// Stop at the end of the file too, a missing END would otherwise never finish
+	while (line != "END" && file >> line) {
+		lines.emplace_back(line);
+	}
+	file.close();
+}
+
+void Materials::fillMaterial(TextureManager* texManager, RendererTypes type, void* data, std::vector<std::string>& lines)
+{
+	(*getLoadingFunction(type))(texManager, data, lines);
+}
+
 RendererTypes Materials::stringToType(std::string typeName)
 {
 	if (typeName == "STATIC")
@@ -79,7 +89,7 @@ void Materials::loadStaticMaterial(TextureManager* texManager, void* data, std::
 
 void Materials::loadTerrainMaterial(TextureManager* texManager, void* data, std::vector<std::string>& lines)
 {
-	ASSERT(lines.size() >= 3);
+	ASSERT(lines.size() >= 5);
 	Terrain material = {};
 	material.normalmapIdx = texManager->requestTexture(lines[0]);
 	material.albedoIdx0 = texManager->requestTexture(lines[1]);
@@ -49,6 +49,10 @@ namespace QZL {
 				uint32_t normalMap;
 			};
 			static void loadMaterial(TextureManager* texManager, RendererTypes type, std::string fileName, void* data);
+			// Loading split so the textures can be requested asynchronously before the material is filled.
+			// Every line of a material file before END names a texture.
+			static void readMaterial(const std::string& fileName, std::vector<std::string>& lines);
+			static void fillMaterial(TextureManager* texManager, RendererTypes type, void* data, std::vector<std::string>& lines);
 			static RendererTypes stringToType(std::string typeName);
 
 			static const size_t materialTextureCountLUT[(size_t)RendererTypes::kNone];
@@ -43,5 +43,19 @@ namespace QZL
 			VkDeviceSize size = 0;
 		};
 #pragma warning (pop)
+
+		// Called when defragmentation has moved an allocation, the details given contain the recreated buffer.
+		// Owners must replace their copy and rewrite anything which referenced the old buffer, e.g. descriptor sets.
+		using RelocationCallback = std::function<void(const MemoryAllocationDetails&)>;
+
+		struct DefragmentationStats {
+			VkDeviceSize bytesMoved = 0;
+			VkDeviceSize bytesFreed = 0;
+			uint32_t allocationsMoved = 0;
+			uint32_t blocksFreed = 0;
+			uint32_t passes = 0;
+			// Portion of the free memory between movable buffers outside of the largest free range as of the last pass, 0 means no fragmentation.
+			float fragmentation = 0.0f;
+		};
 	}
 }
@@ -6,11 +6,57 @@
 namespace QZL
 {
 	namespace Graphics {
+		// A contiguous range of indices drawn with its own base vertex
+		struct MeshPart {
+			uint32_t count;
+			uint32_t indexOffset;
+			int32_t vertexOffset;
+		};
+
+		// A simplified version of the whole mesh, drawn in place of the full index range when far enough away
+		struct MeshLod {
+			uint32_t count;
+			uint32_t indexOffset; // Relative to the mesh's index offset
+			float error; // Object space distance the simplified surface may deviate from the full detail mesh
+		};
+
+		// Bounds of a group of full detail triangles, tested on the gpu so only clusters that may be visible are drawn
+		struct MeshCluster {
+			glm::vec3 center;
+			float radius;
+			glm::vec3 coneAxis;
+			float coneCutoff;
+			uint32_t indexOffset; // Relative to the mesh's index offset
+			uint32_t indexCount;
+		};
+
 		// BasicMesh needs to provide a transform and pointers to it's data
 		struct BasicMesh {
 			uint32_t count; // This will be index count for indexed data, vertex count otherwise
-			uint32_t indexOffset; // Index offset is only used for indexed data
+			uint32_t indexOffset; // Index offset is only used for indexed data, in units of the index type
 			int32_t vertexOffset;
+			// 32 bit only when the mesh has too many vertices for 16 bit indices and was not split
+			VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+			// Object space bounds, left at zero for meshes which are not loaded from file
+			glm::vec3 boundsMin;
+			glm::vec3 boundsMax;
+			// Folded in to the model matrix when drawn, maps packed vertex positions back to object space. Identity for full float vertices.
+			glm::mat4 positionDequantization = glm::mat4(1.0f);
+			// Meshes split to keep 16 bit indices are drawn as one part per split, empty if the mesh is a single draw
+			std::vector<MeshPart> parts;
+			// Ordered from most to least detailed, not including the full detail mesh. Empty for split meshes.
+			std::vector<MeshLod> lods;
+			// Object space clusters covering the full detail mesh, only built for large meshes which are not split
+			std::vector<MeshCluster> clusters;
+			// Run as the mesh is destroyed so anything keyed by its address forgets it before the address can be reused. Set through
+			// const pointers by those caches, which clear it again if they are destroyed first.
+			mutable std::function<void(const BasicMesh*)> onDestroyed;
+
+			~BasicMesh() {
+				if (onDestroyed) {
+					onDestroyed(this);
+				}
+			}
 		};
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,208 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "MeshCache.h"
+#include <fstream>
+#include <filesystem>
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+static constexpr uint64_t kBlobAlignment = 16;
+
+static uint64_t alignOffset(uint64_t offset)
+{
+	return (offset + kBlobAlignment - 1) & ~(kBlobAlignment - 1);
+}
+
+MeshCache::MeshCache()
+	: header_(nullptr)
+{
+}
+
+bool MeshCache::open(const std::string& cacheFile, const std::string& sourceFile)
+{
+	close();
+	if (!file_.open(cacheFile)) {
+		return false;
+	}
+	header_ = static_cast<const MeshCacheHeader*>(file_.getData());
+	if (!validate(sourceFile)) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MeshCache::close()
+{
+	file_.close();
+	header_ = nullptr;
+}
+
+const void* MeshCache::getVertexData() const
+{
+	return static_cast<const char*>(file_.getData()) + header_->vertexDataOffset;
+}
+
+const void* MeshCache::getIndexData() const
+{
+	return static_cast<const char*>(file_.getData()) + header_->indexDataOffset;
+}
+
+const MeshCacheSubmesh* MeshCache::getSubmeshes() const
+{
+	return reinterpret_cast<const MeshCacheSubmesh*>(static_cast<const char*>(file_.getData()) + header_->submeshTableOffset);
+}
+
+const MeshCacheLod* MeshCache::getLods() const
+{
+	return reinterpret_cast<const MeshCacheLod*>(static_cast<const char*>(file_.getData()) + header_->lodTableOffset);
+}
+
+const MeshCacheCluster* MeshCache::getClusters() const
+{
+	return reinterpret_cast<const MeshCacheCluster*>(static_cast<const char*>(file_.getData()) + header_->clusterTableOffset);
+}
+
+bool MeshCache::validate(const std::string& sourceFile)
+{
+	const uint64_t fileSize = file_.getSize();
+	if (fileSize < sizeof(MeshCacheHeader) || header_->magic != kMagic || header_->version != kVersion || header_->vertexStride != sizeof(Vertex)) {
+		return false;
+	}
+	const uint64_t submeshEnd = header_->submeshTableOffset + uint64_t(header_->submeshCount) * sizeof(MeshCacheSubmesh);
+	const uint64_t lodEnd = header_->lodTableOffset + uint64_t(header_->lodCount) * sizeof(MeshCacheLod);
+	const uint64_t clusterEnd = header_->clusterTableOffset + uint64_t(header_->clusterCount) * sizeof(MeshCacheCluster);
+	const uint64_t vertexEnd = header_->vertexDataOffset + uint64_t(header_->vertexCount) * header_->vertexStride;
+	const uint64_t indexEnd = header_->indexDataOffset + uint64_t(header_->indexCount) * header_->indexSize;
+	if (submeshEnd > fileSize || lodEnd > fileSize || clusterEnd > fileSize || vertexEnd > fileSize || indexEnd > fileSize) {
+		return false;
+	}
+	for (uint32_t i = 0; i < header_->lodCount; ++i) {
+		if (uint64_t(getLods()[i].indexOffset) + getLods()[i].indexCount > header_->indexCount) {
+			return false;
+		}
+	}
+	for (uint32_t i = 0; i < header_->clusterCount; ++i) {
+		if (uint64_t(getClusters()[i].indexOffset) + getClusters()[i].indexCount > header_->indexCount) {
+			return false;
+		}
+	}
+
+	SourceStamp stamp;
+	if (!getSourceStamp(sourceFile, stamp)) {
+		return true;
+	}
+	if (stamp.size == header_->sourceSize && stamp.timestamp == header_->sourceTimestamp) {
+		return true;
+	}
+	// Timestamps change on checkout or copy without the content changing
+	return stamp.size == header_->sourceSize && hashFile(sourceFile) == header_->sourceHash;
+}
+
+bool MeshCache::write(const std::string& cacheFile, const std::string& sourceFile, const CookedMesh& mesh)
+{
+	EXPECTS(mesh.indexSize == sizeof(uint16_t) || mesh.indexSize == sizeof(uint32_t));
+	MeshCacheHeader header = {};
+	header.magic = kMagic;
+	header.version = kVersion;
+	SourceStamp stamp = {};
+	getSourceStamp(sourceFile, stamp);
+	header.sourceSize = stamp.size;
+	header.sourceTimestamp = stamp.timestamp;
+	header.sourceHash = hashFile(sourceFile);
+	header.vertexStride = sizeof(Vertex);
+	header.indexSize = mesh.indexSize;
+	header.flags = mesh.flags;
+	header.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+	header.indexCount = static_cast<uint32_t>(mesh.indices.size());
+	header.submeshCount = static_cast<uint32_t>(mesh.submeshes.size());
+	header.lodCount = static_cast<uint32_t>(mesh.lods.size());
+	header.clusterCount = static_cast<uint32_t>(mesh.clusters.size());
+	for (int i = 0; i < 3; ++i) {
+		header.boundsMin[i] = mesh.boundsMin[i];
+		header.boundsMax[i] = mesh.boundsMax[i];
+	}
+	header.submeshTableOffset = sizeof(MeshCacheHeader);
+	header.lodTableOffset = header.submeshTableOffset + mesh.submeshes.size() * sizeof(MeshCacheSubmesh);
+	header.clusterTableOffset = header.lodTableOffset + mesh.lods.size() * sizeof(MeshCacheLod);
+	header.vertexDataOffset = alignOffset(header.clusterTableOffset + mesh.clusters.size() * sizeof(MeshCacheCluster));
+	header.indexDataOffset = alignOffset(header.vertexDataOffset + mesh.vertices.size() * sizeof(Vertex));
+
+	std::vector<char> data(header.indexDataOffset + mesh.indices.size() * mesh.indexSize, 0);
+	memcpy(data.data(), &header, sizeof(header));
+	if (!mesh.submeshes.empty()) {
+		memcpy(data.data() + header.submeshTableOffset, mesh.submeshes.data(), mesh.submeshes.size() * sizeof(MeshCacheSubmesh));
+	}
+	if (!mesh.lods.empty()) {
+		memcpy(data.data() + header.lodTableOffset, mesh.lods.data(), mesh.lods.size() * sizeof(MeshCacheLod));
+	}
+	if (!mesh.clusters.empty()) {
+		memcpy(data.data() + header.clusterTableOffset, mesh.clusters.data(), mesh.clusters.size() * sizeof(MeshCacheCluster));
+	}
+	if (!mesh.vertices.empty()) {
+		memcpy(data.data() + header.vertexDataOffset, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+	}
+	if (mesh.indexSize == sizeof(uint32_t)) {
+		memcpy(data.data() + header.indexDataOffset, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+	}
+	else {
+		uint16_t* indices = reinterpret_cast<uint16_t*>(data.data() + header.indexDataOffset);
+		for (size_t i = 0; i < mesh.indices.size(); ++i) {
+			ASSERT(mesh.indices[i] <= std::numeric_limits<uint16_t>::max());
+			indices[i] = static_cast<uint16_t>(mesh.indices[i]);
+		}
+	}
+
+	// Write to a temporary file first so a partially written cache is never picked up
+	const std::string tempFile = cacheFile + ".tmp";
+	{
+		std::ofstream file(tempFile, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			DEBUG_ERR("Could not write mesh cache " << cacheFile);
+			return false;
+		}
+		file.write(data.data(), data.size());
+		if (!file.good()) {
+			return false;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(tempFile, cacheFile, error);
+	if (error) {
+		DEBUG_ERR("Could not replace mesh cache " << cacheFile << ": " << error.message());
+		std::filesystem::remove(tempFile, error);
+		return false;
+	}
+	return true;
+}
+
+uint64_t MeshCache::hashFile(const std::string& fileName)
+{
+	MappedFile file;
+	if (!file.open(fileName)) {
+		return 0;
+	}
+	uint64_t hash = 14695981039346656037ull;
+	const unsigned char* data = static_cast<const unsigned char*>(file.getData());
+	for (size_t i = 0; i < file.getSize(); ++i) {
+		hash = (hash ^ data[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+bool MeshCache::getSourceStamp(const std::string& sourceFile, SourceStamp& stamp)
+{
+	std::error_code error;
+	const auto size = std::filesystem::file_size(sourceFile, error);
+	if (error) {
+		return false;
+	}
+	const auto time = std::filesystem::last_write_time(sourceFile, error);
+	if (error) {
+		return false;
+	}
+	stamp.size = static_cast<uint64_t>(size);
+	stamp.timestamp = static_cast<int64_t>(time.time_since_epoch().count());
+	return true;
+}
@@ -0,0 +1,125 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Binary mesh format cooked from source meshes, mapped in to memory when loaded so nothing needs parsing.
+#pragma once
+#include "Vertex.h"
+#include "MappedFile.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		struct MeshCacheSubmesh {
+			static constexpr size_t kMaxNameLength = 64;
+			char name[kMaxNameLength]; // Null terminated, truncated if too long
+			uint32_t indexOffset;
+			uint32_t indexCount;
+			int32_t vertexOffset; // Base vertex of the indices, only non zero for meshes split to keep 16 bit indices
+			float boundsMin[3];
+			float boundsMax[3];
+		};
+
+		// A simplified version of the whole mesh, its indices follow the full detail indices in the index blob
+		struct MeshCacheLod {
+			uint32_t indexOffset;
+			uint32_t indexCount;
+			float error; // Object space distance the simplified surface may deviate from the original
+		};
+
+		// A small group of neighbouring full detail triangles with conservative bounds for culling, in object space
+		struct MeshCacheCluster {
+			float center[3];
+			float radius;
+			float coneAxis[3];
+			float coneCutoff; // Sine of the normal cone's spread, 1 when the triangles face too many ways for the cluster to ever be back facing
+			uint32_t indexOffset;
+			uint32_t indexCount;
+		};
+
+		/*
+			File layout: header, submesh table, lod table, cluster table, vertex blob, index blob. Blobs are 16 byte aligned from the start of the file.
+			The source size and timestamp are checked first, only if they differ is the source hashed to decide if a re-cook is needed.
+		*/
+		struct MeshCacheHeader {
+			uint32_t magic;
+			uint32_t version;
+			uint64_t sourceSize;
+			int64_t sourceTimestamp;
+			uint64_t sourceHash;
+			uint32_t vertexStride;
+			uint32_t indexSize;
+			uint32_t vertexCount;
+			uint32_t indexCount;
+			uint32_t submeshCount;
+			float boundsMin[3];
+			float boundsMax[3];
+			uint32_t flags;
+			uint32_t lodCount;
+			uint32_t clusterCount;
+			uint32_t padding;
+			uint64_t submeshTableOffset;
+			uint64_t lodTableOffset;
+			uint64_t clusterTableOffset;
+			uint64_t vertexDataOffset;
+			uint64_t indexDataOffset;
+		};
+
+		// Mesh data as it is cooked, indices are narrowed to indexSize bytes when written
+		struct CookedMesh {
+			std::vector<Vertex> vertices;
+			std::vector<uint32_t> indices;
+			uint32_t indexSize;
+			uint32_t flags = 0;
+			std::vector<MeshCacheSubmesh> submeshes;
+			std::vector<MeshCacheLod> lods;
+			std::vector<MeshCacheCluster> clusters;
+			glm::vec3 boundsMin;
+			glm::vec3 boundsMax;
+		};
+
+		class MeshCache {
+		public:
+			static constexpr uint32_t kMagic = 0x4D4C5A51; // "QZLM"
+			// Increment whenever the layout or the cooking output changes
+			static constexpr uint32_t kVersion = 5;
+			// Header flags for cooking options that change the output
+			static constexpr uint32_t kFlagSplit = 1;
+
+			MeshCache();
+
+			// Map the cache file, false if it is missing, malformed or out of date with the source file.
+			// A cache without its source is still accepted so cooked meshes can be shipped alone.
+			bool open(const std::string& cacheFile, const std::string& sourceFile);
+			void close();
+
+			// Pointers are in to the mapping and are valid until close
+			const MeshCacheHeader& getHeader() const {
+				return *header_;
+			}
+			const void* getVertexData() const;
+			const void* getIndexData() const;
+			const MeshCacheSubmesh* getSubmeshes() const;
+			const MeshCacheLod* getLods() const;
+			const MeshCacheCluster* getClusters() const;
+			void prefetch() const {
+				file_.prefetch();
+			}
+
+			static bool write(const std::string& cacheFile, const std::string& sourceFile, const CookedMesh& mesh);
+			// FNV-1a over the file contents, 0 if it can not be read
+			static uint64_t hashFile(const std::string& fileName);
+
+			// Also used by the other cooked formats to tell when their source has changed
+			struct SourceStamp {
+				uint64_t size;
+				int64_t timestamp;
+			};
+			static bool getSourceStamp(const std::string& sourceFile, SourceStamp& stamp);
+
+		private:
+			bool validate(const std::string& sourceFile);
+
+			MappedFile file_;
+			const MeshCacheHeader* header_;
+		};
+	}
+}
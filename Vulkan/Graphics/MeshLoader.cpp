@@ -3,6 +3,11 @@
 // Reference: https://github.com/syoyo/tinyobjloader code example for loading using tinyobj
 #include "MeshLoader.h"
 #include "ElementBufferObject.h"
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+#include "VertexPacker.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "../../Shared/tiny_obj_loader.h"
@@ -12,12 +17,21 @@ using namespace QZL::Graphics;
 
 const std::string MeshLoader::kPath = "../Data/Meshes/";
 const std::string MeshLoader::kExt = ".obj";
+const std::string MeshLoader::kCacheExt = ".qmesh";
+bool MeshLoader::splitLargeMeshes_ = false;
+std::unordered_map<std::string, MeshLoader::PendingMesh> MeshLoader::pendingMeshes_;
 
 BasicMesh* MeshLoader::loadMesh(const std::string& meshName, ElementBufferObject& eleBuf, MeshLoadFunc loaderFunc)
 {
 	ASSERT(!eleBuf.isCommitted());
 	if (!eleBuf.containsMesh(meshName)) {
-		if (loaderFunc == nullptr) {
+		auto pending = pendingMeshes_.find(meshName);
+		if (pending != pendingMeshes_.end() && loaderFunc == nullptr) {
+			pending->second.handle.get();
+			placeParsedMesh(meshName, eleBuf, *pending->second.mesh);
+			pendingMeshes_.erase(pending);
+		}
+		else if (loaderFunc == nullptr) {
 			loadMeshFromFile(meshName, eleBuf);
 		}
 		else {
@@ -31,15 +45,187 @@ BasicMesh* MeshLoader::loadMesh(const std::string& meshName, ElementBufferObject
 	return eleBuf.getMesh(meshName);
 }
 
+JobSystem::JobHandle MeshLoader::loadMeshAsync(const std::string& meshName, JobSystem* jobSystem)
+{
+	auto pending = pendingMeshes_.find(meshName);
+	if (pending != pendingMeshes_.end()) {
+		return pending->second.handle;
+	}
+	auto mesh = std::make_shared<ParsedMesh>();
+	JobSystem::JobHandle handle = jobSystem->submit([meshName, mesh]() {
+		readMesh(meshName, *mesh);
+	});
+	pendingMeshes_[meshName] = { handle, mesh };
+	return handle;
+}
+
 void MeshLoader::placeMeshInBuffer(const std::string& meshName, ElementBufferObject& eleBuf, uint32_t count, 
-	void* indices, void* vertices, size_t indicesSize, size_t verticesSize)
+	const void* indices, const void* vertices, size_t indicesSize, size_t verticesSize, size_t indexStride)
 {
-	auto indexOffset = eleBuf.addIndices(indices, indicesSize);
+	auto indexOffset = eleBuf.addIndices(indices, indicesSize, indexStride);
 	auto vertexOffset = eleBuf.addVertices(vertices, verticesSize);
 	eleBuf.emplaceMesh(meshName, count, static_cast<uint32_t>(vertexOffset), static_cast<uint32_t>(indexOffset));
+	if (indexStride != 0) {
+		eleBuf.getMesh(meshName)->indexType = indexStride == sizeof(uint32_t) ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16;
+	}
+}
+
+void MeshLoader::addMeshParts(BasicMesh* basicMesh, const MeshCacheSubmesh* submeshes, uint32_t submeshCount)
+{
+	for (uint32_t i = 0; i < submeshCount; ++i) {
+		if (submeshes[i].indexCount == 0) {
+			continue;
+		}
+		const uint32_t indexOffset = basicMesh->indexOffset + submeshes[i].indexOffset;
+		const int32_t vertexOffset = basicMesh->vertexOffset + submeshes[i].vertexOffset;
+		if (!basicMesh->parts.empty() && basicMesh->parts.back().vertexOffset == vertexOffset && 
+			basicMesh->parts.back().indexOffset + basicMesh->parts.back().count == indexOffset) {
+			basicMesh->parts.back().count += submeshes[i].indexCount;
+		}
+		else {
+			basicMesh->parts.push_back({ submeshes[i].indexCount, indexOffset, vertexOffset });
+		}
+	}
+	if (basicMesh->parts.size() <= 1) {
+		basicMesh->parts.clear();
+	}
+}
+
+bool MeshLoader::cookMesh(const std::string& meshName)
+{
+	MeshCache cache;
+	if (openCache(meshName, cache)) {
+		return true;
+	}
+	CookedMesh mesh;
+	return cookFromSource(meshName, mesh);
 }
 
 void MeshLoader::loadMeshFromFile(const std::string& meshName, ElementBufferObject& eleBuf)
+{
+	ParsedMesh mesh;
+	readMesh(meshName, mesh);
+	placeParsedMesh(meshName, eleBuf, mesh);
+}
+
+bool MeshLoader::readMesh(const std::string& meshName, ParsedMesh& mesh)
+{
+	mesh.cached = openCache(meshName, mesh.cache);
+	if (mesh.cached) {
+		mesh.cache.prefetch();
+		return true;
+	}
+	return cookFromSource(meshName, mesh.cooked);
+}
+
+void MeshLoader::placeParsedMesh(const std::string& meshName, ElementBufferObject& eleBuf, const ParsedMesh& parsed)
+{
+	if (parsed.cached) {
+		// Copied straight out of the mapping in to the buffer's staging data
+		const MeshCache& cache = parsed.cache;
+		const MeshCacheHeader& header = cache.getHeader();
+		placeCookedMesh(meshName, eleBuf, static_cast<const Vertex*>(cache.getVertexData()), header.vertexCount, cache.getIndexData(), header.indexCount,
+			header.indexSize, cache.getSubmeshes(), header.submeshCount, cache.getLods(), header.lodCount, cache.getClusters(), header.clusterCount, glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]),
+			glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]));
+		return;
+	}
+
+	// Left empty when the source could not be parsed, rather than place an empty range the load fails here
+	const CookedMesh& mesh = parsed.cooked;
+	ASSERT(!mesh.vertices.empty() && !mesh.indices.empty());
+	if (mesh.indexSize == sizeof(uint32_t)) {
+		placeCookedMesh(meshName, eleBuf, mesh.vertices.data(), static_cast<uint32_t>(mesh.vertices.size()), mesh.indices.data(), 
+			static_cast<uint32_t>(mesh.indices.size()), sizeof(uint32_t), mesh.submeshes.data(), static_cast<uint32_t>(mesh.submeshes.size()), 
+			mesh.lods.data(), static_cast<uint32_t>(mesh.lods.size()), mesh.clusters.data(), static_cast<uint32_t>(mesh.clusters.size()), mesh.boundsMin, mesh.boundsMax);
+	}
+	else {
+		std::vector<uint16_t> indices(mesh.indices.begin(), mesh.indices.end());
+		placeCookedMesh(meshName, eleBuf, mesh.vertices.data(), static_cast<uint32_t>(mesh.vertices.size()), indices.data(), 
+			static_cast<uint32_t>(indices.size()), sizeof(uint16_t), mesh.submeshes.data(), static_cast<uint32_t>(mesh.submeshes.size()), 
+			mesh.lods.data(), static_cast<uint32_t>(mesh.lods.size()), mesh.clusters.data(), static_cast<uint32_t>(mesh.clusters.size()), mesh.boundsMin, mesh.boundsMax);
+	}
+}
+
+void MeshLoader::placeCookedMesh(const std::string& meshName, ElementBufferObject& eleBuf, const Vertex* vertices, uint32_t vertexCount,
+	const void* indices, uint32_t indexCount, uint32_t indexSize, const MeshCacheSubmesh* submeshes, uint32_t submeshCount,
+	const MeshCacheLod* lods, uint32_t lodCount, const MeshCacheCluster* clusters, uint32_t clusterCount, const glm::vec3& boundsMin, 
+	const glm::vec3& boundsMax)
+{
+	const VertexTypes vertexType = eleBuf.getVertexType();
+	ASSERT(eleBuf.sizeOfVertices_ == getVertexSize(vertexType));
+	// The level of detail indices are placed with the rest but the mesh's count only covers the full detail indices
+	const uint32_t baseCount = lodCount > 0 ? lods[0].indexOffset : indexCount;
+	if (vertexType == VertexTypes::VERTEX) {
+		placeMeshInBuffer(meshName, eleBuf, baseCount, indices, vertices, size_t(indexCount) * indexSize, size_t(vertexCount) * sizeof(Vertex), indexSize);
+	}
+	else {
+		// Tangent generation needs indices in to the whole vertex list, so undo the per part base vertex of split meshes
+		std::vector<uint32_t> meshIndices(vertexType == VertexTypes::PACKED_VERTEX_TANGENT_COLOUR ? baseCount : 0);
+		for (uint32_t i = 0; i < submeshCount && !meshIndices.empty(); ++i) {
+			for (uint32_t j = submeshes[i].indexOffset; j < submeshes[i].indexOffset + submeshes[i].indexCount; ++j) {
+				const uint32_t index = indexSize == sizeof(uint32_t) ? static_cast<const uint32_t*>(indices)[j] : static_cast<const uint16_t*>(indices)[j];
+				meshIndices[j] = index + submeshes[i].vertexOffset;
+			}
+		}
+		std::vector<char> packed = VertexPacker::pack(vertexType, vertices, vertexCount, meshIndices, boundsMin, boundsMax);
+		placeMeshInBuffer(meshName, eleBuf, baseCount, indices, packed.data(), size_t(indexCount) * indexSize, packed.size(), indexSize);
+		eleBuf.getMesh(meshName)->positionDequantization = VertexPacker::makeDequantization(boundsMin, boundsMax);
+	}
+	BasicMesh* basicMesh = eleBuf.getMesh(meshName);
+	basicMesh->boundsMin = boundsMin;
+	basicMesh->boundsMax = boundsMax;
+	addMeshParts(basicMesh, submeshes, submeshCount);
+	for (uint32_t i = 0; i < lodCount; ++i) {
+		basicMesh->lods.push_back({ lods[i].indexCount, lods[i].indexOffset, lods[i].error });
+	}
+	for (uint32_t i = 0; i < clusterCount; ++i) {
+		const MeshCacheCluster& cluster = clusters[i];
+		basicMesh->clusters.push_back({ glm::vec3(cluster.center[0], cluster.center[1], cluster.center[2]), cluster.radius,
+			glm::vec3(cluster.coneAxis[0], cluster.coneAxis[1], cluster.coneAxis[2]), cluster.coneCutoff, cluster.indexOffset, cluster.indexCount });
+	}
+}
+
+bool MeshLoader::openCache(const std::string& meshName, MeshCache& cache)
+{
+	if (!cache.open(kPath + meshName + kCacheExt, kPath + meshName + kExt)) {
+		return false;
+	}
+	// Only meshes too large for 16 bit indices are affected by the split option, re-cook those if it has changed
+	const MeshCacheHeader& header = cache.getHeader();
+	const bool wasSplit = (header.flags & MeshCache::kFlagSplit) != 0;
+	if ((wasSplit && !splitLargeMeshes_) || (header.indexSize == sizeof(uint32_t) && splitLargeMeshes_)) {
+		cache.close();
+		return false;
+	}
+	return true;
+}
+
+bool MeshLoader::cookFromSource(const std::string& meshName, CookedMesh& mesh)
+{
+	const std::string sourceFile = kPath + meshName + kExt;
+	if (!parseObj(sourceFile, mesh)) {
+		return false;
+	}
+	optimizeMesh(meshName, mesh);
+	mesh.indexSize = sizeof(uint16_t);
+	if (mesh.vertices.size() > kMaxShortIndexVertices) {
+		if (splitLargeMeshes_) {
+			splitMesh(mesh);
+			DEBUG_LOG("Split mesh " << meshName << " in to " << mesh.submeshes.size() << " parts to keep 16 bit indices");
+		}
+		else {
+			mesh.indexSize = sizeof(uint32_t);
+		}
+	}
+	// The parts of a split mesh index different vertex ranges, so neither a simplified version nor its clusters can be drawn as one range
+	if ((mesh.flags & MeshCache::kFlagSplit) == 0) {
+		buildClusters(meshName, mesh);
+		generateLods(meshName, mesh);
+	}
+	return MeshCache::write(kPath + meshName + kCacheExt, sourceFile, mesh);
+}
+
+bool MeshLoader::parseObj(const std::string& fileName, CookedMesh& mesh)
 {
 	tinyobj::attrib_t attrib;
 	std::vector<tinyobj::shape_t> shapes;
@@ -47,17 +233,23 @@ void MeshLoader::loadMeshFromFile(const std::string& meshName, ElementBufferObje
 
 	std::string err;
 	std::string warn;
-	bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, (kPath + meshName + kExt).c_str());
+	bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, fileName.c_str());
 	if (!warn.empty())
 		std::cout << warn << std::endl;
 	if (!err.empty())
 		std::cout << err << std::endl;
 
-	std::vector<IndexType> indices;
-	std::vector<Vertex> verts;
-	uint16_t count = 0;
+	mesh.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+	mesh.boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+	uint32_t count = 0;
 
 	for (const auto& shape : shapes) {
+		MeshCacheSubmesh submesh = {};
+		shape.name.copy(submesh.name, MeshCacheSubmesh::kMaxNameLength - 1);
+		submesh.indexOffset = static_cast<uint32_t>(mesh.indices.size());
+		glm::vec3 submeshMin(std::numeric_limits<float>::max());
+		glm::vec3 submeshMax(std::numeric_limits<float>::lowest());
+
 		for (const auto& index : shape.mesh.indices) {
 			Vertex vertex = {};
 			vertex.x = attrib.vertices[3 * (size_t)index.vertex_index + 0];
@@ -72,10 +264,137 @@ void MeshLoader::loadMeshFromFile(const std::string& meshName, ElementBufferObje
 				vertex.ny = attrib.normals[3 * (size_t)index.normal_index + 1];
 				vertex.nz = attrib.normals[3 * (size_t)index.normal_index + 2];
 			}
+			submeshMin = glm::min(submeshMin, glm::vec3(vertex.x, vertex.y, vertex.z));
+			submeshMax = glm::max(submeshMax, glm::vec3(vertex.x, vertex.y, vertex.z));
 
-			verts.push_back(vertex);
-			indices.push_back(count++);
+			mesh.vertices.push_back(vertex);
+			mesh.indices.push_back(count++);
 		}
+
+		submesh.indexCount = static_cast<uint32_t>(mesh.indices.size()) - submesh.indexOffset;
+		for (int i = 0; i < 3; ++i) {
+			submesh.boundsMin[i] = submeshMin[i];
+			submesh.boundsMax[i] = submeshMax[i];
+		}
+		mesh.boundsMin = glm::min(mesh.boundsMin, submeshMin);
+		mesh.boundsMax = glm::max(mesh.boundsMax, submeshMax);
+		mesh.submeshes.push_back(submesh);
+	}
+	if (mesh.vertices.empty()) {
+		mesh.boundsMin = mesh.boundsMax = glm::vec3(0.0f);
 	}
-	placeMeshInBuffer(meshName, eleBuf, static_cast<uint32_t>(indices.size()), indices.data(), verts.data(), indices.size() * sizeof(IndexType), verts.size() * sizeof(Vertex));
+	return ret;
+}
+
+void MeshLoader::optimizeMesh(const std::string& meshName, CookedMesh& mesh)
+{
+	const size_t vertexCountBefore = mesh.vertices.size();
+	const float acmrBefore = MeshOptimizer::calculateACMR(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+
+	MeshOptimizer::weldVertices(mesh.vertices, mesh.indices);
+	for (const auto& submesh : mesh.submeshes) {
+		if (submesh.indexCount == 0) {
+			continue;
+		}
+		MeshOptimizer::optimizeVertexCache(&mesh.indices[submesh.indexOffset], submesh.indexCount, mesh.vertices.size());
+		MeshOptimizer::optimizeOverdraw(&mesh.indices[submesh.indexOffset], submesh.indexCount, mesh.vertices);
+	}
+	MeshOptimizer::optimizeVertexFetch(mesh.vertices, mesh.indices);
+
+	const float acmrAfter = MeshOptimizer::calculateACMR(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+	DEBUG_LOG("Cooked mesh " << meshName << ": " << vertexCountBefore << " -> " << mesh.vertices.size() << " vertices, ACMR " 
+		<< acmrBefore << " -> " << acmrAfter);
+}
+
+void MeshLoader::buildClusters(const std::string& meshName, CookedMesh& mesh)
+{
+	if (mesh.indices.size() / 3 < kMinClusteredTriangles) {
+		return;
+	}
+	for (const auto& submesh : mesh.submeshes) {
+		if (submesh.indexCount == 0) {
+			continue;
+		}
+		MeshletBuilder::build(&mesh.indices[submesh.indexOffset], submesh.indexCount, mesh.vertices, submesh.indexOffset, mesh.clusters);
+	}
+	DEBUG_LOG("Built " << mesh.clusters.size() << " clusters for mesh " << meshName);
+}
+
+void MeshLoader::generateLods(const std::string& meshName, CookedMesh& mesh)
+{
+	if (mesh.indices.empty()) {
+		return;
+	}
+	const uint32_t baseCount = static_cast<uint32_t>(mesh.indices.size());
+	const float maxError = glm::length(mesh.boundsMax - mesh.boundsMin) * kMaxLodErrorFraction;
+	// Each level is simplified from the full detail indices so its error is measured against the original surface
+	const std::vector<uint32_t> baseIndices = mesh.indices;
+	size_t previousCount = baseCount;
+	while (mesh.lods.size() < kMaxLods) {
+		const size_t targetCount = (previousCount / 6) * 3;
+		float error;
+		std::vector<uint32_t> lodIndices = MeshSimplifier::simplify(baseIndices, mesh.vertices, targetCount, maxError, error);
+		if (lodIndices.empty() || lodIndices.size() > previousCount * (1.0f - kMinLodReduction)) {
+			break;
+		}
+		MeshOptimizer::optimizeVertexCache(lodIndices.data(), lodIndices.size(), mesh.vertices.size());
+
+		mesh.lods.push_back({ static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(lodIndices.size()), error });
+		mesh.indices.insert(mesh.indices.end(), lodIndices.begin(), lodIndices.end());
+		previousCount = lodIndices.size();
+	}
+	DEBUG_LOG("Generated " << mesh.lods.size() << " levels of detail for mesh " << meshName << ", " << baseCount << " -> " << previousCount << " indices");
+}
+
+void MeshLoader::splitMesh(CookedMesh& mesh)
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<MeshCacheSubmesh> submeshes;
+	vertices.reserve(mesh.vertices.size());
+	indices.reserve(mesh.indices.size());
+	// Vertices are duplicated in to each part that uses them, the remap is only valid for the part it was made in
+	std::vector<uint32_t> remap(mesh.vertices.size());
+	std::vector<uint32_t> remapPart(mesh.vertices.size(), std::numeric_limits<uint32_t>::max());
+	uint32_t partIdx = 0;
+	size_t partBase = 0;
+
+	for (const auto& submesh : mesh.submeshes) {
+		ASSERT(submesh.indexCount % 3 == 0);
+		MeshCacheSubmesh part = submesh;
+		part.indexOffset = static_cast<uint32_t>(indices.size());
+		part.vertexOffset = static_cast<int32_t>(partBase);
+		for (uint32_t i = 0; i < submesh.indexCount; i += 3) {
+			const uint32_t* triangle = &mesh.indices[size_t(submesh.indexOffset) + i];
+			size_t newVertices = 0;
+			for (int j = 0; j < 3; ++j) {
+				newVertices += remapPart[triangle[j]] != partIdx ? 1 : 0;
+			}
+			if (vertices.size() - partBase + newVertices > kMaxShortIndexVertices) {
+				part.indexCount = static_cast<uint32_t>(indices.size()) - part.indexOffset;
+				submeshes.push_back(part);
+				++partIdx;
+				partBase = vertices.size();
+				part.indexOffset = static_cast<uint32_t>(indices.size());
+				part.vertexOffset = static_cast<int32_t>(partBase);
+			}
+			for (int j = 0; j < 3; ++j) {
+				const uint32_t vertex = triangle[j];
+				if (remapPart[vertex] != partIdx) {
+					remapPart[vertex] = partIdx;
+					remap[vertex] = static_cast<uint32_t>(vertices.size() - partBase);
+					vertices.push_back(mesh.vertices[vertex]);
+				}
+				indices.push_back(remap[vertex]);
+			}
+		}
+		part.indexCount = static_cast<uint32_t>(indices.size()) - part.indexOffset;
+		submeshes.push_back(part);
+	}
+
+	mesh.vertices.swap(vertices);
+	mesh.indices.swap(indices);
+	mesh.submeshes.swap(submeshes);
+	mesh.indexSize = sizeof(uint16_t);
+	mesh.flags |= MeshCache::kFlagSplit;
 }
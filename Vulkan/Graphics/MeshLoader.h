@@ -3,24 +3,79 @@
 // Purpose: Encapsulate and support loading meshes from .obj files.
 #pragma once
 #include "Vertex.h"
+#include "MeshCache.h"
+#include "../JobSystem.h"
 
 namespace QZL
 {
 	namespace Graphics {
-		using IndexType = uint16_t;
-
 		class ElementBufferObject;
 		struct BasicMesh;
 
+		// A mesh read from its cache or cooked from source, ready to be placed in an element buffer
+		struct ParsedMesh {
+			MeshCache cache;
+			CookedMesh cooked;
+			bool cached = false;
+		};
+
 		class MeshLoader {
 		public:
 			static BasicMesh* loadMesh(const std::string& meshName, ElementBufferObject& eleBuf, MeshLoadFunc loaderFunc);
+			// Read or cook the mesh on a worker so a later loadMesh only has to place it. Must be called from the main thread.
+			static JobSystem::JobHandle loadMeshAsync(const std::string& meshName, JobSystem* jobSystem);
+			// Write the binary cache for a mesh if it is missing or out of date, allows meshes to be cooked offline
+			static bool cookMesh(const std::string& meshName);
+			// Meshes with too many vertices for 16 bit indices use 32 bit indices unless splitting is enabled, in which case they are cut in to
+			// parts that each address fewer vertices and are drawn separately. Changing this re-cooks the affected meshes.
+			static void setSplitLargeMeshes(bool split) {
+				splitLargeMeshes_ = split;
+			}
 		private:
 			static void placeMeshInBuffer(const std::string& meshName, ElementBufferObject& eleBuf, uint32_t count, 
-				void* indices, void* vertices, size_t indicesSize, size_t verticesSize);
+				const void* indices, const void* vertices, size_t indicesSize, size_t verticesSize, size_t indexStride = 0);
+			// Convert the vertices to the buffer's format and place them with the indices, shared by the cache and source paths
+			static void placeCookedMesh(const std::string& meshName, ElementBufferObject& eleBuf, const Vertex* vertices, uint32_t vertexCount,
+				const void* indices, uint32_t indexCount, uint32_t indexSize, const MeshCacheSubmesh* submeshes, uint32_t submeshCount,
+				const MeshCacheLod* lods, uint32_t lodCount, const MeshCacheCluster* clusters, uint32_t clusterCount, const glm::vec3& boundsMin, 
+				const glm::vec3& boundsMax);
+			// Give the mesh one part per run of submeshes sharing a base vertex, meshes which were not split stay a single draw
+			static void addMeshParts(BasicMesh* basicMesh, const MeshCacheSubmesh* submeshes, uint32_t submeshCount);
+			// Loads from the binary cache when it is valid, otherwise the .obj is parsed and the cache is rewritten
 			static void loadMeshFromFile(const std::string& meshName, ElementBufferObject& eleBuf);
+			// The file half of loadMeshFromFile, safe to call from any thread
+			static bool readMesh(const std::string& meshName, ParsedMesh& mesh);
+			static void placeParsedMesh(const std::string& meshName, ElementBufferObject& eleBuf, const ParsedMesh& mesh);
+			static bool openCache(const std::string& meshName, MeshCache& cache);
+			static bool cookFromSource(const std::string& meshName, CookedMesh& mesh);
+			static bool parseObj(const std::string& fileName, CookedMesh& mesh);
+			// Weld duplicate vertices and reorder each submesh for the vertex cache and overdraw
+			static void optimizeMesh(const std::string& meshName, CookedMesh& mesh);
+			// Regroup the triangles of each submesh in to clusters for gpu culling
+			static void buildClusters(const std::string& meshName, CookedMesh& mesh);
+			// Append progressively simplified index lists after the full detail indices, each sharing the full detail vertices
+			static void generateLods(const std::string& meshName, CookedMesh& mesh);
+			// Cut the submeshes so no part addresses more than kMaxShortIndexVertices, indices become relative to each part's base vertex
+			static void splitMesh(CookedMesh& mesh);
+
+			// One short of the 16 bit range so the largest index never collides with a primitive restart value
+			static constexpr size_t kMaxShortIndexVertices = std::numeric_limits<uint16_t>::max();
+			// Smaller meshes are cheap enough to draw whole that culling their clusters would cost more than it saves
+			static constexpr size_t kMinClusteredTriangles = 4096;
+			static constexpr size_t kMaxLods = 4;
+			// A level is only kept if it removes at least this fraction of the previous level's triangles
+			static constexpr float kMinLodReduction = 0.2f;
+			// Simplification stops once the surface would move further than this fraction of the bounds' diagonal
+			static constexpr float kMaxLodErrorFraction = 0.1f;
+			static bool splitLargeMeshes_;
+			struct PendingMesh {
+				JobSystem::JobHandle handle;
+				std::shared_ptr<ParsedMesh> mesh;
+			};
+			static std::unordered_map<std::string, PendingMesh> pendingMeshes_;
 			static const std::string kPath;
 			static const std::string kExt;
+			static const std::string kCacheExt;
 		};
 	}
 }
\ No newline at end of file
@@ -0,0 +1,290 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "MeshOptimizer.h"
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+static constexpr uint32_t kInvalidIndex = ~0u;
+static constexpr float kLastTriangleScore = 0.75f;
+static constexpr float kCacheDecayPower = 1.5f;
+static constexpr float kValenceBoostScale = 2.0f;
+static constexpr float kValenceBoostPower = 0.5f;
+
+namespace {
+	struct VertexHasher {
+		size_t operator()(const Vertex& v) const {
+			// FNV-1a over the raw bytes, welding only merges bitwise identical vertices
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&v);
+			size_t hash = 2166136261u;
+			for (size_t i = 0; i < sizeof(Vertex); ++i) {
+				hash = (hash ^ bytes[i]) * 16777619u;
+			}
+			return hash;
+		}
+	};
+	struct VertexEqual {
+		bool operator()(const Vertex& a, const Vertex& b) const {
+			return memcmp(&a, &b, sizeof(Vertex)) == 0;
+		}
+	};
+
+	// Forsyth's vertex score, cachePosition is kInvalidIndex when not in the cache
+	float vertexScore(uint32_t cachePosition, uint32_t remainingTriangles)
+	{
+		if (remainingTriangles == 0) {
+			return -1.0f;
+		}
+		float score = 0.0f;
+		if (cachePosition != kInvalidIndex) {
+			if (cachePosition < 3) {
+				score = kLastTriangleScore;
+			}
+			else {
+				const float scaler = 1.0f / (MeshOptimizer::kCacheSize - 3);
+				score = powf(1.0f - (cachePosition - 3) * scaler, kCacheDecayPower);
+			}
+		}
+		return score + kValenceBoostScale * powf(float(remainingTriangles), -kValenceBoostPower);
+	}
+}
+
+size_t MeshOptimizer::weldVertices(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	std::unordered_map<Vertex, uint32_t, VertexHasher, VertexEqual> unique;
+	unique.reserve(vertices.size());
+	std::vector<uint32_t> remap(vertices.size());
+	std::vector<Vertex> welded;
+	welded.reserve(vertices.size());
+	for (size_t i = 0; i < vertices.size(); ++i) {
+		auto result = unique.emplace(vertices[i], static_cast<uint32_t>(welded.size()));
+		if (result.second) {
+			welded.push_back(vertices[i]);
+		}
+		remap[i] = result.first->second;
+	}
+	for (auto& index : indices) {
+		index = remap[index];
+	}
+	const size_t removed = vertices.size() - welded.size();
+	vertices.swap(welded);
+	return removed;
+}
+
+void MeshOptimizer::optimizeVertexCache(uint32_t* indices, size_t count, size_t vertexCount)
+{
+	EXPECTS(count % 3 == 0);
+	const size_t triangleCount = count / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// Triangle adjacency per vertex, packed in to one array
+	std::vector<uint32_t> remaining(vertexCount, 0);
+	for (size_t i = 0; i < count; ++i) {
+		remaining[indices[i]]++;
+	}
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remaining[v];
+	}
+	std::vector<uint32_t> adjacency(count);
+	std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t t = 0; t < triangleCount; ++t) {
+		for (size_t k = 0; k < 3; ++k) {
+			adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+		}
+	}
+
+	std::vector<uint32_t> cachePosition(vertexCount, kInvalidIndex);
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		vertexScores[v] = vertexScore(kInvalidIndex, remaining[v]);
+	}
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	for (size_t t = 0; t < triangleCount; ++t) {
+		triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+	}
+
+	std::vector<uint32_t> output;
+	output.reserve(count);
+	std::vector<uint32_t> cache, nextCache;
+	cache.reserve(kCacheSize + 3);
+	nextCache.reserve(kCacheSize + 3);
+	size_t deadEndCursor = 0;
+	uint32_t best = static_cast<uint32_t>(std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin());
+
+	while (best != kInvalidIndex) {
+		emitted[best] = true;
+		const uint32_t* tri = &indices[best * 3];
+		output.insert(output.end(), tri, tri + 3);
+
+		// Emitted vertices move to the front of the LRU cache
+		nextCache.assign(tri, tri + 3);
+		for (uint32_t v : cache) {
+			if (v != tri[0] && v != tri[1] && v != tri[2]) {
+				nextCache.push_back(v);
+			}
+		}
+		for (size_t k = 0; k < 3; ++k) {
+			remaining[tri[k]]--;
+		}
+		for (size_t i = kCacheSize; i < nextCache.size(); ++i) {
+			cachePosition[nextCache[i]] = kInvalidIndex;
+			vertexScores[nextCache[i]] = vertexScore(kInvalidIndex, remaining[nextCache[i]]);
+		}
+		if (nextCache.size() > kCacheSize) {
+			nextCache.resize(kCacheSize);
+		}
+		cache.swap(nextCache);
+
+		// Only triangles touching the cache change score, the best of those is the next triangle
+		best = kInvalidIndex;
+		float bestScore = -1.0f;
+		for (uint32_t i = 0; i < cache.size(); ++i) {
+			cachePosition[cache[i]] = i;
+			vertexScores[cache[i]] = vertexScore(i, remaining[cache[i]]);
+		}
+		for (uint32_t v : cache) {
+			for (uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; ++a) {
+				const uint32_t t = adjacency[a];
+				if (emitted[t]) {
+					continue;
+				}
+				triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+				if (triangleScores[t] > bestScore) {
+					bestScore = triangleScores[t];
+					best = t;
+				}
+			}
+		}
+		// Dead end, continue from the next triangle which has not been emitted
+		if (best == kInvalidIndex) {
+			while (deadEndCursor < triangleCount && emitted[deadEndCursor]) {
+				deadEndCursor++;
+			}
+			if (deadEndCursor < triangleCount) {
+				best = static_cast<uint32_t>(deadEndCursor);
+			}
+		}
+	}
+	// Small or already well ordered meshes can come out marginally worse, keep whichever order is better
+	if (calculateACMR(output.data(), count, vertexCount) < calculateACMR(indices, count, vertexCount)) {
+		memcpy(indices, output.data(), count * sizeof(uint32_t));
+	}
+}
+
+void MeshOptimizer::optimizeOverdraw(uint32_t* indices, size_t count, const std::vector<Vertex>& vertices, float threshold)
+{
+	EXPECTS(count % 3 == 0);
+	const size_t triangleCount = count / 3;
+	if (triangleCount < 2) {
+		return;
+	}
+	const float acmrBefore = calculateACMR(indices, count, vertices.size());
+
+	// Clusters start where the cache simulation misses every vertex of a triangle, these are
+	// natural restarts in the cache optimised order so moving whole clusters costs little
+	std::vector<size_t> clusterStarts = { 0 };
+	{
+		std::vector<uint32_t> timestamps(vertices.size(), 0);
+		uint32_t time = kCacheSize + 1;
+		for (size_t t = 0; t < triangleCount; ++t) {
+			uint32_t misses = 0;
+			for (size_t k = 0; k < 3; ++k) {
+				const uint32_t v = indices[t * 3 + k];
+				if (time - timestamps[v] > kCacheSize) {
+					timestamps[v] = time++;
+					misses++;
+				}
+			}
+			if (misses == 3 && t > clusterStarts.back()) {
+				clusterStarts.push_back(t);
+			}
+		}
+	}
+	if (clusterStarts.size() < 2) {
+		return;
+	}
+
+	auto position = [&vertices](uint32_t i) {
+		return glm::vec3(vertices[i].x, vertices[i].y, vertices[i].z);
+	};
+	glm::vec3 meshCentroid(0.0f);
+	for (size_t i = 0; i < count; ++i) {
+		meshCentroid = meshCentroid + position(indices[i]);
+	}
+	meshCentroid = meshCentroid / float(count);
+
+	// Clusters facing away from the mesh centre are most likely to occlude others
+	struct Cluster {
+		size_t first;
+		size_t triangleCount;
+		float sortKey;
+	};
+	std::vector<Cluster> clusters;
+	for (size_t c = 0; c < clusterStarts.size(); ++c) {
+		const size_t first = clusterStarts[c];
+		const size_t end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+		glm::vec3 centroid(0.0f);
+		glm::vec3 normal(0.0f);
+		for (size_t t = first; t < end; ++t) {
+			const glm::vec3 p0 = position(indices[t * 3]);
+			const glm::vec3 p1 = position(indices[t * 3 + 1]);
+			const glm::vec3 p2 = position(indices[t * 3 + 2]);
+			const glm::vec3 areaNormal = glm::cross(p1 - p0, p2 - p0);
+			centroid = centroid + (p0 + p1 + p2) / 3.0f;
+			normal = normal + areaNormal;
+		}
+		centroid = centroid / float(end - first);
+		const float normalLength = glm::length(normal);
+		const float sortKey = normalLength > 0.0f ? glm::dot(centroid - meshCentroid, normal) / normalLength : 0.0f;
+		clusters.push_back({ first, end - first, sortKey });
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+		return a.sortKey > b.sortKey;
+	});
+
+	std::vector<uint32_t> sorted;
+	sorted.reserve(count);
+	for (const auto& cluster : clusters) {
+		sorted.insert(sorted.end(), indices + cluster.first * 3, indices + (cluster.first + cluster.triangleCount) * 3);
+	}
+	if (calculateACMR(sorted.data(), count, vertices.size()) <= acmrBefore * threshold) {
+		memcpy(indices, sorted.data(), count * sizeof(uint32_t));
+	}
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	std::vector<uint32_t> remap(vertices.size(), kInvalidIndex);
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+	for (auto& index : indices) {
+		if (remap[index] == kInvalidIndex) {
+			remap[index] = static_cast<uint32_t>(reordered.size());
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	// Unreferenced vertices are dropped
+	vertices.swap(reordered);
+}
+
+float MeshOptimizer::calculateACMR(const uint32_t* indices, size_t count, size_t vertexCount, uint32_t cacheSize)
+{
+	if (count < 3) {
+		return 0.0f;
+	}
+	std::vector<uint32_t> timestamps(vertexCount, 0);
+	uint32_t time = cacheSize + 1;
+	size_t misses = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (time - timestamps[indices[i]] > cacheSize) {
+			timestamps[indices[i]] = time++;
+			misses++;
+		}
+	}
+	return float(misses) / float(count / 3);
+}
@@ -0,0 +1,29 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Purpose: Reduce vertex count and improve gpu cache use of indexed triangle lists when meshes are cooked.
+// Reference: Tom Forsyth, Linear-Speed Vertex Cache Optimisation, https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+// Reference: Sander, Nehab, Barczak, Fast Triangle Reordering for Vertex Locality and Reduced Overdraw, 2007
+#pragma once
+#include "Vertex.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		class MeshOptimizer {
+		public:
+			static constexpr uint32_t kCacheSize = 32;
+
+			// Merge bitwise identical vertices and remap the indices, returns the number of vertices removed
+			static size_t weldVertices(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+			// Reorder the triangles of the index list for the post transform cache, the order is kept if it would not improve
+			static void optimizeVertexCache(uint32_t* indices, size_t count, size_t vertexCount);
+			// Group the cache optimised triangles in to clusters and draw outward facing clusters first, so nearer surfaces
+			// tend to be drawn before those they hide. Reverted if the ACMR grows by more than the threshold ratio.
+			static void optimizeOverdraw(uint32_t* indices, size_t count, const std::vector<Vertex>& vertices, float threshold = 1.05f);
+			// Reorder vertices by first use so fetches are close together, indices are remapped
+			static void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+			// Average cache miss ratio, transformed vertices per triangle for a FIFO cache
+			static float calculateACMR(const uint32_t* indices, size_t count, size_t vertexCount, uint32_t cacheSize = kCacheSize);
+		};
+	}
+}
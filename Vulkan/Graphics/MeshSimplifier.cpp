@@ -0,0 +1,242 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "MeshSimplifier.h"
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+namespace {
+	// Symmetric 4x4 matrix of plane equations with the summed area weighting, evaluates to the mean squared distance to the planes
+	struct Quadric {
+		double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+		double b0 = 0.0, b1 = 0.0, b2 = 0.0, c = 0.0;
+		double weight = 0.0;
+
+		void addPlane(const glm::dvec3& n, double d, double w) {
+			a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z;
+			a11 += w * n.y * n.y; a12 += w * n.y * n.z; a22 += w * n.z * n.z;
+			b0 += w * n.x * d; b1 += w * n.y * d; b2 += w * n.z * d;
+			c += w * d * d;
+			weight += w;
+		}
+		void add(const Quadric& q) {
+			a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+			b0 += q.b0; b1 += q.b1; b2 += q.b2; c += q.c;
+			weight += q.weight;
+		}
+	};
+
+	double evaluate(const Quadric& a, const Quadric& b, const glm::dvec3& p)
+	{
+		Quadric q = a;
+		q.add(b);
+		const double result = q.a00 * p.x * p.x + 2.0 * q.a01 * p.x * p.y + 2.0 * q.a02 * p.x * p.z
+			+ q.a11 * p.y * p.y + 2.0 * q.a12 * p.y * p.z + q.a22 * p.z * p.z
+			+ 2.0 * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+		return q.weight > 0.0 ? glm::max(result / q.weight, 0.0) : 0.0;
+	}
+
+	struct PositionHasher {
+		size_t operator()(const glm::vec3& p) const {
+			uint32_t bits[3];
+			memcpy(bits, &p, sizeof(bits));
+			return (size_t(bits[0]) * 73856093u) ^ (size_t(bits[1]) * 19349663u) ^ (size_t(bits[2]) * 83492791u);
+		}
+	};
+
+	struct Collapse {
+		uint32_t from;
+		uint32_t to;
+		double cost;
+	};
+
+	glm::dvec3 positionOf(const Vertex& v)
+	{
+		return glm::dvec3(v.x, v.y, v.z);
+	}
+}
+
+std::vector<uint32_t> MeshSimplifier::simplify(const std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, size_t targetIndexCount,
+	float targetError, float& resultError)
+{
+	EXPECTS(indices.size() % 3 == 0);
+	const size_t vertexCount = vertices.size();
+	std::vector<uint32_t> result = indices;
+	resultError = 0.0f;
+
+	// Vertices sharing a position are one point of the surface, topology and quadrics are tracked per position
+	std::vector<uint32_t> positionIds(vertexCount);
+	std::vector<uint32_t> wedgeCounts(vertexCount, 0);
+	{
+		std::unordered_map<glm::vec3, uint32_t, PositionHasher> unique;
+		unique.reserve(vertexCount);
+		for (uint32_t i = 0; i < vertexCount; ++i) {
+			positionIds[i] = unique.emplace(glm::vec3(vertices[i].x, vertices[i].y, vertices[i].z), i).first->second;
+		}
+	}
+	std::vector<bool> used(vertexCount, false);
+	for (uint32_t index : result) {
+		if (!used[index]) {
+			used[index] = true;
+			++wedgeCounts[positionIds[index]];
+		}
+	}
+
+	// Border edges have no opposite half edge, their vertices and seam vertices are locked in place
+	std::vector<bool> locked(vertexCount, false);
+	{
+		std::unordered_map<uint64_t, uint32_t> halfEdges;
+		halfEdges.reserve(result.size());
+		for (size_t i = 0; i < result.size(); ++i) {
+			const uint64_t p0 = positionIds[result[i]];
+			const uint64_t p1 = positionIds[result[i - i % 3 + (i + 1) % 3]];
+			++halfEdges[(p0 << 32) | p1];
+		}
+		for (auto& edge : halfEdges) {
+			const uint64_t p0 = edge.first >> 32;
+			const uint64_t p1 = edge.first & 0xFFFFFFFFu;
+			if (halfEdges.count((p1 << 32) | p0) == 0) {
+				locked[p0] = true;
+				locked[p1] = true;
+			}
+		}
+	}
+	for (uint32_t i = 0; i < vertexCount; ++i) {
+		locked[i] = locked[positionIds[i]] || wedgeCounts[positionIds[i]] > 1;
+	}
+
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i < result.size(); i += 3) {
+		const glm::dvec3 p0 = positionOf(vertices[result[i]]);
+		const glm::dvec3 normal = glm::cross(positionOf(vertices[result[i + 1]]) - p0, positionOf(vertices[result[i + 2]]) - p0);
+		const double area = glm::length(normal);
+		if (area <= 0.0) {
+			continue;
+		}
+		const glm::dvec3 n = normal / area;
+		for (size_t j = 0; j < 3; ++j) {
+			quadrics[positionIds[result[i + j]]].addPlane(n, -glm::dot(n, p0), area);
+		}
+	}
+
+	const double maxCost = double(targetError) * double(targetError);
+	double resultCost = 0.0;
+	std::vector<uint32_t> triangleOffsets(vertexCount + 1);
+	std::vector<uint32_t> vertexTriangles;
+	std::vector<Collapse> collapses;
+	std::vector<bool> touched(vertexCount);
+	std::vector<uint32_t> remap(vertexCount);
+
+	while (result.size() > targetIndexCount) {
+		// Triangles around each vertex, rebuilt every pass as collapses change the connectivity
+		std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+		for (uint32_t index : result) {
+			++triangleOffsets[index + 1];
+		}
+		for (size_t i = 0; i < vertexCount; ++i) {
+			triangleOffsets[i + 1] += triangleOffsets[i];
+		}
+		vertexTriangles.resize(result.size());
+		std::vector<uint32_t> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+		for (size_t i = 0; i < result.size(); ++i) {
+			vertexTriangles[fill[result[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); ++i) {
+			const uint32_t from = result[i];
+			const uint32_t to = result[i - i % 3 + (i + 1) % 3];
+			if (positionIds[from] == positionIds[to]) {
+				continue;
+			}
+			if (!locked[from]) {
+				collapses.push_back({ from, to, evaluate(quadrics[positionIds[from]], quadrics[positionIds[to]], positionOf(vertices[to])) });
+			}
+			if (!locked[to]) {
+				collapses.push_back({ to, from, evaluate(quadrics[positionIds[to]], quadrics[positionIds[from]], positionOf(vertices[from])) });
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& lhs, const Collapse& rhs) {
+			return lhs.cost < rhs.cost;
+		});
+
+		std::fill(touched.begin(), touched.end(), false);
+		for (uint32_t i = 0; i < vertexCount; ++i) {
+			remap[i] = i;
+		}
+		size_t triangleCount = result.size() / 3;
+		size_t collapseCount = 0;
+		for (const Collapse& collapse : collapses) {
+			if (collapse.cost > maxCost || triangleCount * 3 <= targetIndexCount) {
+				break;
+			}
+			const uint32_t fromPosition = positionIds[collapse.from];
+			const uint32_t toPosition = positionIds[collapse.to];
+			if (touched[fromPosition] || touched[toPosition]) {
+				continue;
+			}
+
+			// Reject the collapse if it flips a triangle, or if a triangle would pick up a different wedge of the target position
+			bool valid = true;
+			size_t removedTriangles = 0;
+			for (uint32_t t = triangleOffsets[collapse.from]; t < triangleOffsets[collapse.from + 1] && valid; ++t) {
+				const uint32_t* triangle = &result[size_t(vertexTriangles[t]) * 3];
+				bool hasTarget = false;
+				for (int j = 0; j < 3; ++j) {
+					if (positionIds[triangle[j]] == toPosition) {
+						hasTarget = true;
+						valid = triangle[j] == collapse.to;
+					}
+				}
+				if (hasTarget) {
+					++removedTriangles;
+					continue;
+				}
+				glm::dvec3 before[3];
+				glm::dvec3 after[3];
+				for (int j = 0; j < 3; ++j) {
+					before[j] = positionOf(vertices[triangle[j]]);
+					after[j] = triangle[j] == collapse.from ? positionOf(vertices[collapse.to]) : before[j];
+				}
+				const glm::dvec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+				const glm::dvec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+				valid = glm::dot(normalBefore, normalAfter) > 0.0;
+			}
+			if (!valid) {
+				continue;
+			}
+
+			// The ring around the collapsed vertex is fixed for the rest of the pass so the flip tests above stay correct
+			for (uint32_t t = triangleOffsets[collapse.from]; t < triangleOffsets[collapse.from + 1]; ++t) {
+				const uint32_t* triangle = &result[size_t(vertexTriangles[t]) * 3];
+				for (int j = 0; j < 3; ++j) {
+					touched[positionIds[triangle[j]]] = true;
+				}
+			}
+			remap[collapse.from] = collapse.to;
+			quadrics[toPosition].add(quadrics[fromPosition]);
+			resultCost = std::max(resultCost, collapse.cost);
+			triangleCount -= removedTriangles;
+			++collapseCount;
+		}
+		if (collapseCount == 0) {
+			break;
+		}
+
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3) {
+			const uint32_t a = remap[result[i]];
+			const uint32_t b = remap[result[i + 1]];
+			const uint32_t c = remap[result[i + 2]];
+			if (positionIds[a] != positionIds[b] && positionIds[b] != positionIds[c] && positionIds[a] != positionIds[c]) {
+				result[write++] = a;
+				result[write++] = b;
+				result[write++] = c;
+			}
+		}
+		result.resize(write);
+	}
+
+	resultError = static_cast<float>(std::sqrt(resultCost));
+	return result;
+}
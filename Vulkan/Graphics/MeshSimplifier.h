@@ -0,0 +1,23 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Purpose: Generate simplified versions of meshes for levels of detail by collapsing edges in order of quadric error.
+// Reference: Garland, Heckbert, Surface Simplification Using Quadric Error Metrics, 1997
+#pragma once
+#include "Vertex.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		class MeshSimplifier {
+		public:
+			/*
+				Collapse edges until the index count is at most the target or no collapse is within the error limit. Vertices are never moved or
+				created, a vertex is only collapsed on to a neighbour so the vertex buffer can be shared by every level of detail. Vertices on
+				borders or on attribute seams (the same position with different normals or uvs) are never collapsed, keeping the silhouette and uv layout.
+				Error is an object space distance, the achieved error is written to resultError.
+			*/
+			static std::vector<uint32_t> simplify(const std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, size_t targetIndexCount,
+				float targetError, float& resultError);
+		};
+	}
+}
@@ -0,0 +1,154 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "MeshletBuilder.h"
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+// Clusters whose normals spread further than this can not be back facing as a whole, so cone culling is disabled for them
+static constexpr float kMinConeDot = 0.1f;
+static constexpr uint32_t kNoCluster = std::numeric_limits<uint32_t>::max();
+
+void MeshletBuilder::build(uint32_t* indices, size_t count, const std::vector<Vertex>& vertices, uint32_t indexOffset, std::vector<MeshCacheCluster>& clusters)
+{
+	EXPECTS(count % 3 == 0);
+	const size_t triangleCount = count / 3;
+
+	// Triangles around each vertex, to find the neighbours of a growing cluster
+	std::vector<uint32_t> triangleOffsets(vertices.size() + 1, 0);
+	for (size_t i = 0; i < count; ++i) {
+		++triangleOffsets[indices[i] + 1];
+	}
+	for (size_t i = 0; i < vertices.size(); ++i) {
+		triangleOffsets[i + 1] += triangleOffsets[i];
+	}
+	std::vector<uint32_t> vertexTriangles(count);
+	{
+		std::vector<uint32_t> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+		for (size_t i = 0; i < count; ++i) {
+			vertexTriangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	std::vector<uint32_t> output;
+	output.reserve(count);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> vertexCluster(vertices.size(), kNoCluster);
+	std::vector<uint32_t> clusterVertices;
+	clusterVertices.reserve(kMaxVertices);
+	uint32_t clusterIdx = 0;
+	size_t clusterStart = 0;
+	size_t nextSeed = 0;
+
+	auto newVertexCount = [&](uint32_t triangle) {
+		size_t newVertices = 0;
+		for (int j = 0; j < 3; ++j) {
+			newVertices += vertexCluster[indices[size_t(triangle) * 3 + j]] != clusterIdx ? 1 : 0;
+		}
+		return newVertices;
+	};
+	auto finishCluster = [&]() {
+		MeshCacheCluster cluster = makeCluster(&output[clusterStart], output.size() - clusterStart, vertices);
+		cluster.indexOffset = indexOffset + static_cast<uint32_t>(clusterStart);
+		clusters.push_back(cluster);
+		clusterStart = output.size();
+		clusterVertices.clear();
+		++clusterIdx;
+	};
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+		// Prefer the neighbour adding the fewest vertices, the earliest in the cache optimised order wins ties
+		uint32_t best = kNoCluster;
+		size_t bestNewVertices = 4;
+		for (uint32_t vertex : clusterVertices) {
+			for (uint32_t t = triangleOffsets[vertex]; t < triangleOffsets[vertex + 1]; ++t) {
+				const uint32_t triangle = vertexTriangles[t];
+				if (emitted[triangle]) {
+					continue;
+				}
+				const size_t newVertices = newVertexCount(triangle);
+				if (newVertices < bestNewVertices || (newVertices == bestNewVertices && triangle < best)) {
+					best = triangle;
+					bestNewVertices = newVertices;
+				}
+			}
+		}
+
+		const size_t clusterTriangles = (output.size() - clusterStart) / 3;
+		if (best == kNoCluster || clusterVertices.size() + bestNewVertices > kMaxVertices || clusterTriangles == kMaxTriangles) {
+			if (clusterTriangles > 0) {
+				finishCluster();
+			}
+			// Disconnected from the cluster, or the cluster is full, so start again from the first triangle left
+			while (emitted[nextSeed]) {
+				++nextSeed;
+			}
+			best = static_cast<uint32_t>(nextSeed);
+		}
+
+		emitted[best] = true;
+		for (int j = 0; j < 3; ++j) {
+			const uint32_t vertex = indices[size_t(best) * 3 + j];
+			if (vertexCluster[vertex] != clusterIdx) {
+				vertexCluster[vertex] = clusterIdx;
+				clusterVertices.push_back(vertex);
+			}
+			output.push_back(vertex);
+		}
+	}
+	if (output.size() > clusterStart) {
+		finishCluster();
+	}
+	std::copy(output.begin(), output.end(), indices);
+}
+
+MeshCacheCluster MeshletBuilder::makeCluster(const uint32_t* indices, size_t count, const std::vector<Vertex>& vertices)
+{
+	glm::vec3 boundsMin(std::numeric_limits<float>::max());
+	glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+	glm::vec3 normalSum(0.0f);
+	std::vector<glm::vec3> normals;
+	normals.reserve(count / 3);
+	for (size_t i = 0; i < count; i += 3) {
+		const glm::vec3 p0(vertices[indices[i]].x, vertices[indices[i]].y, vertices[indices[i]].z);
+		const glm::vec3 p1(vertices[indices[i + 1]].x, vertices[indices[i + 1]].y, vertices[indices[i + 1]].z);
+		const glm::vec3 p2(vertices[indices[i + 2]].x, vertices[indices[i + 2]].y, vertices[indices[i + 2]].z);
+		boundsMin = glm::min(boundsMin, glm::min(p0, glm::min(p1, p2)));
+		boundsMax = glm::max(boundsMax, glm::max(p0, glm::max(p1, p2)));
+
+		const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		const float length = glm::length(normal);
+		if (length > 0.0f) {
+			normals.push_back(normal / length);
+			normalSum += normals.back();
+		}
+	}
+
+	const glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	float radius = 0.0f;
+	for (size_t i = 0; i < count; ++i) {
+		radius = glm::max(radius, glm::distance(center, glm::vec3(vertices[indices[i]].x, vertices[indices[i]].y, vertices[indices[i]].z)));
+	}
+
+	// The cone holds every triangle normal, a view direction within 90 degrees minus its spread of the axis sees only back faces
+	glm::vec3 axis(0.0f, 0.0f, 1.0f);
+	float minDot = -1.0f;
+	const float sumLength = glm::length(normalSum);
+	if (sumLength > 0.0f) {
+		axis = normalSum / sumLength;
+		minDot = 1.0f;
+		for (const auto& normal : normals) {
+			minDot = glm::min(minDot, glm::dot(normal, axis));
+		}
+	}
+
+	MeshCacheCluster cluster = {};
+	for (int i = 0; i < 3; ++i) {
+		cluster.center[i] = center[i];
+		cluster.coneAxis[i] = axis[i];
+	}
+	cluster.radius = radius;
+	cluster.coneCutoff = minDot < kMinConeDot ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+	cluster.indexCount = static_cast<uint32_t>(count);
+	return cluster;
+}
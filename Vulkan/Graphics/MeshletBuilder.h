@@ -0,0 +1,26 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Purpose: Group the triangles of large meshes in to small clusters which can be culled individually.
+// Reference: Arseny Kapoulkine, meshoptimizer, cluster building and cone culling, https://github.com/zeux/meshoptimizer
+#pragma once
+#include "MeshCache.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		class MeshletBuilder {
+		public:
+			// Limits chosen so a cluster could also be drawn by a mesh shader workgroup
+			static constexpr size_t kMaxVertices = 64;
+			static constexpr size_t kMaxTriangles = 124;
+
+			/*
+				Reorder the triangles of the index range so each cluster is contiguous, appending a cluster per group to clusters.
+				Clusters are grown across shared vertices so they stay compact, which keeps their bounds and normal cones tight.
+			*/
+			static void build(uint32_t* indices, size_t count, const std::vector<Vertex>& vertices, uint32_t indexOffset, std::vector<MeshCacheCluster>& clusters);
+		private:
+			static MeshCacheCluster makeCluster(const uint32_t* indices, size_t count, const std::vector<Vertex>& vertices);
+		};
+	}
+}
@@ -0,0 +1,215 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "MipGenerator.h"
+#include "LogicDevice.h"
+#include "DeviceMemory.h"
+#include "Descriptor.h"
+#include "ComputePipeline.h"
+#include "RendererBase.h"
+#include "Image.h"
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+// Stages the textures are sampled in once generated
+static constexpr VkPipelineStageFlags kSamplingPipelineStages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
+	VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+struct MipDownsamplePushConstants {
+	MipFilter filter;
+};
+
+MipGenerator::MipGenerator(const LogicDevice* logicDevice, uint32_t frameCount)
+	: logicDevice_(logicDevice)
+{
+	VkDescriptorSetLayoutBinding bindings[2] = {};
+	for (uint32_t i = 0; i < 2; ++i) {
+		bindings[i].binding = i;
+		bindings[i].descriptorCount = 1;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	layout_ = logicDevice->getPrimaryDescriptor()->makeLayout({ bindings[0], bindings[1] });
+	std::vector<VkPushConstantRange> pushConstantRanges = { RendererBase::setupPushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(MipDownsamplePushConstants), 0) };
+	pipeline_ = new ComputePipeline(logicDevice, ComputePipeline::makeLayoutInfo(1, &layout_, pushConstantRanges), "MipDownsample");
+
+	// Each batch's sets are freed together when it is next used, so batches have their own pools rather than the primary descriptor's
+	batches_.resize(frameCount + 1);
+	for (auto& batch : batches_) {
+		batch.descriptor = new Descriptor(logicDevice, kMaxDispatchesPerBatch, { { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, kMaxDispatchesPerBatch * 2 } });
+		batch.dispatchCount = 0;
+	}
+}
+
+MipGenerator::~MipGenerator()
+{
+	for (auto& batch : batches_) {
+		resetBatch(batch);
+		SAFE_DELETE(batch.descriptor);
+	}
+	SAFE_DELETE(pipeline_);
+}
+
+bool MipGenerator::canGenerate(const LogicDevice* logicDevice, VkFormat format, MipFilter filter)
+{
+	return filter != MipFilter::kNone && (format == kDownsampleFormat || usesBlits(logicDevice, format, filter));
+}
+
+VkImageUsageFlags MipGenerator::getRequiredUsage(VkFormat format, MipFilter filter)
+{
+	// Without the device the blit support cannot be known, so rgba8 images can always be given to the downsampler
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	if (format == kDownsampleFormat && filter != MipFilter::kNone) {
+		usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+	}
+	return usage;
+}
+
+void MipGenerator::enqueue(Image* image, MipFilter filter, std::function<void()> onGenerated)
+{
+	EXPECTS(image->getLayout() == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && canGenerate(logicDevice_, image->getFormat(), filter));
+	queue_.push_back({ image, filter, onGenerated });
+}
+
+void MipGenerator::record(VkCommandBuffer cmdBuffer, uint32_t frameIdx)
+{
+	// The frame's fence has been waited on, so the last batch recorded in to this slot is finished with
+	Batch& batch = batches_[frameIdx];
+	resetBatch(batch);
+	recordBatch(cmdBuffer, batch);
+}
+
+void MipGenerator::flush()
+{
+	Batch& batch = batches_.back();
+	while (!queue_.empty()) {
+		logicDevice_->getDeviceMemory()->submitImmediate([this, &batch](VkCommandBuffer cmdBuffer) {
+			recordBatch(cmdBuffer, batch);
+		});
+		resetBatch(batch);
+	}
+}
+
+bool MipGenerator::supportsBlits(const LogicDevice* logicDevice, VkFormat format)
+{
+	constexpr VkFormatFeatureFlags kBlitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+		VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(logicDevice->getPhysicalDevice(), format, &properties);
+	return (properties.optimalTilingFeatures & kBlitFeatures) == kBlitFeatures;
+}
+
+bool MipGenerator::usesBlits(const LogicDevice* logicDevice, VkFormat format, MipFilter filter)
+{
+	// Blits between srgb formats already filter in linear space
+	const bool srgbFormat = format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_B8G8R8A8_SRGB;
+	return (filter == MipFilter::kLinear || (filter == MipFilter::kSrgb && srgbFormat)) && supportsBlits(logicDevice, format);
+}
+
+void MipGenerator::recordBatch(VkCommandBuffer cmdBuffer, Batch& batch)
+{
+	size_t recorded = 0;
+	for (; recorded < queue_.size(); ++recorded) {
+		const Request& request = queue_[recorded];
+		if (usesBlits(logicDevice_, request.image->getFormat(), request.filter)) {
+			request.image->generateMipmaps(cmdBuffer, kSamplingPipelineStages);
+		}
+		else if (!recordDownsample(cmdBuffer, batch, request)) {
+			break;
+		}
+	}
+	for (size_t i = 0; i < recorded; ++i) {
+		if (queue_[i].onGenerated) {
+			queue_[i].onGenerated();
+		}
+	}
+	queue_.erase(queue_.begin(), queue_.begin() + recorded);
+}
+
+bool MipGenerator::recordDownsample(VkCommandBuffer cmdBuffer, Batch& batch, const Request& request)
+{
+	Image* image = request.image;
+	const uint32_t mipCount = image->getMipLevels();
+	if (batch.dispatchCount + mipCount - 1 > kMaxDispatchesPerBatch) {
+		return false;
+	}
+	image->changeLayout(cmdBuffer, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	const size_t firstView = batch.views.size();
+	for (uint32_t i = 0; i < mipCount; ++i) {
+		batch.views.push_back(createMipView(image, i));
+	}
+	std::vector<VkDescriptorSetLayout> layouts(mipCount - 1, layout_);
+	const size_t firstSet = batch.descriptor->createSets(layouts);
+
+	vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_->getPipeline());
+	MipDownsamplePushConstants pushConstants = { request.filter };
+	vkCmdPushConstants(cmdBuffer, pipeline_->getLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	for (uint32_t i = 1; i < mipCount; ++i) {
+		VkDescriptorSet set = batch.descriptor->getSet(firstSet + i - 1);
+		VkDescriptorImageInfo imageInfos[2] = {
+			{ VK_NULL_HANDLE, batch.views[firstView + i - 1], VK_IMAGE_LAYOUT_GENERAL },
+			{ VK_NULL_HANDLE, batch.views[firstView + i], VK_IMAGE_LAYOUT_GENERAL }
+		};
+		std::vector<VkWriteDescriptorSet> descriptorWrites(2);
+		for (uint32_t j = 0; j < 2; ++j) {
+			descriptorWrites[j] = {};
+			descriptorWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[j].dstSet = set;
+			descriptorWrites[j].dstBinding = j;
+			descriptorWrites[j].dstArrayElement = 0;
+			descriptorWrites[j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			descriptorWrites[j].descriptorCount = 1;
+			descriptorWrites[j].pImageInfo = &imageInfos[j];
+		}
+		batch.descriptor->updateDescriptorSets(descriptorWrites);
+
+		// The mip read here was written by the previous dispatch
+		if (i > 1) {
+			vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+		vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_->getLayout(), 0, 1, &set, 0, nullptr);
+		const uint32_t width = std::max(image->getWidth() >> i, 1u);
+		const uint32_t height = std::max(image->getHeight() >> i, 1u);
+		vkCmdDispatch(cmdBuffer, (width + kGroupSize - 1) / kGroupSize, (height + kGroupSize - 1) / kGroupSize, 1);
+	}
+	batch.dispatchCount += mipCount - 1;
+
+	image->changeLayout(cmdBuffer, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, kSamplingPipelineStages);
+	return true;
+}
+
+VkImageView MipGenerator::createMipView(Image* image, uint32_t mip)
+{
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = image->getImage();
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = image->getFormat();
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseMipLevel = mip;
+	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+
+	VkImageView view;
+	CHECK_VKRESULT(vkCreateImageView(*logicDevice_, &viewInfo, nullptr, &view));
+	return view;
+}
+
+void MipGenerator::resetBatch(Batch& batch)
+{
+	for (auto view : batch.views) {
+		vkDestroyImageView(*logicDevice_, view, nullptr);
+	}
+	batch.views.clear();
+	if (batch.dispatchCount > 0) {
+		batch.descriptor->reset();
+		batch.dispatchCount = 0;
+	}
+}
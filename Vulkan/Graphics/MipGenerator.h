@@ -0,0 +1,89 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Purpose: Fill in the mips of textures made or decoded on the cpu, many textures to a submission.
+#pragma once
+#include "VkUtil.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		class LogicDevice;
+		class Image;
+		class ComputePipeline;
+		class Descriptor;
+
+		// How each mip is filtered down from the one above, must match MIP_FILTER_* in mip_downsample.comp
+		enum class MipFilter : uint32_t {
+			kLinear = 0,
+			// Colour stored in srgb, averaged in linear space so dark and bright texels are weighted as they are seen
+			kSrgb,
+			// Unit vectors packed in to rgb, renormalised after averaging so the shortened mean does not dim lighting with distance
+			kNormalMap,
+			// A single mip
+			kNone
+		};
+
+		/*
+			Textures are queued once their first mip is uploaded and every queued texture is filtered in one batch, recorded in to the
+			frame's command buffer ahead of anything sampling them or submitted at once by flush. Linear filtering is done with a chain
+			of blits where the format supports them. Srgb colour and normal maps are filtered by the downsampler compute shader, which
+			reads and writes the rgba8 mips as storage images and so can decode before averaging and encode after. The downsampler runs
+			once per mip with a barrier between, every texture's chains in the batch are recorded back to back.
+			Each batch's descriptor sets and mip views are kept until the frame slot, or the next flush, comes round again.
+		*/
+		class MipGenerator {
+		public:
+			MipGenerator(const LogicDevice* logicDevice, uint32_t frameCount);
+			~MipGenerator();
+
+			// False if the format cannot be filtered that way, images that cannot be filtered should be made with a single mip
+			static bool canGenerate(const LogicDevice* logicDevice, VkFormat format, MipFilter filter);
+			// Usage the image must be made with on top of sampling for its mips to be generated
+			static VkImageUsageFlags getRequiredUsage(VkFormat format, MipFilter filter);
+
+			// The image's first mip must be written and every mip in the transfer dst layout. onGenerated runs once the image's mips have
+			// been recorded, when it has been left shader read only, and is where its sampler should be made. Other frames may still be in
+			// flight when it runs, so its descriptor must be queued with TextureManager::updateTextureDescriptor rather than written.
+			void enqueue(Image* image, MipFilter filter, std::function<void()> onGenerated = nullptr);
+			// Record every queued texture's mips before anything samples them this frame
+			void record(VkCommandBuffer cmdBuffer, uint32_t frameIdx);
+			// Generate every queued texture's mips now and wait for them, for textures sampled by something other than the frame
+			void flush();
+
+			// Invocations per side of the downsampler's groups, must match MIP_GROUP_SIZE in mip_downsample.comp
+			static constexpr uint32_t kGroupSize = 8;
+			// The only format the downsampler reads and writes
+			static constexpr VkFormat kDownsampleFormat = VK_FORMAT_R8G8B8A8_UNORM;
+			// Downsampler dispatches a batch has descriptor sets for, textures past it wait for the next batch
+			static constexpr uint32_t kMaxDispatchesPerBatch = 256;
+		private:
+			struct Request {
+				Image* image;
+				MipFilter filter;
+				std::function<void()> onGenerated;
+			};
+			struct Batch {
+				Descriptor* descriptor;
+				// A view of each mip the downsampler read or wrote
+				std::vector<VkImageView> views;
+				uint32_t dispatchCount;
+			};
+
+			static bool supportsBlits(const LogicDevice* logicDevice, VkFormat format);
+			static bool usesBlits(const LogicDevice* logicDevice, VkFormat format, MipFilter filter);
+			// Record as many queued textures as the batch has room for
+			void recordBatch(VkCommandBuffer cmdBuffer, Batch& batch);
+			// False if the batch has no room for the texture
+			bool recordDownsample(VkCommandBuffer cmdBuffer, Batch& batch, const Request& request);
+			VkImageView createMipView(Image* image, uint32_t mip);
+			void resetBatch(Batch& batch);
+
+			const LogicDevice* logicDevice_;
+			ComputePipeline* pipeline_;
+			VkDescriptorSetLayout layout_;
+			// One for each frame in flight followed by flush's
+			std::vector<Batch> batches_;
+			std::vector<Request> queue_;
+		};
+	}
+}
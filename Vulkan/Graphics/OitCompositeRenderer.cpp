@@ -0,0 +1,101 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "OitCompositeRenderer.h"
+#include "GlobalRenderData.h"
+#include "SceneDescriptorInfo.h"
+#include "LogicDevice.h"
+#include "DeviceMemory.h"
+#include "Descriptor.h"
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+// Matches the node in oit.glsl, the list's length is kept ahead of the nodes
+struct OitNode {
+	glm::uvec2 colour;
+	float depth;
+	uint32_t next;
+};
+static constexpr VkDeviceSize kNodeHeaderSize = sizeof(glm::uvec4);
+
+OitCompositeRenderer::OitCompositeRenderer(RendererCreateInfo2& createInfo2, LogicDevice* logicDevice, VkRenderPass renderPass, GlobalRenderData* grd,
+	SceneGraphicsInfo* graphicsInfo, VkExtent2D extent)
+	: RendererBase(logicDevice, nullptr, graphicsInfo), layout_(VK_NULL_HANDLE), set_(VK_NULL_HANDLE), headSize_(sizeof(uint32_t) * extent.width * extent.height),
+	  nodeCapacity_(nodeCapacityFor(extent))
+{
+	DeviceMemory* deviceMemory = logicDevice->getDeviceMemory();
+	headBuffer_ = deviceMemory->createBuffer("OitListHeads", MemoryAllocationPattern::kRenderTarget, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		headSize_);
+	nodeBuffer_ = deviceMemory->createBuffer("OitListNodes", MemoryAllocationPattern::kRenderTarget, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		kNodeHeaderSize + sizeof(OitNode) * nodeCapacity_);
+	createDescriptorSet();
+
+	pipelineLayouts_.push_back(graphicsInfo->layout);
+	pipelineLayouts_.push_back(grd->getLayout());
+	pipelineLayouts_.push_back(layout_);
+
+	createPipeline(logicDevice, renderPass, RendererPipeline::makeLayoutInfo(static_cast<uint32_t>(pipelineLayouts_.size()),
+		pipelineLayouts_.data(), createInfo2.pcRangesCount, createInfo2.pcRanges), createInfo2.shaderStages, createInfo2.pipelineCreateInfo, RendererPipeline::PrimitiveType::kNone);
+}
+
+OitCompositeRenderer::~OitCompositeRenderer()
+{
+	DeviceMemory* deviceMemory = logicDevice_->getDeviceMemory();
+	deviceMemory->deleteAllocation(headBuffer_.id, headBuffer_.buffer);
+	deviceMemory->deleteAllocation(nodeBuffer_.id, nodeBuffer_.buffer);
+}
+
+void OitCompositeRenderer::clearLists(VkCommandBuffer cmdBuffer)
+{
+	// The previous frame's composite may still be reading the lists
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	// Every head points nowhere and no nodes are taken
+	vkCmdFillBuffer(cmdBuffer, headBuffer_.buffer, 0, headSize_, ~0u);
+	vkCmdFillBuffer(cmdBuffer, nodeBuffer_.buffer, 0, kNodeHeaderSize, 0u);
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void OitCompositeRenderer::recordFrame(const uint32_t frameIdx, VkCommandBuffer cmdBuffer, std::vector<IndexedDrawCommand>* commandList, bool ignoreEboBind)
+{
+	beginFrame(cmdBuffer);
+	vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipelineLayout(), kListSet, 1, &set_, 0, nullptr);
+	vkCmdDraw(cmdBuffer, 3, 1, 0, 0);
+}
+
+void OitCompositeRenderer::createDescriptorSet()
+{
+	VkDescriptorSetLayoutBinding bindings[2] = {};
+	for (uint32_t i = 0; i < 2; ++i) {
+		bindings[i].binding = i;
+		bindings[i].descriptorCount = 1;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	}
+	layout_ = descriptor_->makeLayout({ bindings[0], bindings[1] });
+	set_ = descriptor_->getSet(descriptor_->createSets({ layout_ }));
+
+	VkDescriptorBufferInfo bufferInfos[2] = {
+		{ headBuffer_.buffer, 0, VK_WHOLE_SIZE },
+		{ nodeBuffer_.buffer, 0, VK_WHOLE_SIZE }
+	};
+	std::vector<VkWriteDescriptorSet> descriptorWrites(2);
+	for (uint32_t i = 0; i < 2; ++i) {
+		descriptorWrites[i] = {};
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].dstSet = set_;
+		descriptorWrites[i].dstBinding = i;
+		descriptorWrites[i].dstArrayElement = 0;
+		descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrites[i].descriptorCount = 1;
+		descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+	}
+	descriptor_->updateDescriptorSets(descriptorWrites);
+}
@@ -0,0 +1,70 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#pragma once
+#include "RendererBase.h"
+#include "MemoryAllocation.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		// How blended draws are resolved without being sorted, must match OIT_MODE_* in oit.glsl
+		enum class OitMode : uint32_t {
+			// Colour and coverage accumulated with weights falling off with depth, approximate but fixed cost
+			kWeightedBlended = 0,
+			// Every fragment appended to a per pixel list that the composite sorts, exact until the lists' storage runs out
+			kLinkedList
+		};
+
+		struct OitCompositePushConstants {
+			OitMode mode;
+			uint32_t padding[3];
+		};
+
+		/*
+			Composites the frame's order independent transparency over the lit scene. Weighted blended draws leave a weighted sum of
+			premultiplied colour and the product of their transmittance in the accumulation and revealage targets, the composite divides
+			the sum out to the average colour and blends it over the scene by the revealage.
+			In linked list mode blended draws instead append their fragments to a list per pixel, held in the storage buffers this
+			renderer owns, and the composite sorts each pixel's list back to front. Fragments past the lists' capacity fall back to the
+			weighted targets and are composited behind the listed ones.
+		*/
+		class OitCompositeRenderer : public RendererBase {
+		public:
+			OitCompositeRenderer(RendererCreateInfo2& createInfo2, LogicDevice* logicDevice, VkRenderPass renderPass, GlobalRenderData* grd, SceneGraphicsInfo* graphicsInfo,
+				VkExtent2D extent);
+			~OitCompositeRenderer();
+			// Empty every pixel's list, outside of a render pass and before any blended draw of the frame
+			void clearLists(VkCommandBuffer cmdBuffer);
+			void recordFrame(const uint32_t frameIdx, VkCommandBuffer cmdBuffer, std::vector<IndexedDrawCommand>* commandList, bool ignoreEboBind = false) override;
+
+			// Bound by the blended renderers appending to the lists
+			VkDescriptorSetLayout getListLayout() const {
+				return layout_;
+			}
+			VkDescriptorSet getListSet() const {
+				return set_;
+			}
+			uint32_t getNodeCapacity() const {
+				return nodeCapacity_;
+			}
+			// Nodes the lists hold at this extent, which the shaders appending to them need before the renderer is made
+			static uint32_t nodeCapacityFor(VkExtent2D extent) {
+				return extent.width * extent.height * kNodesPerPixel;
+			}
+
+			// Fragments per pixel the lists hold on average before overflowing
+			static constexpr uint32_t kNodesPerPixel = 4;
+			// Set the lists are bound to by the composite, must match OIT_SET in particles_composite.frag
+			static constexpr uint32_t kListSet = 2;
+		private:
+			void createDescriptorSet();
+
+			MemoryAllocationDetails headBuffer_;
+			MemoryAllocationDetails nodeBuffer_;
+			VkDescriptorSetLayout layout_;
+			VkDescriptorSet set_;
+			VkDeviceSize headSize_;
+			uint32_t nodeCapacity_;
+		};
+	}
+}
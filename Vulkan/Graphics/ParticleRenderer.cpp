@@ -3,69 +3,104 @@
 
 #include "ParticleRenderer.h"
 #include "DynamicElementBuffer.h"
-#include "StorageBuffer.h"
 #include "GlobalRenderData.h"
 #include "LogicDevice.h"
 #include "Descriptor.h"
-#include "ShaderParams.h"
-#include "RenderObject.h"
-#include "Material.h"
 #include "SceneDescriptorInfo.h"
-#include "../Assets/Entity.h"
+#include "ParticleSimulator.h"
+#include "OitCompositeRenderer.h"
 
 using namespace QZL;
 using namespace QZL::Graphics;
-/*
-ParticleRenderer::ParticleRenderer(RendererCreateInfo& createInfo)
-	: RendererBase(createInfo, new DynamicElementBuffer(createInfo.logicDevice->getDeviceMemory(), createInfo.swapChainImageCount, sizeof(ParticleVertex)))
-{
-	pipelineLayouts_.push_back(createInfo.graphicsInfo->layout);
-	pipelineLayouts_.push_back(createInfo.globalRenderData->getLayout());
-
-	VkPushConstantRange pushConstants[1] = {
-		setupPushConstantRange<VertexPushConstants>(VK_SHADER_STAGE_VERTEX_BIT)
-	};
 
-	uint32_t offsets[3] = { graphicsInfo_->mvpOffsetSizes[(size_t)RendererTypes::kParticle], graphicsInfo_->paramsOffsetSizes[(size_t)RendererTypes::kParticle], graphicsInfo_->materialOffsetSizes[(size_t)RendererTypes::kParticle] };
-	std::vector<VkSpecializationMapEntry> mapEntry = {
-		makeSpecConstantEntry(0, 0,	sizeof(uint32_t)),
-		makeSpecConstantEntry(1, sizeof(uint32_t), sizeof(uint32_t))
-	};
-	auto geomSpecConstant = setupSpecConstants(2, mapEntry.data(), sizeof(uint32_t) * 2, &offsets[0]);
-	auto fragSpecConstant = setupSpecConstants(2, mapEntry.data(), sizeof(uint32_t) * 2, &offsets[1]);
+ParticleRenderer::ParticleRenderer(RendererCreateInfo2& createInfo2, LogicDevice* logicDevice, VkRenderPass renderPass, GlobalRenderData* grd, SceneGraphicsInfo* graphicsInfo,
+	OitCompositeRenderer* oitComposite)
+	: RendererBase(logicDevice, new DynamicElementBuffer(logicDevice->getDeviceMemory(), graphicsInfo->numFrameIndices, sizeof(ParticleVertex)), graphicsInfo),
+	  simulator_(graphicsInfo->particleSimulator), oitComposite_(oitComposite), oitMode_(OitMode::kWeightedBlended), layout_(VK_NULL_HANDLE), set_(VK_NULL_HANDLE)
+{
+	ASSERT(simulator_ != nullptr && oitComposite_ != nullptr);
+	particleBuffer_ = static_cast<DynamicElementBuffer*>(ebo_);
+	// Read by the vertex shader as a storage buffer rather than bound as vertices
+	particleBuffer_->addVertexUsage(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	createDescriptorSet();
 
-	std::vector<ShaderStageInfo> stageInfos;
-	stageInfos.emplace_back(createInfo.vertexShader, VK_SHADER_STAGE_VERTEX_BIT, nullptr);
-	stageInfos.emplace_back(createInfo.fragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT, &fragSpecConstant);
-	stageInfos.emplace_back(createInfo.geometryShader, VK_SHADER_STAGE_GEOMETRY_BIT, &geomSpecConstant);
+	pipelineLayouts_.push_back(graphicsInfo->layout);
+	pipelineLayouts_.push_back(grd->getLayout());
+	pipelineLayouts_.push_back(layout_);
+	pipelineLayouts_.push_back(oitComposite_->getListLayout());
 
-	PipelineCreateInfo pci = {};
-	pci.debugName = "Particle";
-	pci.enableDepthTest = VK_TRUE;
-	pci.enableDepthWrite = VK_FALSE;
-	pci.extent = createInfo.extent;
-	pci.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-	pci.primitiveTopology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
-	pci.subpassIndex = createInfo.subpassIndex;
-	pci.dynamicState = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-	pci.sampleCount = VK_SAMPLE_COUNT_1_BIT;
-	pci.colourAttachmentCount = createInfo.colourAttachmentCount;
-	pci.colourBlendEnables = createInfo.colourBlendEnables;
+	createPipeline(logicDevice, renderPass, RendererPipeline::makeLayoutInfo(static_cast<uint32_t>(pipelineLayouts_.size()),
+		pipelineLayouts_.data(), createInfo2.pcRangesCount, createInfo2.pcRanges), createInfo2.shaderStages, createInfo2.pipelineCreateInfo, RendererPipeline::PrimitiveType::kNone);
+}
 
-	createPipeline<ParticleVertex>(createInfo.logicDevice, createInfo.renderPass, RendererPipeline::makeLayoutInfo(static_cast<uint32_t>(pipelineLayouts_.size()),
-		pipelineLayouts_.data(), 1, pushConstants), stageInfos, pci);
+void ParticleRenderer::preframeSetup()
+{
+	RendererBase::preframeSetup();
+	// With every system on the gpu there is no cpu buffer, the binding still needs a buffer though nothing reads it
+	const VkBuffer cpuParticles = particleBuffer_->getVertexBuffer() != VK_NULL_HANDLE ? particleBuffer_->getVertexBuffer() : simulator_->getInstanceBuffer();
+	VkDescriptorBufferInfo bufferInfos[2] = {
+		{ cpuParticles, 0, VK_WHOLE_SIZE },
+		{ simulator_->getInstanceBuffer(), 0, VK_WHOLE_SIZE }
+	};
+	std::vector<VkWriteDescriptorSet> descriptorWrites(2);
+	for (uint32_t i = 0; i < 2; ++i) {
+		descriptorWrites[i] = {};
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].dstSet = set_;
+		descriptorWrites[i].dstBinding = i;
+		descriptorWrites[i].dstArrayElement = 0;
+		descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrites[i].descriptorCount = 1;
+		descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+	}
+	descriptor_->updateDescriptorSets(descriptorWrites);
 }
 
-void ParticleRenderer::recordFrame(const uint32_t frameIdx, VkCommandBuffer cmdBuffer, std::vector<VkDrawIndexedIndirectCommand>* commandList, bool ignoreEboBind)
+void ParticleRenderer::recordFrame(const uint32_t frameIdx, VkCommandBuffer cmdBuffer, std::vector<IndexedDrawCommand>* commandList, bool ignoreEboBind)
 {
 	if (commandList->size() == 0)
 		return;
 	beginFrame(cmdBuffer);
-	if (!ignoreEboBind) {
+	const bool hasCpuParticles = particleBuffer_->getVertexRegionSize() > 0;
+	if (!ignoreEboBind && hasCpuParticles) {
 		ebo_->updateBuffer(cmdBuffer, frameIdx);
-		bindEBO(cmdBuffer, frameIdx);
 	}
+	VkDescriptorSet sets[2] = { set_, oitComposite_->getListSet() };
+	vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipelineLayout(), kParticleSet, 2, sets, 0, nullptr);
+	static_assert(kOitListSet == kParticleSet + 1, "The particle and list sets are bound together");
+
+	const uint32_t regionFirstParticle = static_cast<uint32_t>(particleBuffer_->getVertexRegionSize() / sizeof(ParticleVertex) * frameIdx);
 	for (auto& cmd : *commandList) {
-		vkCmdDrawIndexed(cmdBuffer, cmd.indexCount, cmd.instanceCount, cmd.firstIndex, cmd.vertexOffset, cmd.firstInstance);
+		ParticlePushConstants pushConstants;
+		pushConstants.paramsIdx = cmd.draw.firstInstance;
+		pushConstants.oitMode = static_cast<uint32_t>(oitMode_);
+		if (cmd.particleEmitter != ParticleSimulator::kInvalidEmitter) {
+			pushConstants.firstParticle = simulator_->getFirstParticle(cmd.particleEmitter);
+			pushConstants.gpuSimulated = 1;
+			vkCmdPushConstants(cmdBuffer, getPipelineLayout(), kParticlePushConstantStages, sizeof(VertexPushConstants), sizeof(pushConstants), &pushConstants);
+			vkCmdDrawIndirect(cmdBuffer, simulator_->getDrawBuffer(), simulator_->getDrawOffset(cmd.particleEmitter), 1, 0);
+			continue;
+		}
+		if (cmd.draw.indexCount == 0 || !hasCpuParticles) {
+			continue;
+		}
+		// Cpu systems' draws hold their live count and where their particles start in a frame's region
+		pushConstants.firstParticle = regionFirstParticle + static_cast<uint32_t>(cmd.draw.vertexOffset);
+		pushConstants.gpuSimulated = 0;
+		vkCmdPushConstants(cmdBuffer, getPipelineLayout(), kParticlePushConstantStages, sizeof(VertexPushConstants), sizeof(pushConstants), &pushConstants);
+		vkCmdDraw(cmdBuffer, 4, cmd.draw.indexCount, 0, 0);
 	}
-}*/
+}
+
+void ParticleRenderer::createDescriptorSet()
+{
+	VkDescriptorSetLayoutBinding bindings[2] = {};
+	for (uint32_t i = 0; i < 2; ++i) {
+		bindings[i].binding = i;
+		bindings[i].descriptorCount = 1;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	}
+	layout_ = descriptor_->makeLayout({ bindings[0], bindings[1] });
+	set_ = descriptor_->getSet(descriptor_->createSets({ layout_ }));
+}
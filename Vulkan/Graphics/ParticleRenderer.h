@@ -2,15 +2,61 @@
 // Date: 01/11/19
 #pragma once
 #include "RendererBase.h"
+#include "OitCompositeRenderer.h"
 
 namespace QZL
 {
 	namespace Graphics {
-		/*class ParticleRenderer : public RendererBase {
+		class DynamicElementBuffer;
+		class ParticleSimulator;
+		class OitCompositeRenderer;
+
+		// Pushed after the VertexPushConstants for each particle system drawn
+		struct ParticlePushConstants {
+			uint32_t paramsIdx;
+			// Index in the particle buffer read of the system's first particle
+			uint32_t firstParticle;
+			uint32_t gpuSimulated;
+			// OitMode the fragment shader resolves with, the only member it reads
+			uint32_t oitMode;
+		};
+		// Both stages read the particle push constants
+		constexpr VkShaderStageFlagBits kParticlePushConstantStages = static_cast<VkShaderStageFlagBits>(VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+
+		/*
+			Every particle system is one instanced draw of a 4 vertex strip, the vertex shader building each instance's quad around a
+			particle it reads from a storage buffer, rather than a geometry shader expanding points. Cpu simulated systems are read from
+			this renderer's dynamic buffer, a frame index region at a time, and gpu simulated ones from the particle simulator's instance
+			buffer with the simulator's indirect draw, so their counts never come back to the cpu.
+			Particles are never sorted for drawing, they write to the order independent transparency targets and lists of the composite.
+		*/
+		class ParticleRenderer : public RendererBase {
 		public:
-			ParticleRenderer(RendererCreateInfo& createInfo);
+			ParticleRenderer(RendererCreateInfo2& createInfo2, LogicDevice* logicDevice, VkRenderPass renderPass, GlobalRenderData* grd, SceneGraphicsInfo* graphicsInfo,
+				OitCompositeRenderer* oitComposite);
 			~ParticleRenderer() = default;
-			void recordFrame(const uint32_t frameIdx, VkCommandBuffer cmdBuffer, std::vector<VkDrawIndexedIndirectCommand>* commandList, bool ignoreEboBind = false) override;
-		};*/
+			// The particle systems have filled the buffer by now, so it can be created and the particle set pointed at it
+			void preframeSetup() override;
+			// Expects the scene's sets bound with this renderer's layout and the vertex push constants pushed. The cpu particles are copied
+			// in to the frame's region unless ignoreEboBind is set, as when the frame is drawn again for another camera.
+			void recordFrame(const uint32_t frameIdx, VkCommandBuffer cmdBuffer, std::vector<IndexedDrawCommand>* commandList, bool ignoreEboBind = false) override;
+			void setOitMode(OitMode mode) {
+				oitMode_ = mode;
+			}
+		private:
+			void createDescriptorSet();
+
+			DynamicElementBuffer* particleBuffer_;
+			ParticleSimulator* simulator_;
+			OitCompositeRenderer* oitComposite_;
+			OitMode oitMode_;
+			VkDescriptorSetLayout layout_;
+			VkDescriptorSet set_;
+
+			// Set the particle buffers are bound to, must match PARTICLE_SET in particles.vert
+			static constexpr uint32_t kParticleSet = 2;
+			// Set the order independent transparency lists are bound to, must match OIT_SET in particles.frag
+			static constexpr uint32_t kOitListSet = 3;
+		};
 	}
 }
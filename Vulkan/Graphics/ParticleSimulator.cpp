@@ -0,0 +1,319 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "ParticleSimulator.h"
+#include "LogicDevice.h"
+#include "DeviceMemory.h"
+#include "Descriptor.h"
+#include "ComputePipeline.h"
+#include "FrameAllocator.h"
+#include "RendererBase.h"
+#include "Vertex.h"
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+// Must match PARTICLE_GROUP_SIZE in particle_simulation.glsl
+static constexpr uint32_t kWorkgroupSize = 64;
+// Size of the ParticleInstance written by compact, laid out as the ParticleVertex cpu simulated particles are drawn from
+static constexpr VkDeviceSize kInstanceSize = sizeof(ParticleVertex);
+
+static uint32_t nextPowerOfTwo(uint32_t value)
+{
+	uint32_t result = 1;
+	while (result < value) {
+		result <<= 1;
+	}
+	return result;
+}
+
+ParticleSimulator::ParticleSimulator(const LogicDevice* logicDevice, uint32_t frameCount)
+	: logicDevice_(logicDevice), frameCount_(frameCount), pipelines_(), paramsAllocator_(nullptr), layout_(VK_NULL_HANDLE), set_(VK_NULL_HANDLE),
+	  pool_(kMaxParticles), emitters_(kMaxEmitters), frameCounter_(0)
+{
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(logicDevice->getPhysicalDevice(), &properties);
+
+	DeviceMemory* deviceMemory = logicDevice_->getDeviceMemory();
+	particleBuffer_ = deviceMemory->createBuffer("ParticlePool", MemoryAllocationPattern::kRenderTarget, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		sizeof(GpuParticle) * kMaxParticles);
+	aliveListBuffer_ = deviceMemory->createBuffer("ParticleAliveLists", MemoryAllocationPattern::kRenderTarget, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		sizeof(uint32_t) * kMaxParticles * 2);
+	deadListBuffer_ = deviceMemory->createBuffer("ParticleDeadList", MemoryAllocationPattern::kRenderTarget, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		sizeof(uint32_t) * kMaxParticles);
+	stateBuffer_ = deviceMemory->createBuffer("ParticleEmitterStates", MemoryAllocationPattern::kRenderTarget,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(GpuEmitterState) * kMaxEmitters);
+	instanceBuffer_ = deviceMemory->createBuffer("ParticleInstances", MemoryAllocationPattern::kRenderTarget, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		kInstanceSize * kMaxParticles);
+	sortKeyBuffer_ = deviceMemory->createBuffer("ParticleSortKeys", MemoryAllocationPattern::kRenderTarget, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		sizeof(float) * kMaxParticles);
+	sortValueBuffer_ = deviceMemory->createBuffer("ParticleSortValues", MemoryAllocationPattern::kRenderTarget, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		sizeof(uint32_t) * kMaxParticles);
+	// Every frame takes the whole range so the dynamic offset plus the descriptor's range is always within the buffer
+	paramsAllocator_ = new FrameAllocator(deviceMemory, sizeof(GpuEmitterParams) * kMaxEmitters, frameCount, properties.limits.minStorageBufferOffsetAlignment,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, "ParticleParamsAllocator");
+	updates_.reserve(kMaxEmitters);
+
+	freeEmitters_.reserve(kMaxEmitters);
+	for (uint32_t i = kMaxEmitters; i > 0; --i) {
+		freeEmitters_.push_back(i - 1);
+	}
+
+	createDescriptorSet();
+	std::vector<VkPushConstantRange> pushConstantRanges = { RendererBase::setupPushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, sizeof(PushConstants), 0) };
+	const char* shaders[kKernelCount] = { "ParticleSimulate", "ParticleEmit", "ParticleCompact", "ParticleSortBlock", "ParticleSortMerge", "ParticleSortGather" };
+	for (uint32_t i = 0; i < kKernelCount; ++i) {
+		pipelines_[i] = new ComputePipeline(logicDevice_, ComputePipeline::makeLayoutInfo(1, &layout_, pushConstantRanges), shaders[i]);
+	}
+}
+
+ParticleSimulator::~ParticleSimulator()
+{
+	for (auto& pipeline : pipelines_) {
+		SAFE_DELETE(pipeline);
+	}
+	SAFE_DELETE(paramsAllocator_);
+	DeviceMemory* deviceMemory = logicDevice_->getDeviceMemory();
+	for (const auto* buffer : { &particleBuffer_, &aliveListBuffer_, &deadListBuffer_, &stateBuffer_, &instanceBuffer_, &sortKeyBuffer_, &sortValueBuffer_ }) {
+		deviceMemory->deleteAllocation(buffer->id, buffer->buffer);
+	}
+}
+
+uint32_t ParticleSimulator::createEmitter(const ParticleEmitterSettings& settings)
+{
+	EXPECTS(settings.maxParticles > 0);
+	if (freeEmitters_.empty()) {
+		DEBUG_LOG("Out of particle emitters");
+		return kInvalidEmitter;
+	}
+	const uint32_t poolSize = settings.sortMode == ParticleSortMode::kPerParticle ? nextPowerOfTwo(settings.maxParticles) : settings.maxParticles;
+	const VkDeviceSize first = pool_.allocate(poolSize);
+	if (first == FreeListAllocator::kInvalidOffset) {
+		DEBUG_LOG("Particle pool can not fit an emitter of " << poolSize << " particles");
+		return kInvalidEmitter;
+	}
+	const uint32_t emitter = freeEmitters_.back();
+	freeEmitters_.pop_back();
+	emitters_[emitter].settings = settings;
+	emitters_[emitter].firstParticle = first;
+	emitters_[emitter].poolSize = poolSize;
+	emitters_[emitter].currentList = 0;
+	emitters_[emitter].needsReset = true;
+	return emitter;
+}
+
+void ParticleSimulator::destroyEmitter(uint32_t emitter)
+{
+	EXPECTS(emitter < kMaxEmitters && emitters_[emitter].firstParticle != FreeListAllocator::kInvalidOffset);
+	pendingFrees_.push_back({ emitter, frameCounter_ + frameCount_ });
+}
+
+void ParticleSimulator::updateEmitter(uint32_t emitter, const glm::vec3& origin, const glm::vec3& viewPosition, float dt, uint32_t emitCount)
+{
+	EXPECTS(emitter < kMaxEmitters && emitters_[emitter].firstParticle != FreeListAllocator::kInvalidOffset);
+	const Emitter& state = emitters_[emitter];
+	const ParticleEmitterSettings& settings = state.settings;
+	GpuEmitterParams params;
+	params.origin = glm::vec4(origin + settings.spawnOffset, dt);
+	params.spawnExtent = glm::vec4(settings.spawnExtent, settings.lifetime);
+	params.velocity = glm::vec4(settings.velocity, settings.lifetimeVariance);
+	params.velocityVariance = glm::vec4(settings.velocityVariance, settings.scale);
+	params.acceleration = glm::vec4(settings.acceleration, 0.0f);
+	params.viewPosition = glm::vec4(viewPosition, 1.0f);
+	params.emitterIdx = emitter;
+	params.firstParticle = static_cast<uint32_t>(state.firstParticle);
+	params.capacity = settings.maxParticles;
+	params.emitCount = std::min(emitCount, settings.maxParticles);
+	params.currentList = state.currentList;
+	params.seed = static_cast<uint32_t>(frameCounter_ * kMaxEmitters + emitter);
+	params.sortSize = settings.sortMode == ParticleSortMode::kPerParticle ? state.poolSize : 0;
+	params.padding = 0;
+	updates_.push_back(params);
+}
+
+void ParticleSimulator::simulate(VkCommandBuffer cmdBuffer, uint32_t frameIdx)
+{
+	++frameCounter_;
+	for (auto it = pendingFrees_.begin(); it != pendingFrees_.end();) {
+		if (it->releaseFrame > frameCounter_) {
+			++it;
+			continue;
+		}
+		Emitter& emitter = emitters_[it->emitter];
+		pool_.free(emitter.firstParticle, emitter.poolSize);
+		emitter.firstParticle = FreeListAllocator::kInvalidOffset;
+		freeEmitters_.push_back(it->emitter);
+		it = pendingFrees_.erase(it);
+	}
+	if (updates_.empty()) {
+		return;
+	}
+
+	paramsAllocator_->beginFrame(frameIdx);
+	const FrameAllocation paramsAllocation = paramsAllocator_->upload(updates_.data(), updates_.size());
+	const uint32_t dynamicOffset = static_cast<uint32_t>(paramsAllocation.offset);
+	vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines_[kSimulate]->getLayout(), 0, 1, &set_, 1, &dynamicOffset);
+
+	// The last frame's draws must be done with the instances and draw arguments before they are rewritten
+	recordBarrier(cmdBuffer, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+	bool reset = false;
+	for (const auto& update : updates_) {
+		Emitter& emitter = emitters_[update.emitterIdx];
+		if (!emitter.needsReset) {
+			continue;
+		}
+		// Empty with every slot never used, a simulate of no groups, a compact of the one group that keeps the books and a draw of nothing
+		GpuEmitterState state = {};
+		state.simulateDispatch = glm::uvec4(0, 1, 1, 0);
+		state.compactDispatch[0] = glm::uvec4(1, 1, 1, 0);
+		state.compactDispatch[1] = glm::uvec4(1, 1, 1, 0);
+		state.draw = glm::uvec4(4, 0, 0, 0);
+		vkCmdUpdateBuffer(cmdBuffer, stateBuffer_.buffer, VkDeviceSize(update.emitterIdx) * sizeof(GpuEmitterState), sizeof(state), &state);
+		emitter.needsReset = false;
+		reset = true;
+	}
+	if (reset) {
+		recordBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+	}
+
+	// Each kernel runs for every emitter before the next, so one barrier between them covers all the emitters
+	for (uint32_t kernel = 0; kernel <= kCompact; ++kernel) {
+		if (kernel > 0) {
+			recordBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+				VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+		}
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines_[kernel]->getPipeline());
+		for (uint32_t i = 0; i < updates_.size(); ++i) {
+			recordKernel(cmdBuffer, Kernel(kernel), i);
+		}
+	}
+	// Sorting steps depend on the step before for the same emitter, so sorted emitters are recorded one after the other
+	bool sortBarrierRecorded = false;
+	for (uint32_t i = 0; i < updates_.size(); ++i) {
+		if (updates_[i].sortSize == 0) {
+			continue;
+		}
+		if (!sortBarrierRecorded) {
+			recordBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+				VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+			sortBarrierRecorded = true;
+		}
+		recordSort(cmdBuffer, i);
+	}
+	recordBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+		VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+
+	for (const auto& update : updates_) {
+		emitters_[update.emitterIdx].currentList ^= 1;
+	}
+	updates_.clear();
+}
+
+void ParticleSimulator::recordKernel(VkCommandBuffer cmdBuffer, Kernel kernel, uint32_t paramsIdx)
+{
+	const GpuEmitterParams& params = updates_[paramsIdx];
+	const PushConstants pushConstants = { paramsIdx, 0, 0 };
+	vkCmdPushConstants(cmdBuffer, pipelines_[kernel]->getLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+	const VkDeviceSize stateOffset = VkDeviceSize(params.emitterIdx) * sizeof(GpuEmitterState);
+	switch (kernel) {
+	case kSimulate:
+		vkCmdDispatchIndirect(cmdBuffer, stateBuffer_.buffer, stateOffset + offsetof(GpuEmitterState, simulateDispatch));
+		break;
+	case kEmit:
+		if (params.emitCount > 0) {
+			vkCmdDispatch(cmdBuffer, (params.emitCount + kWorkgroupSize - 1) / kWorkgroupSize, 1, 1);
+		}
+		break;
+	case kCompact:
+		// Always at least one group, its first invocation does the emitter's bookkeeping
+		vkCmdDispatchIndirect(cmdBuffer, stateBuffer_.buffer, stateOffset + offsetof(GpuEmitterState, compactDispatch) +
+			sizeof(glm::uvec4) * (params.currentList ^ 1));
+		break;
+	case kSortGather:
+		// Compact has sized next frame's simulate to the particles now alive, which are what gather writes
+		vkCmdDispatchIndirect(cmdBuffer, stateBuffer_.buffer, stateOffset + offsetof(GpuEmitterState, simulateDispatch));
+		break;
+	default:
+		ASSERT(false);
+	}
+}
+
+void ParticleSimulator::recordSort(VkCommandBuffer cmdBuffer, uint32_t paramsIdx)
+{
+	const uint32_t sortSize = updates_[paramsIdx].sortSize;
+	const uint32_t blockCount = std::max(sortSize / kSortBlockSize, 1u);
+	// Every block is sorted alternately ascending and descending, so neighbouring blocks form bitonic sequences to merge
+	recordSortStep(cmdBuffer, kSortBlock, paramsIdx, 0, 0, blockCount);
+	for (uint32_t sequence = kSortBlockSize * 2; sequence <= sortSize; sequence <<= 1) {
+		// Strides of a block or more compare elements in different blocks, so each is its own dispatch
+		for (uint32_t stride = sequence / 2; stride >= kSortBlockSize; stride >>= 1) {
+			recordSortStep(cmdBuffer, kSortMerge, paramsIdx, sequence, stride, sortSize / 2 / kWorkgroupSize);
+		}
+		// The rest of the merge stays within blocks
+		recordSortStep(cmdBuffer, kSortBlock, paramsIdx, sequence, kSortBlockSize / 2, blockCount);
+	}
+	vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines_[kSortGather]->getPipeline());
+	recordKernel(cmdBuffer, kSortGather, paramsIdx);
+}
+
+void ParticleSimulator::recordSortStep(VkCommandBuffer cmdBuffer, Kernel kernel, uint32_t paramsIdx, uint32_t sequence, uint32_t stride, uint32_t groupCount)
+{
+	const PushConstants pushConstants = { paramsIdx, sequence, stride };
+	vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines_[kernel]->getPipeline());
+	vkCmdPushConstants(cmdBuffer, pipelines_[kernel]->getLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+	vkCmdDispatch(cmdBuffer, groupCount, 1, 1);
+	recordBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+}
+
+void ParticleSimulator::recordBarrier(VkCommandBuffer cmdBuffer, VkPipelineStageFlags srcStages, VkAccessFlags srcAccess, VkPipelineStageFlags dstStages,
+	VkAccessFlags dstAccess)
+{
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstAccessMask = dstAccess;
+	vkCmdPipelineBarrier(cmdBuffer, srcStages, dstStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void ParticleSimulator::createDescriptorSet()
+{
+	Descriptor* descriptor = logicDevice_->getPrimaryDescriptor();
+	constexpr uint32_t kBindingCount = 8;
+	VkDescriptorSetLayoutBinding bindings[kBindingCount] = {};
+	for (uint32_t i = 0; i < kBindingCount; ++i) {
+		bindings[i].binding = i;
+		bindings[i].descriptorCount = 1;
+		bindings[i].descriptorType = i == 4 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	layout_ = descriptor->makeLayout({ bindings[0], bindings[1], bindings[2], bindings[3], bindings[4], bindings[5], bindings[6], bindings[7] });
+	set_ = descriptor->getSet(descriptor->createSets({ layout_ }));
+
+	VkDescriptorBufferInfo bufferInfos[kBindingCount] = {
+		{ particleBuffer_.buffer, 0, VK_WHOLE_SIZE },
+		{ aliveListBuffer_.buffer, 0, VK_WHOLE_SIZE },
+		{ deadListBuffer_.buffer, 0, VK_WHOLE_SIZE },
+		{ stateBuffer_.buffer, 0, VK_WHOLE_SIZE },
+		{ paramsAllocator_->getBuffer(), 0, paramsAllocator_->getFrameCapacity() },
+		{ instanceBuffer_.buffer, 0, VK_WHOLE_SIZE },
+		{ sortKeyBuffer_.buffer, 0, VK_WHOLE_SIZE },
+		{ sortValueBuffer_.buffer, 0, VK_WHOLE_SIZE }
+	};
+	std::vector<VkWriteDescriptorSet> descriptorWrites(kBindingCount);
+	for (uint32_t i = 0; i < kBindingCount; ++i) {
+		descriptorWrites[i] = {};
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].dstSet = set_;
+		descriptorWrites[i].dstBinding = i;
+		descriptorWrites[i].dstArrayElement = 0;
+		descriptorWrites[i].descriptorType = bindings[i].descriptorType;
+		descriptorWrites[i].descriptorCount = 1;
+		descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+	}
+	descriptor->updateDescriptorSets(descriptorWrites);
+}
@@ -0,0 +1,186 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Purpose: Simulate particle systems on the gpu so the cpu never touches individual particles.
+#pragma once
+#include "VkUtil.h"
+#include "MemoryAllocation.h"
+#include "FreeListAllocator.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		class LogicDevice;
+		class ComputePipeline;
+		class FrameAllocator;
+
+		enum class ParticleSortMode {
+			// Drawn in whatever order they are stored, for opaque or additive particles
+			kNone = 0,
+			// Particles are left unsorted and the renderer orders whole systems back to front, enough when systems rarely overlap
+			kPerEmitter,
+			// Every particle is drawn back to front from the viewer
+			kPerParticle
+		};
+
+		// What an emitter spawns and how its particles move, in the particle system's model space
+		struct ParticleEmitterSettings {
+			uint32_t maxParticles = 0;
+			// Particles a second, limited by how many of maxParticles are dead
+			float spawnRate = 0.0f;
+			float lifetime = 1.0f;
+			float lifetimeVariance = 0.0f;
+			// Particles spawn uniformly in the box of half size spawnExtent centred spawnOffset from the emitter's origin
+			glm::vec3 spawnOffset = glm::vec3(0.0f);
+			glm::vec3 spawnExtent = glm::vec3(0.0f);
+			glm::vec3 velocity = glm::vec3(0.0f);
+			glm::vec3 velocityVariance = glm::vec3(0.0f);
+			glm::vec3 acceleration = glm::vec3(0.0f);
+			float scale = 1.0f;
+			ParticleSortMode sortMode = ParticleSortMode::kPerParticle;
+		};
+
+		/*
+			Every emitter takes a range of one shared particle pool. A frame runs three kernels per emitter updated that frame: simulate
+			integrates and ages the particles of the emitter's current alive list, appending survivors to the other list and the dead to
+			the dead list, emit pops dead slots (or never used ones) for the particles spawned this frame and appends them to the other list
+			too, and compact writes the survivors' draw data densely in alive list order. Compact also writes the indirect draw of the
+			emitter's quads, and the indirect dispatch sizing next frame's simulate, so counts never come back to the cpu.
+			The lists swap every frame the emitter is updated.
+			Emitters sorted per particle have compact write a distance key and alive index per particle instead, which a bitonic sort
+			orders back to front before a gather writes the draw data in that order. Bitonic sorting needs a power of two elements, so
+			those emitters take a power of two range of the pool and the sort runs over all of it, padding past the alive count with keys
+			that sort last. Blocks of kSortBlockSize are sorted and merged in shared memory, so only merge steps wider than a block run
+			as dispatches of their own.
+		*/
+		class ParticleSimulator {
+		public:
+			ParticleSimulator(const LogicDevice* logicDevice, uint32_t frameCount);
+			~ParticleSimulator();
+
+			// Reserve pool space for an emitter, kInvalidEmitter if the pool or the emitter slots are full
+			uint32_t createEmitter(const ParticleEmitterSettings& settings);
+			// The emitter's pool range is reused once no frame in flight can be drawing it
+			void destroyEmitter(uint32_t emitter);
+			// Spawn emitCount particles at origin and advance the emitter by dt in the next simulate, sorting from viewPosition if the
+			// emitter sorts per particle
+			void updateEmitter(uint32_t emitter, const glm::vec3& origin, const glm::vec3& viewPosition, float dt, uint32_t emitCount);
+			// Record the kernels of every emitter updated since the last call, before any pass draws
+			void simulate(VkCommandBuffer cmdBuffer, uint32_t frameIdx);
+
+			// Compacted draw data of the alive particles, kMaxParticles ParticleInstances
+			VkBuffer getInstanceBuffer() const {
+				return instanceBuffer_.buffer;
+			}
+			// Holds a VkDrawIndirectCommand per emitter drawing its alive particles as instanced 4 vertex strips
+			VkBuffer getDrawBuffer() const {
+				return stateBuffer_.buffer;
+			}
+			VkDeviceSize getDrawOffset(uint32_t emitter) const {
+				return VkDeviceSize(emitter) * sizeof(GpuEmitterState) + offsetof(GpuEmitterState, draw);
+			}
+			// Index of the emitter's first particle in the instance buffer
+			uint32_t getFirstParticle(uint32_t emitter) const {
+				return static_cast<uint32_t>(emitters_[emitter].firstParticle);
+			}
+
+			// Must match PARTICLE_POOL_SIZE in particle_simulation.glsl
+			static constexpr uint32_t kMaxParticles = 512 * 1024;
+			static constexpr uint32_t kMaxEmitters = 256;
+			static constexpr uint32_t kInvalidEmitter = ~0u;
+			// Must match PARTICLE_SORT_BLOCK_SIZE in particle_sort.glsl
+			static constexpr uint32_t kSortBlockSize = 1024;
+		private:
+			// Matches the layouts in particle_simulation.glsl
+			struct GpuParticle {
+				glm::vec4 position; // w is the scale
+				glm::vec4 velocity; // w is the remaining lifetime
+				glm::vec4 textureOffset;
+			};
+			struct GpuEmitterParams {
+				glm::vec4 origin; // w is the time step
+				glm::vec4 spawnExtent; // w is the lifetime
+				glm::vec4 velocity; // w is the lifetime variance
+				glm::vec4 velocityVariance; // w is the scale
+				glm::vec4 acceleration;
+				glm::vec4 viewPosition;
+				uint32_t emitterIdx;
+				uint32_t firstParticle;
+				uint32_t capacity;
+				uint32_t emitCount;
+				uint32_t currentList;
+				uint32_t seed;
+				// Power of two elements sorted, 0 for emitters not sorted per particle
+				uint32_t sortSize;
+				uint32_t padding;
+			};
+			// Must match the push constants in particle_simulation.glsl
+			struct PushConstants {
+				uint32_t paramsIdx;
+				// Size of the bitonic sequences being merged and the distance between the elements compared, 0 for the first block sort
+				uint32_t sortSequence;
+				uint32_t sortStride;
+			};
+			// Dispatch and draw arguments are padded to 16 bytes so the shader can treat them as uvec4s
+			struct GpuEmitterState {
+				uint32_t aliveCount[2];
+				uint32_t deadCount;
+				// Spawn attempts this frame, taken from the dead list first and then from the never used slots past highWater
+				uint32_t claimed;
+				uint32_t highWater;
+				uint32_t padding[3];
+				glm::uvec4 simulateDispatch;
+				glm::uvec4 compactDispatch[2];
+				glm::uvec4 draw;
+			};
+			struct Emitter {
+				ParticleEmitterSettings settings;
+				VkDeviceSize firstParticle = FreeListAllocator::kInvalidOffset;
+				// Particles taken from the pool, rounded up to a power of two when sorting
+				uint32_t poolSize = 0;
+				uint32_t currentList = 0;
+				bool needsReset = false;
+			};
+			struct PendingFree {
+				uint32_t emitter;
+				uint64_t releaseFrame;
+			};
+			enum Kernel {
+				kSimulate = 0,
+				kEmit,
+				kCompact,
+				kSortBlock,
+				kSortMerge,
+				kSortGather,
+				kKernelCount
+			};
+
+			void createDescriptorSet();
+			void recordKernel(VkCommandBuffer cmdBuffer, Kernel kernel, uint32_t paramsIdx);
+			// Record the block sort, merges and gather of one emitter, with a barrier after each
+			void recordSort(VkCommandBuffer cmdBuffer, uint32_t paramsIdx);
+			void recordSortStep(VkCommandBuffer cmdBuffer, Kernel kernel, uint32_t paramsIdx, uint32_t sequence, uint32_t stride, uint32_t groupCount);
+			static void recordBarrier(VkCommandBuffer cmdBuffer, VkPipelineStageFlags srcStages, VkAccessFlags srcAccess, VkPipelineStageFlags dstStages,
+				VkAccessFlags dstAccess);
+
+			const LogicDevice* logicDevice_;
+			const uint32_t frameCount_;
+			std::array<ComputePipeline*, kKernelCount> pipelines_;
+			FrameAllocator* paramsAllocator_;
+			VkDescriptorSetLayout layout_;
+			VkDescriptorSet set_;
+			MemoryAllocationDetails particleBuffer_;
+			MemoryAllocationDetails aliveListBuffer_;
+			MemoryAllocationDetails deadListBuffer_;
+			MemoryAllocationDetails stateBuffer_;
+			MemoryAllocationDetails instanceBuffer_;
+			MemoryAllocationDetails sortKeyBuffer_;
+			MemoryAllocationDetails sortValueBuffer_;
+			FreeListAllocator pool_;
+			std::vector<Emitter> emitters_;
+			std::vector<uint32_t> freeEmitters_;
+			std::vector<PendingFree> pendingFrees_;
+			std::vector<GpuEmitterParams> updates_;
+			uint64_t frameCounter_;
+		};
+	}
+}
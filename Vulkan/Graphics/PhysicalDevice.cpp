@@ -42,6 +42,9 @@ LogicDevice* PhysicalDevice::createLogicDevice(const GraphicsSystemDetails& sysD
 	deviceFeatures.geometryShader = VK_TRUE;
 	deviceFeatures.textureCompressionBC = VK_TRUE;
 	deviceFeatures.independentBlend = VK_TRUE;
+	// Optional, cluster culling falls back to drawing whole meshes or one indirect draw per call without them
+	deviceFeatures.drawIndirectFirstInstance = features_.drawIndirectFirstInstance;
+	deviceFeatures.multiDrawIndirect = features_.multiDrawIndirect;
 
 	VkDeviceCreateInfo deviceCreateInfo = {};
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -73,14 +73,16 @@ void PostProcessPass::doFrame(FrameInfo& frameInfo)
 	vpc.screenY = float(swapChainDetails_.extent.height);
 	vkCmdPushConstants(frameInfo.cmdBuffer, presentRenderer_->getPipelineLayout(), VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(vpc), &vpc);
 
-	const uint32_t dynamicOffsets[3] = {
+	const auto globalOffsets = globalRenderData_->getDynamicOffsets();
+	const uint32_t dynamicOffsets[3 + GlobalRenderData::kDynamicOffsetCount] = {
 		uint32_t(graphicsInfo_->mvpRange) * frameInfo.frameIdx,
 		uint32_t(graphicsInfo_->paramsRange) * frameInfo.frameIdx,
-		uint32_t(graphicsInfo_->materialRange) * frameInfo.frameIdx
+		uint32_t(graphicsInfo_->materialRange) * frameInfo.frameIdx,
+		globalOffsets[0], globalOffsets[1], globalOffsets[2]
 	};
 
 	VkDescriptorSet sets[2] = { graphicsInfo_->set, globalRenderData_->getSet() };
-	vkCmdBindDescriptorSets(frameInfo.cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, presentRenderer_->getPipelineLayout(), 0, 2, sets, 3, dynamicOffsets);
+	vkCmdBindDescriptorSets(frameInfo.cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, presentRenderer_->getPipelineLayout(), 0, 2, sets, 3 + GlobalRenderData::kDynamicOffsetCount, dynamicOffsets);
 
 	std::array<VkClearValue, 1> clearValues = {};
 	clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
@@ -0,0 +1,177 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "ReadbackService.h"
+#include "DeviceMemory.h"
+#include "ImageWriter.h"
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+ReadbackService::ReadbackService(DeviceMemory* deviceMemory, uint32_t frameCount)
+	: deviceMemory_(deviceMemory), inFlight_(frameCount)
+{
+}
+
+ReadbackService::~ReadbackService()
+{
+	for (auto& requests : inFlight_) {
+		for (auto& request : requests) {
+			deviceMemory_->deleteAllocation(request.readbackBuffer.id, request.readbackBuffer.buffer);
+		}
+	}
+	for (auto& details : freeBuffers_) {
+		deviceMemory_->deleteAllocation(details.id, details.buffer);
+	}
+}
+
+void ReadbackService::requestBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, ReadbackCallback callback)
+{
+	EXPECTS(buffer != VK_NULL_HANDLE && size > 0);
+	Request request = {};
+	request.srcBuffer = buffer;
+	request.srcOffset = offset;
+	request.size = size;
+	request.callback = callback;
+	pending_.push_back(request);
+}
+
+void ReadbackService::requestImage(VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t width, uint32_t height, VkImageLayout layout, 
+	ReadbackCallback callback, uint32_t texelSize)
+{
+	texelSize = texelSize == 0 ? ImageWriter::formatSize(format) : texelSize;
+	ASSERT(image != VK_NULL_HANDLE && texelSize > 0 && layout != VK_IMAGE_LAYOUT_UNDEFINED);
+	Request request = {};
+	request.srcImage = image;
+	request.aspect = aspect;
+	request.layout = layout;
+	request.format = format;
+	request.width = width;
+	request.height = height;
+	request.texelSize = texelSize;
+	request.size = VkDeviceSize(width) * height * texelSize;
+	request.callback = callback;
+	pending_.push_back(request);
+}
+
+void ReadbackService::requestCapture(VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t width, uint32_t height, VkImageLayout layout, 
+	const std::string& fileName)
+{
+	requestImage(image, format, aspect, width, height, layout, [fileName](const ReadbackResult& result) {
+		std::vector<uint8_t> rgba;
+		if (ImageWriter::convertToRGBA8(result.format, result.width, result.height, result.data, result.rowPitch, rgba)) {
+			ImageWriter::writePng(fileName, result.width, result.height, 4, rgba.data());
+		}
+		else {
+			DEBUG_ERR("Capture " << fileName << " has an unsupported format");
+		}
+	});
+}
+
+void ReadbackService::recordCopies(VkCommandBuffer cmdBuffer, uint32_t frameIdx)
+{
+	EXPECTS(frameIdx < inFlight_.size() && inFlight_[frameIdx].empty());
+	if (pending_.empty()) {
+		return;
+	}
+
+	// Make all prior writes available to the copies
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	for (auto& request : pending_) {
+		request.readbackBuffer = acquireBuffer(request.size);
+		if (request.srcImage != VK_NULL_HANDLE) {
+			recordImageCopy(cmdBuffer, request);
+		}
+		else {
+			VkBufferCopy region = { request.srcOffset, 0, request.size };
+			vkCmdCopyBuffer(cmdBuffer, request.srcBuffer, request.readbackBuffer.buffer, 1, &region);
+		}
+	}
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	inFlight_[frameIdx].swap(pending_);
+}
+
+void ReadbackService::beginFrame(uint32_t frameIdx)
+{
+	EXPECTS(frameIdx < inFlight_.size());
+	for (auto& request : inFlight_[frameIdx]) {
+		deviceMemory_->invalidateMemory(request.readbackBuffer.id, 0, request.size);
+		ReadbackResult result = {};
+		result.data = request.readbackBuffer.mappedData;
+		result.size = request.size;
+		result.format = request.format;
+		result.width = request.width;
+		result.height = request.height;
+		result.rowPitch = size_t(request.width) * request.texelSize;
+		request.callback(result);
+		releaseBuffer(request.readbackBuffer);
+	}
+	inFlight_[frameIdx].clear();
+}
+
+MemoryAllocationDetails ReadbackService::acquireBuffer(VkDeviceSize size)
+{
+	// Smallest free buffer which fits, but not one so large that it is wasted on a small request
+	auto best = freeBuffers_.end();
+	for (auto it = freeBuffers_.begin(); it != freeBuffers_.end(); ++it) {
+		if (it->size >= size && it->size <= size * 2 && (best == freeBuffers_.end() || it->size < best->size)) {
+			best = it;
+		}
+	}
+	if (best != freeBuffers_.end()) {
+		MemoryAllocationDetails details = *best;
+		freeBuffers_.erase(best);
+		return details;
+	}
+	MemoryAllocationDetails details = deviceMemory_->createBuffer("ReadbackBuffer", MemoryAllocationPattern::kReadback, VK_BUFFER_USAGE_TRANSFER_DST_BIT, 
+		size, MemoryAccessType::kPersistant);
+	ASSERT(details.mappedData != nullptr);
+	return details;
+}
+
+void ReadbackService::releaseBuffer(const MemoryAllocationDetails& details)
+{
+	freeBuffers_.push_back(details);
+	if (freeBuffers_.size() > kMaxFreeBuffers) {
+		deviceMemory_->deleteAllocation(freeBuffers_.front().id, freeBuffers_.front().buffer);
+		freeBuffers_.erase(freeBuffers_.begin());
+	}
+}
+
+void ReadbackService::recordImageCopy(VkCommandBuffer cmdBuffer, const Request& request)
+{
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = request.layout;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = request.srcImage;
+	barrier.subresourceRange = { request.aspect, 0, 1, 0, 1 };
+	barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	VkBufferImageCopy region = {};
+	region.bufferOffset = 0;
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+	region.imageSubresource = { request.aspect, 0, 0, 1 };
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = { request.width, request.height, 1 };
+	vkCmdCopyImageToBuffer(cmdBuffer, request.srcImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, request.readbackBuffer.buffer, 1, &region);
+
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barrier.newLayout = request.layout;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
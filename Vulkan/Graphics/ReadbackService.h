@@ -0,0 +1,80 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#pragma once
+#include "VkUtil.h"
+#include "MemoryAllocation.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		class DeviceMemory;
+
+		struct ReadbackResult {
+			const void* data; // Only valid during the callback
+			VkDeviceSize size;
+			// Image readbacks only, rows are tightly packed
+			VkFormat format;
+			uint32_t width;
+			uint32_t height;
+			size_t rowPitch;
+		};
+		using ReadbackCallback = std::function<void(const ReadbackResult&)>;
+
+		/*
+			Copies buffers and images in to host visible memory without stalling. Requests are recorded at the end of the next frame
+			and the callbacks are invoked once that frame's fence has signalled, which is MAX_FRAMES_IN_FLIGHT frames later.
+			Readback buffers are recycled between requests of a similar size.
+		*/
+		class ReadbackService {
+		public:
+			ReadbackService(DeviceMemory* deviceMemory, uint32_t frameCount);
+			// Results which have not been delivered yet are discarded
+			~ReadbackService();
+
+			void requestBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, ReadbackCallback callback);
+			// Layout is the layout of the image at the end of the frame, the image is returned to it after the copy.
+			// Texel size may be 0 for formats known to ImageWriter.
+			void requestImage(VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t width, uint32_t height, VkImageLayout layout, 
+				ReadbackCallback callback, uint32_t texelSize = 0);
+			// Image readback written to a lossless png, the format must be supported by ImageWriter::convertToRGBA8
+			void requestCapture(VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t width, uint32_t height, VkImageLayout layout, 
+				const std::string& fileName);
+
+			// Record every pending request at the end of the frame's command buffer, after all passes
+			void recordCopies(VkCommandBuffer cmdBuffer, uint32_t frameIdx);
+			// Deliver results recorded the last time this frame index was used, its fence must have signalled
+			void beginFrame(uint32_t frameIdx);
+
+			bool hasPendingRequests() const {
+				return !pending_.empty();
+			}
+
+		private:
+			struct Request {
+				VkBuffer srcBuffer;
+				VkDeviceSize srcOffset;
+				VkImage srcImage;
+				VkImageAspectFlags aspect;
+				VkImageLayout layout;
+				VkFormat format;
+				uint32_t width;
+				uint32_t height;
+				uint32_t texelSize;
+				VkDeviceSize size;
+				ReadbackCallback callback;
+				MemoryAllocationDetails readbackBuffer;
+			};
+
+			MemoryAllocationDetails acquireBuffer(VkDeviceSize size);
+			void releaseBuffer(const MemoryAllocationDetails& details);
+			void recordImageCopy(VkCommandBuffer cmdBuffer, const Request& request);
+
+			DeviceMemory* deviceMemory_;
+			std::vector<Request> pending_;
+			std::vector<std::vector<Request>> inFlight_;
+			std::vector<MemoryAllocationDetails> freeBuffers_;
+
+			static constexpr size_t kMaxFreeBuffers = 8;
+		};
+	}
+}
@@ -89,8 +89,8 @@ void RendererBase::createPipeline(const LogicDevice* logicDevice, VkRenderPass r
 void RendererBase::createPipeline(const LogicDevice* logicDevice, VkRenderPass renderPass, VkPipelineLayoutCreateInfo layoutInfo, std::vector<ShaderStageInfo>& stages,
 	PipelineCreateInfo pipelineCreateInfo, RendererPipeline::PrimitiveType patchVertexCount, VertexTypes vertexType)
 {
-	auto bindingDesc = makeVertexBindingDescription(0, uint32_t(getVertexSize(vertexType)), VK_VERTEX_INPUT_RATE_VERTEX);
-	auto attribDesc = makeVertexAttribDescriptions(0, makeVertexAttribInfo(vertexType));
+	auto bindingDesc = makeVertexBindingDescription(getVertexBinding(vertexType), uint32_t(getVertexSize(vertexType)), getVertexInputRate(vertexType));
+	auto attribDesc = makeVertexAttribDescriptions(getVertexBinding(vertexType), makeVertexAttribInfo(vertexType));
 	pipelineCreateInfo.vertexInputInfo = RendererPipeline::makeVertexInputInfo(bindingDesc, attribDesc);
 	pipeline_ = new RendererPipeline(logicDevice, renderPass, layoutInfo, stages, pipelineCreateInfo, patchVertexCount);
 }
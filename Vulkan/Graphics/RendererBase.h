@@ -49,11 +49,7 @@ namespace QZL
 		};
 
 		struct TessellationPushConstants {
-			float distanceFarMinusClose = 0.0f;
-			float closeDistance = 0.0f;
-			float patchRadius = 0.0f;
-			float maxTessellationWeight = 0.0f;
-			std::array<glm::vec4, 6> frustumPlanes;
+			glm::vec2 viewportSize;
 		};
 
 		struct CameraPushConstants {
@@ -81,13 +77,13 @@ namespace QZL
 			RendererBase(LogicDevice* logicDevice, ElementBufferObject* ebo, SceneGraphicsInfo* graphicsInfo);
 
 			virtual ~RendererBase();
-			virtual void recordFrame(const uint32_t frameIdx, VkCommandBuffer cmdBuffer, std::vector<VkDrawIndexedIndirectCommand>* commandList, bool ignoreEboBind = false) = 0;
+			virtual void recordFrame(const uint32_t frameIdx, VkCommandBuffer cmdBuffer, std::vector<IndexedDrawCommand>* commandList, bool ignoreEboBind = false) = 0;
 			std::vector<VkWriteDescriptorSet> getDescriptorWrites(uint32_t frameIdx);
 
 			ElementBufferObject* getElementBuffer();
 			VkPipelineLayout getPipelineLayout();
 
-			void preframeSetup();
+			virtual void preframeSetup();
 			virtual void toggleWiremeshMode();
 
 			static VkSpecializationMapEntry makeSpecConstantEntry(uint32_t id, uint32_t offset, size_t size);
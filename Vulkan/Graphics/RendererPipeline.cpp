@@ -79,7 +79,8 @@ VkPipelineVertexInputStateCreateInfo RendererPipeline::makeVertexInputInfo(VkVer
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 
-	vertexInputInfo.vertexBindingDescriptionCount = 1;
+	// A binding without attributes is a vertex pulling pipeline, which has nothing to bind
+	vertexInputInfo.vertexBindingDescriptionCount = attribDescs.empty() ? 0 : 1;
 	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attribDescs.size());
 	vertexInputInfo.pVertexBindingDescriptions = &bindingDesc;
 	vertexInputInfo.pVertexAttributeDescriptions = attribDescs.data();
@@ -140,12 +141,13 @@ void RendererPipeline::createPipeline(const LogicDevice* logicDevice, VkRenderPa
 		VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
 		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
 		colorBlendAttachment.blendEnable = pipelineCreateInfo.colourBlendEnables.size() == 0 ? VK_TRUE : pipelineCreateInfo.colourBlendEnables[i];
-		colorBlendAttachment.alphaBlendOp = pipelineCreateInfo.blendOps.alphaOp;
-		colorBlendAttachment.srcAlphaBlendFactor = pipelineCreateInfo.blendOps.srcAlphaFactor;
-		colorBlendAttachment.dstAlphaBlendFactor = pipelineCreateInfo.blendOps.dstAlphaFactor;
-		colorBlendAttachment.colorBlendOp = pipelineCreateInfo.blendOps.colourOp;
-		colorBlendAttachment.srcColorBlendFactor = pipelineCreateInfo.blendOps.srcColourFactor;
-		colorBlendAttachment.dstColorBlendFactor = pipelineCreateInfo.blendOps.dstColourFactor;
+		const auto& blendOps = pipelineCreateInfo.attachmentBlendOps.size() == 0 ? pipelineCreateInfo.blendOps : pipelineCreateInfo.attachmentBlendOps[i];
+		colorBlendAttachment.alphaBlendOp = blendOps.alphaOp;
+		colorBlendAttachment.srcAlphaBlendFactor = blendOps.srcAlphaFactor;
+		colorBlendAttachment.dstAlphaBlendFactor = blendOps.dstAlphaFactor;
+		colorBlendAttachment.colorBlendOp = blendOps.colourOp;
+		colorBlendAttachment.srcColorBlendFactor = blendOps.srcColourFactor;
+		colorBlendAttachment.dstColorBlendFactor = blendOps.dstColourFactor;
 		colorBlendAttachments.push_back(colorBlendAttachment);
 	}
 
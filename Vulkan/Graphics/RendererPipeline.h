@@ -39,6 +39,8 @@ namespace QZL
 				VkBlendFactor dstAlphaFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
 				VkBlendOp alphaOp = VK_BLEND_OP_ADD;
 			} blendOps;
+			// One per colour attachment when they blend differently, otherwise blendOps is used for all of them
+			std::vector<BlendOps> attachmentBlendOps;
 			std::vector<VkDynamicState> dynamicState;
 			std::vector<VkBool32> colourBlendEnables;
 		};
@@ -9,6 +9,9 @@ namespace QZL {
 	namespace Graphics {
 		class DescriptorBuffer;
 		class ElementBufferObject;
+		class ClusterCuller;
+		class TerrainNodeSelector;
+		class ParticleSimulator;
 		struct SceneGraphicsInfo {
 			uint32_t numFrameIndices = 0;
 			VkDescriptorSet set = VK_NULL_HANDLE;
@@ -28,6 +31,12 @@ namespace QZL {
 
 			ElementBufferObject* shadowCastingEBOs[(size_t)RendererTypes::kNone];
 			DescriptorBuffer* lightsBuffer = nullptr;
+			// Owned by the swap chain, culls the clustered static draws for every camera before the passes are recorded
+			ClusterCuller* clusterCuller = nullptr;
+			// Owned by the swap chain, selects the quadtree nodes of the terrain draws for every camera
+			TerrainNodeSelector* terrainSelector = nullptr;
+			// Owned by the swap chain, runs the gpu simulated particle systems
+			ParticleSimulator* particleSimulator = nullptr;
 		};
 	}
 }
@@ -27,10 +27,13 @@ namespace QZL {
 		struct TerrainShaderParams : ShaderParams {
 			glm::mat4 model;
 			glm::vec4 heights;
-			float distanceFarMinusClose = 300.0f;
-			float closeDistance = 50.0f;
-			float patchRadius = 40.0f;
-			float maxTessellationWeight = 4.0f;
+			// Quality knob, patch edges are split so their triangles cover about 1 / trianglesPerPixel pixels each
+			float trianglesPerPixel = 1.0f / 32.0f;
+			// Fraction of that detail kept where the cooked roughness says the terrain is flat
+			float flatTessellationScale = 0.25f;
+			float maxTessellationLevel = 64.0f;
+			// Seconds, wrapped to the grass sway's period
+			float time = 0.0f;
 			std::array<glm::vec4, 6> frustumPlanes;
 			TerrainShaderParams(float maxHeight, float sandHeight, float grassHeight, float snowHeight)
 				: heights(maxHeight, sandHeight, grassHeight, snowHeight) { }
@@ -48,11 +51,25 @@ namespace QZL {
 			float padding0;
 			float padding1;
 		};
+		// How particles' quads are turned, must match the BILLBOARD_ values in particles.vert
+		enum class ParticleBillboardMode : uint32_t {
+			// The quad faces the viewer
+			kCameraFacing = 0,
+			// The quad's up is the particle's velocity and it is lengthened by its speed, turning only about that to face the viewer
+			kVelocityStretched,
+			// The quad's up is a fixed axis and it turns only about that to face the viewer
+			kAxisAligned
+		};
 		struct ParticleShaderParams : ShaderParams {
 			glm::mat4 modelMatrix;
-			glm::vec4 tint;
+			glm::vec4 tint; // w is the texture tile length
+			glm::vec4 billboardAxis = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f); // In model space, w is the ParticleBillboardMode
+			// x is the seconds of travel a velocity stretched quad spans, the others are unused
+			glm::vec4 billboardStretch = glm::vec4(0.0f);
 			ParticleShaderParams(float texTileLength, glm::vec3 tint) : tint(tint, texTileLength) { }
 			ParticleShaderParams(glm::mat4 model, glm::vec4 tint) : modelMatrix(model), tint(tint) { }
+			ParticleShaderParams(float texTileLength, glm::vec3 tint, ParticleBillboardMode mode, const glm::vec3& axis, float stretch)
+				: tint(tint, texTileLength), billboardAxis(axis, float(mode)), billboardStretch(stretch, 0.0f, 0.0f, 0.0f) { }
 		};
 		struct WaterShaderParams : ShaderParams {
 			glm::mat4 modelMatrix;
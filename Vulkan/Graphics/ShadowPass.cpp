@@ -9,7 +9,10 @@
 #include "SceneDescriptorInfo.h"
 #include "GlobalRenderData.h"
 #include "ElementBufferObject.h"
+#include "GeometryArena.h"
 #include "TextureManager.h"
+#include "ClusterCuller.h"
+#include "TerrainNodeSelector.h"
 
 using namespace QZL;
 using namespace QZL::Graphics;
@@ -43,7 +46,6 @@ ShadowPass::ShadowPass(GraphicsMaster* master, LogicDevice* logicDevice, const S
 	std::vector<VkImageView> attachmentImages = { depthBuffer_->getImageView() };
 	createRenderPass(createInfo, attachmentImages, { SHADOW_DIMENSIONS, SHADOW_DIMENSIONS });
 	createRenderers();
-	terrainHeightmapIdx_ = graphicsMaster_->getMasters().textureManager->requestTexture("Heightmaps/hmap2");
 }
 
 ShadowPass::~ShadowPass()
@@ -80,26 +82,30 @@ void ShadowPass::doFrame(FrameInfo& frameInfo)
 	scissor.offset.y = 0;
 	vkCmdSetScissor(frameInfo.cmdBuffer, 0, 1, &scissor);
 
-	const uint32_t dynamicOffsets[3] = {
+	const auto globalOffsets = globalRenderData_->getDynamicOffsets();
+	const uint32_t dynamicOffsets[3 + GlobalRenderData::kDynamicOffsetCount] = {
 		uint32_t(graphicsInfo_->mvpRange) * (frameInfo.frameIdx + (graphicsInfo_->numFrameIndices * frameInfo.mainCameraIdx)),
 		uint32_t(graphicsInfo_->paramsRange) * frameInfo.frameIdx,
-		uint32_t(graphicsInfo_->materialRange) * frameInfo.frameIdx
+		uint32_t(graphicsInfo_->materialRange) * frameInfo.frameIdx,
+		globalOffsets[0], globalOffsets[1], globalOffsets[2]
 	};
 
 	VkDescriptorSet sets[2] = { graphicsInfo_->set, globalRenderData_->getSet() };
-	vkCmdBindDescriptorSets(frameInfo.cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowRenderer_->getPipelineLayout(), 0, 2, sets, 3, dynamicOffsets);
+	vkCmdBindDescriptorSets(frameInfo.cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowRenderer_->getPipelineLayout(), 0, 2, sets, 3 + GlobalRenderData::kDynamicOffsetCount, dynamicOffsets);
 
 	vkCmdSetDepthBias(frameInfo.cmdBuffer, 1.25f, 0.0f, 1.75f);
 
 	uint32_t mvpOffset = graphicsInfo_->mvpOffsetSizes[(size_t)RendererTypes::kStatic];
 	vkCmdPushConstants(frameInfo.cmdBuffer, shadowRenderer_->getPipelineLayout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t), &mvpOffset);
-	graphicsInfo_->shadowCastingEBOs[(size_t)RendererTypes::kStatic]->bind(frameInfo.cmdBuffer, frameInfo.frameIdx);
+	// Shadow casters share the geometry arena, so a single bind covers both renderers
+	logicDevice_->getGeometryArena()->bind(frameInfo.cmdBuffer);
+	graphicsInfo_->clusterCuller->bindView(frameInfo.mainCameraIdx);
+	graphicsInfo_->terrainSelector->bindView(frameInfo.mainCameraIdx);
 	shadowRenderer_->recordFrame(frameInfo.frameIdx, frameInfo.cmdBuffer, &frameInfo.commandLists[(size_t)RendererTypes::kStatic], true);
 
 	vkCmdSetDepthBias(frameInfo.cmdBuffer, 3.0f, 0.0f, 4.0f);
 	mvpOffset = graphicsInfo_->mvpOffsetSizes[(size_t)RendererTypes::kTerrain];
 	vkCmdPushConstants(frameInfo.cmdBuffer, shadowTerrainRenderer_->getPipelineLayout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t), &mvpOffset);
-	graphicsInfo_->shadowCastingEBOs[(size_t)RendererTypes::kTerrain]->bind(frameInfo.cmdBuffer, frameInfo.frameIdx);
 	shadowTerrainRenderer_->recordFrame(frameInfo.frameIdx, frameInfo.cmdBuffer, &frameInfo.commandLists[(size_t)RendererTypes::kTerrain], true);
 	vkCmdEndRenderPass(frameInfo.cmdBuffer);
 }
@@ -133,7 +139,8 @@ void ShadowPass::createRenderers()
 	createInfo2.pcRangesCount = 1;
 	createInfo2.pcRanges = pushConstants;
 	createInfo2.ebo = nullptr;
-	createInfo2.vertexTypes = VertexTypes::VERTEX;
+	// Shadow shaders only read the position, which every static vertex format can provide as a vec3
+	createInfo2.vertexTypes = kStaticVertexType;
 
 	shadowRenderer_ = new IndexedRenderer(createInfo2, logicDevice_, renderPass_, globalRenderData_, graphicsInfo_);
 
@@ -145,6 +152,7 @@ void ShadowPass::createRenderers()
 
 	pci.primitiveTopology = VK_PRIMITIVE_TOPOLOGY_PATCH_LIST;
 	createInfo2.pipelineCreateInfo = pci;
+	createInfo2.vertexTypes = VertexTypes::TERRAIN_NODE;
 	shadowTerrainRenderer_ = new IndexedRenderer(createInfo2, logicDevice_, renderPass_, globalRenderData_, graphicsInfo_);
 
 	graphicsMaster_->setRenderer(RendererTypes::kShadow, shadowRenderer_);
@@ -24,8 +24,6 @@ namespace QZL {
 			RendererBase* shadowTerrainRenderer_;
 			Image* depthBuffer_;
 			Image* colourBuffer_;
-
-			uint32_t terrainHeightmapIdx_;
 		};
 	}
 }
@@ -15,6 +15,8 @@ void DescriptorBuffer::init(MemoryAllocationPattern pattern, VkBufferUsageFlags
 	binding_.descriptorType = getType();
 	binding_.pImmutableSamplers = nullptr;
 	binding_.stageFlags = stageFlags;
+
+	logicDevice_->getDeviceMemory()->setMovable(bufferDetails_.id, [this](const MemoryAllocationDetails& details) { relocate(details); });
 }
 
 DescriptorBuffer::~DescriptorBuffer()
@@ -34,10 +36,22 @@ VkWriteDescriptorSet DescriptorBuffer::descriptorWrite(VkDescriptorSet set, VkDe
 	bufferInfo_.offset = offset;
 	bufferInfo_.range = range == 0 ? size_ : range;
 
+	const uint32_t binding = idx == 0 ? bindingIdx_ : idx;
+	auto target = std::find_if(descriptorTargets_.begin(), descriptorTargets_.end(), [set, binding](const DescriptorTarget& existing) {
+		return existing.set == set && existing.binding == binding;
+	});
+	if (target == descriptorTargets_.end()) {
+		descriptorTargets_.push_back({ set, bufferInfo_.offset, bufferInfo_.range, binding });
+	}
+	else {
+		target->offset = bufferInfo_.offset;
+		target->range = bufferInfo_.range;
+	}
+
 	VkWriteDescriptorSet descriptorWrite = {};
 	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	descriptorWrite.dstSet = set;
-	descriptorWrite.dstBinding = idx == 0 ? bindingIdx_ : idx;
+	descriptorWrite.dstBinding = binding;
 	descriptorWrite.dstArrayElement = 0;
 	descriptorWrite.descriptorType = getType();
 	descriptorWrite.descriptorCount = 1;
@@ -56,6 +70,30 @@ void* DescriptorBuffer::unbindRange()
 	return nullptr;
 }
 
+void DescriptorBuffer::relocate(const MemoryAllocationDetails& details)
+{
+	bufferDetails_ = details;
+	if (descriptorTargets_.empty()) {
+		return;
+	}
+
+	std::vector<VkDescriptorBufferInfo> bufferInfos(descriptorTargets_.size());
+	std::vector<VkWriteDescriptorSet> descriptorWrites(descriptorTargets_.size());
+	for (size_t i = 0; i < descriptorTargets_.size(); ++i) {
+		bufferInfos[i] = { bufferDetails_.buffer, descriptorTargets_[i].offset, descriptorTargets_[i].range };
+
+		descriptorWrites[i] = {};
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].dstSet = descriptorTargets_[i].set;
+		descriptorWrites[i].dstBinding = descriptorTargets_[i].binding;
+		descriptorWrites[i].dstArrayElement = 0;
+		descriptorWrites[i].descriptorType = getType();
+		descriptorWrites[i].descriptorCount = 1;
+		descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+	}
+	vkUpdateDescriptorSets(*logicDevice_, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
 DescriptorBuffer::DescriptorBuffer(const LogicDevice* logicDevice, uint32_t binding, VkDeviceSize maxSize)
 	: logicDevice_(logicDevice), size_(maxSize), bindingIdx_(binding)
 {
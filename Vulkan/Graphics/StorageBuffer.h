@@ -36,8 +36,18 @@ namespace QZL
 			DescriptorBuffer(const LogicDevice* logicDevice, uint32_t binding, VkDeviceSize maxSize);
 			virtual VkBufferUsageFlagBits getUsageBits() = 0;
 			virtual VkDescriptorType getType() = 0;
+			// Replace the buffer after defragmentation moved it and rewrite every descriptor set which referenced the old one
+			void relocate(const MemoryAllocationDetails& details);
+
+			struct DescriptorTarget {
+				VkDescriptorSet set;
+				VkDeviceSize offset;
+				VkDeviceSize range;
+				uint32_t binding;
+			};
 
 			MemoryAllocationDetails bufferDetails_;
+			std::vector<DescriptorTarget> descriptorTargets_;
 			VkDeviceSize size_;
 			uint32_t bindingIdx_;
 			VkDescriptorSetLayoutBinding binding_;
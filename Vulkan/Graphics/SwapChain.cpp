@@ -2,6 +2,8 @@
 // Date: 04/11/19
 #include "SwapChain.h"
 #include "LogicDevice.h"
+#include "DeviceMemory.h"
+#include "GeometryArena.h"
 #include "CombinePass.h"
 #include "GeometryPass.h"
 #include "PostProcessPass.h"
@@ -9,8 +11,14 @@
 #include "LightingPass.h"
 #include "RendererBase.h"
 #include "GlobalRenderData.h"
+#include "ReadbackService.h"
+#include "ClusterCuller.h"
+#include "TerrainNodeSelector.h"
+#include "ParticleSimulator.h"
 #include "GraphicsMaster.h"
 #include "TextureManager.h"
+#include "TextureStreamer.h"
+#include "MipGenerator.h"
 #include "SceneDescriptorInfo.h"
 #include "../InputManager.h"
 #include "../System.h"
@@ -21,6 +29,12 @@
 using namespace QZL;
 using namespace QZL::Graphics;
 
+// Fragmentation is only measured periodically as it walks every VMA block
+static constexpr size_t kDefragCheckInterval = 300;
+static constexpr float kDefragThreshold = 0.3f;
+static constexpr uint32_t kMaxDefragMovesPerFrame = 8;
+static constexpr VkDeviceSize kMaxDefragBytesPerFrame = 8 * 1024 * 1024;
+
 size_t SwapChain::numSwapChainImages = 0;
 
 LogicalCamera* SwapChain::getCamera(size_t idx)
@@ -30,7 +44,13 @@ LogicalCamera* SwapChain::getCamera(size_t idx)
 
 void SwapChain::loop()
 {
+	defragmentMemory();
+
 	const uint32_t imgIdx = aquireImage();
+	// The fence for this frame has been waited on so its transient memory can be reused
+	globalRenderData_->beginFrame(uint32_t(currentFrame_));
+	readbackService_->beginFrame(uint32_t(currentFrame_));
+	logicDevice_->getGeometryArena()->beginFrame();
 
 	auto commandLists = activeScene_->update(frameInfo_.cameras, NUM_CAMERAS, System::deltaTimeSeconds, imgIdx, globalRenderData_);
 
@@ -52,6 +72,18 @@ void SwapChain::loop()
 
 	CHECK_VKRESULT(vkBeginCommandBuffer(commandBuffers_[imgIdx], &beginInfo));
 
+	// Cluster culling, terrain tile and texture uploads, mip generation and particle simulation must finish before any pass draws
+	clusterCuller_->cull(commandBuffers_[imgIdx], uint32_t(currentFrame_), imgIdx, frameInfo_.cameras, commandLists[(size_t)RendererTypes::kStatic]);
+	terrainSelector_->select(commandBuffers_[imgIdx], uint32_t(currentFrame_), frameInfo_.cameras, commandLists[(size_t)RendererTypes::kTerrain]);
+	master_->getMasters().textureManager->getMipGenerator()->record(commandBuffers_[imgIdx], uint32_t(currentFrame_));
+	TextureStreamer* textureStreamer = master_->getMasters().textureManager->getStreamer();
+	if (textureStreamer != nullptr) {
+		textureStreamer->beginFrame(commandBuffers_[imgIdx], uint32_t(currentFrame_));
+	}
+	particleSimulator_->simulate(commandBuffers_[imgIdx], uint32_t(currentFrame_));
+	// The frame's set is not pending and not yet bound, so the texture array writes queued up to here can go in
+	globalRenderData_->writeTextureDescriptors();
+
 	// Shadow pass
 	renderPasses_[0]->doFrame(frameInfo_);
 
@@ -84,15 +116,27 @@ void SwapChain::loop()
 	// Post process ping ponging passes
 	renderPasses_[4]->doFrame(frameInfo_);
 
+	if (!pendingCapture_.empty()) {
+		readbackService_->requestCapture(details_.images[imgIdx], details_.surfaceFormat.format, VK_IMAGE_ASPECT_COLOR_BIT, details_.extent.width, 
+			details_.extent.height, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, pendingCapture_);
+		pendingCapture_.clear();
+	}
+	readbackService_->recordCopies(commandBuffers_[imgIdx], uint32_t(currentFrame_));
+
 	CHECK_VKRESULT(vkEndCommandBuffer(commandBuffers_[imgIdx]));
 
 	submitQueue(imgIdx, signalSemaphores);
 
 	present(imgIdx, signalSemaphores);
+
+	// The scene has asked for every texture it drew this frame
+	if (textureStreamer != nullptr) {
+		textureStreamer->endFrame();
+	}
 }
 
 SwapChain::SwapChain(GraphicsMaster* master, GLFWwindow* window, VkSurfaceKHR surface, LogicDevice* logicDevice, DeviceSurfaceCapabilities& surfaceCapabilities)
-	: logicDevice_(logicDevice), master_(master), splitscreenEnabled_(true)
+	: clusterCuller_(nullptr), terrainSelector_(nullptr), particleSimulator_(nullptr), logicDevice_(logicDevice), master_(master), splitscreenEnabled_(true)
 {
 	initSwapChain(window, surfaceCapabilities);
 	initSwapChainImages(window, surface, surfaceCapabilities);
@@ -101,6 +145,7 @@ SwapChain::SwapChain(GraphicsMaster* master, GLFWwindow* window, VkSurfaceKHR su
 	initDepthFormat();
 	globalRenderData_ = new GlobalRenderData(logicDevice, master->getMasters().textureManager, master->getMasters().textureManager->getSetlayoutBinding());
 	createSyncObjects();
+	readbackService_ = new ReadbackService(logicDevice->getDeviceMemory(), MAX_FRAMES_IN_FLIGHT);
 	toggleSplitscreen();
 
 	frameInfo_.cameras[0] = {};
@@ -109,6 +154,7 @@ SwapChain::SwapChain(GraphicsMaster* master, GLFWwindow* window, VkSurfaceKHR su
 	frameInfo_.cameras[0].projectionMatrix[1][1] *= -1.0f;
 	frameInfo_.cameras[0].position = glm::vec3(200.0f, 100.0f, 200.0f);
 	frameInfo_.cameras[0].lookPoint = glm::vec3(0.0f, 0.0f, 10.0f);
+	frameInfo_.cameras[0].viewportHeight = float(details_.extent.height);
 	frameInfo_.cameras[1] = {};
 	frameInfo_.cameras[1].position = glm::vec3(100.0f, 300.0f, 200.0f);
 	frameInfo_.cameras[1].lookPoint = glm::vec3(100.0f, 10.0f, 300.0f);
@@ -123,6 +169,10 @@ SwapChain::~SwapChain()
 {
 	SAFE_DELETE(inputProfile_);
 	SAFE_DELETE(globalRenderData_);
+	SAFE_DELETE(readbackService_);
+	SAFE_DELETE(clusterCuller_);
+	SAFE_DELETE(terrainSelector_);
+	SAFE_DELETE(particleSimulator_);
 	SAFE_DELETE(computePrePass_);
 	for (size_t i = 0; i < renderPasses_.size(); ++i) {
 		SAFE_DELETE(renderPasses_[i]);
@@ -161,6 +211,11 @@ void SwapChain::initSwapChainImages(GLFWwindow* window, VkSurfaceKHR surface, De
 	createInfo.imageExtent = details_.extent;
 	createInfo.imageArrayLayers = 1;
 	createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	// Needed for frame captures
+	captureSupported_ = (surfaceCapabilities.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != 0;
+	if (captureSupported_) {
+		createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	}
 
 	if (logicDevice_->getFamilyIndex(QueueFamilyType::kGraphicsQueue) !=
 		logicDevice_->getFamilyIndex(QueueFamilyType::kPresentationQueue)) {
@@ -344,9 +399,16 @@ void SwapChain::initialiseRenderPath(Scene* scene, SceneGraphicsInfo* graphicsIn
 
 	inputProfile_ = new InputProfile();
 	inputProfile_->profileBindings.push_back({ { GLFW_KEY_P }, std::bind(&SwapChain::toggleSplitscreen, this), 0.5f });
+	inputProfile_->profileBindings.push_back({ { GLFW_KEY_F12 }, std::bind(&SwapChain::captureScreenshot, this), 0.5f });
 	master_->getMasters().inputManager->addProfile("SplitScreen", inputProfile_);
 
 	activeScene_ = scene;
+	clusterCuller_ = new ClusterCuller(logicDevice_, graphicsInfo, MAX_FRAMES_IN_FLIGHT);
+	graphicsInfo->clusterCuller = clusterCuller_;
+	terrainSelector_ = new TerrainNodeSelector(logicDevice_->getDeviceMemory(), MAX_FRAMES_IN_FLIGHT);
+	graphicsInfo->terrainSelector = terrainSelector_;
+	particleSimulator_ = new ParticleSimulator(logicDevice_, MAX_FRAMES_IN_FLIGHT);
+	graphicsInfo->particleSimulator = particleSimulator_;
 	renderPasses_.push_back(new ShadowPass(master_, logicDevice_, details_, globalRenderData_, graphicsInfo));
 	renderPasses_.push_back(new DeferredPass(master_, logicDevice_, details_, globalRenderData_, graphicsInfo));
 	renderPasses_.push_back(new LightingPass(master_, logicDevice_, details_, globalRenderData_, graphicsInfo));
@@ -361,7 +423,8 @@ void SwapChain::initialiseRenderPath(Scene* scene, SceneGraphicsInfo* graphicsIn
 	});
 	renderPasses_[3]->initRenderPassDependency({
 		static_cast<LightingPass*>(renderPasses_[2])->diffuseBuffer_, static_cast<LightingPass*>(renderPasses_[2])->specularBuffer_, 
-		static_cast<DeferredPass*>(renderPasses_[1])->albedoBuffer_, static_cast<LightingPass*>(renderPasses_[2])->ambientBuffer_
+		static_cast<DeferredPass*>(renderPasses_[1])->albedoBuffer_, static_cast<LightingPass*>(renderPasses_[2])->ambientBuffer_,
+		static_cast<DeferredPass*>(renderPasses_[1])->depthBuffer_
 	});
 	renderPasses_[4]->initRenderPassDependency({ 
 		static_cast<CombinePass*>(renderPasses_[3])->colourBuffer_, static_cast<DeferredPass*>(renderPasses_[1])->depthBuffer_
@@ -382,3 +445,41 @@ void SwapChain::toggleSplitscreen()
 	frameInfo_.viewportWidth = splitscreenEnabled_ ? details_.extent.width / 2 : details_.extent.width;
 	updateCameraAspectRatio();
 }
+
+void SwapChain::captureFrame(const std::string& fileName)
+{
+	if (!captureSupported_) {
+		DEBUG_ERR("Swap chain images can not be copied from on this surface");
+		return;
+	}
+	pendingCapture_ = fileName;
+}
+
+void SwapChain::captureScreenshot()
+{
+	captureFrame("Screenshot" + std::to_string(screenshotCount_++) + ".png");
+}
+
+void SwapChain::defragmentMemory()
+{
+	DeviceMemory* deviceMemory = logicDevice_->getDeviceMemory();
+	if (!defragmenting_) {
+		if (++framesSinceDefragCheck_ < kDefragCheckInterval) {
+			return;
+		}
+		framesSinceDefragCheck_ = 0;
+		// Compacting leaves the old arena buffers to be freed once no frame in flight reads them
+		GeometryArena* arena = logicDevice_->getGeometryArena();
+		if (arena->calculateFragmentation() > kDefragThreshold) {
+			arena->compact();
+		}
+		defragmenting_ = deviceMemory->calculateFragmentation() > kDefragThreshold;
+		if (!defragmenting_) {
+			return;
+		}
+	}
+	// Moved buffers may still be referenced by any frame in flight
+	vkWaitForFences(*logicDevice_, MAX_FRAMES_IN_FLIGHT, inFlightFences_.data(), VK_TRUE, std::numeric_limits<uint64_t>::max());
+	defragmenting_ = deviceMemory->defragment(kMaxDefragMovesPerFrame, kMaxDefragBytesPerFrame) &&
+		deviceMemory->getDefragmentationStats().fragmentation > kDefragThreshold;
+}
@@ -16,6 +16,10 @@ namespace QZL
 		class LogicDevice;
 		class RenderPass;
 		class GlobalRenderData;
+		class ReadbackService;
+		class ClusterCuller;
+		class TerrainNodeSelector;
+		class ParticleSimulator;
 		class GraphicsMaster;
 		class RendererBase;
 		struct DeviceSurfaceCapabilities;
@@ -26,6 +30,14 @@ namespace QZL
 		public:
 			LogicalCamera* getCamera(size_t idx);
 			void loop();
+			ReadbackService* getReadbackService() {
+				return readbackService_;
+			}
+			ParticleSimulator* getParticleSimulator() {
+				return particleSimulator_;
+			}
+			// Write the next presented image to a png once the GPU has finished with it
+			void captureFrame(const std::string& fileName);
 			static size_t numSwapChainImages;
 		private:
 			SwapChain(GraphicsMaster* master, GLFWwindow* window, VkSurfaceKHR surface, LogicDevice* logicDevice, DeviceSurfaceCapabilities& surfaceCapabilities);
@@ -56,8 +68,16 @@ namespace QZL
 			void initialiseRenderPath(Scene* scene, SceneGraphicsInfo* graphicsInfo);
 			void updateCameraAspectRatio();
 			void toggleSplitscreen();
+			// Incrementally compact device memory while it is fragmented, a bounded number of moves per frame.
+			// The geometry arena is compacted in one go when its free space is fragmented.
+			void defragmentMemory();
+			void captureScreenshot();
 
 			GlobalRenderData* globalRenderData_;
+			ReadbackService* readbackService_;
+			ClusterCuller* clusterCuller_;
+			TerrainNodeSelector* terrainSelector_;
+			ParticleSimulator* particleSimulator_;
 
 			std::vector<VkCommandBuffer> commandBuffers_;
 			std::vector<RenderPass*> renderPasses_;
@@ -72,6 +92,11 @@ namespace QZL
 			std::vector<VkSemaphore> renderFinishedSemaphores_;
 			std::vector<VkFence> inFlightFences_;
 			size_t currentFrame_ = 0;
+			size_t framesSinceDefragCheck_ = 0;
+			bool defragmenting_ = false;
+			std::string pendingCapture_;
+			bool captureSupported_ = false;
+			size_t screenshotCount_ = 0;
 			bool splitscreenEnabled_;
 			InputProfile* inputProfile_;
 			FrameInfo frameInfo_;
@@ -0,0 +1,70 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "TerrainNodeSelector.h"
+#include "TerrainQuadtree.h"
+#include "TerrainTileStreamer.h"
+#include "FrameAllocator.h"
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+TerrainNodeSelector::TerrainNodeSelector(DeviceMemory* deviceMemory, uint32_t frameCount)
+	: nodeBuffer_(VK_NULL_HANDLE), nodeOffset_(0), viewIdx_(0)
+{
+	nodeAllocator_ = new FrameAllocator(deviceMemory, sizeof(TerrainNodeInstance) * kMaxNodesPerView * NUM_CAMERAS, frameCount, sizeof(TerrainNodeInstance),
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, "TerrainNodeAllocator");
+	nodes_.reserve(kMaxNodesPerView * NUM_CAMERAS);
+}
+
+TerrainNodeSelector::~TerrainNodeSelector()
+{
+	SAFE_DELETE(nodeAllocator_);
+}
+
+void TerrainNodeSelector::select(VkCommandBuffer cmdBuffer, uint32_t frameIdx, const LogicalCamera* cameras, std::vector<IndexedDrawCommand>& commandList)
+{
+	draws_.clear();
+	nodes_.clear();
+	std::array<size_t, NUM_CAMERAS> viewNodeCounts = {};
+	for (auto& cmd : commandList) {
+		if (cmd.terrain == nullptr) {
+			continue;
+		}
+		cmd.terrainDraw = static_cast<uint32_t>(draws_.size());
+		TerrainTileStreamer* streamer = cmd.terrain->getStreamer();
+		streamer->beginFrame(cmdBuffer, frameIdx);
+		std::array<ViewNodes, NUM_CAMERAS> views;
+		for (uint32_t view = 0; view < NUM_CAMERAS; ++view) {
+			// Perspective projections have a w row of (0, 0, -1, 0), orthographic ones (0, 0, 0, 1)
+			const glm::vec3 lodCentre = cameras[view].projectionMatrix[2][3] != 0.0f ? cameras[view].position : cameras[0].position;
+			views[view].firstNode = static_cast<uint32_t>(nodes_.size());
+			// Every view has its own budget so one camera can not starve another
+			if (!cmd.terrain->select(cameras[view], lodCentre, cmd.draw.firstInstance, nodes_, kMaxNodesPerView - viewNodeCounts[view])) {
+				DEBUG_LOG("Terrain node budget reached, some of the terrain is not drawn");
+			}
+			views[view].nodeCount = static_cast<uint32_t>(nodes_.size()) - views[view].firstNode;
+			viewNodeCounts[view] += views[view].nodeCount;
+		}
+		streamer->endFrame();
+		draws_.push_back(views);
+	}
+	if (nodes_.empty()) {
+		return;
+	}
+	nodeAllocator_->beginFrame(frameIdx);
+	const FrameAllocation allocation = nodeAllocator_->upload(nodes_.data(), nodes_.size());
+	nodeBuffer_ = allocation.buffer;
+	nodeOffset_ = allocation.offset;
+}
+
+void TerrainNodeSelector::recordDraws(VkCommandBuffer cmdBuffer, const IndexedDrawCommand& cmd) const
+{
+	EXPECTS(cmd.terrain != nullptr && cmd.terrainDraw < draws_.size());
+	const ViewNodes& nodes = draws_[cmd.terrainDraw][viewIdx_];
+	if (nodes.nodeCount == 0) {
+		return;
+	}
+	const VkDeviceSize offset = nodeOffset_ + VkDeviceSize(nodes.firstNode) * sizeof(TerrainNodeInstance);
+	vkCmdBindVertexBuffers(cmdBuffer, getVertexBinding(VertexTypes::TERRAIN_NODE), 1, &nodeBuffer_, &offset);
+	vkCmdDrawIndexed(cmdBuffer, cmd.draw.indexCount, nodes.nodeCount, cmd.draw.firstIndex, cmd.draw.vertexOffset, 0);
+}
@@ -0,0 +1,53 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Purpose: Select the quadtree nodes of every terrain draw for every camera before the passes are recorded.
+#pragma once
+#include "VkUtil.h"
+#include "DrawElementsCommand.h"
+#include "LogicalCamera.h"
+#include "Vertex.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		class DeviceMemory;
+		class FrameAllocator;
+
+		/*
+			Selection runs on the cpu, the nodes of each camera are written to a per frame buffer and bound as the per instance input of
+			the terrain pipelines, so a terrain draw becomes one instanced draw of the node grid per camera. Orthographic cameras measure
+			lod distances from the first camera, so the shadow pass culls against its own frustum but casts from the surface the viewer sees.
+			Each terrain's tile streamer is stepped around its selection, so tiles that finished loading are uploaded before the nodes name
+			them and the tiles the nodes missed start loading.
+		*/
+		class TerrainNodeSelector {
+		public:
+			TerrainNodeSelector(DeviceMemory* deviceMemory, uint32_t frameCount);
+			~TerrainNodeSelector();
+
+			// Select the nodes of the terrain draws in the command list for every camera, recording tile uploads in to the command buffer
+			void select(VkCommandBuffer cmdBuffer, uint32_t frameIdx, const LogicalCamera* cameras, std::vector<IndexedDrawCommand>& commandList);
+			// Select the camera whose nodes following draws use
+			void bindView(uint32_t viewIdx) {
+				viewIdx_ = viewIdx;
+			}
+			// Record the instanced draw of a terrain command's nodes for the bound view
+			void recordDraws(VkCommandBuffer cmdBuffer, const IndexedDrawCommand& cmd) const;
+
+			static constexpr uint32_t kMaxNodesPerView = 2048;
+		private:
+			struct ViewNodes {
+				uint32_t firstNode;
+				uint32_t nodeCount;
+			};
+
+			FrameAllocator* nodeAllocator_;
+			VkBuffer nodeBuffer_;
+			VkDeviceSize nodeOffset_;
+			// Indexed by the command's terrainDraw
+			std::vector<std::array<ViewNodes, NUM_CAMERAS>> draws_;
+			std::vector<TerrainNodeInstance> nodes_;
+			uint32_t viewIdx_;
+		};
+	}
+}
@@ -0,0 +1,108 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "TerrainQuadtree.h"
+#include "TerrainTileStreamer.h"
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+TerrainQuadtree::TerrainQuadtree(TerrainTileStreamer* streamer)
+	: streamer_(streamer), model_(1.0f), levelCount_(1)
+{
+	ASSERT(streamer_->getWorldSize() >= kLeafNodeSize);
+	while (nodeSize(levelCount_ - 1) < streamer_->getWorldSize()) {
+		++levelCount_;
+	}
+	for (uint32_t level = 0; level < levelCount_; ++level) {
+		lodRanges_.push_back(kLeafLodRange * float(1u << level));
+	}
+}
+
+bool TerrainQuadtree::select(const LogicalCamera& camera, const glm::vec3& lodCentre, uint32_t paramsIdx, std::vector<TerrainNodeInstance>& nodes, size_t maxNodes)
+{
+	Selection selection;
+	// Planes of the model view projection are in the terrain's space, so nodes are culled without transforming their bounds
+	camera.calculateFrustumPlanes(camera.viewProjection * model_, selection.frustumPlanes);
+	// Ranges and morphing are measured in the terrain's space, which the shadow shaders share without a model matrix
+	selection.lodCentre = glm::vec3(glm::inverse(model_) * glm::vec4(lodCentre, 1.0f));
+	selection.paramsIdx = paramsIdx;
+	selection.nodes = &nodes;
+	selection.maxNodes = nodes.size() + maxNodes;
+	selection.overflowed = false;
+
+	const uint32_t rootLevel = levelCount_ - 1;
+	// The root has nothing above it to fall back on, so it is drawn whatever its range
+	if (!selectNode(selection, 0, 0, rootLevel)) {
+		addNode(selection, 0, 0, rootLevel);
+	}
+	return !selection.overflowed;
+}
+
+bool TerrainQuadtree::selectNode(Selection& selection, int x, int z, uint32_t level)
+{
+	const uint32_t size = nodeSize(level);
+	const glm::vec2 minMax = streamer_->getAreaMinMax(level, x, z, size);
+	const glm::vec3 boundsMin(float(x), minMax.x, float(z));
+	const glm::vec3 boundsMax(float(x + size), minMax.y, float(z + size));
+	if (!isInFrustum(selection, boundsMin, boundsMax)) {
+		// Nothing to draw, but the area is handled
+		return true;
+	}
+	if (!isInRange(selection, boundsMin, boundsMax, lodRanges_[level])) {
+		return false;
+	}
+	if (level == 0 || !isInRange(selection, boundsMin, boundsMax, lodRanges_[level - 1])) {
+		addNode(selection, x, z, level);
+		return true;
+	}
+	const int childSize = static_cast<int>(size / 2);
+	for (int child = 0; child < 4; ++child) {
+		const int childX = x + (child & 1) * childSize;
+		const int childZ = z + (child >> 1) * childSize;
+		// A child beyond its own range is drawn at the child's size, but fully morphed so it matches this level's grid
+		if (!selectNode(selection, childX, childZ, level - 1)) {
+			addNode(selection, childX, childZ, level - 1);
+		}
+	}
+	return true;
+}
+
+void TerrainQuadtree::addNode(Selection& selection, int x, int z, uint32_t level)
+{
+	if (selection.nodes->size() >= selection.maxNodes) {
+		selection.overflowed = true;
+		return;
+	}
+	const float previousRange = level > 0 ? lodRanges_[level - 1] : 0.0f;
+	const float halfSize = float(nodeSize(level)) * 0.5f;
+	// Nearer tiles load first
+	const float priority = glm::distance(glm::vec2(float(x) + halfSize, float(z) + halfSize), glm::vec2(selection.lodCentre.x, selection.lodCentre.z));
+	TerrainNodeInstance node = {};
+	node.origin = glm::vec2(float(x), float(z));
+	node.size = float(nodeSize(level));
+	node.morphCentre = glm::vec4(selection.lodCentre, 1.0f);
+	node.morphRange = glm::vec2(glm::mix(previousRange, lodRanges_[level], kMorphStartRatio), lodRanges_[level]);
+	node.paramsIdx = selection.paramsIdx;
+	node.fineTile = streamer_->acquireTile(level, x, z, priority);
+	// Levels past the top of the tile pyramid all sample the top tile
+	node.coarseTile = level + 1 < streamer_->getLevelCount() ? streamer_->acquireTile(level + 1, x, z, priority) : node.fineTile;
+	selection.nodes->push_back(node);
+}
+
+bool TerrainQuadtree::isInFrustum(const Selection& selection, const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+{
+	for (const auto& plane : selection.frustumPlanes) {
+		// Only the corner furthest along the plane's normal needs testing
+		const glm::vec3 corner(plane.x >= 0.0f ? boundsMax.x : boundsMin.x, plane.y >= 0.0f ? boundsMax.y : boundsMin.y, plane.z >= 0.0f ? boundsMax.z : boundsMin.z);
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool TerrainQuadtree::isInRange(const Selection& selection, const glm::vec3& boundsMin, const glm::vec3& boundsMax, float range) const
+{
+	const glm::vec3 closest = glm::clamp(selection.lodCentre, boundsMin, boundsMax);
+	return glm::distance(closest, selection.lodCentre) <= range;
+}
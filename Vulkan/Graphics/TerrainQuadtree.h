@@ -0,0 +1,67 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Purpose: Continuous distance dependent level of detail (CDLOD) node selection for a heightmap terrain.
+// Reference: Filip Strugar, Continuous Distance-Dependent Level of Detail for Rendering Heightmaps, 2010
+#pragma once
+#include "Vertex.h"
+#include "LogicalCamera.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		class TerrainTileStreamer;
+
+		/*
+			The terrain is covered by a quadtree whose leaves are kLeafNodeSize samples across, every node is drawn with the same grid of
+			kNodeGridDimension quads so a node's detail halves with each level up. A level is used out to its lod range, which doubles per level,
+			and nodes are bounded by the min/max mips of the tiles they sample so they can be frustum culled before anything is drawn. Over the
+			last part of a level's range its odd grid vertices slide on to the even ones, so by the range's end the grid matches the next level
+			and there are no seams or pops between levels. Quadtree level l samples the tile pyramid's level l, blending towards level l + 1 as
+			it morphs, and selecting a node is what asks the streamer for those tiles.
+		*/
+		class TerrainQuadtree {
+		public:
+			TerrainQuadtree(TerrainTileStreamer* streamer);
+
+			TerrainTileStreamer* getStreamer() const {
+				return streamer_;
+			}
+			void setModelMatrix(const glm::mat4& model) {
+				model_ = model;
+			}
+			// Append the nodes to draw for the camera, returns false if maxNodes was reached and some were left out. Lod distances are measured
+			// from lodCentre, a world position which for orthographic views should be the viewer the shadows are for so the same surface casts the shadows.
+			bool select(const LogicalCamera& camera, const glm::vec3& lodCentre, uint32_t paramsIdx, std::vector<TerrainNodeInstance>& nodes, size_t maxNodes);
+
+			// Quads along each side of the shared node grid, must match TERRAIN_NODE_GRID_DIMENSION in terrain_heightmap.glsl
+			static constexpr uint32_t kNodeGridDimension = 16;
+			static constexpr uint32_t kLeafNodeSize = 32;
+			// Distance covered by leaf nodes, in the terrain's space where a level 0 sample is one unit
+			static constexpr float kLeafLodRange = 96.0f;
+			// Morphing starts this far through a level's range
+			static constexpr float kMorphStartRatio = 0.7f;
+		private:
+			struct Selection {
+				std::array<glm::vec4, 6> frustumPlanes;
+				glm::vec3 lodCentre;
+				uint32_t paramsIdx;
+				std::vector<TerrainNodeInstance>* nodes;
+				size_t maxNodes;
+				bool overflowed;
+			};
+			// Returns false if the node is beyond the range of its level, leaving its area for the parent to draw
+			bool selectNode(Selection& selection, int x, int z, uint32_t level);
+			void addNode(Selection& selection, int x, int z, uint32_t level);
+			bool isInFrustum(const Selection& selection, const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+			bool isInRange(const Selection& selection, const glm::vec3& boundsMin, const glm::vec3& boundsMax, float range) const;
+			uint32_t nodeSize(uint32_t level) const {
+				return kLeafNodeSize << level;
+			}
+
+			TerrainTileStreamer* streamer_;
+			glm::mat4 model_;
+			uint32_t levelCount_;
+			std::vector<float> lodRanges_;
+		};
+	}
+}
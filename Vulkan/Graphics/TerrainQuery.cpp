@@ -0,0 +1,316 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "TerrainQuery.h"
+#include "TerrainTileCache.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define QZL_TERRAIN_SSE
+#endif
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+// Entry distance of the ray in to the box if it enters before maxDistance
+static bool intersectBounds(const glm::vec3& origin, const glm::vec3& inverseDirection, const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+	float maxDistance, float& entry)
+{
+	const glm::vec3 t0 = (boundsMin - origin) * inverseDirection;
+	const glm::vec3 t1 = (boundsMax - origin) * inverseDirection;
+	const glm::vec3 tNear = glm::min(t0, t1);
+	const glm::vec3 tFar = glm::max(t0, t1);
+	entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	const float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+	return entry <= exit;
+}
+
+// Moller-Trumbore, double sided
+static bool intersectTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2,
+	float& distance)
+{
+	constexpr float kEpsilon = 1e-7f;
+	const glm::vec3 edge1 = v1 - v0;
+	const glm::vec3 edge2 = v2 - v0;
+	const glm::vec3 p = glm::cross(direction, edge2);
+	const float determinant = glm::dot(edge1, p);
+	if (std::abs(determinant) < kEpsilon) {
+		return false;
+	}
+	const float inverseDeterminant = 1.0f / determinant;
+	const glm::vec3 s = origin - v0;
+	const float u = glm::dot(s, p) * inverseDeterminant;
+	if (u < 0.0f || u > 1.0f) {
+		return false;
+	}
+	const glm::vec3 q = glm::cross(s, edge1);
+	const float v = glm::dot(direction, q) * inverseDeterminant;
+	if (v < 0.0f || u + v > 1.0f) {
+		return false;
+	}
+	distance = glm::dot(edge2, q) * inverseDeterminant;
+	return distance >= 0.0f;
+}
+
+TerrainQuery::TerrainQuery(const TerrainTileCache* cache)
+	: cache_(cache), tileSize_(static_cast<int>(cache->getHeader().tileSize)), tileMip_(0), tilesPerSide_(static_cast<int>(cache->getTilesPerSide(0))),
+	useCounter_(0)
+{
+	while ((1 << tileMip_) < tileSize_) {
+		++tileMip_;
+	}
+	rootMip_ = tileMip_ + cache_->getHeader().levelCount - 1;
+
+	std::vector<glm::vec2> bounds(size_t(tilesPerSide_) * tilesPerSide_);
+	for (int tz = 0; tz < tilesPerSide_; ++tz) {
+		for (int tx = 0; tx < tilesPerSide_; ++tx) {
+			bounds[size_t(tz) * tilesPerSide_ + tx] = cache_->getTileBounds(tx, tz);
+		}
+	}
+	tileBoundsMips_.push_back(std::move(bounds));
+	for (int blocks = tilesPerSide_ / 2; blocks > 0; blocks /= 2) {
+		const std::vector<glm::vec2>& children = tileBoundsMips_.back();
+		std::vector<glm::vec2> parents(size_t(blocks) * blocks);
+		for (int bz = 0; bz < blocks; ++bz) {
+			for (int bx = 0; bx < blocks; ++bx) {
+				glm::vec2 block(std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest());
+				for (int child = 0; child < 4; ++child) {
+					const glm::vec2& bound = children[size_t(bz * 2 + (child >> 1)) * blocks * 2 + bx * 2 + (child & 1)];
+					block = glm::vec2(glm::min(block.x, bound.x), glm::max(block.y, bound.y));
+				}
+				parents[size_t(bz) * blocks + bx] = block;
+			}
+		}
+		tileBoundsMips_.push_back(std::move(parents));
+	}
+}
+
+float TerrainQuery::getHeight(float x, float z)
+{
+	TileCursor cursor;
+	return sampleHeight(x, z, cursor);
+}
+
+glm::vec3 TerrainQuery::getNormal(float x, float z)
+{
+	TileCursor cursor;
+	return sampleNormal(x, z, cursor);
+}
+
+float TerrainQuery::getSlope(float x, float z)
+{
+	return std::acos(glm::clamp(getNormal(x, z).y, -1.0f, 1.0f));
+}
+
+bool TerrainQuery::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance)
+{
+	Ray ray;
+	ray.origin = origin;
+	ray.direction = direction;
+	// Zero components give infinities, which the slab tests handle
+	ray.inverseDirection = 1.0f / direction;
+	float nearest = maxDistance;
+	if (!intersectBlock(ray, rootMip_, 0, 0, nearest)) {
+		return false;
+	}
+	distance = nearest;
+	return true;
+}
+
+void TerrainQuery::getHeights(const glm::vec2* positions, float* heights, size_t count)
+{
+	TileCursor cursor;
+	std::array<float, kBatchSize> x, z;
+	for (size_t first = 0; first < count; first += kBatchSize) {
+		const size_t batchCount = std::min(count - first, kBatchSize);
+		for (size_t i = 0; i < batchCount; ++i) {
+			x[i] = positions[first + i].x;
+			z[i] = positions[first + i].y;
+		}
+		sampleHeights(x.data(), z.data(), heights + first, batchCount, cursor);
+	}
+}
+
+void TerrainQuery::getNormals(const glm::vec2* positions, glm::vec3* normals, size_t count)
+{
+	// Central differences as sampleNormal, each position's four neighbours kept together so they share a run
+	TileCursor cursor;
+	std::array<float, kBatchSize * 4> x, z, neighbours;
+	static const glm::vec2 kOffsets[4] = { { -1.0f, 0.0f }, { 1.0f, 0.0f }, { 0.0f, -1.0f }, { 0.0f, 1.0f } };
+	for (size_t first = 0; first < count; first += kBatchSize) {
+		const size_t batchCount = std::min(count - first, kBatchSize);
+		for (size_t i = 0; i < batchCount; ++i) {
+			for (size_t neighbour = 0; neighbour < 4; ++neighbour) {
+				x[i * 4 + neighbour] = positions[first + i].x + kOffsets[neighbour].x;
+				z[i * 4 + neighbour] = positions[first + i].y + kOffsets[neighbour].y;
+			}
+		}
+		sampleHeights(x.data(), z.data(), neighbours.data(), batchCount * 4, cursor);
+		size_t i = 0;
+#ifdef QZL_TERRAIN_SSE
+		// The same operations in the same order as glm::normalize, so the batch agrees with getNormal
+		const __m128 up = _mm_set1_ps(2.0f);
+		const __m128 one = _mm_set1_ps(1.0f);
+		for (; i + Heightfield::kLaneCount <= batchCount; i += Heightfield::kLaneCount) {
+			// Each position's neighbours are a row, transposed in to a lane per position
+			__m128 hl = _mm_loadu_ps(neighbours.data() + i * 4);
+			__m128 hr = _mm_loadu_ps(neighbours.data() + i * 4 + 4);
+			__m128 hd = _mm_loadu_ps(neighbours.data() + i * 4 + 8);
+			__m128 hu = _mm_loadu_ps(neighbours.data() + i * 4 + 12);
+			_MM_TRANSPOSE4_PS(hl, hr, hd, hu);
+			const __m128 nx = _mm_sub_ps(hl, hr);
+			const __m128 nz = _mm_sub_ps(hd, hu);
+			const __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(up, up)), _mm_mul_ps(nz, nz));
+			const __m128 inverseLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSquared));
+			alignas(16) float components[3][Heightfield::kLaneCount];
+			_mm_store_ps(components[0], _mm_mul_ps(nx, inverseLength));
+			_mm_store_ps(components[1], _mm_mul_ps(up, inverseLength));
+			_mm_store_ps(components[2], _mm_mul_ps(nz, inverseLength));
+			for (size_t lane = 0; lane < Heightfield::kLaneCount; ++lane) {
+				normals[first + i + lane] = glm::vec3(components[0][lane], components[1][lane], components[2][lane]);
+			}
+		}
+#endif
+		for (; i < batchCount; ++i) {
+			const float* h = neighbours.data() + i * 4;
+			normals[first + i] = glm::normalize(glm::vec3(h[0] - h[1], 2.0f, h[2] - h[3]));
+		}
+	}
+}
+
+const Heightfield& TerrainQuery::getTile(int tx, int tz)
+{
+	const uint64_t key = (uint64_t(tz) << 32) | uint64_t(uint32_t(tx));
+	auto it = tiles_.find(key);
+	if (it == tiles_.end()) {
+		if (tiles_.size() >= kMaxCachedTiles) {
+			tiles_.erase(std::min_element(tiles_.begin(), tiles_.end(), [](const auto& lhs, const auto& rhs) {
+				return lhs.second.lastUsed < rhs.second.lastUsed;
+			}));
+		}
+		const TerrainTileLayout layout = TerrainTileCache::getTileLayout(uint32_t(tileSize_));
+		const uint16_t* heights = reinterpret_cast<const uint16_t*>(cache_->getTileData(0, uint32_t(tx), uint32_t(tz)) + layout.heightOffset);
+		CachedTile tile = { std::make_unique<Heightfield>(heights, uint32_t(tileSize_), cache_->getHeader().heightScale), 0 };
+		it = tiles_.emplace(key, std::move(tile)).first;
+	}
+	it->second.lastUsed = ++useCounter_;
+	return *it->second.heightfield;
+}
+
+float TerrainQuery::sampleHeight(float x, float z, TileCursor& cursor)
+{
+	const float worldSize = float(tileSize_ * tilesPerSide_);
+	x = glm::clamp(x, 0.0f, worldSize);
+	z = glm::clamp(z, 0.0f, worldSize);
+	// Tiles hold their far edge, so the far edge of the terrain belongs to the last tile
+	const int tx = std::min(static_cast<int>(x) / tileSize_, tilesPerSide_ - 1);
+	const int tz = std::min(static_cast<int>(z) / tileSize_, tilesPerSide_ - 1);
+	// The cursor's tile was the last one used, so loading another never evicts it
+	if (tx != cursor.tx || tz != cursor.tz) {
+		cursor.tx = tx;
+		cursor.tz = tz;
+		cursor.tile = &getTile(tx, tz);
+	}
+	return cursor.tile->getHeight(x - float(tx * tileSize_), z - float(tz * tileSize_));
+}
+
+void TerrainQuery::sampleHeights(float* x, float* z, float* heights, size_t count, TileCursor& cursor)
+{
+	const float worldSize = float(tileSize_ * tilesPerSide_);
+	size_t runStart = 0;
+	for (size_t i = 0; i < count; ++i) {
+		x[i] = glm::clamp(x[i], 0.0f, worldSize);
+		z[i] = glm::clamp(z[i], 0.0f, worldSize);
+		const int tx = std::min(static_cast<int>(x[i]) / tileSize_, tilesPerSide_ - 1);
+		const int tz = std::min(static_cast<int>(z[i]) / tileSize_, tilesPerSide_ - 1);
+		// Each run is filtered as it ends, so only the cursor's tile needs to be held
+		if (tx != cursor.tx || tz != cursor.tz) {
+			if (i > runStart) {
+				cursor.tile->getHeights(x + runStart, z + runStart, heights + runStart, i - runStart);
+			}
+			runStart = i;
+			cursor.tx = tx;
+			cursor.tz = tz;
+			cursor.tile = &getTile(tx, tz);
+		}
+		x[i] -= float(tx * tileSize_);
+		z[i] -= float(tz * tileSize_);
+	}
+	if (count > runStart) {
+		cursor.tile->getHeights(x + runStart, z + runStart, heights + runStart, count - runStart);
+	}
+}
+
+glm::vec3 TerrainQuery::sampleNormal(float x, float z, TileCursor& cursor)
+{
+	const float hl = sampleHeight(x - 1.0f, z, cursor);
+	const float hr = sampleHeight(x + 1.0f, z, cursor);
+	const float hd = sampleHeight(x, z - 1.0f, cursor);
+	const float hu = sampleHeight(x, z + 1.0f, cursor);
+	return glm::normalize(glm::vec3(hl - hr, 2.0f, hd - hu));
+}
+
+glm::vec2 TerrainQuery::getBlockMinMax(uint32_t mip, int bx, int bz)
+{
+	if (mip >= tileMip_) {
+		const int blocks = tilesPerSide_ >> (mip - tileMip_);
+		return tileBoundsMips_[mip - tileMip_][size_t(bz) * blocks + bx];
+	}
+	const uint32_t shift = tileMip_ - mip;
+	const int tx = bx >> shift;
+	const int tz = bz >> shift;
+	return getTile(tx, tz).getBlockMinMax(mip, bx - (tx << shift), bz - (tz << shift));
+}
+
+bool TerrainQuery::intersectBlock(const Ray& ray, uint32_t mip, int bx, int bz, float& nearest)
+{
+	const glm::vec2 minMax = getBlockMinMax(mip, bx, bz);
+	const float size = float(1 << mip);
+	const glm::vec3 boundsMin(float(bx) * size, minMax.x, float(bz) * size);
+	const glm::vec3 boundsMax(float(bx + 1) * size, minMax.y, float(bz + 1) * size);
+	float entry;
+	if (!intersectBounds(ray.origin, ray.inverseDirection, boundsMin, boundsMax, nearest, entry)) {
+		return false;
+	}
+	if (mip == Heightfield::kFirstMip) {
+		return intersectQuads(ray, bx << mip, bz << mip, 1 << mip, nearest);
+	}
+	// Visit the children in the order the ray passes over them, so a hit in an early one culls the rest
+	std::array<std::pair<float, int>, 4> children;
+	for (int child = 0; child < 4; ++child) {
+		const glm::vec2 centre = (glm::vec2(float(bx * 2 + (child & 1)), float(bz * 2 + (child >> 1))) + 0.5f) * (size * 0.5f);
+		children[child] = { glm::dot(centre - glm::vec2(ray.origin.x, ray.origin.z), glm::vec2(ray.direction.x, ray.direction.z)), child };
+	}
+	std::sort(children.begin(), children.end());
+	bool hit = false;
+	for (const auto& child : children) {
+		hit = intersectBlock(ray, mip - 1, bx * 2 + (child.second & 1), bz * 2 + (child.second >> 1), nearest) || hit;
+	}
+	return hit;
+}
+
+bool TerrainQuery::intersectQuads(const Ray& ray, int x0, int z0, int count, float& nearest)
+{
+	// A leaf block never crosses a tile, its far edge being the tile's own when it is the last
+	const int tx = x0 >> tileMip_;
+	const int tz = z0 >> tileMip_;
+	const Heightfield& tile = getTile(tx, tz);
+	const int localX = x0 - tx * tileSize_;
+	const int localZ = z0 - tz * tileSize_;
+	bool hit = false;
+	for (int z = 0; z < count; ++z) {
+		for (int x = 0; x < count; ++x) {
+			auto corner = [&](int dx, int dz) {
+				return glm::vec3(float(x0 + x + dx), tile.getSampleHeight(localX + x + dx, localZ + z + dz), float(z0 + z + dz));
+			};
+			const glm::vec3 p00 = corner(0, 0), p10 = corner(1, 0), p01 = corner(0, 1), p11 = corner(1, 1);
+			float distance;
+			for (const auto& triangle : { std::array<glm::vec3, 3>{ p00, p10, p11 }, std::array<glm::vec3, 3>{ p00, p11, p01 } }) {
+				if (intersectTriangle(ray.origin, ray.direction, triangle[0], triangle[1], triangle[2], distance) && distance <= nearest) {
+					nearest = distance;
+					hit = true;
+				}
+			}
+		}
+	}
+	return hit;
+}
@@ -0,0 +1,80 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Purpose: Cpu height, normal and ray queries against the full resolution terrain, for gameplay placement and collision.
+#pragma once
+#include "VkUtil.h"
+#include "Heightfield.h"
+#include <memory>
+
+namespace QZL
+{
+	namespace Graphics {
+		class TerrainTileCache;
+
+		/*
+			Queries read the level 0 tiles straight out of the mapped tile cache, independent of what the streamer has resident on the gpu,
+			so answers do not change with the view. Tiles are decoded in to heightfields on first use and the least recently used are
+			dropped past kMaxCachedTiles. Rays descend the cache's per tile bounds and then each tile's min/max mips, only testing the
+			triangles of the 2^kFirstMip blocks they actually pass through. Positions are in the terrain's space where a level 0 sample is
+			one unit, the Terrain entity converts to and from world space. Not thread safe, queries come from the game thread.
+		*/
+		class TerrainQuery {
+		public:
+			TerrainQuery(const TerrainTileCache* cache);
+
+			// Bilinear between the samples around x, z, positions off the terrain are clamped to its edge
+			float getHeight(float x, float z);
+			// From central differences one sample either side, like the cooked normals
+			glm::vec3 getNormal(float x, float z);
+			// Radians between the normal and straight up
+			float getSlope(float x, float z);
+			// Distance along direction to the first hit no further than maxDistance, in multiples of direction's length
+			bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance);
+
+			// Batched variants, runs of positions in one tile are filtered together by Heightfield::getHeights and the normals
+			// normalised four at a time with SSE2 where it is available
+			void getHeights(const glm::vec2* positions, float* heights, size_t count);
+			void getNormals(const glm::vec2* positions, glm::vec3* normals, size_t count);
+
+			static constexpr size_t kMaxCachedTiles = 64;
+			// Positions the batched queries split in to and out of their own layout at a time
+			static constexpr size_t kBatchSize = 64;
+		private:
+			struct CachedTile {
+				std::unique_ptr<Heightfield> heightfield;
+				uint64_t lastUsed;
+			};
+			// The tile last sampled, so runs of positions in one tile skip the lookup
+			struct TileCursor {
+				int tx = -1;
+				int tz = -1;
+				const Heightfield* tile = nullptr;
+			};
+			struct Ray {
+				glm::vec3 origin;
+				glm::vec3 direction;
+				glm::vec3 inverseDirection;
+			};
+
+			const Heightfield& getTile(int tx, int tz);
+			float sampleHeight(float x, float z, TileCursor& cursor);
+			// Heights of count positions, which are clamped and made local to their tiles in place
+			void sampleHeights(float* x, float* z, float* heights, size_t count, TileCursor& cursor);
+			glm::vec3 sampleNormal(float x, float z, TileCursor& cursor);
+			// Bounds of the block of 2^mip quads at bx, bz, from the cache's tile bounds above the tile size and the tile's mips below it
+			glm::vec2 getBlockMinMax(uint32_t mip, int bx, int bz);
+			bool intersectBlock(const Ray& ray, uint32_t mip, int bx, int bz, float& nearest);
+			bool intersectQuads(const Ray& ray, int x0, int z0, int count, float& nearest);
+
+			const TerrainTileCache* cache_;
+			int tileSize_;
+			uint32_t tileMip_;
+			uint32_t rootMip_;
+			int tilesPerSide_;
+			// Level 0 tile bounds and their unions up to the whole terrain, mip 0 being a tile
+			std::vector<std::vector<glm::vec2>> tileBoundsMips_;
+			std::unordered_map<uint64_t, CachedTile> tiles_;
+			uint64_t useCounter_;
+		};
+	}
+}
@@ -0,0 +1,248 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "TerrainTileCache.h"
+#include "MeshCache.h"
+#include "TextureLoader.h"
+#include <fstream>
+#include <filesystem>
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+static constexpr uint64_t kBlobAlignment = 16;
+// Height fractions where the splat weights move from the first albedo to the second and from the second to the third,
+// matching the defaults of TerrainShaderParams
+static constexpr float kSplatBoundaries[2] = { 0.3f, 0.9f };
+static constexpr float kSplatBlend = 0.1f;
+// Slopes whose normal is less upright than the start lose the second and third albedos to the first, all of them by the end
+static constexpr float kSplatSteepStart = 0.7f;
+static constexpr float kSplatSteepEnd = 0.5f;
+// Root mean square distance of a sample's neighbours from its tangent plane, as a fraction of the level's spacing, that counts as
+// fully rough
+static constexpr float kRoughnessRange = 0.25f;
+
+static uint64_t alignOffset(uint64_t offset)
+{
+	return (offset + kBlobAlignment - 1) & ~(kBlobAlignment - 1);
+}
+
+TerrainTileCache::TerrainTileCache()
+	: header_(nullptr)
+{
+}
+
+bool TerrainTileCache::open(const std::string& cacheFile, const std::string& sourceFile, uint32_t tileSize, float heightScale)
+{
+	close();
+	if (!file_.open(cacheFile)) {
+		return false;
+	}
+	header_ = static_cast<const TerrainTileCacheHeader*>(file_.getData());
+	if (!validate(sourceFile, tileSize, heightScale)) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void TerrainTileCache::close()
+{
+	file_.close();
+	header_ = nullptr;
+}
+
+const char* TerrainTileCache::getTileData(uint32_t level, uint32_t x, uint32_t z) const
+{
+	EXPECTS(level < header_->levelCount && x < getTilesPerSide(level) && z < getTilesPerSide(level));
+	uint64_t tileIdx = 0;
+	for (uint32_t i = 0; i < level; ++i) {
+		tileIdx += uint64_t(getTilesPerSide(i)) * getTilesPerSide(i);
+	}
+	tileIdx += uint64_t(z) * getTilesPerSide(level) + x;
+	return static_cast<const char*>(file_.getData()) + header_->dataOffset + tileIdx * header_->tileBytes;
+}
+
+glm::vec2 TerrainTileCache::getTileBounds(uint32_t x, uint32_t z) const
+{
+	EXPECTS(x < getTilesPerSide(0) && z < getTilesPerSide(0));
+	const float* bounds = reinterpret_cast<const float*>(static_cast<const char*>(file_.getData()) + header_->boundsOffset);
+	const size_t idx = (size_t(z) * getTilesPerSide(0) + x) * 2;
+	return glm::vec2(bounds[idx], bounds[idx + 1]);
+}
+
+TerrainTileLayout TerrainTileCache::getTileLayout(uint32_t tileSize)
+{
+	TerrainTileLayout layout;
+	layout.samplesPerSide = tileSize + 1;
+	const uint64_t sampleCount = uint64_t(layout.samplesPerSide) * layout.samplesPerSide;
+	layout.heightOffset = 0;
+	layout.normalOffset = alignOffset(layout.heightOffset + sampleCount * sizeof(uint16_t));
+	layout.splatOffset = alignOffset(layout.normalOffset + sampleCount * sizeof(int8_t) * 2);
+	layout.size = alignOffset(layout.splatOffset + sampleCount * sizeof(uint8_t) * 4);
+	return layout;
+}
+
+bool TerrainTileCache::validate(const std::string& sourceFile, uint32_t tileSize, float heightScale)
+{
+	const uint64_t fileSize = file_.getSize();
+	if (fileSize < sizeof(TerrainTileCacheHeader) || header_->magic != kMagic || header_->version != kVersion || header_->levelCount == 0 ||
+		header_->tileSize != tileSize || header_->heightScale != heightScale || header_->tileBytes != getTileLayout(tileSize).size) {
+		return false;
+	}
+	uint64_t tileCount = 0;
+	for (uint32_t level = 0; level < header_->levelCount; ++level) {
+		tileCount += uint64_t(getTilesPerSide(level)) * getTilesPerSide(level);
+	}
+	const uint64_t boundsSize = uint64_t(getTilesPerSide(0)) * getTilesPerSide(0) * sizeof(float) * 2;
+	if (header_->boundsOffset + boundsSize > header_->dataOffset || header_->dataOffset + tileCount * header_->tileBytes > fileSize) {
+		return false;
+	}
+
+	MeshCache::SourceStamp stamp;
+	if (!MeshCache::getSourceStamp(sourceFile, stamp)) {
+		return true;
+	}
+	if (stamp.size == header_->sourceSize && stamp.timestamp == header_->sourceTimestamp) {
+		return true;
+	}
+	// Timestamps change on checkout or copy without the content changing
+	return stamp.size == header_->sourceSize && MeshCache::hashFile(sourceFile) == header_->sourceHash;
+}
+
+bool TerrainTileCache::cook(const std::string& cacheFile, const std::string& sourceName, uint32_t tileSize, float heightScale)
+{
+	EXPECTS(tileSize > 0 && (tileSize & (tileSize - 1)) == 0);
+	int width = 0, height = 0;
+	uint16_t* source = TextureLoader::getCPUImage16(sourceName, width, height);
+	if (source == nullptr) {
+		DEBUG_ERR("Could not load terrain source " << sourceName);
+		return false;
+	}
+	if (width != height || uint32_t(width) < tileSize || (width & (width - 1)) != 0) {
+		DEBUG_ERR("Terrain source " << sourceName << " must be square with a power of two size no smaller than a tile");
+		TextureLoader::freeCPUImage(source);
+		return false;
+	}
+	const std::string sourceFile = TextureLoader::getFilePath(sourceName);
+	TerrainTileCacheHeader header = {};
+	header.magic = kMagic;
+	header.version = kVersion;
+	MeshCache::SourceStamp stamp = {};
+	MeshCache::getSourceStamp(sourceFile, stamp);
+	header.sourceSize = stamp.size;
+	header.sourceTimestamp = stamp.timestamp;
+	header.sourceHash = MeshCache::hashFile(sourceFile);
+	header.tileSize = tileSize;
+	header.levelCount = 1;
+	while ((tileSize << (header.levelCount - 1)) < uint32_t(width)) {
+		++header.levelCount;
+	}
+	header.heightScale = heightScale;
+	const TerrainTileLayout layout = getTileLayout(tileSize);
+	header.tileBytes = layout.size;
+	const uint32_t baseTilesPerSide = 1u << (header.levelCount - 1);
+	std::vector<float> bounds(size_t(baseTilesPerSide) * baseTilesPerSide * 2);
+	header.boundsOffset = alignOffset(sizeof(TerrainTileCacheHeader));
+	header.dataOffset = alignOffset(header.boundsOffset + bounds.size() * sizeof(float));
+
+	// Samples past the far edge of the source repeat its last row and column
+	const int last = width - 1;
+	auto sourceHeight = [source, width, last, heightScale](int x, int z) {
+		return float(source[size_t(glm::clamp(z, 0, last)) * width + glm::clamp(x, 0, last)]) / float(std::numeric_limits<uint16_t>::max()) * heightScale;
+	};
+
+	// Write to a temporary file first so a partially written cache is never picked up
+	const std::string tempFile = cacheFile + ".tmp";
+	bool written = true;
+	{
+		std::ofstream file(tempFile, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			DEBUG_ERR("Could not write terrain cache " << cacheFile);
+			TextureLoader::freeCPUImage(source);
+			return false;
+		}
+		// The bounds are only known once level 0 is written, so the space before the tiles is filled in last
+		std::vector<char> headerData(header.dataOffset, 0);
+		memcpy(headerData.data(), &header, sizeof(header));
+		file.write(headerData.data(), headerData.size());
+
+		std::vector<char> tile(layout.size);
+		for (uint32_t level = 0; level < header.levelCount; ++level) {
+			const int spacing = 1 << level;
+			const uint32_t tilesPerSide = 1u << (header.levelCount - 1 - level);
+			for (uint32_t tz = 0; tz < tilesPerSide && written; ++tz) {
+				for (uint32_t tx = 0; tx < tilesPerSide; ++tx) {
+					std::fill(tile.begin(), tile.end(), char(0));
+					uint16_t* heights = reinterpret_cast<uint16_t*>(tile.data() + layout.heightOffset);
+					int8_t* normals = reinterpret_cast<int8_t*>(tile.data() + layout.normalOffset);
+					uint8_t* splats = reinterpret_cast<uint8_t*>(tile.data() + layout.splatOffset);
+					for (uint32_t z = 0; z < layout.samplesPerSide; ++z) {
+						for (uint32_t x = 0; x < layout.samplesPerSide; ++x) {
+							const size_t idx = size_t(z) * layout.samplesPerSide + x;
+							const int sx = int(tx * tileSize + x) * spacing;
+							const int sz = int(tz * tileSize + z) * spacing;
+							heights[idx] = source[size_t(glm::clamp(sz, 0, last)) * width + glm::clamp(sx, 0, last)];
+							if (level == 0) {
+								float* tileBounds = &bounds[(size_t(tz) * tilesPerSide + tx) * 2];
+								const float sampleHeight = sourceHeight(sx, sz);
+								tileBounds[0] = idx == 0 ? sampleHeight : std::min(tileBounds[0], sampleHeight);
+								tileBounds[1] = idx == 0 ? sampleHeight : std::max(tileBounds[1], sampleHeight);
+							}
+
+							// Central differences at the level's own spacing, as finer detail is not drawn at this level
+							const float hl = sourceHeight(sx - spacing, sz);
+							const float hr = sourceHeight(sx + spacing, sz);
+							const float hd = sourceHeight(sx, sz - spacing);
+							const float hu = sourceHeight(sx, sz + spacing);
+							const glm::vec3 normal = glm::normalize(glm::vec3(hl - hr, 2.0f * float(spacing), hd - hu));
+							normals[idx * 2] = static_cast<int8_t>(std::round(normal.x * 127.0f));
+							normals[idx * 2 + 1] = static_cast<int8_t>(std::round(normal.z * 127.0f));
+
+							const float heightFactor = sourceHeight(sx, sz) / heightScale;
+							const float lower = glm::clamp((heightFactor - (kSplatBoundaries[0] - kSplatBlend)) / (kSplatBlend * 2.0f), 0.0f, 1.0f);
+							const float upper = glm::clamp((heightFactor - (kSplatBoundaries[1] - kSplatBlend)) / (kSplatBlend * 2.0f), 0.0f, 1.0f);
+							const float steep = 1.0f - glm::smoothstep(kSplatSteepEnd, kSplatSteepStart, normal.y);
+							glm::vec3 weights(1.0f - lower, lower * (1.0f - upper), upper);
+							weights = glm::vec3(weights.x + (weights.y + weights.z) * steep, weights.y * (1.0f - steep), weights.z * (1.0f - steep));
+							for (int i = 0; i < 3; ++i) {
+								splats[idx * 4 + i] = static_cast<uint8_t>(std::round(weights[i] * 255.0f));
+							}
+
+							// Slopes alone are drawn well by few triangles, so only what the plane through the sample misses counts
+							const glm::vec2 slope((hr - hl) * 0.5f, (hu - hd) * 0.5f);
+							const float centre = sourceHeight(sx, sz);
+							float variance = 0.0f;
+							for (int dz = -1; dz <= 1; ++dz) {
+								for (int dx = -1; dx <= 1; ++dx) {
+									const float residual = sourceHeight(sx + dx * spacing, sz + dz * spacing) - (centre + slope.x * float(dx) + slope.y * float(dz));
+									variance += residual * residual;
+								}
+							}
+							const float roughness = glm::clamp(std::sqrt(variance / 9.0f) / (kRoughnessRange * float(spacing)), 0.0f, 1.0f);
+							splats[idx * 4 + 3] = static_cast<uint8_t>(std::round(roughness * 255.0f));
+						}
+					}
+					file.write(tile.data(), tile.size());
+					written = file.good();
+				}
+			}
+		}
+		file.seekp(header.boundsOffset);
+		file.write(reinterpret_cast<const char*>(bounds.data()), bounds.size() * sizeof(float));
+		written = written && file.good();
+	}
+	TextureLoader::freeCPUImage(source);
+	std::error_code error;
+	if (!written) {
+		DEBUG_ERR("Could not write terrain cache " << cacheFile);
+		std::filesystem::remove(tempFile, error);
+		return false;
+	}
+	std::filesystem::rename(tempFile, cacheFile, error);
+	if (error) {
+		DEBUG_ERR("Could not replace terrain cache " << cacheFile << ": " << error.message());
+		std::filesystem::remove(tempFile, error);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,80 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Binary tiled terrain format cooked from a source heightmap, mapped in to memory so tiles are paged in only when streamed.
+#pragma once
+#include "MappedFile.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		/*
+			The terrain is a pyramid of levels, level 0 at the source resolution and each level above it a quarter of the tiles with samples
+			twice as far apart, up to a single tile covering everything. Heights are decimated rather than filtered so every sample of a level
+			is also a sample of the levels below it, which keeps the vertices shared by neighbouring lod rings at the same height.
+			Every tile holds tileSize quads, its last row and column of samples duplicating the first of the next tile so tiles meet without seams.
+		*/
+		struct TerrainTileCacheHeader {
+			uint32_t magic;
+			uint32_t version;
+			uint64_t sourceSize;
+			int64_t sourceTimestamp;
+			uint64_t sourceHash;
+			uint32_t tileSize;
+			uint32_t levelCount;
+			float heightScale;
+			uint32_t padding;
+			uint64_t tileBytes;
+			uint64_t boundsOffset; // Min and max height of every level 0 tile as float pairs, row by row
+			uint64_t dataOffset;
+		};
+
+		// Offsets of the blobs within a tile, each 16 byte aligned so they can be copied to images straight from a staging buffer
+		struct TerrainTileLayout {
+			uint32_t samplesPerSide;
+			uint64_t heightOffset; // 16 bit unorm heights
+			uint64_t normalOffset; // 8 bit snorm x and z of the normal, y is positive and rebuilt from them
+			uint64_t splatOffset; // 8 bit unorm weights of the terrain material's three albedo textures, alpha the roughness steering tessellation
+			uint64_t size;
+		};
+
+		class TerrainTileCache {
+		public:
+			static constexpr uint32_t kMagic = 0x54545A51; // "QZTT"
+			// Increment whenever the layout or the cooking output changes
+			static constexpr uint32_t kVersion = 3;
+
+			TerrainTileCache();
+
+			// Map the cache file, false if it is missing, malformed, out of date with the source or cooked with other parameters.
+			// A cache without its source is still accepted so cooked terrain can be shipped alone.
+			bool open(const std::string& cacheFile, const std::string& sourceFile, uint32_t tileSize, float heightScale);
+			void close();
+
+			const TerrainTileCacheHeader& getHeader() const {
+				return *header_;
+			}
+			uint32_t getTilesPerSide(uint32_t level) const {
+				return 1u << (header_->levelCount - 1 - level);
+			}
+			// Size of the whole terrain in level 0 samples
+			uint32_t getWorldSize() const {
+				return header_->tileSize << (header_->levelCount - 1);
+			}
+			// Pointer in to the mapping, valid until close. Reading it pages the tile in, so it is best done away from the main thread.
+			const char* getTileData(uint32_t level, uint32_t x, uint32_t z) const;
+			// Min and max height of a level 0 tile, without paging the tile in
+			glm::vec2 getTileBounds(uint32_t x, uint32_t z) const;
+
+			// Split a square power of two heightmap, given relative to the texture directory, in to tiles. Normals and splat weights
+			// are derived from the heights of each level.
+			static bool cook(const std::string& cacheFile, const std::string& sourceName, uint32_t tileSize, float heightScale);
+			static TerrainTileLayout getTileLayout(uint32_t tileSize);
+
+		private:
+			bool validate(const std::string& sourceFile, uint32_t tileSize, float heightScale);
+
+			MappedFile file_;
+			const TerrainTileCacheHeader* header_;
+		};
+	}
+}
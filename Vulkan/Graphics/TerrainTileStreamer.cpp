@@ -0,0 +1,230 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "TerrainTileStreamer.h"
+#include "TextureManager.h"
+#include "TextureLoader.h"
+#include "FrameAllocator.h"
+#include "LogicDevice.h"
+#include "Image.h"
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+// Tiles are sampled when placing the grid, when choosing tessellation levels from the splat roughness and when tessellating it
+static constexpr VkShaderStageFlags kSamplingShaderStages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT |
+	VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+static constexpr VkPipelineStageFlags kSamplingPipelineStages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT |
+	VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT;
+
+static uint32_t keyLevel(uint64_t key)
+{
+	return uint32_t(key >> 48);
+}
+
+static uint32_t keyX(uint64_t key)
+{
+	return uint32_t(key & 0xFFFFFF);
+}
+
+static uint32_t keyZ(uint64_t key)
+{
+	return uint32_t((key >> 24) & 0xFFFFFF);
+}
+
+TerrainTileStreamer::TerrainTileStreamer(const LogicDevice* logicDevice, TextureManager* textureManager, JobSystem* jobSystem,
+	const std::string& heightmapName, float heightScale, uint32_t frameCount)
+	: layout_(TerrainTileCache::getTileLayout(kTileSize)), heightScale_(heightScale), frameCount_(frameCount), jobSystem_(jobSystem), frameCounter_(0)
+{
+	const std::string cacheFile = TextureLoader::getFilePath(heightmapName) + ".qterrain";
+	const std::string sourceName = heightmapName + ".png";
+	if (!cache_.open(cacheFile, TextureLoader::getFilePath(sourceName), kTileSize, heightScale)) {
+		DEBUG_LOG("Cooking terrain tiles " << cacheFile);
+		const bool cooked = TerrainTileCache::cook(cacheFile, sourceName, kTileSize, heightScale) &&
+			cache_.open(cacheFile, TextureLoader::getFilePath(sourceName), kTileSize, heightScale);
+		ASSERT(cooked);
+	}
+	stagingAllocator_ = new FrameAllocator(logicDevice->getDeviceMemory(), layout_.size * kMaxUploadsPerFrame, frameCount, 16,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT, "TerrainTileStaging");
+
+	const std::array<VkFormat, 3> formats = { VK_FORMAT_R16_UNORM, VK_FORMAT_R8G8_SNORM, VK_FORMAT_R8G8B8A8_UNORM };
+	const std::array<std::string, 3> names = { "Height", "Normal", "Splat" };
+	slots_.resize(kPoolSize);
+	for (uint32_t i = 0; i < kPoolSize; ++i) {
+		Slot& slot = slots_[i];
+		slot.key = kNoTile;
+		slot.lastUsedFrame = 0;
+		slot.pinned = false;
+		for (size_t j = 0; j < formats.size(); ++j) {
+			slot.textures[uint32_t(j)] = textureManager->allocateTexture(heightmapName + "Tile" + std::to_string(i) + names[j], slot.images[j],
+				Image::makeCreateInfo(VK_IMAGE_TYPE_2D, 1, 1, formats[j], VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+					VK_SAMPLE_COUNT_1_BIT, layout_.samplesPerSide, layout_.samplesPerSide),
+				MemoryAllocationPattern::kStaticResource, { VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+				SamplerInfo(VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, 0.0f, kSamplingShaderStages));
+		}
+		slot.textures.w = 0;
+	}
+
+	// The top tile is read now so the first frame uploads it before any selection
+	const uint64_t topKey = makeKey(getLevelCount() - 1, 0, 0);
+	auto top = std::make_shared<LoadedTile>();
+	loadTile(topKey, *top);
+	pendingLoads_.push_back({ topKey, JobSystem::JobHandle(), top, true });
+}
+
+TerrainTileStreamer::~TerrainTileStreamer()
+{
+	// Loads read the mapping, so they must finish before the cache closes. The images belong to the texture manager.
+	for (const auto& load : pendingLoads_) {
+		load.handle.get();
+	}
+	SAFE_DELETE(stagingAllocator_);
+}
+
+void TerrainTileStreamer::beginFrame(VkCommandBuffer cmdBuffer, uint32_t frameIdx)
+{
+	++frameCounter_;
+	stagingAllocator_->beginFrame(frameIdx);
+	uint32_t uploads = 0;
+	for (auto it = pendingLoads_.begin(); it != pendingLoads_.end();) {
+		if (uploads >= kMaxUploadsPerFrame || !it->handle.isComplete()) {
+			++it;
+			continue;
+		}
+		it->handle.get();
+		// With every slot in use the load is dropped, the tile is asked for again while it is still wanted
+		Slot* slot = findFreeSlot();
+		if (slot != nullptr) {
+			if (slot->key != kNoTile) {
+				residentSlots_.erase(slot->key);
+			}
+			upload(cmdBuffer, *slot, *it->tile);
+			slot->key = it->key;
+			slot->lastUsedFrame = frameCounter_;
+			slot->pinned = it->pinned;
+			slot->textures.w = keyLevel(it->key);
+			slot->heightfield = std::move(it->tile->heightfield);
+			residentSlots_[it->key] = static_cast<uint32_t>(slot - slots_.data());
+			++uploads;
+		}
+		it = pendingLoads_.erase(it);
+	}
+}
+
+void TerrainTileStreamer::endFrame()
+{
+	if (requests_.empty()) {
+		return;
+	}
+	std::vector<std::pair<float, uint64_t>> wanted;
+	wanted.reserve(requests_.size());
+	for (const auto& request : requests_) {
+		wanted.emplace_back(request.second, request.first);
+	}
+	requests_.clear();
+	std::sort(wanted.begin(), wanted.end());
+	for (const auto& request : wanted) {
+		if (pendingLoads_.size() >= kMaxLoadsInFlight) {
+			break;
+		}
+		const uint64_t key = request.second;
+		auto tile = std::make_shared<LoadedTile>();
+		JobSystem::JobHandle handle = jobSystem_->submit([this, key, tile]() {
+			loadTile(key, *tile);
+		});
+		pendingLoads_.push_back({ key, handle, tile, false });
+	}
+}
+
+glm::uvec4 TerrainTileStreamer::acquireTile(uint32_t level, int x, int z, float priority)
+{
+	const uint64_t key = findTileKey(level, x, z);
+	if (residentSlots_.count(key) == 0) {
+		const bool loading = std::any_of(pendingLoads_.begin(), pendingLoads_.end(), [key](const PendingLoad& load) {
+			return load.key == key;
+		});
+		if (!loading) {
+			auto request = requests_.emplace(key, priority).first;
+			request->second = std::min(request->second, priority);
+		}
+	}
+	Slot& slot = slots_[findResidentSlot(level, x, z)];
+	slot.lastUsedFrame = frameCounter_;
+	return slot.textures;
+}
+
+glm::vec2 TerrainTileStreamer::getAreaMinMax(uint32_t level, int x, int z, uint32_t size) const
+{
+	const Slot& slot = slots_[findResidentSlot(level, x, z)];
+	const uint32_t tileLevel = keyLevel(slot.key);
+	const int span = static_cast<int>(kTileSize << tileLevel);
+	// Into the tile's own samples, rounding outwards so the area is covered
+	const int localX = x - static_cast<int>(keyX(slot.key)) * span;
+	const int localZ = z - static_cast<int>(keyZ(slot.key)) * span;
+	const int round = (1 << tileLevel) - 1;
+	return slot.heightfield->getAreaMinMax(localX >> tileLevel, localZ >> tileLevel, (localX + int(size) + round) >> tileLevel,
+		(localZ + int(size) + round) >> tileLevel);
+}
+
+uint64_t TerrainTileStreamer::findTileKey(uint32_t level, int x, int z) const
+{
+	level = std::min(level, getLevelCount() - 1);
+	const int span = static_cast<int>(kTileSize << level);
+	// The far edge of the terrain belongs to the last tile
+	const int last = static_cast<int>(cache_.getTilesPerSide(level)) - 1;
+	return makeKey(level, uint32_t(glm::clamp(x / span, 0, last)), uint32_t(glm::clamp(z / span, 0, last)));
+}
+
+uint32_t TerrainTileStreamer::findResidentSlot(uint32_t level, int x, int z) const
+{
+	for (uint32_t l = std::min(level, getLevelCount() - 1); l < getLevelCount(); ++l) {
+		const auto it = residentSlots_.find(findTileKey(l, x, z));
+		if (it != residentSlots_.end()) {
+			return it->second;
+		}
+	}
+	// The top tile is resident from the first frame on
+	ASSERT(false);
+	return 0;
+}
+
+void TerrainTileStreamer::loadTile(uint64_t key, LoadedTile& tile) const
+{
+	const char* data = cache_.getTileData(keyLevel(key), keyX(key), keyZ(key));
+	tile.data.assign(data, data + layout_.size);
+	tile.heightfield = std::make_unique<Heightfield>(reinterpret_cast<const uint16_t*>(tile.data.data() + layout_.heightOffset), kTileSize, heightScale_);
+}
+
+void TerrainTileStreamer::upload(VkCommandBuffer cmdBuffer, Slot& slot, const LoadedTile& tile)
+{
+	const FrameAllocation staging = stagingAllocator_->upload(tile.data.data(), tile.data.size());
+	const std::array<uint64_t, 3> offsets = { layout_.heightOffset, layout_.normalOffset, layout_.splatOffset };
+	for (size_t i = 0; i < slot.images.size(); ++i) {
+		Image* image = slot.images[i];
+		// The frames that sampled the slot's previous tile have finished, only the layout needs to change
+		image->changeLayout(cmdBuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, kSamplingPipelineStages, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		VkBufferImageCopy copy = {};
+		copy.bufferOffset = staging.offset + offsets[i];
+		copy.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		copy.imageExtent = { layout_.samplesPerSide, layout_.samplesPerSide, 1 };
+		vkCmdCopyBufferToImage(cmdBuffer, staging.buffer, image->getImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+		image->changeLayout(cmdBuffer, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, kSamplingPipelineStages);
+	}
+}
+
+TerrainTileStreamer::Slot* TerrainTileStreamer::findFreeSlot()
+{
+	Slot* oldest = nullptr;
+	for (auto& slot : slots_) {
+		if (slot.key == kNoTile) {
+			return &slot;
+		}
+		// A slot used within the last frameCount frames may still be sampled by a frame in flight
+		if (slot.pinned || frameCounter_ - slot.lastUsedFrame < frameCount_) {
+			continue;
+		}
+		if (oldest == nullptr || slot.lastUsedFrame < oldest->lastUsedFrame) {
+			oldest = &slot;
+		}
+	}
+	return oldest;
+}
@@ -0,0 +1,109 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Purpose: Keep the terrain tiles near the viewer resident on the gpu, loading them from the tile cache in the background.
+#pragma once
+#include "VkUtil.h"
+#include "TerrainTileCache.h"
+#include "Heightfield.h"
+#include "../JobSystem.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		class LogicDevice;
+		class TextureManager;
+		class FrameAllocator;
+		class Image;
+
+		/*
+			Tiles live in a fixed pool of slots, each with its own height, normal and splat textures in the bindless array so nodes name
+			the tiles they sample rather than one texture holding the whole terrain. Selection asks for the tile each node wants, and if it
+			is not resident yet is given the nearest resident ancestor, whose samples cover the same area at a lower resolution. The single
+			top tile is loaded up front and never evicted, so there is always something to draw. Missing tiles are read from the mapped
+			cache on workers, nearest first, and copied in to the least recently used slot that no frame in flight still samples.
+		*/
+		class TerrainTileStreamer {
+		public:
+			// The cache is cooked from the heightmap, given relative to the texture directory without its extension, if it is missing
+			// or out of date
+			TerrainTileStreamer(const LogicDevice* logicDevice, TextureManager* textureManager, JobSystem* jobSystem, const std::string& heightmapName,
+				float heightScale, uint32_t frameCount);
+			~TerrainTileStreamer();
+
+			const TerrainTileCache& getCache() const {
+				return cache_;
+			}
+			uint32_t getWorldSize() const {
+				return cache_.getWorldSize();
+			}
+			uint32_t getLevelCount() const {
+				return cache_.getHeader().levelCount;
+			}
+
+			// Record the uploads of the tiles whose loads have finished, before anything samples the pool this frame
+			void beginFrame(VkCommandBuffer cmdBuffer, uint32_t frameIdx);
+			// Start loading the most wanted of the tiles found missing this frame
+			void endFrame();
+
+			// Texture indices of the height, normal and splat maps and the level of the tile holding the level 0 sample x, z at the level,
+			// or of its nearest resident ancestor. Marks the tile used this frame, and if the wanted one is missing it is requested, the
+			// lowest priority first.
+			glm::uvec4 acquireTile(uint32_t level, int x, int z, float priority);
+			// Min and max height of the level 0 samples [x, x + size] as drawn from the tile acquireTile gives for x, z
+			glm::vec2 getAreaMinMax(uint32_t level, int x, int z, uint32_t size) const;
+
+			// Must match TERRAIN_TILE_SIZE in terrain_heightmap.glsl
+			static constexpr uint32_t kTileSize = 256;
+			static constexpr uint32_t kPoolSize = 64;
+			static constexpr uint32_t kMaxLoadsInFlight = 8;
+			// Bounds the staging memory and the copies recorded in one frame
+			static constexpr uint32_t kMaxUploadsPerFrame = 4;
+		private:
+			struct LoadedTile {
+				std::vector<char> data;
+				std::unique_ptr<Heightfield> heightfield;
+			};
+			struct PendingLoad {
+				uint64_t key;
+				JobSystem::JobHandle handle;
+				std::shared_ptr<LoadedTile> tile;
+				bool pinned;
+			};
+			struct Slot {
+				uint64_t key;
+				uint64_t lastUsedFrame;
+				bool pinned;
+				std::array<Image*, 3> images;
+				glm::uvec4 textures;
+				std::unique_ptr<Heightfield> heightfield;
+			};
+
+			static uint64_t makeKey(uint32_t level, uint32_t x, uint32_t z) {
+				return (uint64_t(level) << 48) | (uint64_t(z) << 24) | uint64_t(x);
+			}
+			uint64_t findTileKey(uint32_t level, int x, int z) const;
+			// The slot of the tile holding x, z at the level or of its nearest resident ancestor
+			uint32_t findResidentSlot(uint32_t level, int x, int z) const;
+			// Read a tile out of the mapped cache, safe to call from a worker
+			void loadTile(uint64_t key, LoadedTile& tile) const;
+			void upload(VkCommandBuffer cmdBuffer, Slot& slot, const LoadedTile& tile);
+			// An empty slot, or the least recently used unpinned one no frame in flight can still be sampling, nullptr if there is none
+			Slot* findFreeSlot();
+
+			const TerrainTileLayout layout_;
+			const float heightScale_;
+			const uint32_t frameCount_;
+			TerrainTileCache cache_;
+			JobSystem* jobSystem_;
+			FrameAllocator* stagingAllocator_;
+			std::vector<Slot> slots_;
+			std::unordered_map<uint64_t, uint32_t> residentSlots_;
+			std::vector<PendingLoad> pendingLoads_;
+			// Tiles wanted but missing this frame and the lowest priority they were asked for with
+			std::unordered_map<uint64_t, float> requests_;
+			uint64_t frameCounter_;
+
+			static constexpr uint64_t kNoTile = std::numeric_limits<uint64_t>::max();
+		};
+	}
+}
@@ -7,6 +7,7 @@
 #include "../../Shared/nv_dds.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "../../Shared/stb_image.h"
+#include <fstream>
 
 using namespace QZL;
 using namespace QZL::Graphics;
@@ -29,18 +30,155 @@ unsigned char* TextureLoader::getCPUImage(std::string name, int width, int heigh
 	return image;
 }
 
-void TextureLoader::freeCPUImage(unsigned char* image) 
+uint16_t* TextureLoader::getCPUImage16(const std::string& name, int& width, int& height)
+{
+	int channels = 0;
+	return stbi_load_16((kPath + name).c_str(), &width, &height, &channels, 1);
+}
+
+void TextureLoader::freeCPUImage(void* image) 
 {
 	stbi_image_free(image);
 }
 
-// Adapted from https://vulkan-tutorial.com/Texture_mapping/Images
+bool TextureLoader::isImageFile(const std::string& name)
+{
+	return name.find('.', name.find_last_of('/') + 1) != std::string::npos;
+}
+
+unsigned char* TextureLoader::readImageFile(const std::string& name, int& width, int& height)
+{
+	DEBUG_LOG("Loading image file " << name);
+	int channels = 0;
+	unsigned char* image = stbi_load((kPath + name).c_str(), &width, &height, &channels, STBI_rgb_alpha);
+	ASSERT(image != nullptr);
+	return image;
+}
+
+MipFilter TextureLoader::getImageFileMipFilter(const std::string& name)
+{
+	const std::string stem = name.substr(0, name.find_last_of('.'));
+	for (const char* suffix : { "_n", "_nm", "_normal" }) {
+		const size_t length = strlen(suffix);
+		if (stem.size() > length && stem.compare(stem.size() - length, length, suffix) == 0) {
+			return MipFilter::kNormalMap;
+		}
+	}
+	return MipFilter::kSrgb;
+}
+
 Image* TextureLoader::loadTexture(const std::string& fileName, VkShaderStageFlags stages)
 {
-	DEBUG_LOG("Loading texture " << fileName);
 	nv_dds::CDDSImage image;
+	readTexture(fileName, image);
+	return uploadTexture(image, stages);
+}
+
+void TextureLoader::readTexture(const std::string& fileName, nv_dds::CDDSImage& image)
+{
+	DEBUG_LOG("Loading texture " << fileName);
 	image.load(kPath + fileName + kExt, false);
 	ASSERT(image.is_valid());
+}
+
+static constexpr uint32_t makeFourCC(char a, char b, char c, char d)
+{
+	return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8) | (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+}
+
+bool TextureLoader::readMipChain(const std::string& fileName, DdsMipChain& chain)
+{
+	// The magic number then the header, see https://docs.microsoft.com/en-us/windows/win32/direct3ddds/dds-header
+	enum HeaderField { kMagic = 0, kFlags = 2, kHeight = 3, kWidth = 4, kMipCount = 7, kPixelFlags = 20, kFourCC = 21, kCaps2 = 28, kHeaderSize = 32 };
+	constexpr uint32_t kMipCountFlag = 0x20000;
+	constexpr uint32_t kFourCCFlag = 0x4;
+	// Cubemap and volume
+	constexpr uint32_t kUnsupportedCaps2 = 0x200 | 0x200000;
+	// The extended header's dxgi format, resource dimension and array size
+	enum Dx10Field { kDxgiFormat = 0, kDimension = 1, kArraySize = 3, kDx10Size = 5 };
+	constexpr uint32_t kTexture2D = 3;
+
+	std::ifstream file(kPath + fileName + kExt, std::ios::binary);
+	uint32_t header[kHeaderSize];
+	if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) || header[kMagic] != makeFourCC('D', 'D', 'S', ' ') ||
+		!(header[kPixelFlags] & kFourCCFlag) || (header[kCaps2] & kUnsupportedCaps2)) {
+		return false;
+	}
+	uint64_t offset = sizeof(header);
+	uint32_t blockSize = 16;
+	switch (header[kFourCC]) {
+	case makeFourCC('D', 'X', 'T', '1'):
+		chain.format = VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+		blockSize = 8;
+		break;
+	case makeFourCC('D', 'X', 'T', '3'):
+		chain.format = VK_FORMAT_BC2_UNORM_BLOCK;
+		break;
+	case makeFourCC('D', 'X', 'T', '5'):
+		chain.format = VK_FORMAT_BC3_UNORM_BLOCK;
+		break;
+	case makeFourCC('D', 'X', '1', '0'): {
+		uint32_t dx10[kDx10Size];
+		if (!file.read(reinterpret_cast<char*>(dx10), sizeof(dx10)) || dx10[kDimension] != kTexture2D || dx10[kArraySize] != 1) {
+			return false;
+		}
+		offset += sizeof(dx10);
+		switch (dx10[kDxgiFormat]) {
+		case 71:
+			chain.format = VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+			blockSize = 8;
+			break;
+		case 74:
+			chain.format = VK_FORMAT_BC2_UNORM_BLOCK;
+			break;
+		case 77:
+			chain.format = VK_FORMAT_BC3_UNORM_BLOCK;
+			break;
+		case 80:
+			chain.format = VK_FORMAT_BC4_UNORM_BLOCK;
+			blockSize = 8;
+			break;
+		case 83:
+			chain.format = VK_FORMAT_BC5_UNORM_BLOCK;
+			break;
+		case 98:
+			chain.format = VK_FORMAT_BC7_UNORM_BLOCK;
+			break;
+		default:
+			return false;
+		}
+		break;
+	}
+	default:
+		return false;
+	}
+
+	chain.width = header[kWidth];
+	chain.height = header[kHeight];
+	const uint32_t mipCount = (header[kFlags] & kMipCountFlag) && header[kMipCount] > 0 ? header[kMipCount] : 1;
+	chain.mipOffsets.resize(mipCount + 1);
+	for (uint32_t i = 0; i < mipCount; ++i) {
+		chain.mipOffsets[i] = offset;
+		const VkExtent2D extent = chain.getMipExtent(i);
+		offset += uint64_t((extent.width + 3) / 4) * ((extent.height + 3) / 4) * blockSize;
+	}
+	chain.mipOffsets[mipCount] = offset;
+	return true;
+}
+
+void TextureLoader::readMips(const std::string& fileName, const DdsMipChain& chain, uint32_t firstMip, uint32_t lastMip, std::vector<char>& data)
+{
+	EXPECTS(firstMip < lastMip && lastMip <= chain.getMipCount());
+	std::ifstream file(kPath + fileName + kExt, std::ios::binary);
+	file.seekg(chain.mipOffsets[firstMip]);
+	data.resize(chain.getSize(firstMip, lastMip));
+	file.read(data.data(), data.size());
+	ASSERT(file);
+}
+
+// Adapted from https://vulkan-tutorial.com/Texture_mapping/Images
+Image* TextureLoader::uploadTexture(nv_dds::CDDSImage& image, VkShaderStageFlags stages)
+{
 	Image* texture = nullptr;
 	VkFormat format = convertToVkFormat(image.get_format());
 
@@ -100,20 +238,28 @@ Image* TextureLoader::loadTexture(const std::string& fileName, VkShaderStageFlag
 	return texture;
 }
 
-Image* TextureLoader::loadTextureGenerated(const std::string& fileName, VkShaderStageFlags stages, void* data, uint32_t width, uint32_t height, VkFormat format)
+Image* TextureLoader::loadTextureGenerated(const std::string& fileName, VkShaderStageFlags stages, void* data, uint32_t width, uint32_t height, VkFormat format,
+	MipFilter mipFilter)
 {
 	Image* texture = nullptr;
 
-	texture = new Image(logicDevice_, Image::makeCreateInfo(VK_IMAGE_TYPE_2D, 1, 1, format, VK_IMAGE_TILING_OPTIMAL,
-		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT, width, height),
-		MemoryAllocationPattern::kStaticResource, { VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL });
+	const bool mipmapped = Image::calculateMipLevels(width, height) > 1 && MipGenerator::canGenerate(logicDevice_, format, mipFilter);
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	if (mipmapped) {
+		usage |= MipGenerator::getRequiredUsage(format, mipFilter);
+	}
+	texture = new Image(logicDevice_, Image::makeCreateInfo(VK_IMAGE_TYPE_2D, mipmapped ? Image::calculateMipLevels(width, height) : 1, 1, format, VK_IMAGE_TILING_OPTIMAL,
+		usage, VK_SAMPLE_COUNT_1_BIT, width, height), MemoryAllocationPattern::kStaticResource, { VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL },
+		fileName);
 	MemoryAllocationDetails stagingBuffer = deviceMemory_->createBuffer("", MemoryAllocationPattern::kStaging, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, (VkDeviceSize)width * height * formatToSize(format));
 	void* stagingData = deviceMemory_->mapMemory(stagingBuffer.id);
 	memcpy(stagingData, data, (size_t)width * height * formatToSize(format));
 	deviceMemory_->unmapMemory(stagingBuffer.id);
 	deviceMemory_->transferMemory(stagingBuffer.buffer, texture->getImage(), 0, width, height, stages);
 	deviceMemory_->deleteAllocation(stagingBuffer.id, stagingBuffer.buffer);
-	texture->changeLayout(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0, stages);
+	if (!mipmapped) {
+		texture->changeLayout(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 0, stages);
+	}
 	return texture;
 }
 
@@ -183,6 +329,9 @@ VkDeviceSize TextureLoader::formatToSize(VkFormat format)
 	switch (format) {
 	case VK_FORMAT_R16G16B16A16_SFLOAT:
 		return sizeof(uint16_t) * 4;
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+		return sizeof(uint8_t) * 4;
 	default:
 		ASSERT(false);
 	}
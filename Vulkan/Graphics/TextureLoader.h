@@ -2,6 +2,11 @@
 // Date: 01/11/19
 #pragma once
 #include "VkUtil.h"
+#include "MipGenerator.h"
+
+namespace nv_dds {
+	class CDDSImage;
+}
 
 namespace QZL
 {
@@ -10,15 +15,56 @@ namespace QZL
 		class LogicDevice;
 		class DeviceMemory;
 
+		// Where each mip of a block compressed dds file lies, so any run of mips can be read without the rest of the file
+		struct DdsMipChain {
+			VkFormat format = VK_FORMAT_UNDEFINED;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			// File offset of every mip, most detailed first, followed by the end of the last
+			std::vector<uint64_t> mipOffsets;
+
+			uint32_t getMipCount() const {
+				return mipOffsets.empty() ? 0 : static_cast<uint32_t>(mipOffsets.size() - 1);
+			}
+			// Bytes of the mips [firstMip, lastMip)
+			uint64_t getSize(uint32_t firstMip, uint32_t lastMip) const {
+				return mipOffsets[lastMip] - mipOffsets[firstMip];
+			}
+			VkExtent2D getMipExtent(uint32_t mip) const {
+				return { std::max(width >> mip, 1u), std::max(height >> mip, 1u) };
+			}
+		};
+
 		class TextureLoader {
 		public:
 			TextureLoader(const LogicDevice* logicDevice);
 			~TextureLoader();
 			Image* loadTexture(const std::string& fileName, VkShaderStageFlags stages);
-			Image* loadTextureGenerated(const std::string& fileName, VkShaderStageFlags stages, void* data, uint32_t width, uint32_t height, VkFormat format);
+			// Loading is split so the file can be read and decoded on any thread, only the upload must happen on the main thread
+			static void readTexture(const std::string& fileName, nv_dds::CDDSImage& image);
+			Image* uploadTexture(nv_dds::CDDSImage& image, VkShaderStageFlags stages);
+			// Reads only the header, false if the file is not a single 2D block compressed image
+			static bool readMipChain(const std::string& fileName, DdsMipChain& chain);
+			// The mips [firstMip, lastMip), which lie one after another in the file
+			static void readMips(const std::string& fileName, const DdsMipChain& chain, uint32_t firstMip, uint32_t lastMip, std::vector<char>& data);
+			// With a mip filter the format supports, only the first mip is written and the image is left in the transfer dst layout for
+			// the mip generator
+			Image* loadTextureGenerated(const std::string& fileName, VkShaderStageFlags stages, void* data, uint32_t width, uint32_t height, VkFormat format,
+				MipFilter mipFilter = MipFilter::kNone);
 			Image* loadCubeTexture(const std::array<std::string, 6U> fileName, VkShaderStageFlags stages);
 			static unsigned char* getCPUImage(std::string name, int width, int height, int channels, int format);
-			static void freeCPUImage(unsigned char* image);
+			// Single channel 16 bit, 8 bit sources are widened. Free with freeCPUImage.
+			static uint16_t* getCPUImage16(const std::string& name, int& width, int& height);
+			static void freeCPUImage(void* image);
+			// Names with an extension are image files decoded by stb_image, any other name is a dds file given without its extension
+			static bool isImageFile(const std::string& name);
+			// Decoded to rgba8, free with freeCPUImage
+			static unsigned char* readImageFile(const std::string& name, int& width, int& height);
+			// Image files named as normal maps, ending _n, _nm or _normal, are filtered as such and the rest as srgb colour
+			static MipFilter getImageFileMipFilter(const std::string& name);
+			static std::string getFilePath(const std::string& name) {
+				return kPath + name;
+			}
 		private:
 			VkFormat convertToVkFormat(unsigned int oldFormat);
 			VkDeviceSize formatToSize(VkFormat format);
@@ -3,17 +3,32 @@
 #include "TextureManager.h"
 #include "Descriptor.h"
 #include "TextureLoader.h"
+#include "TextureStreamer.h"
 #include "TextureSampler.h"
 #include "Image.h"
 #include "GlobalRenderData.h"
+#include "../../Shared/nv_dds.h"
 
 using namespace QZL;
 using namespace Graphics;
 
-TextureManager::TextureManager(const LogicDevice* logicDevice, Descriptor* descriptor, uint32_t maxTextures, bool descriptorIndexing)
+// An image file decoded on a worker
+struct DecodedImageFile {
+	unsigned char* pixels = nullptr;
+	int width = 0;
+	int height = 0;
+};
+
+TextureManager::TextureManager(const LogicDevice* logicDevice, Descriptor* descriptor, uint32_t maxTextures, bool descriptorIndexing, 
+	JobSystem* jobSystem, uint32_t frameCount)
 	: logicDevice_(logicDevice), descriptorIndexingActive_(descriptorIndexing), maxTextures_(maxTextures), textureLoader_(new TextureLoader(logicDevice)),
-	descriptorSetIdx_(0), descriptor_(descriptor)
+	fallbackSampler_(nullptr), textureStreamer_(nullptr), mipGenerator_(new MipGenerator(logicDevice, frameCount)), jobSystem_(jobSystem), descriptor_(descriptor),
+	pendingDescriptorWrites_(frameCount)
 {
+	if (jobSystem != nullptr) {
+		textureStreamer_ = new TextureStreamer(logicDevice, this, jobSystem, frameCount);
+	}
+
 	setLayoutBinding_ = {};
 	setLayoutBinding_.binding = 4;
 	setLayoutBinding_.descriptorCount = maxTextures;
@@ -31,6 +46,9 @@ TextureManager::TextureManager(const LogicDevice* logicDevice, Descriptor* descr
 
 TextureManager::~TextureManager()
 {
+	SAFE_DELETE(textureStreamer_);
+	SAFE_DELETE(mipGenerator_);
+	SAFE_DELETE(fallbackSampler_);
 	SAFE_DELETE(textureLoader_);
 	for (auto it : materials_) {
 		SAFE_DELETE(it.second);
@@ -43,19 +61,25 @@ TextureManager::~TextureManager()
 	}
 }
 
-uint32_t TextureManager::allocateGeneratedTexture(std::string name, void* data, uint32_t width, uint32_t height, VkFormat format, MemoryAllocationPattern allocationPattern, ImageParameters parameters, SamplerInfo samplerInfo)
+uint32_t TextureManager::allocateGeneratedTexture(std::string name, void* data, uint32_t width, uint32_t height, VkFormat format, MemoryAllocationPattern allocationPattern, ImageParameters parameters, SamplerInfo samplerInfo,
+	MipFilter mipFilter)
 {
-	auto image = textureLoader_->loadTextureGenerated(name, samplerInfo.stages, data, width, height, format);
+	auto image = textureLoader_->loadTextureGenerated(name, samplerInfo.stages, data, width, height, format, mipFilter);
 	textures_[name] = image;
-	auto sampler = image->createTextureSampler(name, samplerInfo.magFilter, samplerInfo.minFilter, samplerInfo.addressMode, samplerInfo.anisotropy);
-	textureSamplersDI_[name].first = sampler;
 
 	uint32_t arrayIdx = freeDescriptors_.front();
 	freeDescriptors_.pop();
+	textureSamplersDI_[name] = std::make_pair(nullptr, arrayIdx);
 
-	descriptor_->updateDescriptorSets({ makeDescriptorWrite(sampler->getImageInfo(), arrayIdx, 1) });
-
-	textureSamplersDI_[name].second = arrayIdx;
+	// Samplers take the image's layout, so the descriptor waits for the mips to leave the image shader read only
+	if (image->getMipLevels() > 1) {
+		mipGenerator_->enqueue(image, mipFilter, [this, name, arrayIdx, samplerInfo]() {
+			writeTextureDescriptor(name, arrayIdx, samplerInfo);
+		});
+	}
+	else {
+		writeTextureDescriptor(name, arrayIdx, samplerInfo);
+	}
 	return arrayIdx;
 }
 
@@ -72,20 +96,98 @@ uint32_t TextureManager::requestTexture(const std::string& name, SamplerInfo sam
 		uint32_t arrayIdx = freeDescriptors_.front();
 		freeDescriptors_.pop();
 
-		descriptor_->updateDescriptorSets({ makeDescriptorWrite(sampler->getImageInfo(), arrayIdx, 1) });
+		updateTextureDescriptor(arrayIdx, sampler->getImageInfo());
 
 		textureSamplersDI_[name].second = arrayIdx;
 		return arrayIdx;
 	}
 }
 
+uint32_t TextureManager::requestTextureAsync(const std::string& name, JobSystem::JobHandle* upload, SamplerInfo samplerInfo)
+{
+	EXPECTS(jobSystem_ != nullptr);
+	if (textureSamplersDI_.count(name)) {
+		if (upload != nullptr) {
+			auto pending = pendingTextures_.find(name);
+			*upload = pending != pendingTextures_.end() ? pending->second : JobSystem::JobHandle();
+		}
+		return textureSamplersDI_[name].second;
+	}
+	// The sampler is left null until the upload so requestTexture hands out the reserved index without loading the texture again
+	uint32_t arrayIdx = freeDescriptors_.front();
+	freeDescriptors_.pop();
+	textureSamplersDI_[name] = std::make_pair(nullptr, arrayIdx);
+
+	// Image files have their mips generated, dds files that cannot be streamed are loaded whole
+	auto load = std::make_shared<StreamedTextureLoad>();
+	auto image = std::make_shared<nv_dds::CDDSImage>();
+	auto decoded = std::make_shared<DecodedImageFile>();
+	JobSystem::JobHandle read = jobSystem_->submit([name, load, image, decoded]() {
+		if (TextureLoader::isImageFile(name)) {
+			decoded->pixels = TextureLoader::readImageFile(name, decoded->width, decoded->height);
+			return;
+		}
+		TextureStreamer::readTail(name, *load);
+		if (!load->streamed) {
+			TextureLoader::readTexture(name, *image);
+		}
+	});
+	JobSystem::JobHandle uploaded = jobSystem_->submit([this, name, load, image, decoded, read, arrayIdx, samplerInfo]() {
+		try {
+			read.get();
+		}
+		catch (...) {
+			// Materials may already hold the index, so it stays reserved to the name and shows the fallback rather than being reused
+			pendingTextures_.erase(name);
+			updateTextureDescriptor(arrayIdx, getFallbackSampler()->getImageInfo());
+			throw;
+		}
+		pendingTextures_.erase(name);
+		// The descriptor write is queued when the mips are recorded and reaches the recording frame's set before the set is bound
+		if (decoded->pixels != nullptr) {
+			uploadImageFile(name, decoded->pixels, decoded->width, decoded->height, samplerInfo.stages, [this, name, arrayIdx, samplerInfo]() {
+				writeTextureDescriptor(name, arrayIdx, samplerInfo);
+			});
+			return;
+		}
+		// The streamer owns the image and sampler, so the sampler is left null
+		if (load->streamed) {
+			textureStreamer_->addTexture(name, arrayIdx, samplerInfo, *load);
+			return;
+		}
+		textures_[name] = textureLoader_->uploadTexture(*image, samplerInfo.stages);
+		image->clear();
+		writeTextureDescriptor(name, arrayIdx, samplerInfo);
+	}, { read }, JobThread::kMain);
+	pendingTextures_[name] = uploaded;
+	if (upload != nullptr) {
+		*upload = uploaded;
+	}
+	return arrayIdx;
+}
+
 TextureSampler* TextureManager::requestTextureSeparate(const std::string& name, VkFilter magFilter, VkFilter minFilter, VkSamplerAddressMode addressMode,
 	float anisotropy, VkShaderStageFlags stages)
 {
-	// Always make a new sampler, but reuse image if it exists
+	// Finish an asynchronous load of the same file rather than loading it twice
+	auto pending = pendingTextures_.find(name);
+	if (pending != pendingTextures_.end()) {
+		// Copied as the upload job removes the entry
+		JobSystem::JobHandle upload = pending->second;
+		jobSystem_->wait(upload);
+	}
+	// Always make a new sampler, but reuse image if it exists. Streamed textures' images change as they stream, so they are loaded again whole.
 	if (textures_.count(name)) {
 		return textures_[name]->createTextureSampler(name, magFilter, minFilter, addressMode, anisotropy);
 	}
+	else if (TextureLoader::isImageFile(name)) {
+		int width = 0, height = 0;
+		unsigned char* pixels = TextureLoader::readImageFile(name, width, height);
+		Image* image = uploadImageFile(name, pixels, width, height, stages);
+		// The sampler may be used before the next frame, so its mips are generated now along with any others queued
+		mipGenerator_->flush();
+		return image->createTextureSampler(name, magFilter, minFilter, addressMode, anisotropy);
+	}
 	else {
 		auto image = textureLoader_->loadTexture(name, stages);
 		textures_[name] = image;
@@ -118,7 +220,7 @@ uint32_t TextureManager::allocateTexture(const std::string& name, Image* img, Sa
 	uint32_t arrayIdx = freeDescriptors_.front();
 	freeDescriptors_.pop();
 	TextureSampler* sampler = img->createTextureSampler(name, samplerInfo.magFilter, samplerInfo.minFilter, samplerInfo.addressMode, samplerInfo.anisotropy);
-	descriptor_->updateDescriptorSets({ makeDescriptorWrite(sampler->getImageInfo(), arrayIdx, 1) });
+	updateTextureDescriptor(arrayIdx, sampler->getImageInfo());
 	textureSamplersDI_[name] = std::make_pair(sampler, arrayIdx);
 	return arrayIdx;
 }
@@ -137,7 +239,60 @@ Material* TextureManager::requestMaterial(const RendererTypes type, const std::s
 	return materials_[name];
 }
 
-VkWriteDescriptorSet TextureManager::makeDescriptorWrite(VkDescriptorImageInfo imageInfo, uint32_t idx, uint32_t count)
+Material* TextureManager::requestMaterialAsync(const RendererTypes type, const std::string name, JobSystem::JobHandle* loaded)
+{
+	EXPECTS(jobSystem_ != nullptr);
+	if (!materials_[name]) {
+		Material* mat = new Material();
+		mat->data = &materialData_[materialCount_];
+		mat->size = Materials::materialSizeLUT[(size_t)type];
+		materialCount_ += uint32_t(mat->size);
+		materials_[name] = mat;
+
+		// A material file is a handful of names, reading it here lets every texture start decoding straight away rather than 
+		// after a round trip through the main thread queue. The material only needs the textures' reserved indices.
+		std::vector<std::string> lines;
+		Materials::readMaterial(name, lines);
+		std::vector<JobSystem::JobHandle> uploads(!lines.empty() && lines.back() == "END" ? lines.size() - 1 : lines.size());
+		for (size_t i = 0; i < uploads.size(); ++i) {
+			requestTextureAsync(lines[i], &uploads[i]);
+		}
+		Materials::fillMaterial(this, type, mat->data, lines);
+		materialLoads_[name] = jobSystem_->submit([uploads]() {
+			for (const auto& upload : uploads) {
+				upload.get();
+			}
+		}, uploads, JobThread::kMain);
+	}
+	if (loaded != nullptr) {
+		*loaded = materialLoads_[name];
+	}
+	return materials_[name];
+}
+
+void TextureManager::updateTextureDescriptor(uint32_t idx, const VkDescriptorImageInfo& imageInfo)
+{
+	for (auto& pending : pendingDescriptorWrites_) {
+		pending.emplace_back(idx, imageInfo);
+	}
+}
+
+void TextureManager::writePendingDescriptors(VkDescriptorSet set, uint32_t frameIdx)
+{
+	auto& pending = pendingDescriptorWrites_[frameIdx];
+	if (pending.empty()) {
+		return;
+	}
+	std::vector<VkWriteDescriptorSet> writes;
+	writes.reserve(pending.size());
+	for (const auto& write : pending) {
+		writes.push_back(makeDescriptorWrite(set, &write.second, write.first, 1));
+	}
+	descriptor_->updateDescriptorSets(writes);
+	pending.clear();
+}
+
+VkWriteDescriptorSet TextureManager::makeDescriptorWrite(VkDescriptorSet set, const VkDescriptorImageInfo* imageInfo, uint32_t idx, uint32_t count)
 {
 	VkWriteDescriptorSet write = {};
 	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -146,11 +301,47 @@ VkWriteDescriptorSet TextureManager::makeDescriptorWrite(VkDescriptorImageInfo i
 	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	write.descriptorCount = count;
 	write.pBufferInfo = 0;
-	write.dstSet = descriptor_->getSet(descriptorSetIdx_);
-	write.pImageInfo = &imageInfo;
+	write.dstSet = set;
+	write.pImageInfo = imageInfo;
 	return write;
 }
 
+Image* TextureManager::uploadImageFile(const std::string& name, unsigned char* pixels, int width, int height, VkShaderStageFlags stages,
+	std::function<void()> onGenerated)
+{
+	const MipFilter mipFilter = TextureLoader::getImageFileMipFilter(name);
+	Image* image = textureLoader_->loadTextureGenerated(name, stages, pixels, uint32_t(width), uint32_t(height), MipGenerator::kDownsampleFormat, mipFilter);
+	TextureLoader::freeCPUImage(pixels);
+	textures_[name] = image;
+	if (image->getMipLevels() > 1) {
+		mipGenerator_->enqueue(image, mipFilter, onGenerated);
+	}
+	else if (onGenerated) {
+		onGenerated();
+	}
+	return image;
+}
+
+TextureSampler* TextureManager::getFallbackSampler()
+{
+	if (fallbackSampler_ == nullptr) {
+		// A single magenta texel, so a texture that failed to load stands out
+		const uint32_t texel = 0xFFFF00FF;
+		Image* image = textureLoader_->loadTextureGenerated(kFallbackTextureName, VK_SHADER_STAGE_ALL_GRAPHICS, (void*)&texel, 1, 1,
+			VK_FORMAT_R8G8B8A8_UNORM, MipFilter::kNone);
+		textures_[kFallbackTextureName] = image;
+		fallbackSampler_ = image->createTextureSampler(kFallbackTextureName, VK_FILTER_NEAREST, VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_REPEAT, 1.0f);
+	}
+	return fallbackSampler_;
+}
+
+void TextureManager::writeTextureDescriptor(const std::string& name, uint32_t arrayIdx, const SamplerInfo& samplerInfo)
+{
+	TextureSampler* sampler = textures_[name]->createTextureSampler(name, samplerInfo.magFilter, samplerInfo.minFilter, samplerInfo.addressMode, samplerInfo.anisotropy);
+	textureSamplersDI_[name].first = sampler;
+	updateTextureDescriptor(arrayIdx, sampler->getImageInfo());
+}
+
 Image* TextureManager::allocateImage(std::string name, VkImageCreateInfo createInfo, MemoryAllocationPattern allocationPattern, ImageParameters parameters)
 {
 	return textures_.find(name) != textures_.end() ? nullptr : new Image(logicDevice_, createInfo, allocationPattern, parameters, name);
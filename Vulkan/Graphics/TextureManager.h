@@ -5,6 +5,8 @@
 #include "Material.h"
 #include "Image.h"
 #include "GraphicsTypes.h"
+#include "MipGenerator.h"
+#include "../JobSystem.h"
 
 namespace QZL {
 	namespace Graphics {
@@ -12,6 +14,7 @@ namespace QZL {
 		class TextureSampler;
 		class Descriptor;
 		class TextureLoader;
+		class TextureStreamer;
 
 		struct SamplerInfo {
 			VkFilter magFilter = VK_FILTER_LINEAR;
@@ -28,13 +31,24 @@ namespace QZL {
 
 		class TextureManager {
 		public:
-			TextureManager(const LogicDevice* logicDevice, Descriptor* descriptor, uint32_t maxTextures, bool descriptorIndexing = false);
+			static constexpr char const* kFallbackTextureName = "FallbackTexture";
+
+			// Textures requested asynchronously are streamed when there is a job system, frameCount is the number of frames in flight
+			TextureManager(const LogicDevice* logicDevice, Descriptor* descriptor, uint32_t maxTextures, bool descriptorIndexing = false, 
+				JobSystem* jobSystem = nullptr, uint32_t frameCount = 1);
 			~TextureManager();
 
-			uint32_t allocateGeneratedTexture(std::string name, void* data, uint32_t width, uint32_t height, VkFormat format, MemoryAllocationPattern allocationPattern, ImageParameters parameters, SamplerInfo samplerInfo = {});
+			// With a mip filter the texture's mips are generated with the next frame's, when its descriptor write is queued
+			uint32_t allocateGeneratedTexture(std::string name, void* data, uint32_t width, uint32_t height, VkFormat format, MemoryAllocationPattern allocationPattern, ImageParameters parameters, SamplerInfo samplerInfo = {},
+				MipFilter mipFilter = MipFilter::kNone);
 			
 			// Returns the index of the texture sampler in the texture aray descriptor
 			uint32_t requestTexture(const std::string& name, SamplerInfo samplerInfo = {});
+			// Returns the index straight away while the file is decoded on a worker, the image is uploaded and its descriptor written 
+			// by a main thread job. The index must not be sampled until that job, returned through upload, has run. If the file cannot
+			// be read the job throws and the index is left reserved to the name, showing the fallback texture.
+			// Only the texture's lowest mips are loaded if it can be streamed, the rest follow as the streamer finds them wanted.
+			uint32_t requestTextureAsync(const std::string& name, JobSystem::JobHandle* upload = nullptr, SamplerInfo samplerInfo = {});
 
 			// Returns a texture sampler and passes ownership of the sampler to the caller, which is expected to destroy the resource prior to this class
 			// destructor being called.
@@ -55,13 +69,25 @@ namespace QZL {
 			}
 			
 			Material* requestMaterial(const RendererTypes type, const std::string name);
+			// As requestMaterial but its textures are loaded with requestTextureAsync, loaded completes once all of them are uploaded
+			Material* requestMaterialAsync(const RendererTypes type, const std::string name, JobSystem::JobHandle* loaded = nullptr);
 
-			VkDescriptorSetLayoutBinding getSetlayoutBinding() {
-				return setLayoutBinding_;
+			// Point the texture array entry at a different image, used as streamed textures' resident mips change. Each frame's set is
+			// written when its slot next comes round, so the old image must be kept until every frame in flight has finished with it.
+			void updateTextureDescriptor(uint32_t idx, const VkDescriptorImageInfo& imageInfo);
+			// Write the texture array entries changed since the frame slot last came round in to its set. The slot's fence must have
+			// been waited on and the set not yet bound this frame, sets are never written while a frame that could be using them is pending.
+			void writePendingDescriptors(VkDescriptorSet set, uint32_t frameIdx);
+			// Null without a job system
+			TextureStreamer* getStreamer() {
+				return textureStreamer_;
+			}
+			MipGenerator* getMipGenerator() {
+				return mipGenerator_;
 			}
 
-			void setDescriptorSetIdx(uint32_t idx) {
-				descriptorSetIdx_ = idx;
+			VkDescriptorSetLayoutBinding getSetlayoutBinding() {
+				return setLayoutBinding_;
 			}
 
 			const bool descriptorIndexingEnabled() {
@@ -70,20 +96,36 @@ namespace QZL {
 
 			std::vector<uint32_t> materialData_;
 		private:
-			VkWriteDescriptorSet makeDescriptorWrite(VkDescriptorImageInfo imageInfo, uint32_t idx, uint32_t count = 1); 
+			VkWriteDescriptorSet makeDescriptorWrite(VkDescriptorSet set, const VkDescriptorImageInfo* imageInfo, uint32_t idx, uint32_t count = 1);
 			Image* allocateImage(std::string name, VkImageCreateInfo createInfo, MemoryAllocationPattern allocationPattern, ImageParameters parameters);
+			// Upload and free a decoded image file, onGenerated runs once its mips are recorded by the mip generator or straight away
+			// if it has none
+			Image* uploadImageFile(const std::string& name, unsigned char* pixels, int width, int height, VkShaderStageFlags stages,
+				std::function<void()> onGenerated = nullptr);
+			// Made the first time it is needed, shown in place of textures that failed to load
+			TextureSampler* getFallbackSampler();
+			// Make the loaded texture's sampler and queue the texture array entry's write, safe while frames are in flight
+			void writeTextureDescriptor(const std::string& name, uint32_t arrayIdx, const SamplerInfo& samplerInfo);
 
 			const bool descriptorIndexingActive_;
 			const uint32_t maxTextures_;
 			const LogicDevice* logicDevice_;
 			TextureLoader* textureLoader_;
+			TextureSampler* fallbackSampler_;
+			TextureStreamer* textureStreamer_;
+			MipGenerator* mipGenerator_;
+			JobSystem* jobSystem_;
 			Descriptor* descriptor_;
-			uint32_t descriptorSetIdx_;
+			// Texture array writes waiting for each frame slot's set, in the order they were made
+			std::vector<std::vector<std::pair<uint32_t, VkDescriptorImageInfo>>> pendingDescriptorWrites_;
 			VkDescriptorSetLayoutBinding setLayoutBinding_;
 			std::unordered_map<std::string, Image*> textures_;
 			std::unordered_map<std::string, TextureSampler*> texturesSamplers_;
 			std::unordered_map<std::string, std::pair<TextureSampler*, uint32_t>> textureSamplersDI_;
 			std::unordered_map<std::string, Material*> materials_;
+			// Textures whose upload job has not run yet
+			std::unordered_map<std::string, JobSystem::JobHandle> pendingTextures_;
+			std::unordered_map<std::string, JobSystem::JobHandle> materialLoads_;
 			std::queue<uint32_t> freeDescriptors_;
 			uint32_t materialCount_;
 		};
@@ -0,0 +1,298 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "TextureStreamer.h"
+#include "TextureSampler.h"
+#include "FrameAllocator.h"
+#include "LogicDevice.h"
+#include "DeviceMemory.h"
+#include "Image.h"
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+// Material textures are sampled by every kind of shader that draws geometry
+static constexpr VkPipelineStageFlags kSamplingPipelineStages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
+	VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+// Copies from the staging buffer must start on a block
+static constexpr VkDeviceSize kStagingAlignment = 16;
+
+static uint32_t findTailMip(const DdsMipChain& chain)
+{
+	uint32_t mip = 0;
+	while (mip + 1 < chain.getMipCount() && std::max(chain.width >> mip, chain.height >> mip) > TextureStreamer::kTailSize) {
+		++mip;
+	}
+	return mip;
+}
+
+TextureStreamer::TextureStreamer(const LogicDevice* logicDevice, TextureManager* textureManager, JobSystem* jobSystem, uint32_t frameCount, VkDeviceSize budget)
+	: logicDevice_(logicDevice), textureManager_(textureManager), jobSystem_(jobSystem), frameCount_(frameCount), budget_(budget), residentSize_(0),
+	  committedSize_(0), frameCounter_(0), overBudget_(false)
+{
+	stagingAllocator_ = new FrameAllocator(logicDevice->getDeviceMemory(), kStagingSize, frameCount, kStagingAlignment, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		"TextureStreamingStaging");
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	// Loads write in to the moves' data, so they must finish before it goes
+	for (const auto& move : pendingMoves_) {
+		move.handle.get();
+	}
+	for (auto& retired : retiredImages_) {
+		SAFE_DELETE(retired.sampler);
+		SAFE_DELETE(retired.image);
+	}
+	for (auto& texture : textures_) {
+		SAFE_DELETE(texture.sampler);
+		SAFE_DELETE(texture.image);
+	}
+	SAFE_DELETE(stagingAllocator_);
+}
+
+void TextureStreamer::readTail(const std::string& name, StreamedTextureLoad& load)
+{
+	DEBUG_LOG("Loading texture tail " << name);
+	load.streamed = false;
+	if (!TextureLoader::readMipChain(name, load.chain)) {
+		return;
+	}
+	// Moves copy the mips both images hold, so the chain must run all the way down for the images to match it
+	const uint32_t fullMipCount = static_cast<uint32_t>(std::floor(std::log2(std::max(load.chain.width, load.chain.height)))) + 1;
+	if (load.chain.getMipCount() != fullMipCount) {
+		return;
+	}
+	TextureLoader::readMips(name, load.chain, findTailMip(load.chain), load.chain.getMipCount(), load.data);
+	load.streamed = true;
+}
+
+void TextureStreamer::addTexture(const std::string& name, uint32_t arrayIdx, const SamplerInfo& samplerInfo, const StreamedTextureLoad& load)
+{
+	EXPECTS(load.streamed);
+	StreamedTexture texture;
+	texture.name = name;
+	texture.chain = load.chain;
+	texture.samplerInfo = samplerInfo;
+	texture.arrayIdx = arrayIdx;
+	texture.tailMip = findTailMip(load.chain);
+	texture.residentMip = texture.tailMip;
+	texture.targetMip = texture.tailMip;
+	texture.wantedMip = texture.tailMip;
+	texture.lastUsedFrame = frameCounter_;
+
+	// The tail is small, so it is uploaded straight away like any other texture rather than waiting for a frame
+	DeviceMemory* deviceMemory = logicDevice_->getDeviceMemory();
+	texture.image = createImage(texture, texture.tailMip, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	MemoryAllocationDetails stagingBuffer = deviceMemory->createBuffer("", MemoryAllocationPattern::kStaging, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, load.data.size());
+	memcpy(deviceMemory->mapMemory(stagingBuffer.id), load.data.data(), load.data.size());
+	deviceMemory->unmapMemory(stagingBuffer.id);
+	std::vector<VkBufferImageCopy> copies;
+	makeCopies(texture.chain, texture.tailMip, texture.chain.getMipCount(), texture.tailMip, 0, copies);
+	deviceMemory->transferMemory(stagingBuffer.buffer, texture.image->getImage(), copies.data(), uint32_t(copies.size()));
+	deviceMemory->deleteAllocation(stagingBuffer.id, stagingBuffer.buffer);
+	texture.image->changeLayout(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, kSamplingPipelineStages);
+	texture.sampler = texture.image->createTextureSampler(name, samplerInfo.magFilter, samplerInfo.minFilter, samplerInfo.addressMode, samplerInfo.anisotropy);
+
+	const VkDeviceSize size = texture.chain.getSize(texture.tailMip, texture.chain.getMipCount());
+	residentSize_ += size;
+	committedSize_ += size;
+	textureIndices_[arrayIdx] = static_cast<uint32_t>(textures_.size());
+	textures_.push_back(texture);
+	writeDescriptor(textures_.back());
+}
+
+void TextureStreamer::requestDetail(uint32_t arrayIdx, float screenPixels)
+{
+	const auto it = textureIndices_.find(arrayIdx);
+	if (it == textureIndices_.end()) {
+		return;
+	}
+	StreamedTexture& texture = textures_[it->second];
+	texture.lastUsedFrame = frameCounter_;
+	// About one texel per pixel, rounding towards more detail
+	const float texels = float(std::max(texture.chain.width, texture.chain.height));
+	const uint32_t mip = screenPixels >= texels ? 0 : static_cast<uint32_t>(std::log2(texels / std::max(screenPixels, 1.0f)));
+	texture.wantedMip = std::min(texture.wantedMip, std::min(mip, texture.tailMip));
+}
+
+void TextureStreamer::beginFrame(VkCommandBuffer cmdBuffer, uint32_t frameIdx)
+{
+	stagingAllocator_->beginFrame(frameIdx);
+	// The fences of the frames that could sample a retired image have been waited on
+	for (auto it = retiredImages_.begin(); it != retiredImages_.end();) {
+		if (frameCounter_ - it->frame < frameCount_) {
+			++it;
+			continue;
+		}
+		SAFE_DELETE(it->sampler);
+		SAFE_DELETE(it->image);
+		it = retiredImages_.erase(it);
+	}
+
+	VkDeviceSize staged = 0;
+	for (auto it = pendingMoves_.begin(); it != pendingMoves_.end();) {
+		const VkDeviceSize size = it->data != nullptr ? (it->data->size() + kStagingAlignment - 1) / kStagingAlignment * kStagingAlignment : 0;
+		// Moves that do not fit wait for the next frame
+		if (!it->handle.isComplete() || staged + size > kStagingSize) {
+			++it;
+			continue;
+		}
+		it->handle.get();
+		staged += size;
+		move(cmdBuffer, textures_[it->texture], it->mip, it->data.get());
+		it = pendingMoves_.erase(it);
+	}
+}
+
+void TextureStreamer::endFrame()
+{
+	// The textures missing the most detail first
+	std::vector<std::pair<uint32_t, uint32_t>> wanted;
+	for (uint32_t i = 0; i < textures_.size(); ++i) {
+		const StreamedTexture& texture = textures_[i];
+		if (!isMoving(texture) && texture.wantedMip < texture.residentMip) {
+			wanted.emplace_back(texture.residentMip - texture.wantedMip, i);
+		}
+	}
+	std::sort(wanted.begin(), wanted.end(), std::greater<std::pair<uint32_t, uint32_t>>());
+
+	uint32_t loadsInFlight = static_cast<uint32_t>(std::count_if(pendingMoves_.begin(), pendingMoves_.end(), [](const PendingMove& move) {
+		return move.data != nullptr;
+	}));
+	bool overBudget = false;
+	for (const auto& request : wanted) {
+		if (loadsInFlight >= kMaxLoadsInFlight) {
+			break;
+		}
+		StreamedTexture& texture = textures_[request.second];
+		uint32_t mip = texture.wantedMip;
+		while (texture.chain.getSize(mip, texture.residentMip) > kStagingSize) {
+			++mip;
+		}
+		if (mip == texture.residentMip) {
+			continue;
+		}
+		const VkDeviceSize growth = texture.chain.getSize(mip, texture.residentMip);
+		if (committedSize_ + growth > budget_) {
+			const VkDeviceSize over = committedSize_ + growth - budget_;
+			if (cutBack(over) < over) {
+				overBudget = true;
+				continue;
+			}
+		}
+		// The texture is copied as adding textures may move it
+		auto data = std::make_shared<std::vector<char>>();
+		JobSystem::JobHandle handle = jobSystem_->submit([name = texture.name, chain = texture.chain, mip, lastMip = texture.residentMip, data]() {
+			TextureLoader::readMips(name, chain, mip, lastMip, *data);
+		});
+		pendingMoves_.push_back({ request.second, mip, handle, data });
+		texture.targetMip = mip;
+		committedSize_ += growth;
+		++loadsInFlight;
+	}
+	// Nothing wanted may still be over, if the budget was lowered
+	if (committedSize_ > budget_) {
+		cutBack(committedSize_ - budget_);
+		overBudget = overBudget || committedSize_ > budget_;
+	}
+	if (overBudget != overBudget_) {
+		DEBUG_LOG("Texture streaming budget " << (overBudget ? "exceeded" : "recovered") << ": " << committedSize_ << " of " << budget_ << " bytes resident");
+		overBudget_ = overBudget;
+	}
+
+	for (auto& texture : textures_) {
+		texture.wantedMip = texture.tailMip;
+	}
+	++frameCounter_;
+}
+
+Image* TextureStreamer::createImage(const StreamedTexture& texture, uint32_t firstMip, VkImageLayout layout)
+{
+	const VkExtent2D extent = texture.chain.getMipExtent(firstMip);
+	Image* image = new Image(logicDevice_, Image::makeCreateInfo(VK_IMAGE_TYPE_2D, texture.chain.getMipCount() - firstMip, 1, texture.chain.format,
+		VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT,
+		extent.width, extent.height), MemoryAllocationPattern::kStaticResource, { VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, layout }, texture.name);
+	ASSERT(image->getMipLevels() == texture.chain.getMipCount() - firstMip);
+	return image;
+}
+
+void TextureStreamer::makeCopies(const DdsMipChain& chain, uint32_t firstMip, uint32_t lastMip, uint32_t imageMip, VkDeviceSize bufferOffset,
+	std::vector<VkBufferImageCopy>& copies)
+{
+	for (uint32_t mip = firstMip; mip < lastMip; ++mip) {
+		const VkExtent2D extent = chain.getMipExtent(mip);
+		VkBufferImageCopy copy = {};
+		copy.bufferOffset = bufferOffset + chain.getSize(firstMip, mip);
+		copy.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip - imageMip, 0, 1 };
+		copy.imageExtent = { extent.width, extent.height, 1 };
+		copies.push_back(copy);
+	}
+}
+
+void TextureStreamer::move(VkCommandBuffer cmdBuffer, StreamedTexture& texture, uint32_t mip, const std::vector<char>* data)
+{
+	Image* image = createImage(texture, mip, VK_IMAGE_LAYOUT_UNDEFINED);
+	image->changeLayout(cmdBuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+	if (data != nullptr) {
+		const FrameAllocation staging = stagingAllocator_->upload(data->data(), data->size());
+		std::vector<VkBufferImageCopy> copies;
+		makeCopies(texture.chain, mip, texture.residentMip, mip, staging.offset, copies);
+		vkCmdCopyBufferToImage(cmdBuffer, staging.buffer, image->getImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, uint32_t(copies.size()), copies.data());
+	}
+
+	// The mips both images hold are copied on the gpu, after the frames in flight have finished sampling the old image
+	const uint32_t firstShared = std::max(mip, texture.residentMip);
+	std::vector<VkImageCopy> copies;
+	for (uint32_t shared = firstShared; shared < texture.chain.getMipCount(); ++shared) {
+		const VkExtent2D extent = texture.chain.getMipExtent(shared);
+		VkImageCopy copy = {};
+		copy.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, shared - texture.residentMip, 0, 1 };
+		copy.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, shared - mip, 0, 1 };
+		copy.extent = { extent.width, extent.height, 1 };
+		copies.push_back(copy);
+	}
+	texture.image->changeLayout(cmdBuffer, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, kSamplingPipelineStages, VK_PIPELINE_STAGE_TRANSFER_BIT);
+	vkCmdCopyImage(cmdBuffer, texture.image->getImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image->getImage(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		uint32_t(copies.size()), copies.data());
+	image->changeLayout(cmdBuffer, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, kSamplingPipelineStages);
+
+	// Kept until the copy and the frames in flight that sample it have finished
+	retiredImages_.push_back({ texture.image, texture.sampler, frameCounter_ });
+	residentSize_ = residentSize_ - texture.chain.getSize(texture.residentMip, texture.chain.getMipCount()) + texture.chain.getSize(mip, texture.chain.getMipCount());
+	texture.image = image;
+	texture.sampler = image->createTextureSampler(texture.name, texture.samplerInfo.magFilter, texture.samplerInfo.minFilter, texture.samplerInfo.addressMode,
+		texture.samplerInfo.anisotropy);
+	texture.residentMip = mip;
+	writeDescriptor(texture);
+}
+
+void TextureStreamer::writeDescriptor(StreamedTexture& texture)
+{
+	textureManager_->updateTextureDescriptor(texture.arrayIdx, texture.sampler->getImageInfo());
+}
+
+VkDeviceSize TextureStreamer::cutBack(VkDeviceSize size)
+{
+	std::vector<std::pair<uint64_t, uint32_t>> candidates;
+	for (uint32_t i = 0; i < textures_.size(); ++i) {
+		const StreamedTexture& texture = textures_[i];
+		if (!isMoving(texture) && texture.wantedMip > texture.residentMip) {
+			candidates.emplace_back(texture.lastUsedFrame, i);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end());
+
+	VkDeviceSize freed = 0;
+	for (const auto& candidate : candidates) {
+		if (freed >= size) {
+			break;
+		}
+		StreamedTexture& texture = textures_[candidate.second];
+		const VkDeviceSize shrink = texture.chain.getSize(texture.residentMip, texture.wantedMip);
+		pendingMoves_.push_back({ candidate.second, texture.wantedMip, JobSystem::JobHandle(), nullptr });
+		texture.targetMip = texture.wantedMip;
+		committedSize_ -= shrink;
+		freed += shrink;
+	}
+	return freed;
+}
@@ -0,0 +1,134 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Purpose: Stream the mips of dds textures in and out of video memory as the scene needs them.
+#pragma once
+#include "VkUtil.h"
+#include "TextureLoader.h"
+#include "TextureManager.h"
+#include "../JobSystem.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		class LogicDevice;
+		class FrameAllocator;
+		class Image;
+		class TextureSampler;
+
+		// What a texture starts with, read on a worker before any of its detail is streamed in
+		struct StreamedTextureLoad {
+			DdsMipChain chain;
+			// The tail's mips
+			std::vector<char> data;
+			// False if the file cannot be streamed and must be loaded whole
+			bool streamed = false;
+		};
+
+		/*
+			Textures start with only their tail, the mips no larger than kTailSize across, which is never evicted so there is always
+			something to sample. Every frame the scene reports how many pixels across each texture covers on screen and the texture is
+			wanted at the mip with about one texel per pixel. More detail is read on workers and the texture moved to a new image holding
+			the mips from the wanted one down, the mips it already had are copied across on the gpu. While the resident mips are over the
+			budget the least recently used textures are cut back to the mip they are wanted at, their tail if they were not seen this
+			frame, which needs only a gpu copy. Each move queues a write of the texture's bindless descriptor, which reaches each frame's
+			set as its slot comes round, and the old image is kept until no frame in flight can be sampling it.
+			The images and samplers of streamed textures belong to the streamer, not the texture manager.
+		*/
+		class TextureStreamer {
+		public:
+			TextureStreamer(const LogicDevice* logicDevice, TextureManager* textureManager, JobSystem* jobSystem, uint32_t frameCount,
+				VkDeviceSize budget = kDefaultBudget);
+			~TextureStreamer();
+
+			// Read the texture's tail, safe to call from a worker. Files that are not 2D block compressed dds with every mip are not
+			// streamed.
+			static void readTail(const std::string& name, StreamedTextureLoad& load);
+			// Upload the tail and write the texture's descriptor at arrayIdx, on the main thread
+			void addTexture(const std::string& name, uint32_t arrayIdx, const SamplerInfo& samplerInfo, const StreamedTextureLoad& load);
+
+			// The texture at arrayIdx covers screenPixels across this frame, indices of textures that are not streamed are ignored
+			void requestDetail(uint32_t arrayIdx, float screenPixels);
+
+			// Record the moves of textures whose loads have finished and release the images no frame in flight samples, before anything
+			// samples the textures this frame
+			void beginFrame(VkCommandBuffer cmdBuffer, uint32_t frameIdx);
+			// Start loading the detail wanted this frame, cutting back the least recently used textures to keep to the budget
+			void endFrame();
+
+			void setBudget(VkDeviceSize budget) {
+				budget_ = budget;
+			}
+			// Video memory taken by every streamed texture's resident mips
+			VkDeviceSize getResidentSize() const {
+				return residentSize_;
+			}
+
+			static constexpr VkDeviceSize kDefaultBudget = 256ull * 1024 * 1024;
+			// Mips no larger than this across are always resident
+			static constexpr uint32_t kTailSize = 128;
+			static constexpr uint32_t kMaxLoadsInFlight = 8;
+			// Bounds the detail uploaded in one frame, a texture is never moved more mips at once than fit
+			static constexpr VkDeviceSize kStagingSize = 32ull * 1024 * 1024;
+		private:
+			struct StreamedTexture {
+				std::string name;
+				DdsMipChain chain;
+				SamplerInfo samplerInfo;
+				uint32_t arrayIdx;
+				Image* image;
+				TextureSampler* sampler;
+				// Most detailed mip in the image, the one a pending move will leave it at, and the most detailed of the tail
+				uint32_t residentMip;
+				uint32_t targetMip;
+				uint32_t tailMip;
+				// Most detailed mip asked for this frame
+				uint32_t wantedMip;
+				uint64_t lastUsedFrame;
+			};
+			struct PendingMove {
+				uint32_t texture;
+				uint32_t mip;
+				JobSystem::JobHandle handle;
+				// The mips the texture does not have yet, null when it is cut back
+				std::shared_ptr<std::vector<char>> data;
+			};
+			struct RetiredImage {
+				Image* image;
+				TextureSampler* sampler;
+				uint64_t frame;
+			};
+
+			// Holds the texture's mips from firstMip down
+			Image* createImage(const StreamedTexture& texture, uint32_t firstMip, VkImageLayout layout);
+			// Copies of the mips [firstMip, lastMip) packed from bufferOffset to an image whose most detailed mip is imageMip
+			static void makeCopies(const DdsMipChain& chain, uint32_t firstMip, uint32_t lastMip, uint32_t imageMip, VkDeviceSize bufferOffset,
+				std::vector<VkBufferImageCopy>& copies);
+			// Move the texture to a new image from mip down, data holds the mips read for it
+			void move(VkCommandBuffer cmdBuffer, StreamedTexture& texture, uint32_t mip, const std::vector<char>* data);
+			void writeDescriptor(StreamedTexture& texture);
+			// Cut back idle textures with more detail than they are wanted at, least recently used first, until size is freed or there
+			// are none left. Returns the size freed.
+			VkDeviceSize cutBack(VkDeviceSize size);
+			bool isMoving(const StreamedTexture& texture) const {
+				return texture.targetMip != texture.residentMip;
+			}
+
+			const LogicDevice* logicDevice_;
+			TextureManager* textureManager_;
+			JobSystem* jobSystem_;
+			FrameAllocator* stagingAllocator_;
+			const uint32_t frameCount_;
+			VkDeviceSize budget_;
+			VkDeviceSize residentSize_;
+			// The resident size once every pending move has been made
+			VkDeviceSize committedSize_;
+			std::vector<StreamedTexture> textures_;
+			// Texture array index to streamed texture
+			std::unordered_map<uint32_t, uint32_t> textureIndices_;
+			std::vector<PendingMove> pendingMoves_;
+			std::vector<RetiredImage> retiredImages_;
+			uint64_t frameCounter_;
+			bool overBudget_;
+		};
+	}
+}
@@ -7,7 +7,11 @@ namespace QZL
 {
 	namespace Graphics {
 		enum class VertexTypes {
-			VERTEX, VERTEX_ONLY_POS, PARTICLE_VERTEX
+			VERTEX, VERTEX_ONLY_POS, PARTICLE_VERTEX, PACKED_VERTEX, PACKED_VERTEX_TANGENT_COLOUR,
+			// Index only, the shader builds each vertex from gl_VertexIndex so the pipeline has no vertex input
+			NONE,
+			// Index only grid drawn once per terrain quadtree node, the only input is the per instance node on binding 1
+			TERRAIN_NODE
 		};
 
 		inline VkVertexInputBindingDescription makeVertexBindingDescription(uint32_t binding, uint32_t sizeOfVertex, VkVertexInputRate inputRate) {
@@ -45,6 +49,39 @@ namespace QZL
 				};
 			}
 		};
+
+		/*
+			Compressed form of Vertex, see VertexPacker. Positions are normalized to the mesh bounds and must be drawn with the mesh's
+			position dequantization folded in to its model matrix, normals are octahedral encoded and need decoding in the shader.
+		*/
+		struct PackedVertex {
+			uint16_t x, y, z, w; // w is the bitangent sign for the tangent format, 0 or 1 once normalized
+			uint16_t u, v; // Half floats
+			int16_t nx, ny;
+
+			static std::vector<std::pair<uint32_t, VkFormat>> makeAttribInfo() {
+				return {
+					{ static_cast<uint32_t>(offsetof(PackedVertex, x)), VK_FORMAT_R16G16B16A16_UNORM },
+					{ static_cast<uint32_t>(offsetof(PackedVertex, u)), VK_FORMAT_R16G16_SFLOAT },
+					{ static_cast<uint32_t>(offsetof(PackedVertex, nx)), VK_FORMAT_R16G16_SNORM }
+				};
+			}
+		};
+
+		// Packed vertex with an octahedral tangent and a colour, for meshes which need them
+		struct PackedVertexTangentColour {
+			PackedVertex base;
+			int16_t tx, ty;
+			uint8_t r, g, b, a;
+
+			static std::vector<std::pair<uint32_t, VkFormat>> makeAttribInfo() {
+				auto attribInfo = PackedVertex::makeAttribInfo();
+				attribInfo.push_back({ static_cast<uint32_t>(offsetof(PackedVertexTangentColour, tx)), VK_FORMAT_R16G16_SNORM });
+				attribInfo.push_back({ static_cast<uint32_t>(offsetof(PackedVertexTangentColour, r)), VK_FORMAT_R8G8B8A8_UNORM });
+				return attribInfo;
+			}
+		};
+
 #pragma pack(push, 1)
 		struct VertexOnlyPosition {
 			glm::vec3 pos;
@@ -61,20 +98,53 @@ namespace QZL
 			}
 		};
 #pragma pack(pop)
+		// A particle as the particle vertex shader reads it from a storage buffer, laid out as ParticleInstance in particle_simulation.glsl
 		struct ParticleVertex {
 			glm::vec3 position;
 			float scale = 0.0f;
+			glm::vec3 velocity;
+			float padding = 0.0f;
 			glm::vec2 textureOffset;
+			glm::vec2 padding2;
 
 			static std::vector<std::pair<uint32_t, VkFormat>> makeAttribInfo() {
 				return {
 					{ offsetof(ParticleVertex, position.x), VK_FORMAT_R32G32B32_SFLOAT },
 					{ offsetof(ParticleVertex, scale), VK_FORMAT_R32_SFLOAT },
+					{ offsetof(ParticleVertex, velocity.x), VK_FORMAT_R32G32B32_SFLOAT },
 					{ offsetof(ParticleVertex, textureOffset.x), VK_FORMAT_R32G32_SFLOAT }
 				};
 			}
 		};
 
+		/*
+			A terrain quadtree node selected for one camera, see TerrainQuadtree. The node's grid vertices morph towards the next coarser
+			level's grid as their distance from the morph centre goes from the start to the end of the morph range, and its samples blend
+			from the fine tile to the coarse one alongside. Tiles are the height, normal and splat texture indices and the tile's level.
+		*/
+		struct TerrainNodeInstance {
+			glm::vec2 origin; // In level 0 samples
+			float size;
+			float padding;
+			glm::vec4 morphCentre; // In the terrain's space like the origin, as is the morph range
+			glm::vec2 morphRange;
+			uint32_t paramsIdx;
+			uint32_t padding2;
+			glm::uvec4 fineTile;
+			glm::uvec4 coarseTile;
+
+			static std::vector<std::pair<uint32_t, VkFormat>> makeAttribInfo() {
+				return {
+					{ static_cast<uint32_t>(offsetof(TerrainNodeInstance, origin)), VK_FORMAT_R32G32B32A32_SFLOAT },
+					{ static_cast<uint32_t>(offsetof(TerrainNodeInstance, morphCentre)), VK_FORMAT_R32G32B32A32_SFLOAT },
+					{ static_cast<uint32_t>(offsetof(TerrainNodeInstance, morphRange)), VK_FORMAT_R32G32_SFLOAT },
+					{ static_cast<uint32_t>(offsetof(TerrainNodeInstance, paramsIdx)), VK_FORMAT_R32_UINT },
+					{ static_cast<uint32_t>(offsetof(TerrainNodeInstance, fineTile)), VK_FORMAT_R32G32B32A32_UINT },
+					{ static_cast<uint32_t>(offsetof(TerrainNodeInstance, coarseTile)), VK_FORMAT_R32G32B32A32_UINT }
+				};
+			}
+		};
+
 		inline std::vector<std::pair<uint32_t, VkFormat>> makeVertexAttribInfo(VertexTypes type) {
 			switch (type) {
 			case VertexTypes::VERTEX:
@@ -83,6 +153,14 @@ namespace QZL
 				return VertexOnlyPosition::makeAttribInfo();
 			case VertexTypes::PARTICLE_VERTEX:
 				return ParticleVertex::makeAttribInfo();
+			case VertexTypes::PACKED_VERTEX:
+				return PackedVertex::makeAttribInfo();
+			case VertexTypes::PACKED_VERTEX_TANGENT_COLOUR:
+				return PackedVertexTangentColour::makeAttribInfo();
+			case VertexTypes::NONE:
+				return {};
+			case VertexTypes::TERRAIN_NODE:
+				return TerrainNodeInstance::makeAttribInfo();
 			default:
 				ASSERT(false);
 			}
@@ -96,9 +174,29 @@ namespace QZL
 				return sizeof(VertexOnlyPosition);
 			case VertexTypes::PARTICLE_VERTEX:
 				return sizeof(ParticleVertex);
+			case VertexTypes::PACKED_VERTEX:
+				return sizeof(PackedVertex);
+			case VertexTypes::PACKED_VERTEX_TANGENT_COLOUR:
+				return sizeof(PackedVertexTangentColour);
+			case VertexTypes::NONE:
+				return 0;
+			case VertexTypes::TERRAIN_NODE:
+				return sizeof(TerrainNodeInstance);
 			default:
 				ASSERT(false);
 			}
 		}
+
+		// Per instance formats are bound after the geometry arena's binding so they do not disturb it
+		inline constexpr uint32_t getVertexBinding(VertexTypes type) {
+			return type == VertexTypes::TERRAIN_NODE ? 1 : 0;
+		}
+
+		inline constexpr VkVertexInputRate getVertexInputRate(VertexTypes type) {
+			return type == VertexTypes::TERRAIN_NODE ? VK_VERTEX_INPUT_RATE_INSTANCE : VK_VERTEX_INPUT_RATE_VERTEX;
+		}
+
+		// Format of static meshes in every pass that draws them. Packed formats halve vertex fetch in the shadow and geometry passes.
+		constexpr VertexTypes kStaticVertexType = VertexTypes::VERTEX;
 	}
 }
@@ -0,0 +1,142 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "VertexPacker.h"
+#include <glm/gtc/packing.hpp>
+
+using namespace QZL;
+using namespace QZL::Graphics;
+
+std::vector<char> VertexPacker::pack(VertexTypes type, const Vertex* vertices, size_t vertexCount, const std::vector<uint32_t>& indices,
+	const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::vec4* colours)
+{
+	ASSERT(type == VertexTypes::PACKED_VERTEX || type == VertexTypes::PACKED_VERTEX_TANGENT_COLOUR);
+	const glm::vec3 extent = calculateExtent(boundsMin, boundsMax);
+	std::vector<char> data(vertexCount * getVertexSize(type));
+
+	if (type == VertexTypes::PACKED_VERTEX) {
+		PackedVertex* packed = reinterpret_cast<PackedVertex*>(data.data());
+		for (size_t i = 0; i < vertexCount; ++i) {
+			packVertex(vertices[i], boundsMin, extent, packed[i]);
+		}
+		return data;
+	}
+
+	const std::vector<glm::vec4> tangents = generateTangents(vertices, vertexCount, indices);
+	PackedVertexTangentColour* packed = reinterpret_cast<PackedVertexTangentColour*>(data.data());
+	for (size_t i = 0; i < vertexCount; ++i) {
+		packVertex(vertices[i], boundsMin, extent, packed[i].base);
+		packed[i].base.w = tangents[i].w < 0.0f ? 0 : std::numeric_limits<uint16_t>::max();
+		const glm::vec2 tangent = encodeOctahedral(glm::vec3(tangents[i]) / extent);
+		packed[i].tx = toSnorm(tangent.x);
+		packed[i].ty = toSnorm(tangent.y);
+		const glm::vec4 colour = glm::round(glm::clamp(colours != nullptr ? colours[i] : glm::vec4(1.0f), 0.0f, 1.0f) * 255.0f);
+		packed[i].r = static_cast<uint8_t>(colour.r);
+		packed[i].g = static_cast<uint8_t>(colour.g);
+		packed[i].b = static_cast<uint8_t>(colour.b);
+		packed[i].a = static_cast<uint8_t>(colour.a);
+	}
+	return data;
+}
+
+glm::mat4 VertexPacker::makeDequantization(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	glm::mat4 dequantization = glm::scale(glm::mat4(1.0f), calculateExtent(boundsMin, boundsMax));
+	dequantization[3] = glm::vec4(boundsMin, 1.0f);
+	return dequantization;
+}
+
+glm::vec2 VertexPacker::encodeOctahedral(glm::vec3 n)
+{
+	const float length = glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z);
+	if (length == 0.0f) {
+		return glm::vec2(0.0f);
+	}
+	n /= length;
+	glm::vec2 e(n.x, n.y);
+	if (n.z < 0.0f) {
+		// Fold the lower hemisphere over the diagonals
+		const glm::vec2 signs(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+		e = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * signs;
+	}
+	return e;
+}
+
+glm::vec3 VertexPacker::decodeOctahedral(glm::vec2 e)
+{
+	glm::vec3 n(e.x, e.y, 1.0f - glm::abs(e.x) - glm::abs(e.y));
+	const float t = glm::max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return glm::normalize(n);
+}
+
+void VertexPacker::packVertex(const Vertex& vertex, const glm::vec3& boundsMin, const glm::vec3& extent, PackedVertex& packed)
+{
+	const glm::vec3 position = (glm::vec3(vertex.x, vertex.y, vertex.z) - boundsMin) / extent;
+	packed.x = toUnorm(position.x);
+	packed.y = toUnorm(position.y);
+	packed.z = toUnorm(position.z);
+	packed.w = 0;
+	packed.u = glm::packHalf1x16(vertex.u);
+	packed.v = glm::packHalf1x16(vertex.v);
+	// The inverse transpose of the dequantization divides by the extent, so multiplying here cancels it out
+	const glm::vec2 normal = encodeOctahedral(glm::vec3(vertex.nx, vertex.ny, vertex.nz) * extent);
+	packed.nx = toSnorm(normal.x);
+	packed.ny = toSnorm(normal.y);
+}
+
+std::vector<glm::vec4> VertexPacker::generateTangents(const Vertex* vertices, size_t vertexCount, const std::vector<uint32_t>& indices)
+{
+	std::vector<glm::vec3> tangents(vertexCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> bitangents(vertexCount, glm::vec3(0.0f));
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		const Vertex& v0 = vertices[indices[i]];
+		const Vertex& v1 = vertices[indices[i + 1]];
+		const Vertex& v2 = vertices[indices[i + 2]];
+		const glm::vec3 edge1 = glm::vec3(v1.x, v1.y, v1.z) - glm::vec3(v0.x, v0.y, v0.z);
+		const glm::vec3 edge2 = glm::vec3(v2.x, v2.y, v2.z) - glm::vec3(v0.x, v0.y, v0.z);
+		const glm::vec2 deltaUV1 = glm::vec2(v1.u - v0.u, v1.v - v0.v);
+		const glm::vec2 deltaUV2 = glm::vec2(v2.u - v0.u, v2.v - v0.v);
+		const float determinant = deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y;
+		if (glm::abs(determinant) < std::numeric_limits<float>::epsilon()) {
+			continue;
+		}
+		// Unnormalized so larger triangles have more influence on shared vertices
+		const float r = 1.0f / determinant;
+		const glm::vec3 tangent = (edge1 * deltaUV2.y - edge2 * deltaUV1.y) * r;
+		const glm::vec3 bitangent = (edge2 * deltaUV1.x - edge1 * deltaUV2.x) * r;
+		for (size_t j = 0; j < 3; ++j) {
+			tangents[indices[i + j]] += tangent;
+			bitangents[indices[i + j]] += bitangent;
+		}
+	}
+
+	std::vector<glm::vec4> result(vertexCount);
+	for (size_t i = 0; i < vertexCount; ++i) {
+		const glm::vec3 normal(vertices[i].nx, vertices[i].ny, vertices[i].nz);
+		// Gram-Schmidt orthogonalise against the normal, any perpendicular vector will do if the uvs gave nothing
+		glm::vec3 tangent = tangents[i] - normal * glm::dot(normal, tangents[i]);
+		if (glm::dot(tangent, tangent) < std::numeric_limits<float>::epsilon()) {
+			tangent = glm::abs(normal.x) < 0.9f ? glm::cross(normal, glm::vec3(1.0f, 0.0f, 0.0f)) : glm::cross(normal, glm::vec3(0.0f, 1.0f, 0.0f));
+		}
+		tangent = glm::normalize(tangent);
+		const float sign = glm::dot(glm::cross(normal, tangent), bitangents[i]) < 0.0f ? -1.0f : 1.0f;
+		result[i] = glm::vec4(tangent, sign);
+	}
+	return result;
+}
+
+int16_t VertexPacker::toSnorm(float v)
+{
+	return static_cast<int16_t>(glm::round(glm::clamp(v, -1.0f, 1.0f) * 32767.0f));
+}
+
+uint16_t VertexPacker::toUnorm(float v)
+{
+	return static_cast<uint16_t>(glm::round(glm::clamp(v, 0.0f, 1.0f) * 65535.0f));
+}
+
+glm::vec3 VertexPacker::calculateExtent(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	return glm::max(boundsMax - boundsMin, glm::vec3(kMinExtent));
+}
@@ -0,0 +1,38 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Purpose: Convert full float vertices in to the packed vertex formats when meshes are loaded.
+// Reference: Cigolle et al, A Survey of Efficient Representations for Independent Unit Vectors, 2014
+#pragma once
+#include "Vertex.h"
+
+namespace QZL
+{
+	namespace Graphics {
+		class VertexPacker {
+		public:
+			// Smallest bounds extent used for quantizing, keeps flat meshes invertible once the dequantization is folded in to the model
+			static constexpr float kMinExtent = 1e-4f;
+
+			/*
+				Pack the vertices in to the given packed format. Positions are normalized to the bounds, so the mesh must be drawn with
+				makeDequantization folded in to its model matrix. Normals are pre-scaled by the bounds extent, and tangents by its inverse, so
+				that they come out correct when transformed by that model matrix. Indices are only needed to generate tangents, colours default to white.
+			*/
+			static std::vector<char> pack(VertexTypes type, const Vertex* vertices, size_t vertexCount, const std::vector<uint32_t>& indices,
+				const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::vec4* colours = nullptr);
+			// Maps normalized positions back to the object space bounds
+			static glm::mat4 makeDequantization(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+			static glm::vec2 encodeOctahedral(glm::vec3 n);
+			static glm::vec3 decodeOctahedral(glm::vec2 e);
+
+		private:
+			static void packVertex(const Vertex& vertex, const glm::vec3& boundsMin, const glm::vec3& extent, PackedVertex& packed);
+			// Per vertex tangents from the uv gradients of each triangle, w is the bitangent sign
+			static std::vector<glm::vec4> generateTangents(const Vertex* vertices, size_t vertexCount, const std::vector<uint32_t>& indices);
+			static int16_t toSnorm(float v);
+			static uint16_t toUnorm(float v);
+			static glm::vec3 calculateExtent(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+		};
+	}
+}
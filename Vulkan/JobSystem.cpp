@@ -0,0 +1,165 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+#include "JobSystem.h"
+
+using namespace QZL;
+
+JobSystem::JobHandle::JobHandle(std::shared_ptr<Job> job)
+	: job_(job), future_(job->promise.get_future().share())
+{
+}
+
+bool JobSystem::JobHandle::isComplete() const
+{
+	return !isValid() || future_.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+void JobSystem::JobHandle::get() const
+{
+	if (isValid()) {
+		future_.get();
+	}
+}
+
+JobSystem::JobSystem(size_t workerCount)
+	: outstandingJobs_(0), stopping_(false), mainThreadId_(std::this_thread::get_id())
+{
+	if (workerCount == 0) {
+		workerCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+	}
+	for (size_t i = 0; i < workerCount; ++i) {
+		workers_.emplace_back(&JobSystem::workerLoop, this);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	waitAll();
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	workerCondition_.notify_all();
+	for (auto& worker : workers_) {
+		worker.join();
+	}
+}
+
+JobSystem::JobHandle JobSystem::submit(std::function<void()> work, const std::vector<JobHandle>& dependencies, JobThread thread)
+{
+	auto job = std::make_shared<Job>();
+	job->work = std::move(work);
+	job->thread = thread;
+	JobHandle handle(job);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	++outstandingJobs_;
+	for (const auto& dependency : dependencies) {
+		if (dependency.isValid() && !dependency.job_->finished) {
+			dependency.job_->dependents.push_back(job);
+			++job->pendingDependencies;
+		}
+	}
+	if (job->pendingDependencies == 0) {
+		enqueue(job);
+	}
+	return handle;
+}
+
+size_t JobSystem::runMainThreadJobs()
+{
+	EXPECTS(std::this_thread::get_id() == mainThreadId_);
+	size_t count = 0;
+	while (true) {
+		std::shared_ptr<Job> job;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (mainQueue_.empty()) {
+				return count;
+			}
+			job = mainQueue_.front();
+			mainQueue_.pop();
+		}
+		execute(job);
+		++count;
+	}
+}
+
+void JobSystem::wait(const JobHandle& handle)
+{
+	if (handle.isValid()) {
+		waitUntil([job = handle.job_.get()]() { return job->finished; });
+		handle.get();
+	}
+}
+
+void JobSystem::waitAll()
+{
+	waitUntil([this]() { return outstandingJobs_ == 0; });
+}
+
+void JobSystem::waitUntil(std::function<bool()> predicate)
+{
+	EXPECTS(std::this_thread::get_id() == mainThreadId_);
+	while (true) {
+		runMainThreadJobs();
+		std::unique_lock<std::mutex> lock(mutex_);
+		if (predicate()) {
+			return;
+		}
+		mainCondition_.wait(lock, [this, &predicate]() { return predicate() || !mainQueue_.empty(); });
+	}
+}
+
+void JobSystem::workerLoop()
+{
+	while (true) {
+		std::shared_ptr<Job> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			workerCondition_.wait(lock, [this]() { return stopping_ || !workerQueue_.empty(); });
+			if (workerQueue_.empty()) {
+				return;
+			}
+			job = workerQueue_.front();
+			workerQueue_.pop();
+		}
+		execute(job);
+	}
+}
+
+void JobSystem::execute(std::shared_ptr<Job> job)
+{
+	try {
+		job->work();
+		job->promise.set_value();
+	}
+	catch (...) {
+		job->promise.set_exception(std::current_exception());
+	}
+	// Release anything the job captured now rather than when the last handle goes
+	job->work = nullptr;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	job->finished = true;
+	for (auto& dependent : job->dependents) {
+		if (--dependent->pendingDependencies == 0) {
+			enqueue(dependent);
+		}
+	}
+	job->dependents.clear();
+	--outstandingJobs_;
+	mainCondition_.notify_all();
+}
+
+void JobSystem::enqueue(std::shared_ptr<Job> job)
+{
+	if (job->thread == JobThread::kWorker) {
+		workerQueue_.push(job);
+		workerCondition_.notify_one();
+	}
+	else {
+		mainQueue_.push(job);
+		mainCondition_.notify_all();
+	}
+}
@@ -0,0 +1,75 @@
+// Author: Ralph Ridley
+// Date: 19/10/26
+// Runs jobs on a pool of worker threads, or on the main thread for work that must touch the device.
+// A job is only queued once every job it depends on has finished.
+#pragma once
+#include "Graphics/VkUtil.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+
+namespace QZL {
+	enum class JobThread {
+		kWorker,
+		kMain
+	};
+
+	class JobSystem {
+		struct Job;
+	public:
+		// Completion of a submitted job which later jobs can depend on. A dependent still runs if the job threw,
+		// call get to rethrow the failure.
+		class JobHandle {
+			friend class JobSystem;
+		public:
+			JobHandle() = default;
+			bool isValid() const {
+				return job_ != nullptr;
+			}
+			bool isComplete() const;
+			void get() const;
+		private:
+			JobHandle(std::shared_ptr<Job> job);
+
+			std::shared_ptr<Job> job_;
+			std::shared_future<void> future_;
+		};
+
+		// Zero workers uses one per hardware thread other than the main thread
+		JobSystem(size_t workerCount = 0);
+		~JobSystem();
+
+		JobHandle submit(std::function<void()> work, const std::vector<JobHandle>& dependencies = {}, JobThread thread = JobThread::kWorker);
+		// Run the main thread jobs that are ready, returns how many were run
+		size_t runMainThreadJobs();
+		// Block until the job has finished, running main thread jobs meanwhile so it can not wait on one. Rethrows the job's failure.
+		void wait(const JobHandle& handle);
+		void waitAll();
+
+	private:
+		struct Job {
+			std::function<void()> work;
+			JobThread thread;
+			std::promise<void> promise;
+			size_t pendingDependencies = 0;
+			std::vector<std::shared_ptr<Job>> dependents;
+			bool finished = false;
+		};
+		void workerLoop();
+		void execute(std::shared_ptr<Job> job);
+		// Expects mutex_ to be held
+		void enqueue(std::shared_ptr<Job> job);
+		void waitUntil(std::function<bool()> predicate);
+
+		std::vector<std::thread> workers_;
+		std::queue<std::shared_ptr<Job>> workerQueue_;
+		std::queue<std::shared_ptr<Job>> mainQueue_;
+		std::mutex mutex_;
+		std::condition_variable workerCondition_;
+		std::condition_variable mainCondition_;
+		size_t outstandingJobs_;
+		bool stopping_;
+		const std::thread::id mainThreadId_;
+	};
+}
@@ -4,6 +4,7 @@
 #include "Graphics/TextureLoader.h"
 #include "Graphics/LogicDevice.h"
 #include "InputManager.h"
+#include "JobSystem.h"
 #include "Graphics/OptionalExtensions.h"
 #include "Graphics/TextureManager.h"
 #include <chrono>
@@ -23,6 +24,7 @@ float System::deltaTimeSeconds = 0.0f;
 
 System::System()
 {
+	masters_.jobSystem = new JobSystem();
 	masters_.graphicsMaster = new Graphics::GraphicsMaster(masters_);
 	inputManager_ = new InputManager(masters_.graphicsMaster->details_.window);
 	masters_.system = this;
@@ -37,6 +39,8 @@ System::System()
 
 System::~System()
 {
+	// Outstanding jobs may still reference the other masters
+	SAFE_DELETE(masters_.jobSystem);
 	SAFE_DELETE(masters_.gameMaster);
 	SAFE_DELETE(masters_.textureManager);
 	SAFE_DELETE(masters_.graphicsMaster);
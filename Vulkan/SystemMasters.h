@@ -3,6 +3,7 @@
 namespace QZL {
 	class System;
 	class InputManager;
+	class JobSystem;
 	namespace Graphics {
 		class GraphicsMaster;
 		class TextureManager;
@@ -17,6 +18,7 @@ namespace QZL {
 	struct SystemMasters {
 		System* system;
 		InputManager* inputManager;
+		JobSystem* jobSystem;
 		Game::GameMaster* gameMaster;
 		Physics::PhysicsMaster* physicsMaster;
 		Graphics::GraphicsMaster* graphicsMaster;